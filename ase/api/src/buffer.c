@@ -145,3 +145,28 @@ fpga_result __FPGA_API__ fpgaGetIOAddress(fpga_handle handle, uint64_t wsid,
 
 	return result;
 }
+
+
+fpga_result __FPGA_API__ fpgaGetIOAddressFromVA(fpga_handle handle, void *va,
+						uint64_t *iova)
+{
+	struct buffer_t *iova_match_buf;
+
+	if (NULL == handle) {
+		FPGA_MSG("handle is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (NULL == iova) {
+		FPGA_MSG("iova is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	iova_match_buf = find_buffer_by_vaddr((uint64_t) va);
+	if (iova_match_buf == NULL)
+		return FPGA_NOT_FOUND;
+
+	*iova = iova_match_buf->fake_paddr +
+		((uint64_t) va - iova_match_buf->vbase);
+	return FPGA_OK;
+}
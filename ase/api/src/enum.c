@@ -210,6 +210,23 @@ fpgaEnumerate(const fpga_properties *filters, uint32_t num_filters,
 
 }
 
+/* ASE enumeration never touches sysfs, so there is nothing to cache */
+fpga_result __FPGA_API__ fpgaEnumerateCacheEnable(uint32_t ttl_ms)
+{
+	UNUSED_PARAM(ttl_ms);
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaEnumerateCacheDisable(void)
+{
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaEnumerateCacheInvalidate(void)
+{
+	return FPGA_OK;
+}
+
 fpga_result __FPGA_API__ fpgaDestroyToken(fpga_token *token)
 {
 	if (NULL == token || NULL == *token) {
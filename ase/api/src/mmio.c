@@ -29,6 +29,7 @@
 #endif				// HAVE_CONFIG_H
 
 #include <opae/access.h>
+#include <opae/mmio.h>
 #include <opae/utils.h>
 #include "common_int.h"
 #include "ase_common.h"
@@ -181,6 +182,166 @@ fpga_result __FPGA_API__ fpgaReadMMIO64(fpga_handle handle,
 
 }
 
+/* Validate every element of a vectored access before issuing any */
+static fpga_result mmio_check_ops(const fpga_mmio_op *ops, uint32_t num_ops)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].width != sizeof(uint32_t) &&
+		    ops[i].width != sizeof(uint64_t)) {
+			FPGA_MSG("Invalid MMIO access width");
+			return FPGA_INVALID_PARAM;
+		}
+
+		if (ops[i].offset % ops[i].width != 0) {
+			FPGA_MSG("Misaligned MMIO access");
+			return FPGA_INVALID_PARAM;
+		}
+
+		if (ops[i].offset > MMIO_AFU_OFFSET) {
+			FPGA_MSG("Offset out of bounds");
+			return FPGA_INVALID_PARAM;
+		}
+	}
+
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaWriteMMIOv(fpga_handle handle,
+					 uint32_t mmio_num,
+					 const fpga_mmio_op *ops,
+					 uint32_t num_ops)
+{
+	UNUSED_PARAM(mmio_num);
+	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
+	fpga_result result;
+	uint32_t i;
+
+	if (NULL == handle) {
+		FPGA_MSG("handle is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (NULL == ops) {
+		FPGA_MSG("ops is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (!_handle->fpgaMMIO_is_mapped)
+		_handle->fpgaMMIO_is_mapped = true;
+
+	if (NULL == mmio_afu_vbase)
+		return FPGA_NOT_FOUND;
+
+	result = mmio_check_ops(ops, num_ops);
+	if (result != FPGA_OK)
+		return result;
+
+	// Simulated MMIO is issued in program order, so fences need no action
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].width == sizeof(uint64_t))
+			mmio_write64(ops[i].offset, ops[i].value);
+		else
+			mmio_write32(ops[i].offset, (uint32_t) ops[i].value);
+	}
+
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaReadMMIOv(fpga_handle handle,
+					uint32_t mmio_num,
+					fpga_mmio_op *ops,
+					uint32_t num_ops)
+{
+	UNUSED_PARAM(mmio_num);
+	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
+	fpga_result result;
+	uint32_t value32;
+	uint32_t i;
+
+	if (NULL == handle) {
+		FPGA_MSG("handle is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (NULL == ops) {
+		FPGA_MSG("ops is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (!_handle->fpgaMMIO_is_mapped)
+		_handle->fpgaMMIO_is_mapped = true;
+
+	if (NULL == mmio_afu_vbase)
+		return FPGA_NOT_FOUND;
+
+	result = mmio_check_ops(ops, num_ops);
+	if (result != FPGA_OK)
+		return result;
+
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].width == sizeof(uint64_t)) {
+			mmio_read64(ops[i].offset, &ops[i].value);
+		} else {
+			mmio_read32(ops[i].offset, &value32);
+			ops[i].value = value32;
+		}
+	}
+
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaMMIOv(fpga_handle handle,
+				   uint32_t mmio_num,
+				   fpga_mmio_op *ops,
+				   uint32_t num_ops)
+{
+	UNUSED_PARAM(mmio_num);
+	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
+	fpga_result result;
+	uint32_t value32;
+	uint32_t i;
+
+	if (NULL == handle) {
+		FPGA_MSG("handle is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (NULL == ops) {
+		FPGA_MSG("ops is NULL");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (!_handle->fpgaMMIO_is_mapped)
+		_handle->fpgaMMIO_is_mapped = true;
+
+	if (NULL == mmio_afu_vbase)
+		return FPGA_NOT_FOUND;
+
+	result = mmio_check_ops(ops, num_ops);
+	if (result != FPGA_OK)
+		return result;
+
+	// Simulated MMIO is issued in program order, so fences need no action
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].flags & FPGA_MMIO_READ) {
+			if (ops[i].width == sizeof(uint64_t)) {
+				mmio_read64(ops[i].offset, &ops[i].value);
+			} else {
+				mmio_read32(ops[i].offset, &value32);
+				ops[i].value = value32;
+			}
+		} else if (ops[i].width == sizeof(uint64_t)) {
+			mmio_write64(ops[i].offset, ops[i].value);
+		} else {
+			mmio_write32(ops[i].offset, (uint32_t) ops[i].value);
+		}
+	}
+
+	return FPGA_OK;
+}
+
 fpga_result __FPGA_API__ fpgaMapMMIO(fpga_handle handle, uint32_t mmio_num,
 				     uint64_t **mmio_ptr)
 {
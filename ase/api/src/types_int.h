@@ -50,6 +50,8 @@
 #define FPGA_PROPERTY_MAGIC 0x4650474150524f50
 //FPGA event handle magid (FPGAEVNT)
 #define FPGA_EVENT_HANDLE_MAGIC 0x4650474145564e54
+// FPGA buffer pool magic (FPGAPOOL)
+#define FPGA_BUFFER_POOL_MAGIC 0x46504741504f4f4c
 // FPGA invalid magic (FPGAINVL)
 #define FPGA_INVALID_MAGIC  0x46504741494e564c
 
@@ -175,5 +177,53 @@ struct token_map {
 	struct token_map *next;
 };
 
+/*
+ * Buffer pool size classes are powers of two from one cache line
+ * (FPGA_POOL_MIN_SHIFT) up to one slab (FPGA_POOL_MAX_SHIFT). Regions are
+ * carved into slabs, each of which serves a single size class.
+ */
+#define FPGA_POOL_MIN_SHIFT   6
+#define FPGA_POOL_MAX_SHIFT   16
+#define FPGA_POOL_NUM_CLASSES (FPGA_POOL_MAX_SHIFT - FPGA_POOL_MIN_SHIFT + 1)
+#define FPGA_POOL_SLAB_SIZE   (1UL << FPGA_POOL_MAX_SHIFT)
+#define FPGA_POOL_MAX_REGIONS 64
+
+/*
+ * Free chunk of a buffer pool; the link is stored in the chunk itself
+ */
+struct _fpga_pool_chunk {
+	struct _fpga_pool_chunk *next;
+};
+
+/*
+ * Pinned memory region of a buffer pool. Slabs start slab_off bytes into
+ * the region, where the IO address is slab aligned.
+ */
+struct _fpga_pool_region {
+	uint8_t  *base;
+	uint64_t  len;
+	uint64_t  iova;
+	uint64_t  wsid;
+	uint64_t  slab_off;
+	uint64_t  n_slabs;
+	uint64_t  n_slabs_used;
+	uint8_t  *slab_class;   // size class of each slab (valid if < n_slabs_used)
+};
+
+/*
+ * Pool of small shared buffers. ASE serializes all pool operations on
+ * the pool lock.
+ */
+struct _fpga_buffer_pool {
+	pthread_mutex_t lock;
+	uint64_t magic;
+	fpga_handle handle;
+	uint64_t region_size;
+	int flags;
+	struct _fpga_pool_chunk *free_list[FPGA_POOL_NUM_CLASSES];
+	uint32_t n_regions;
+	struct _fpga_pool_region regions[FPGA_POOL_MAX_REGIONS];
+};
+
 
 #endif // __FPGA_TYPES_INT_H__
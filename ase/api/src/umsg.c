@@ -74,6 +74,8 @@ fpga_result __FPGA_API__ fpgaSetUmsgAttributes(fpga_handle handle, uint64_t valu
 }
 
 // Gets Umsg address
+// Stores through it reach the simulator up to 1 ms late; fpgaTriggerUmsg()
+// notifies the UMsg watcher right away.
 fpga_result __FPGA_API__ fpgaGetUmsgPtr(fpga_handle handle, uint64_t **umsg_ptr)
 {
     fpga_result result = FPGA_OK;
@@ -110,6 +112,7 @@ fpga_result fpgaTriggerUmsg(fpga_handle handle, uint64_t value)
 
 	// Assign Value to UMsg
 	*((volatile uint64_t *) (umsg_ptr)) = value;
+	umsg_notify(0);
 
 	return result;
 }
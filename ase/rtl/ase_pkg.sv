@@ -316,6 +316,30 @@ package ase_pkg;
    parameter CCIPKT_INTR_MODE    = 32'h4040;
 
 
+   /*
+    * Binary transaction trace record kinds (ase_trace.h)
+    */
+   parameter ASE_TRACE_RD_REQ      = 1;
+   parameter ASE_TRACE_RD_RSP      = 2;
+   parameter ASE_TRACE_WR_REQ      = 3;
+   parameter ASE_TRACE_WR_RSP      = 4;
+   parameter ASE_TRACE_WRFENCE_REQ = 5;
+   parameter ASE_TRACE_WRFENCE_RSP = 6;
+   parameter ASE_TRACE_MMIO_RD_REQ = 7;
+   parameter ASE_TRACE_MMIO_WR_REQ = 8;
+   parameter ASE_TRACE_MMIO_RD_RSP = 9;
+   parameter ASE_TRACE_UMSG        = 10;
+   parameter ASE_TRACE_INTR_REQ    = 11;
+   parameter ASE_TRACE_INTR_RSP    = 12;
+   parameter ASE_TRACE_SOFTRESET   = 13;
+   parameter ASE_TRACE_C0_ALMFULL  = 14;
+   parameter ASE_TRACE_C1_ALMFULL  = 15;
+
+   parameter ASE_TRACE_F_SOP       = 1;
+   parameter ASE_TRACE_F_PACKED    = 2;
+   parameter ASE_TRACE_F_HINT      = 4;
+
+
    /*
     * ASE config structure
     * This will reflect ase.cfg
@@ -329,6 +353,7 @@ package ase_pkg;
       int 	  enable_cl_view;
       int 	  usr_tps;
       int 	  phys_memory_available_gb;
+      int 	  enable_binary_trace;
    } ase_cfg_t;
    ase_cfg_t cfg;
 
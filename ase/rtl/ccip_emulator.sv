@@ -1381,6 +1381,7 @@ module ccip_emulator
         cfg.enable_cl_view           = cfg_in.enable_cl_view           ;
         cfg.usr_tps                  = cfg_in.usr_tps                  ;
         cfg.phys_memory_available_gb = cfg_in.phys_memory_available_gb ;
+        cfg.enable_binary_trace      = cfg_in.enable_binary_trace      ;
 
         // Set UsrClk
         update_usrclk_delay( cfg.usr_tps );
@@ -2529,6 +2530,7 @@ module ccip_emulator
         // Logger control
         .finish_logger    ( finish_trigger       ),
         .stdout_en        ( cfg.enable_cl_view[0]),
+        .trace_en         ( cfg.enable_binary_trace[0]),
         // Buffer message injection
         .log_string_en    ( buffer_msg_en        ),
         .log_timestamp_en ( buffer_msg_tstamp_en ),
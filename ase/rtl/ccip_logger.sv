@@ -48,6 +48,7 @@ module ccip_logger
     // Configure enable
     input logic finish_logger,
     input logic stdout_en,
+    input logic trace_en,
     // Buffer message injection
     input logic log_timestamp_en,
     input logic log_string_en,
@@ -65,6 +66,7 @@ module ccip_logger
     * ASE Hardware Interface (CCI) logger
     * - Logs CCI transaction into a transactions.tsv file
     * - Watch for "*valid", and write transaction to log name
+    * - With trace_en, transactions go to the binary trace instead
     */
    // Log file descriptor
    int       log_fd;
@@ -246,6 +248,83 @@ module ccip_logger
    endfunction
 
 
+   /*
+    * Binary trace (trace_ops.c)
+    */
+   import "DPI-C" function void ase_trace_ccip(longint tstamp, int kind,
+					       int vc, int mdata, int cl,
+					       int flags, longint addr);
+
+   /*
+    * FUNCTION: trace_ccip_cycle posts this cycle's transactions to the
+    * binary trace, mirroring the text logging below
+    */
+   function void trace_ccip_cycle();
+      begin
+	 // State changes
+	 if (SoftReset_q != SoftReset)
+	   ase_trace_ccip($time, ASE_TRACE_SOFTRESET, 0, 0, SoftReset, 0, 0);
+	 if (C0TxAlmFull_q != ccip_rx.c0TxAlmFull)
+	   ase_trace_ccip($time, ASE_TRACE_C0_ALMFULL, 0, 0,
+			  ccip_rx.c0TxAlmFull, 0, 0);
+	 if (C1TxAlmFull_q != ccip_rx.c1TxAlmFull)
+	   ase_trace_ccip($time, ASE_TRACE_C1_ALMFULL, 0, 0,
+			  ccip_rx.c1TxAlmFull, 0, 0);
+	 // C0Rx
+	 if (ccip_rx.c0.mmioWrValid)
+	   ase_trace_ccip($time, ASE_TRACE_MMIO_WR_REQ, 0, 0,
+			  C0RxMmioHdr.length, 0, C0RxMmioHdr.address);
+	 else if (ccip_rx.c0.mmioRdValid)
+	   ase_trace_ccip($time, ASE_TRACE_MMIO_RD_REQ, 0, C0RxMmioHdr.tid,
+			  C0RxMmioHdr.length, 0, C0RxMmioHdr.address);
+	 else if (ccip_rx.c0.rspValid && isCCIPRdLineResponse(ccip_rx.c0.hdr.resp_type))
+	   ase_trace_ccip($time, ASE_TRACE_RD_RSP, ccip_rx.c0.hdr.vc_used,
+			  ccip_rx.c0.hdr.mdata, ccip_rx.c0.hdr.cl_num, 0, 0);
+`ifdef ASE_ENABLE_UMSG_FEATURE
+	 else if (ccip_rx.c0.rspValid && isCCIPUmsgResponse(ccip_rx.c0.hdr.resp_type))
+	   ase_trace_ccip($time, ASE_TRACE_UMSG, 0, C0RxUMsgHdr.umsg_id, 0,
+			  C0RxUMsgHdr.umsg_type ? ASE_TRACE_F_HINT : 0, 0);
+`endif
+	 // C1Rx
+	 if (ccip_rx.c1.rspValid && isCCIPWrLineResponse(ccip_rx.c1.hdr.resp_type))
+	   ase_trace_ccip($time, ASE_TRACE_WR_RSP, ccip_rx.c1.hdr.vc_used,
+			  ccip_rx.c1.hdr.mdata, ccip_rx.c1.hdr.cl_num,
+			  ccip_rx.c1.hdr.format ? ASE_TRACE_F_PACKED : 0, 0);
+	 else if (ccip_rx.c1.rspValid && isCCIPWrFenceResponse(ccip_rx.c1.hdr.resp_type))
+	   ase_trace_ccip($time, ASE_TRACE_WRFENCE_RSP, ccip_rx.c1.hdr.vc_used,
+			  ccip_rx.c1.hdr.mdata, 0, 0, 0);
+`ifdef ASE_ENABLE_INTR_FEATURE
+	 else if (ccip_rx.c1.rspValid && isCCIPInterruptResponse(ccip_rx.c1.hdr.resp_type))
+	   ase_trace_ccip($time, ASE_TRACE_INTR_RSP, 0, C1RxIntrRspHdr.id,
+			  0, 0, 0);
+`endif
+	 // C0Tx
+	 if (ccip_tx.c0.valid && isCCIPRdLineRequest(ccip_tx.c0.hdr.req_type))
+	   ase_trace_ccip($time, ASE_TRACE_RD_REQ, ccip_tx.c0.hdr.vc_sel,
+			  ccip_tx.c0.hdr.mdata, ccip_tx.c0.hdr.cl_len, 0,
+			  ccip_tx.c0.hdr.address);
+	 // C1Tx
+	 if (ccip_tx.c1.valid && isCCIPWrLineRequest(ccip_tx.c1.hdr.req_type))
+	   ase_trace_ccip($time, ASE_TRACE_WR_REQ, ccip_tx.c1.hdr.vc_sel,
+			  ccip_tx.c1.hdr.mdata, ccip_tx.c1.hdr.cl_len,
+			  ccip_tx.c1.hdr.sop ? ASE_TRACE_F_SOP : 0,
+			  ccip_tx.c1.hdr.address);
+	 else if (ccip_tx.c1.valid && isCCIPWrFenceRequest(ccip_tx.c1.hdr.req_type))
+	   ase_trace_ccip($time, ASE_TRACE_WRFENCE_REQ, ccip_tx.c1.hdr.vc_sel,
+			  ccip_tx.c1.hdr.mdata, 0, 0, 0);
+`ifdef ASE_ENABLE_INTR_FEATURE
+	 else if (ccip_tx.c1.valid && isCCIPInterruptRequest(ccip_tx.c1.hdr.req_type))
+	   ase_trace_ccip($time, ASE_TRACE_INTR_REQ, 0, C1TxIntrReqHdr.id,
+			  0, 0, 0);
+`endif
+	 // C2Tx
+	 if (ccip_tx.c2.mmioRdValid)
+	   ase_trace_ccip($time, ASE_TRACE_MMIO_RD_RSP, 0,
+			  ccip_tx.c2.hdr.tid, 0, 0, 0);
+      end
+   endfunction // trace_ccip_cycle
+
+
    /*
     * FUNCTION: print_and_post_log wrapper function to simplify logging
     */
@@ -328,6 +407,17 @@ module ccip_logger
 	    end
 	 end
 	 // -------------------------------------------------- //
+	 // Binary trace replaces the per-transaction text below
+	 // -------------------------------------------------- //
+	 if (trace_en) begin
+	    trace_ccip_cycle();
+	    if (finish_logger == 1) begin
+	       $fclose(log_fd);
+	    end
+	    @(posedge clk);
+	    continue;
+	 end
+	 // -------------------------------------------------- //
 	 // C0Rx Channel activity
 	 // -------------------------------------------------- //
 	 // MMIO Write Request
@@ -28,9 +28,16 @@
 #define _GNU_SOURCE
 
 #include "ase_common.h"
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <semaphore.h>
 
 const int TID_DELAY = 10000;   // Wait time for generating TID
 
+// UMsg watcher rescan interval bounds while no UMsg changes
+#define UMSG_POLL_MIN_NSEC  1000
+#define UMSG_POLL_MAX_NSEC  1000000
+
 // UMsg byte offset
 const int umsg_byteindex_arr[] = {
 	0x0, 0x1040, 0x2080, 0x30C0, 0x4100, 0x5140, 0x6180, 0x71C0
@@ -67,6 +74,21 @@ struct mmio_scoreboard_line_t {
 
 volatile struct mmio_scoreboard_line_t mmio_table[MMIO_MAX_OUTSTANDING];
 
+/*
+ * Scoreboard slots in use, one bit per mmio_table line. Claimed under
+ * mmio_port_lock, released by whichever thread retires the request.
+ */
+static volatile uint64_t mmio_slot_busy;
+
+// Scoreboard slot of each in-flight TID
+static volatile int mmio_tid_slot[MMIO_TID_BITMASK + 1];
+
+#if MMIO_MAX_OUTSTANDING > 64
+#error "mmio_slot_busy holds one bit per MMIO_MAX_OUTSTANDING slot"
+#endif
+#define MMIO_SLOTS_ALL ((MMIO_MAX_OUTSTANDING == 64) ? ~(uint64_t)0 : \
+			(((uint64_t)1 << MMIO_MAX_OUTSTANDING) - 1))
+
 // Timestamp char array
 char tstamp_string[20];
 
@@ -102,6 +124,15 @@ uint64_t *umsg_umas_vbase;            // Base addresses of required regions
 
 volatile int umas_init_flag;	      // UMAS initialized flag
 
+// UMsg doorbell, one bit per line posted by umsg_notify(), the watcher
+// sleeps on it
+static volatile uint32_t umsg_doorbell;
+static volatile uint32_t umsg_watcher_waiting;
+
+// Posted by the kill signal handler, simkill_watcher issues SIMKILL
+static sem_t simkill_sem;
+static pthread_t simkill_watch_tid;
+
 // Record of MMIO and UMAS memory
 struct buffer_t *buf_head = (struct buffer_t *) NULL;
 struct buffer_t *buf_end = (struct buffer_t *) NULL;
@@ -178,25 +209,40 @@ void failure_cleanup(void)
   exit(1);
 }
 
+/*
+ * MMIO release a scoreboard slot, callable from any thread
+ */
+static void release_mmio_scoreboard_slot(int slot_idx)
+{
+	mmio_table[slot_idx].tx_flag = false;
+	mmio_table[slot_idx].rx_flag = false;
+	__atomic_and_fetch(&mmio_slot_busy, ~((uint64_t)1 << slot_idx),
+			   __ATOMIC_RELEASE);
+}
+
 /*
  * MMIO Generate TID
  * - Creation of TID must be atomic
+ * - Waits only while all MMIO_MAX_OUTSTANDING credits are in flight
  */
 uint32_t generate_mmio_tid(void)
 {
 	// Return value
 	uint32_t ret_mmio_tid;
 
-	while (count_mmio_tid_used() == MMIO_MAX_OUTSTANDING) {
+	while (__atomic_load_n(&mmio_slot_busy, __ATOMIC_ACQUIRE)
+	       == MMIO_SLOTS_ALL) {
 #ifdef ASE_DEBUG
 		ASE_INFO("MMIO TIDs have run out --- waiting !\n");
 #endif
 		usleep(1);
 	}
 
-	// Increment and mask
-	ret_mmio_tid = io_s.glbl_mmio_tid & MMIO_TID_BITMASK;
-	io_s.glbl_mmio_tid++;
+	// Increment and mask, skipping a TID still in flight after a wrap
+	do {
+		ret_mmio_tid = io_s.glbl_mmio_tid & MMIO_TID_BITMASK;
+		io_s.glbl_mmio_tid++;
+	} while (get_scoreboard_slot_by_tid(ret_mmio_tid) != 0xFFFF);
 
 	// Return ID
 	return ret_mmio_tid;
@@ -255,20 +301,13 @@ void *mmio_response_watcher(void *arg)
 			} else {
 				// MMIO Read response (for credit count only)
 				if (io_s.mmio_rsp_pkt->write_en == MMIO_READ_REQ) {
-					mmio_table[slot_idx].tid =
-						io_s.mmio_rsp_pkt->tid;
 					mmio_table[slot_idx].data =
 						io_s.mmio_rsp_pkt->qword[0];
-					mmio_table[slot_idx].tx_flag =
-						true;
-					mmio_table[slot_idx].rx_flag =
-						true;
+					__atomic_store_n(&mmio_table[slot_idx].rx_flag,
+							 true, __ATOMIC_RELEASE);
 				} else if (io_s.mmio_rsp_pkt->write_en == MMIO_WRITE_REQ) {
 					// MMIO Write response (for credit count only)
-					mmio_table[slot_idx].tx_flag =
-						false;
-					mmio_table[slot_idx].rx_flag =
-						false;
+					release_mmio_scoreboard_slot(slot_idx);
 				}
 #ifdef ASE_DEBUG
 				else {
@@ -317,10 +356,27 @@ void send_swreset(void)
 
 /*
  * Send SIMKILL
+ * Kill signal handler. The interrupted thread may be sending on an IPC
+ * queue itself, so only wake simkill_watcher to do the work.
  */
 void send_simkill(int n)
 {
 	UNUSED_PARAM(n);
+	sem_post(&simkill_sem);
+}
+
+/*
+ * simkill_watcher : Issue SIMKILL and end the application once a kill
+ *                   signal was seen
+ */
+static void *simkill_watcher(void *arg)
+{
+	UNUSED_PARAM(arg);
+
+	// sem_wait() is a cancellation point for session_deinit()
+	while (sem_wait(&simkill_sem) != 0)
+		;
+
 	// Issue Simkill
 	ase_portctrl(ASE_SIMKILL, 0);
 
@@ -375,6 +431,7 @@ void session_init(void)
 		create_new_lock_file(app_ready_lockpath);
 
 		// Register kill signals to issue simkill
+		sem_init(&simkill_sem, 0, 0);
 		signal(SIGTERM, send_simkill);
 		signal(SIGINT, send_simkill);
 		signal(SIGQUIT, send_simkill);
@@ -411,6 +468,13 @@ void session_init(void)
 		sim2app_intr_request_rx =
 			mqueue_open(mq_array[9].name, mq_array[9].perm_flag);
 
+		// The simulator picked the transport when it created the IPCs
+		if (ase_ipc_transport != ase_calc_ipc_transport())
+			ASE_INFO("env(ASE_IPC) differs from the simulator's, using the simulator's transport\n");
+		ASE_MSG("IPC transport: %s\n",
+			(ase_ipc_transport == ASE_IPC_RING) ?
+			"shared memory rings" : "named pipes");
+
 		// Message queues have been established
 		mq_exist_status = ESTABLISHED;
 
@@ -511,6 +575,12 @@ void session_init(void)
 			ASE_MSG("SUCCESS\n");
 		}
 
+		// Kill signals seen so far are handled once this runs
+		thr_err = pthread_create(&simkill_watch_tid, NULL,
+			&simkill_watcher, NULL);
+		if (thr_err != 0)
+			failure_cleanup();
+
 		while (umas_init_flag != 1)
 			usleep(1);
 
@@ -522,6 +592,7 @@ void session_init(void)
 			mmio_table[ii].tx_flag = false;
 			mmio_table[ii].rx_flag = false;
 		}
+		mmio_slot_busy = 0;
 
 		// Session status
 		session_exist_status = ESTABLISHED;
@@ -691,6 +762,10 @@ void session_deinit(void)
 	pthread_join(umas_s.umsg_watch_tid, NULL);
 	pthread_cancel(io_s.mmio_watch_tid);
 	pthread_join(io_s.mmio_watch_tid, NULL);
+	if (!pthread_equal(pthread_self(), simkill_watch_tid)) {
+		pthread_cancel(simkill_watch_tid);
+		pthread_join(simkill_watch_tid, NULL);
+	}
 
 	// End Clock snapshot
 	clock_gettime(CLOCK_MONOTONIC, &end_time_snapshot);
@@ -717,18 +792,17 @@ void session_deinit(void)
 
 /*
  * Get a scoreboard slot
+ * - Lowest free bit of mmio_slot_busy
  */
 int find_empty_mmio_scoreboard_slot(void)
 {
-	int ii;
-	int idx;
-	for (ii = 0; ii < MMIO_MAX_OUTSTANDING; ii = ii + 1) {
-		idx = ii % MMIO_MAX_OUTSTANDING;
-		if ((mmio_table[idx].tx_flag == false)
-			&& (mmio_table[idx].rx_flag == false))
-			return idx;
-	}
-	return 0xFFFF;
+	uint64_t busy;
+
+	busy = __atomic_load_n(&mmio_slot_busy, __ATOMIC_ACQUIRE);
+	if (busy == MMIO_SLOTS_ALL)
+		return 0xFFFF;
+
+	return __builtin_ctzll(~busy);
 }
 
 
@@ -737,12 +811,17 @@ int find_empty_mmio_scoreboard_slot(void)
  */
 int get_scoreboard_slot_by_tid(int in_tid)
 {
-	int ii;
-	for (ii = 0; ii < MMIO_MAX_OUTSTANDING; ii = ii + 1) {
-		if ((mmio_table[ii].tx_flag == true)
-			&& (mmio_table[ii].tid == in_tid))
-			return ii;
-	}
+	int slot_idx;
+
+	if ((in_tid < 0) || ((uint32_t) in_tid > MMIO_TID_BITMASK))
+		return 0xFFFF;
+
+	slot_idx = mmio_tid_slot[in_tid];
+	if ((__atomic_load_n(&mmio_slot_busy, __ATOMIC_ACQUIRE)
+	     & ((uint64_t)1 << slot_idx))
+	    && (mmio_table[slot_idx].tid == in_tid))
+		return slot_idx;
+
 	return 0xFFFF;
 }
 
@@ -752,20 +831,15 @@ int get_scoreboard_slot_by_tid(int in_tid)
  */
 int count_mmio_tid_used(void)
 {
-	int ii;
-	int cnt = 0;
-
-	for (ii = 0; ii < MMIO_MAX_OUTSTANDING; ii = ii + 1)
-		if (mmio_table[ii].tx_flag == true)
-			cnt++;
-
-	return cnt;
+	return __builtin_popcountll(__atomic_load_n(&mmio_slot_busy,
+						    __ATOMIC_ACQUIRE));
 }
 
 
 /*
  * MMIO Request call
  * - Return index value
+ * - pkt is copied into the IPC, callers keep it on the stack
  */
 int mmio_request_put(struct mmio_t *pkt)
 {
@@ -783,6 +857,11 @@ int mmio_request_put(struct mmio_t *pkt)
 		mmio_table[mmiotable_idx].rx_flag = false;
 		mmio_table[mmiotable_idx].tid = pkt->tid;
 		mmio_table[mmiotable_idx].data = pkt->qword[0];
+		mmio_tid_slot[pkt->tid] = mmiotable_idx;
+		// Publish the slot before the response can arrive
+		__atomic_or_fetch(&mmio_slot_busy,
+				  (uint64_t)1 << mmiotable_idx,
+				  __ATOMIC_RELEASE);
 	} else {
 		ASE_ERR
 			("ASE Error generating MMIO TID, simulation cannot proceed !\n");
@@ -828,9 +907,10 @@ void mmio_write32(int offset, uint32_t data)
 		ASE_ERR("MMIO Write Error\n");
 		raise(SIGABRT);
 	} else {
-		mmio_t *mmio_pkt;
-		mmio_pkt =
-			(struct mmio_t *) ase_malloc(sizeof(struct mmio_t));
+		mmio_t pkt;
+		mmio_t *mmio_pkt = &pkt;
+
+		ase_memset(mmio_pkt, 0, sizeof(mmio_t));
 
 		mmio_pkt->write_en = MMIO_WRITE_REQ;
 		mmio_pkt->width = MMIO_WIDTH_32;
@@ -867,8 +947,6 @@ void mmio_write32(int offset, uint32_t data)
 		// Display
 		ASE_MSG("MMIO Write     : tid = 0x%03x, offset = 0x%x, data = 0x%08x\n",
 			mmio_pkt->tid, mmio_pkt->addr, data);
-
-		free(mmio_pkt);
 	}
 
 	FUNC_CALL_EXIT;
@@ -891,9 +969,10 @@ void mmio_write64(int offset, uint64_t data)
 		ASE_ERR("MMIO Write Error\n");
 		raise(SIGABRT);
 	} else {
-		mmio_t *mmio_pkt;
-		mmio_pkt =
-			(struct mmio_t *) ase_malloc(sizeof(struct mmio_t));
+		mmio_t pkt;
+		mmio_t *mmio_pkt = &pkt;
+
+		ase_memset(mmio_pkt, 0, sizeof(mmio_t));
 
 		mmio_pkt->write_en = MMIO_WRITE_REQ;
 		mmio_pkt->width = MMIO_WIDTH_64;
@@ -929,8 +1008,6 @@ void mmio_write64(int offset, uint64_t data)
 		ASE_MSG("MMIO Write     : tid = 0x%03x, offset = 0x%x, data = 0x%llx\n",
 			mmio_pkt->tid, mmio_pkt->addr,
 			(unsigned long long) data);
-
-		free(mmio_pkt);
 	}
 
 	FUNC_CALL_EXIT;
@@ -964,9 +1041,10 @@ void mmio_read32(int offset, uint32_t *data32)
 		ASE_ERR("MMIO Read Error\n");
 		raise(SIGABRT);
 	} else {
-		mmio_t *mmio_pkt;
-		mmio_pkt =
-			(struct mmio_t *) ase_malloc(sizeof(struct mmio_t));
+		mmio_t pkt;
+		mmio_t *mmio_pkt = &pkt;
+
+		ase_memset(mmio_pkt, 0, sizeof(mmio_t));
 
 		mmio_pkt->write_en = MMIO_READ_REQ;
 		mmio_pkt->width = MMIO_WIDTH_32;
@@ -995,7 +1073,8 @@ void mmio_read32(int offset, uint32_t *data32)
 #endif
 
 		// Wait until correct response found
-		while (mmio_table[slot_idx].rx_flag != true) {
+		while (__atomic_load_n(&mmio_table[slot_idx].rx_flag,
+				       __ATOMIC_ACQUIRE) != true) {
 			usleep(1);
 		}
 
@@ -1009,10 +1088,7 @@ void mmio_read32(int offset, uint32_t *data32)
 
 
 		// Reset scoreboard flags
-		mmio_table[slot_idx].tx_flag = false;
-		mmio_table[slot_idx].rx_flag = false;
-
-		free(mmio_pkt);
+		release_mmio_scoreboard_slot(slot_idx);
 	}
 
 	FUNC_CALL_EXIT;
@@ -1036,9 +1112,10 @@ void mmio_read64(int offset, uint64_t *data64)
 		ASE_ERR("MMIO Read Error\n");
 		raise(SIGABRT);
 	} else {
-		mmio_t *mmio_pkt;
-		mmio_pkt =
-			(struct mmio_t *) ase_malloc(sizeof(struct mmio_t));
+		mmio_t pkt;
+		mmio_t *mmio_pkt = &pkt;
+
+		ase_memset(mmio_pkt, 0, sizeof(mmio_t));
 
 		mmio_pkt->write_en = MMIO_READ_REQ;
 		mmio_pkt->width = MMIO_WIDTH_64;
@@ -1068,7 +1145,8 @@ void mmio_read64(int offset, uint64_t *data64)
 #endif
 
 		// Wait for correct response to be back
-		while (mmio_table[slot_idx].rx_flag != true) {
+		while (__atomic_load_n(&mmio_table[slot_idx].rx_flag,
+				       __ATOMIC_ACQUIRE) != true) {
 			usleep(1);
 		};
 
@@ -1082,10 +1160,7 @@ void mmio_read64(int offset, uint64_t *data64)
 			 (unsigned long long) *data64);
 
 		// Reset scoreboard flags
-		mmio_table[slot_idx].tx_flag = false;
-		mmio_table[slot_idx].rx_flag = false;
-
-		free(mmio_pkt);
+		release_mmio_scoreboard_slot(slot_idx);
 	}
 
 	FUNC_CALL_EXIT;
@@ -1420,6 +1495,26 @@ struct buffer_t *find_buffer_by_index(uint64_t wsid)
 	return bufptr;
 }
 
+/*
+ * Find buffer containing a virtual address
+ * find_buffer_by_vaddr: Returns the buffer whose [vbase, vbase + memsize)
+ * contains vaddr, or NULL
+ */
+struct buffer_t *find_buffer_by_vaddr(uint64_t vaddr)
+{
+	struct buffer_t *trav_ptr;
+
+	trav_ptr = buf_head;
+	while (trav_ptr != NULL) {
+		if ((vaddr >= trav_ptr->vbase) &&
+		    (vaddr - trav_ptr->vbase < trav_ptr->memsize))
+			return trav_ptr;
+		trav_ptr = trav_ptr->next;
+	}
+
+	return (struct buffer_t *) NULL;
+}
+
 /*
  * UMSG Get Address
  * umsg_get_address: Takes in umsg_id, and returns App virtual address
@@ -1462,9 +1557,30 @@ void umsg_set_attribute(uint32_t hint_mask)
 }
 
 
+/*
+ * umsg_notify: Wake the UMsg watcher after a write to UMsg line cl_index
+ */
+void umsg_notify(int cl_index)
+{
+	__atomic_or_fetch(&umsg_doorbell, 1U << cl_index, __ATOMIC_SEQ_CST);
+
+	// Pairs with the fence in umsg_watcher()
+	if (__atomic_load_n(&umsg_watcher_waiting, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &umsg_doorbell, FUTEX_WAKE_PRIVATE, 1,
+			NULL, NULL, 0);
+}
+
+
 /*
  * Umsg watcher thread
  * Setup UMSG tracker addresses, and watch for activity
+ * - Sleeps until umsg_notify() rings the doorbell, then checks only the
+ *   lines it names. Stores through the raw UMsg pointer ring nothing, so
+ *   all lines are rescanned on a timeout backing off from
+ *   UMSG_POLL_MIN_NSEC to UMSG_POLL_MAX_NSEC.
+ * - Such stores are detected late: once the watcher has idled, up to
+ *   UMSG_POLL_MAX_NSEC (1 ms) after the store. fpgaTriggerUmsg() is the
+ *   low-latency path.
  */
 void *umsg_watcher(void *arg)
 {
@@ -1475,6 +1591,12 @@ void *umsg_watcher(void *arg)
 	// Generic index
 	int cl_index;
 
+	// Lines to check, and rescan interval
+	uint32_t lines;
+	bool rescan;
+	bool changed;
+	struct timespec nap = { 0, UMSG_POLL_MIN_NSEC };
+
 	// UMsg old data
 	char umsg_old_data[NUM_UMSG_PER_AFU][CL_BYTE_WIDTH];
 
@@ -1507,8 +1629,17 @@ void *umsg_watcher(void *arg)
 
 	// While application is running
 	while (umas_exist_status == ESTABLISHED) {
+		lines = __atomic_exchange_n(&umsg_doorbell, 0,
+					    __ATOMIC_ACQUIRE);
+		rescan = (lines == 0);
+		if (rescan)
+			lines = (1U << NUM_UMSG_PER_AFU) - 1;
+		changed = false;
+
 		// Walk through each line
 		for (cl_index = 0; cl_index < NUM_UMSG_PER_AFU; cl_index++) {
+			if (!(lines & (1U << cl_index)))
+				continue;
 			if (memcmp
 				(umas_s.umsg_addr_array[cl_index],
 				 umsg_old_data[cl_index],
@@ -1530,9 +1661,29 @@ void *umsg_watcher(void *arg)
 						umsg_old_data[cl_index],
 						(char *) umsg_pkt->qword,
 						CL_BYTE_WIDTH);
+				changed = true;
 			}
 		}
-		usleep(1);
+
+		if (changed) {
+			nap.tv_nsec = UMSG_POLL_MIN_NSEC;
+			continue;
+		}
+
+		// Sleep unless the doorbell rang during the scan
+		umsg_watcher_waiting = 1;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (umsg_doorbell == 0)
+			syscall(SYS_futex, &umsg_doorbell, FUTEX_WAIT_PRIVATE,
+				0, &nap, NULL, 0);
+		umsg_watcher_waiting = 0;
+		pthread_testcancel();
+
+		if (rescan) {
+			nap.tv_nsec *= 2;
+			if (nap.tv_nsec > UMSG_POLL_MAX_NSEC)
+				nap.tv_nsec = UMSG_POLL_MAX_NSEC;
+		}
 	}
 
 	// Free memory
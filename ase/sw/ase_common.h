@@ -107,8 +107,8 @@
 
 // MMIO Tid width
 #define MMIO_TID_BITWIDTH          9
-#define MMIO_TID_BITMASK           (uint32_t)(pow((uint32_t)2, MMIO_TID_BITWIDTH)-1)
-#define MMIO_MAX_OUTSTANDING       64
+#define MMIO_TID_BITMASK           ((uint32_t)(1 << MMIO_TID_BITWIDTH) - 1)
+#define MMIO_MAX_OUTSTANDING       64	// One bit each in a uint64_t
 
 // Number of UMsgs per AFU
 #define NUM_UMSG_PER_AFU           8
@@ -413,8 +413,9 @@ void ll_print_info(struct buffer_t *);
 void ll_traverse_print(void);
 void ll_append_buffer(struct buffer_t *);
 void ll_remove_buffer(struct buffer_t *);
-uint32_t check_if_physaddr_used(uint64_t);
+uint32_t check_if_physaddr_used(uint64_t, uint32_t);
 struct buffer_t *ll_search_buffer(int);
+struct buffer_t *ll_search_paddr(uint64_t);
 
 // Mem-ops functions
 int ase_recv_msg(struct buffer_t *);
@@ -475,6 +476,7 @@ void mqueue_close(int);
 void mqueue_destroy(char *);
 void mqueue_send(int, const char *, int);
 int mqueue_recv(int, char *, int);
+int ase_calc_ipc_transport(void);
 
 // Timestamp functions
 void put_timestamp(void);
@@ -528,11 +530,13 @@ extern "C" {
 	void mmio_read64(int, uint64_t *);
 	// GET IOVA
 	struct buffer_t *find_buffer_by_index(uint64_t);
+	struct buffer_t *find_buffer_by_vaddr(uint64_t);
 
 	// UMSG functions
 	// uint64_t *umsg_get_address(int);
 	//void umsg_send(int, uint64_t *);
 	void umsg_set_attribute(uint32_t);
+	void umsg_notify(int);
 	// Driver activity
 	void ase_portctrl(ase_portctrl_cmd, int);
 	// Threaded watch processes
@@ -565,6 +569,36 @@ struct ipc_t {
 };
 struct ipc_t mq_array[ASE_MQ_INSTANCES];
 
+// IPC transports, chosen by the simulator with env(ASE_IPC)
+#define ASE_IPC_FIFO      0	// Named pipes (default)
+#define ASE_IPC_RING      1	// Shared memory single consumer rings
+extern int ase_ipc_transport;
+
+// Shared memory ring geometry, slots must be a power of 2
+#define ASE_RING_SLOTS    128
+#define ASE_RING_MAGIC    0x41524E47	// "ARNG"
+// Blocking receiver spins this many times before sleeping on the futex
+#define ASE_RING_SPINS    256
+
+struct ase_ring_slot_t {
+	uint32_t len;
+	char data[ASE_MQ_MSGSIZE];
+};
+
+// Lives in a file under $ASE_WORKDIR, mapped by both processes
+struct ase_ring_t {
+	uint32_t magic;
+	// Written by the sending process only, futex word of a sleeping
+	// receiver
+	volatile uint32_t head __attribute__((aligned(64)));
+	// Set while the receiver sleeps on head
+	volatile uint32_t waiting;
+	// Written by the receiver only
+	volatile uint32_t tail __attribute__((aligned(64)));
+	struct ase_ring_slot_t slot[ASE_RING_SLOTS]
+		__attribute__((aligned(64)));
+};
+
 
 /* ********************************************************************
  *
@@ -645,6 +679,7 @@ struct ase_cfg_t {
 	int enable_cl_view;
 	int usr_tps;
 	int phys_memory_available_gb;
+	int enable_binary_trace;
 };
 extern struct ase_cfg_t *cfg;
 
@@ -714,6 +749,11 @@ void ase_interrupt_generator(int id);
 // Buffer message injection
 void buffer_msg_inject(int, char *);
 
+// Binary transaction trace
+void ase_trace_open(const char *);
+void ase_trace_close(void);
+void ase_trace_ccip(long long, int, int, int, int, int, long long);
+
 // Count error flag dex
 extern int count_error_flag_ping(void);
 void count_error_flag_pong(int);
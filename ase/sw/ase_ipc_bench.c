@@ -0,0 +1,206 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// **************************************************************************
+/*
+ * Module Info: IPC loopback benchmark
+ *
+ * Measures MMIO request/response round trips between two processes over
+ * each IPC transport. A forked child stands in for the simulator: it
+ * polls the request queue without blocking and echoes every request on
+ * the response queue.
+ *
+ * Usage: ase_ipc_bench [round trips]
+ */
+
+#include "ase_common.h"
+
+// Normally defined by app_backend.c
+char *ase_workdir_path;
+char tstamp_filepath[ASE_FILEPATH_LEN];
+
+#define BENCH_REQ_MQ     "app2sim_mmioreq_smq"
+#define BENCH_RSP_MQ     "sim2app_mmiorsp_smq"
+#define BENCH_WARMUP     1000
+#define BENCH_DEFAULT_RT 100000
+#define BENCH_STOP_TID   -1
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t elapsed_nsec(const struct timespec *start,
+			     const struct timespec *end)
+{
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ULL
+		+ end->tv_nsec - start->tv_nsec;
+}
+
+/*
+ * echo_loop : Simulator stand-in, answers MMIO reads until told to stop
+ */
+static void echo_loop(void)
+{
+	struct mmio_t pkt;
+	int req_rx;
+	int rsp_tx;
+
+	req_rx = mqueue_open(BENCH_REQ_MQ, O_RDONLY | O_NONBLOCK);
+	rsp_tx = mqueue_open(BENCH_RSP_MQ, O_WRONLY);
+
+	while (1) {
+		if (mqueue_recv(req_rx, (char *) &pkt, sizeof(mmio_t))
+		    != ASE_MSG_PRESENT)
+			continue;
+		if (pkt.tid == BENCH_STOP_TID)
+			break;
+		pkt.qword[0] = pkt.addr;
+		pkt.resp_en = 1;
+		mqueue_send(rsp_tx, (char *) &pkt, sizeof(mmio_t));
+	}
+
+	mqueue_close(req_rx);
+	mqueue_close(rsp_tx);
+}
+
+/*
+ * run_transport : Time round trips over one transport, prints a summary
+ */
+static int run_transport(int transport, uint64_t count)
+{
+	struct timespec start, end;
+	struct mmio_t pkt;
+	uint64_t *rtt;
+	uint64_t total = 0;
+	uint64_t i;
+	int req_tx;
+	int rsp_rx;
+	int ret = 0;
+	pid_t pid;
+
+	rtt = (uint64_t *) malloc(count * sizeof(uint64_t));
+	if (rtt == NULL)
+		return -1;
+
+	ase_ipc_transport = transport;
+	mqueue_create(BENCH_REQ_MQ);
+	mqueue_create(BENCH_RSP_MQ);
+
+	pid = fork();
+	if (pid == 0) {
+		echo_loop();
+		_exit(0);
+	} else if (pid < 0) {
+		perror("fork");
+		free(rtt);
+		return -1;
+	}
+
+	req_tx = mqueue_open(BENCH_REQ_MQ, O_WRONLY);
+	rsp_rx = mqueue_open(BENCH_RSP_MQ, O_RDONLY);
+
+	ase_memset(&pkt, 0, sizeof(mmio_t));
+	pkt.write_en = MMIO_READ_REQ;
+	pkt.width = MMIO_WIDTH_64;
+	for (i = 0; i < BENCH_WARMUP + count; i++) {
+		pkt.tid = i & MMIO_TID_BITMASK;
+		pkt.addr = (i * 8) & (MMIO_LENGTH - 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		mqueue_send(req_tx, (char *) &pkt, sizeof(mmio_t));
+		while (mqueue_recv(rsp_rx, (char *) &pkt, sizeof(mmio_t))
+		       != ASE_MSG_PRESENT)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if ((pkt.tid != (int32_t)(i & MMIO_TID_BITMASK))
+		    || (pkt.qword[0] != (uint64_t)pkt.addr)) {
+			ASE_ERR("Bad MMIO response %d\n", pkt.tid);
+			ret = -1;
+			break;
+		}
+		if (i >= BENCH_WARMUP)
+			rtt[i - BENCH_WARMUP] = elapsed_nsec(&start, &end);
+	}
+
+	pkt.tid = BENCH_STOP_TID;
+	mqueue_send(req_tx, (char *) &pkt, sizeof(mmio_t));
+	waitpid(pid, NULL, 0);
+
+	mqueue_close(req_tx);
+	mqueue_close(rsp_rx);
+	mqueue_destroy(BENCH_REQ_MQ);
+	mqueue_destroy(BENCH_RSP_MQ);
+
+	if (ret == 0) {
+		for (i = 0; i < count; i++)
+			total += rtt[i];
+		qsort(rtt, count, sizeof(uint64_t), cmp_u64);
+		printf("%-22s %10.0f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+		       (transport == ASE_IPC_RING) ?
+		       "shared memory rings" : "named pipes",
+		       (double)total / count, rtt[count / 2],
+		       rtt[count * 99 / 100], rtt[count - 1]);
+	}
+
+	free(rtt);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char workdir[] = "/tmp/ase_ipc_bench.XXXXXX";
+	uint64_t count = BENCH_DEFAULT_RT;
+	int ret;
+
+	if (argc > 1)
+		count = strtoull(argv[1], NULL, 0);
+	if (count == 0) {
+		fprintf(stderr, "Usage: %s [round trips]\n", argv[0]);
+		return 1;
+	}
+
+	if (mkdtemp(workdir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	ase_workdir_path = workdir;
+	set_loglevel(ase_calc_loglevel());
+
+	printf("MMIO round trip latency over %" PRIu64 " requests (nsec)\n",
+	       count);
+	printf("%-22s %10s %10s %10s %10s\n", "transport", "mean", "p50",
+	       "p99", "max");
+	ret = run_transport(ASE_IPC_FIFO, count);
+	if (ret == 0)
+		ret = run_transport(ASE_IPC_RING, count);
+
+	rmdir(workdir);
+	return (ret == 0) ? 0 : 1;
+}
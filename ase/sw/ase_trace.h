@@ -0,0 +1,94 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// **************************************************************************
+/*
+ * Module Info: Binary CCI-P transaction trace format
+ *
+ * Shared by the simulator side writer (trace_ops.c) and the offline
+ * analyzer (ase_trace_analyze.cpp). A trace is one ase_trace_file_hdr
+ * followed by records. Every record starts with an ase_trace_rec whose
+ * len covers the whole record, so readers skip kinds and trailing fields
+ * they do not know. The record kinds mirror ASE_TRACE_* in ase_pkg.sv.
+ */
+
+#ifndef _ASE_TRACE_H_
+#define _ASE_TRACE_H_
+
+#include <stdint.h>
+
+#define ASE_TRACE_FILENAME   "ccip_transactions.bin"
+#define ASE_TRACE_MAGIC      "ASETRACE"
+#define ASE_TRACE_VERSION    1
+
+// Record kinds, keep in sync with ase_pkg.sv
+#define ASE_TRACE_RD_REQ       1	// C0Tx read request
+#define ASE_TRACE_RD_RSP       2	// C0Rx read response, one line
+#define ASE_TRACE_WR_REQ       3	// C1Tx write request, one line
+#define ASE_TRACE_WR_RSP       4	// C1Rx write response
+#define ASE_TRACE_WRFENCE_REQ  5	// C1Tx write fence
+#define ASE_TRACE_WRFENCE_RSP  6	// C1Rx write fence response
+#define ASE_TRACE_MMIO_RD_REQ  7	// C0Rx MMIO read request
+#define ASE_TRACE_MMIO_WR_REQ  8	// C0Rx MMIO write request
+#define ASE_TRACE_MMIO_RD_RSP  9	// C2Tx MMIO read response
+#define ASE_TRACE_UMSG         10	// C0Rx UMsg, data or hint
+#define ASE_TRACE_INTR_REQ     11	// C1Tx interrupt request
+#define ASE_TRACE_INTR_RSP     12	// C1Rx interrupt response
+#define ASE_TRACE_SOFTRESET    13	// SoftReset toggled, cl = new value
+#define ASE_TRACE_C0_ALMFULL   14	// C0TxAlmFull toggled, cl = new value
+#define ASE_TRACE_C1_ALMFULL   15	// C1TxAlmFull toggled, cl = new value
+
+// Record flags
+#define ASE_TRACE_F_SOP        0x1	// First line of a write request
+#define ASE_TRACE_F_PACKED     0x2	// Write response covers cl + 1 lines
+#define ASE_TRACE_F_HINT       0x4	// UMsg hint
+
+// File header, timestamps count time_unit_ps picoseconds
+struct ase_trace_file_hdr {
+	char     magic[8];
+	uint32_t version;
+	uint32_t time_unit_ps;
+};
+
+/*
+ * Record header, responses and state changes stop here. Requests carry
+ * an address as well (ase_trace_rec_addr).
+ */
+struct ase_trace_rec {
+	uint16_t len;		// Bytes in this record
+	uint8_t  kind;		// ASE_TRACE_*
+	uint8_t  vc;		// Virtual channel, t_ccip_vc encoding
+	uint16_t mdata;		// mdata, MMIO tid, UMsg or interrupt id
+	uint8_t  cl;		// cl_len of requests, cl_num of responses
+	uint8_t  flags;		// ASE_TRACE_F_*
+	uint64_t time;		// Simulation time
+};
+
+struct ase_trace_rec_addr {
+	struct ase_trace_rec hdr;
+	uint64_t addr;		// Line address, MMIO dword address
+};
+
+#endif				// _ASE_TRACE_H_
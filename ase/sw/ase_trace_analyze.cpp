@@ -0,0 +1,491 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// **************************************************************************
+/*
+ * Module Info: Offline analyzer for binary ASE transaction traces
+ *
+ * Reads a ccip_transactions.bin trace (ase_trace.h) and reports request
+ * latency histograms per channel, bandwidth over time and outstanding
+ * request counts.
+ *
+ * Usage: ase-trace-analyze [-w window_ns] [-c] ccip_transactions.bin
+ */
+
+#include <getopt.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "ase_trace.h"
+
+namespace ase
+{
+namespace trace
+{
+
+const uint64_t line_bytes = 64;
+
+// Latencies are binned per ns up to this, longer ones share the last bin
+const uint64_t histogram_ns = 1 << 16;
+
+/*
+ * Latency histogram of one channel
+ */
+class latency_histogram
+{
+public:
+    latency_histogram()
+    : bins_(histogram_ns + 1, 0)
+    , count_(0)
+    , sum_(0)
+    , min_(UINT64_MAX)
+    , max_(0)
+    {
+    }
+
+    void add(uint64_t ns)
+    {
+        bins_[std::min(ns, histogram_ns)]++;
+        count_++;
+        sum_ += ns;
+        min_ = std::min(min_, ns);
+        max_ = std::max(max_, ns);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? double(sum_) / count_ : 0.0; }
+
+    uint64_t percentile(double pct) const
+    {
+        uint64_t rank = uint64_t(pct / 100.0 * (count_ - 1));
+        uint64_t seen = 0;
+
+        for (uint64_t ns = 0; ns <= histogram_ns; ++ns)
+        {
+            seen += bins_[ns];
+            if (seen > rank)
+            {
+                return ns == histogram_ns ? max_ : ns;
+            }
+        }
+        return max_;
+    }
+
+    // Power of two buckets, [lo, 2 * lo) ns
+    void print_buckets(std::ostream &os) const
+    {
+        uint64_t peak = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> buckets;
+
+        for (uint64_t lo = 0; lo <= histogram_ns; lo = lo ? lo * 2 : 1)
+        {
+            uint64_t hi = lo ? std::min(lo * 2, histogram_ns + 1) : 1;
+            uint64_t n = 0;
+
+            for (uint64_t ns = lo; ns < hi; ++ns)
+            {
+                n += bins_[ns];
+            }
+            if (n)
+            {
+                buckets.push_back(std::make_pair(lo, n));
+                peak = std::max(peak, n);
+            }
+        }
+
+        for (auto &b : buckets)
+        {
+            os << "    " << std::setw(8) << b.first << " ns "
+               << std::setw(12) << b.second << ' '
+               << std::string(size_t(40 * b.second / peak), '#')
+               << std::endl;
+        }
+    }
+
+private:
+    std::vector<uint64_t> bins_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+/*
+ * Request waiting for its responses
+ */
+struct pending
+{
+    uint64_t time;
+    int lines;
+    uint8_t vc;
+};
+
+/*
+ * Per window bandwidth and occupancy
+ */
+struct window
+{
+    uint64_t rd_lines;
+    uint64_t wr_lines;
+    uint64_t rd_outstanding_max;
+    uint64_t wr_outstanding_max;
+};
+
+class analyzer
+{
+public:
+    analyzer(uint64_t window_ns)
+    : window_ns_(window_ns)
+    , unit_ps_(1)
+    , records_(0)
+    , first_(0)
+    , last_(0)
+    , rd_outstanding_(0)
+    , wr_outstanding_(0)
+    , unmatched_(0)
+    {
+    }
+
+    bool load(const std::string &path);
+    void report(std::ostream &os, bool csv) const;
+
+private:
+    uint64_t to_ns(uint64_t t) const { return t * unit_ps_ / 1000; }
+    window &window_at(uint64_t t);
+    void record(const ase_trace_rec &rec);
+    bool retire(std::map<uint16_t, std::deque<pending>> &table,
+                const ase_trace_rec &rec, int lines, const char *name,
+                uint64_t &outstanding);
+
+    uint64_t window_ns_;
+    uint64_t unit_ps_;
+    uint64_t records_;
+    uint64_t first_;
+    uint64_t last_;
+    uint64_t rd_outstanding_;
+    uint64_t wr_outstanding_;
+    uint64_t unmatched_;
+    std::map<uint16_t, std::deque<pending>> reads_;
+    std::map<uint16_t, std::deque<pending>> writes_;
+    std::map<uint16_t, std::deque<pending>> fences_;
+    std::map<uint16_t, std::deque<pending>> mmio_reads_;
+    std::map<std::string, latency_histogram> latency_;
+    std::map<uint64_t, window> windows_;
+};
+
+static const char *vc_name(uint8_t vc)
+{
+    static const char *names[] = { "VA", "VL0", "VH0", "VH1" };
+    return names[vc & 3];
+}
+
+bool analyzer::load(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    ase_trace_file_hdr hdr;
+    std::vector<char> buf;
+    ase_trace_rec rec;
+
+    if (!in)
+    {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+
+    if (!in.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)) ||
+        std::memcmp(hdr.magic, ASE_TRACE_MAGIC, sizeof(hdr.magic)) != 0)
+    {
+        std::cerr << path << " is not an ASE binary trace" << std::endl;
+        return false;
+    }
+    if (hdr.version != ASE_TRACE_VERSION)
+    {
+        std::cerr << path << ": trace version " << hdr.version
+                  << " is not supported" << std::endl;
+        return false;
+    }
+    unit_ps_ = hdr.time_unit_ps ? hdr.time_unit_ps : 1;
+
+    while (in.read(reinterpret_cast<char *>(&rec), sizeof(rec)))
+    {
+        if (rec.len < sizeof(rec))
+        {
+            std::cerr << path << ": corrupt record after " << records_
+                      << " records" << std::endl;
+            return false;
+        }
+
+        // Fields this analyzer does not use
+        buf.resize(rec.len - sizeof(rec));
+        if (!buf.empty() && !in.read(buf.data(), buf.size()))
+        {
+            break;
+        }
+
+        if (records_++ == 0)
+        {
+            first_ = rec.time;
+        }
+        last_ = rec.time;
+        record(rec);
+    }
+
+    return true;
+}
+
+window &analyzer::window_at(uint64_t t)
+{
+    uint64_t start = to_ns(t) / window_ns_ * window_ns_;
+    auto it = windows_.find(start);
+
+    if (it == windows_.end())
+    {
+        window w = { 0, 0, rd_outstanding_, wr_outstanding_ };
+        it = windows_.insert(std::make_pair(start, w)).first;
+    }
+    return it->second;
+}
+
+/*
+ * Retire lines of the oldest request with this mdata, returns false if
+ * no request was waiting
+ */
+bool analyzer::retire(std::map<uint16_t, std::deque<pending>> &table,
+                      const ase_trace_rec &rec, int lines, const char *name,
+                      uint64_t &outstanding)
+{
+    auto it = table.find(rec.mdata);
+
+    if (it == table.end() || it->second.empty())
+    {
+        unmatched_++;
+        return false;
+    }
+
+    pending &p = it->second.front();
+    p.lines -= lines;
+    if (p.lines <= 0)
+    {
+        std::string channel(name);
+
+        // MMIO has no virtual channel
+        if (rec.kind != ASE_TRACE_MMIO_RD_RSP)
+        {
+            channel = channel + ' ' + vc_name(p.vc);
+        }
+        latency_[channel].add(to_ns(rec.time - p.time));
+        it->second.pop_front();
+        outstanding--;
+    }
+    return true;
+}
+
+void analyzer::record(const ase_trace_rec &rec)
+{
+    window &w = window_at(rec.time);
+    uint64_t none = 0;
+
+    switch (rec.kind)
+    {
+    case ASE_TRACE_RD_REQ:
+        reads_[rec.mdata].push_back({ rec.time, rec.cl + 1, rec.vc });
+        rd_outstanding_++;
+        break;
+    case ASE_TRACE_RD_RSP:
+        w.rd_lines++;
+        retire(reads_, rec, 1, "RdLine", rd_outstanding_);
+        break;
+    case ASE_TRACE_WR_REQ:
+        w.wr_lines++;
+        if (rec.flags & ASE_TRACE_F_SOP)
+        {
+            writes_[rec.mdata].push_back({ rec.time, rec.cl + 1, rec.vc });
+            wr_outstanding_++;
+        }
+        break;
+    case ASE_TRACE_WR_RSP:
+        retire(writes_, rec,
+               (rec.flags & ASE_TRACE_F_PACKED) ? rec.cl + 1 : 1,
+               "WrLine", wr_outstanding_);
+        break;
+    case ASE_TRACE_WRFENCE_REQ:
+        fences_[rec.mdata].push_back({ rec.time, 1, rec.vc });
+        break;
+    case ASE_TRACE_WRFENCE_RSP:
+        retire(fences_, rec, 1, "WrFence", none);
+        break;
+    case ASE_TRACE_MMIO_RD_REQ:
+        mmio_reads_[rec.mdata].push_back({ rec.time, 1, 0 });
+        break;
+    case ASE_TRACE_MMIO_RD_RSP:
+        retire(mmio_reads_, rec, 1, "MMIORd", none);
+        break;
+    default:
+        break;
+    }
+
+    w.rd_outstanding_max = std::max(w.rd_outstanding_max, rd_outstanding_);
+    w.wr_outstanding_max = std::max(w.wr_outstanding_max, wr_outstanding_);
+}
+
+void analyzer::report(std::ostream &os, bool csv) const
+{
+    uint64_t span_ns = to_ns(last_ - first_);
+    uint64_t waiting = 0;
+
+    for (auto *table : { &reads_, &writes_, &fences_, &mmio_reads_ })
+    {
+        for (auto &q : *table)
+        {
+            waiting += q.second.size();
+        }
+    }
+
+    if (csv)
+    {
+        os << "window_start_ns,rd_GBps,wr_GBps,rd_outstanding_max,"
+              "wr_outstanding_max" << std::endl;
+        for (auto &w : windows_)
+        {
+            os << w.first << ','
+               << double(w.second.rd_lines * line_bytes) / window_ns_ << ','
+               << double(w.second.wr_lines * line_bytes) / window_ns_ << ','
+               << w.second.rd_outstanding_max << ','
+               << w.second.wr_outstanding_max << std::endl;
+        }
+        return;
+    }
+
+    os << records_ << " records over " << span_ns << " ns" << std::endl;
+    if (unmatched_ || waiting)
+    {
+        os << unmatched_ << " responses without a request, "
+           << waiting << " requests without a response" << std::endl;
+    }
+
+    os << std::endl << "Latency (ns)" << std::endl;
+    os << std::left << std::setw(12) << "channel" << std::right
+       << std::setw(12) << "count" << std::setw(10) << "min"
+       << std::setw(10) << "mean" << std::setw(10) << "p50"
+       << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+    for (auto &l : latency_)
+    {
+        const latency_histogram &h = l.second;
+        os << std::left << std::setw(12) << l.first << std::right
+           << std::setw(12) << h.count() << std::setw(10) << h.min()
+           << std::setw(10) << std::fixed << std::setprecision(1)
+           << h.mean() << std::setw(10) << h.percentile(50.0)
+           << std::setw(10) << h.percentile(99.0)
+           << std::setw(10) << h.max() << std::endl;
+    }
+    for (auto &l : latency_)
+    {
+        os << std::endl << l.first << std::endl;
+        l.second.print_buckets(os);
+    }
+
+    os << std::endl << "Bandwidth (GB/s) and outstanding requests per "
+       << window_ns_ << " ns window" << std::endl;
+    os << std::setw(14) << "start_ns" << std::setw(10) << "rd"
+       << std::setw(10) << "wr" << std::setw(10) << "rd_out"
+       << std::setw(10) << "wr_out" << std::endl;
+    for (auto &w : windows_)
+    {
+        os << std::setw(14) << w.first << std::setprecision(2)
+           << std::setw(10)
+           << double(w.second.rd_lines * line_bytes) / window_ns_
+           << std::setw(10)
+           << double(w.second.wr_lines * line_bytes) / window_ns_
+           << std::setw(10) << w.second.rd_outstanding_max
+           << std::setw(10) << w.second.wr_outstanding_max << std::endl;
+    }
+}
+
+} // end of namespace trace
+} // end of namespace ase
+
+static void show_help(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " [-w window_ns] [-c] trace" << std::endl
+              << "  -w, --window  Bandwidth window in ns (default 1000)" << std::endl
+              << "  -c, --csv     Print the per window table as CSV only" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct option longopts[] =
+    {
+        { "window", required_argument, NULL, 'w' },
+        { "csv",    no_argument,       NULL, 'c' },
+        { "help",   no_argument,       NULL, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    uint64_t window_ns = 1000;
+    bool csv = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "w:ch", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            window_ns = std::strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            csv = true;
+            break;
+        default:
+            show_help(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1 || window_ns == 0)
+    {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    ase::trace::analyzer a(window_ns);
+    if (!a.load(argv[optind]))
+    {
+        return 1;
+    }
+    a.report(std::cout, csv);
+
+    return 0;
+}
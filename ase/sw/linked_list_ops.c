@@ -38,6 +38,91 @@
 struct buffer_t *head;
 struct buffer_t *end;
 
+/*
+ * Buffers sorted by fake_paddr, kept alongside the list so that a
+ * physical address is translated with a binary search
+ */
+static struct buffer_t **paddr_index;
+static uint32_t paddr_count;
+static uint32_t paddr_capacity;
+
+// Buffer that resolved the last translation, streams hit it repeatedly
+static struct buffer_t *paddr_last;
+
+
+/*
+ * paddr_index_find : Number of indexed buffers with fake_paddr <= paddr
+ */
+static uint32_t paddr_index_find(uint64_t paddr)
+{
+	uint32_t lo = 0;
+	uint32_t hi = paddr_count;
+	uint32_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (paddr_index[mid]->fake_paddr <= paddr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+/*
+ * paddr_index_insert : Add a buffer to the physical address index
+ */
+static void paddr_index_insert(struct buffer_t *pbuf)
+{
+	struct buffer_t **grown;
+	uint32_t pos;
+
+	if (paddr_count == paddr_capacity) {
+		paddr_capacity = paddr_capacity ? 2 * paddr_capacity : 64;
+		grown = (struct buffer_t **)
+			ase_malloc(paddr_capacity * sizeof(struct buffer_t *));
+		if (paddr_count)
+			ase_memcpy(grown, paddr_index,
+				   paddr_count * sizeof(struct buffer_t *));
+		free(paddr_index);
+		paddr_index = grown;
+	}
+
+	pos = paddr_index_find(pbuf->fake_paddr);
+	memmove(&paddr_index[pos + 1], &paddr_index[pos],
+		(paddr_count - pos) * sizeof(struct buffer_t *));
+	paddr_index[pos] = pbuf;
+	paddr_count++;
+}
+
+
+/*
+ * paddr_index_remove : Drop a buffer from the physical address index
+ */
+static void paddr_index_remove(struct buffer_t *pbuf)
+{
+	uint32_t pos;
+
+	if (paddr_last == pbuf)
+		paddr_last = NULL;
+
+	pos = paddr_index_find(pbuf->fake_paddr);
+	while (pos > 0) {
+		pos--;
+		if (paddr_index[pos] == pbuf) {
+			memmove(&paddr_index[pos], &paddr_index[pos + 1],
+				(paddr_count - pos - 1) *
+				sizeof(struct buffer_t *));
+			paddr_count--;
+			return;
+		}
+		if (paddr_index[pos]->fake_paddr != pbuf->fake_paddr)
+			return;
+	}
+}
+
 /*
  * ll_print_info: Print linked list node info
  * Thu Oct  2 15:50:06 PDT 2014 : Modified for cleanliness
@@ -101,6 +186,8 @@ void ll_append_buffer(struct buffer_t *pbuf)
 	// Adjust end to point to last node
 	end = pbuf;
 
+	paddr_index_insert(pbuf);
+
 	FUNC_CALL_EXIT;
 }
 
@@ -139,6 +226,8 @@ void ll_remove_buffer(struct buffer_t *ptr)
 			end = prev;
 	}
 
+	paddr_index_remove(temp);
+
 	FUNC_CALL_EXIT;
 }
 
@@ -177,24 +266,50 @@ struct buffer_t *ll_search_buffer(int search_index)
 }
 
 
+// --------------------------------------------------------------------
+// ll_search_paddr : Search buffer containing a fake physical address
+// O(log n) in the number of buffers, O(1) when the last hit matches
+// --------------------------------------------------------------------
+struct buffer_t *ll_search_paddr(uint64_t paddr)
+{
+	struct buffer_t *search_ptr;
+	uint32_t pos;
+
+	search_ptr = paddr_last;
+	if ((search_ptr != NULL) && (paddr >= search_ptr->fake_paddr)
+	    && (paddr < search_ptr->fake_paddr_hi))
+		return search_ptr;
+
+	// Ranges never overlap, only the closest base below can match
+	pos = paddr_index_find(paddr);
+	if (pos == 0)
+		return (struct buffer_t *) NULL;
+
+	search_ptr = paddr_index[pos - 1];
+	if (paddr >= search_ptr->fake_paddr_hi)
+		return (struct buffer_t *) NULL;
+
+	paddr_last = search_ptr;
+	return search_ptr;
+}
+
+
 /*
- * Check if physical address is used
+ * Check if physical address range [paddr, paddr + size) is used
  * RETURN 0 if not found, 1 if found
  */
-uint32_t check_if_physaddr_used(uint64_t paddr)
+uint32_t check_if_physaddr_used(uint64_t paddr, uint32_t size)
 {
-	struct buffer_t *search_ptr;
-	int flag = 0;
+	uint32_t pos;
 
-	search_ptr = head;
-	while (search_ptr != NULL) {
-		if ((paddr >= search_ptr->fake_paddr)
-		    && (paddr < search_ptr->fake_paddr_hi)) {
-			flag = 1;
-			break;
-		} else {
-			search_ptr = search_ptr->next;
-		}
-	}
-	return flag;
+	if (ll_search_paddr(paddr) != NULL)
+		return 1;
+
+	// A buffer starting inside the range
+	pos = paddr_index_find(paddr);
+	if ((pos < paddr_count) &&
+	    (paddr_index[pos]->fake_paddr < paddr + (uint64_t) size))
+		return 1;
+
+	return 0;
 }
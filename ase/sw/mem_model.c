@@ -290,8 +290,8 @@ uint64_t get_range_checked_physaddr(uint32_t size)
 		ret_fake_paddr = ret_fake_paddr & PHYS_ADDR_PREFIX_MASK;
 
 		// Check for conditions
-		// Is address in sysmem range, go back
-		search_flag = check_if_physaddr_used(ret_fake_paddr);
+		// Does range overlap a buffer, go back
+		search_flag = check_if_physaddr_used(ret_fake_paddr, size);
 
 		// Is HI smaller than LO, go back
 		opposite_flag = 0;
@@ -354,31 +354,26 @@ uint64_t *ase_fakeaddr_to_vaddr(uint64_t req_paddr)
 #endif
 
 		// Search which buffer offset_from_pin lies in
-		trav_ptr = head;
-		while (trav_ptr != NULL) {
-			if ((req_paddr >= trav_ptr->fake_paddr)
-			    && (req_paddr < trav_ptr->fake_paddr_hi)) {
-				real_offset =
-				    (uint64_t) req_paddr -
-				    (uint64_t) trav_ptr->fake_paddr;
-				calc_pbase = trav_ptr->pbase;
-				ase_pbase =
-				    (uint64_t *) (uintptr_t) (calc_pbase +
-							      real_offset);
-
-				// Debug only
+		trav_ptr = ll_search_paddr(req_paddr);
+		if (trav_ptr != NULL) {
+			real_offset =
+			    (uint64_t) req_paddr -
+			    (uint64_t) trav_ptr->fake_paddr;
+			calc_pbase = trav_ptr->pbase;
+			ase_pbase =
+			    (uint64_t *) (uintptr_t) (calc_pbase +
+						      real_offset);
+
+			// Debug only
 #ifdef ASE_DEBUG
-				if (fp_memaccess_log != NULL) {
-					fprintf(fp_memaccess_log,
-						"offset=0x%016" PRIx64
-						" | pbase=%p\n",
-						real_offset, ase_pbase);
-				}
-#endif
-				return ase_pbase;
-			} else {
-				trav_ptr = trav_ptr->next;
+			if (fp_memaccess_log != NULL) {
+				fprintf(fp_memaccess_log,
+					"offset=0x%016" PRIx64
+					" | pbase=%p\n",
+					real_offset, ase_pbase);
 			}
+#endif
+			return ase_pbase;
 		}
 	}
 
@@ -26,6 +26,27 @@
 // **************************************************************************
 
 #include "ase_common.h"
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Transport of queues created by this process
+int ase_ipc_transport = ASE_IPC_FIFO;
+
+/*
+ * Shared memory rings mapped by this process, looked up by the descriptor
+ * that mqueue_open() returned
+ */
+static struct {
+	int fd;
+	struct ase_ring_t *ring;
+	// Opened O_NONBLOCK, receive polls like a non-blocking pipe read
+	bool nonblock;
+	// Serializes threads of this process sending on the ring
+	pthread_mutex_t send_lock;
+} ring_map[ASE_MQ_INSTANCES];
+
+// Spins before a receiver sleeps, 0 if spinning cannot help
+static int ring_spins = -1;
 
 /*
  * Named pipe string array
@@ -108,6 +129,210 @@ int get_smq_perm_flag(const char *mq_name_str)
 }
 
 
+/*
+ * ase_calc_ipc_transport : Evaluate env(ASE_IPC), "ring" selects shared
+ *                          memory rings, anything else named pipes
+ */
+int ase_calc_ipc_transport(void)
+{
+	char *str_env;
+
+	str_env = getenv("ASE_IPC");
+	if (str_env && (ase_strncmp(str_env, "ring", 5) == 0))
+		return ASE_IPC_RING;
+
+	return ASE_IPC_FIFO;
+}
+
+
+/*
+ * ring_lookup : Ring_map index of a message queue descriptor, -1 for a pipe
+ */
+static int ring_lookup(int mq)
+{
+	int i;
+
+	for (i = 0; i < ASE_MQ_INSTANCES; i++) {
+		if (ring_map[i].ring && (ring_map[i].fd == mq))
+			return i;
+	}
+
+	return -1;
+}
+
+
+/*
+ * ring_futex : futex(2) on a word of a ring, shared between processes
+ */
+static void ring_futex(volatile uint32_t *uaddr, int op, uint32_t val,
+		       const struct timespec *timeout)
+{
+	syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+
+/*
+ * ring_create : Create and initialize a ring file at mq_path
+ */
+static int ring_create(const char *mq_path)
+{
+	struct ase_ring_t *ring;
+	int fd;
+
+	fd = open(mq_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return -1;
+
+	if (ftruncate(fd, sizeof(struct ase_ring_t)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	ring = mmap(NULL, sizeof(struct ase_ring_t), PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED)
+		return -1;
+
+	// The file is zero filled, publish it last
+	__atomic_store_n(&ring->magic, ASE_RING_MAGIC, __ATOMIC_RELEASE);
+	munmap(ring, sizeof(struct ase_ring_t));
+
+	return 0;
+}
+
+
+/*
+ * ring_open : Map the ring file at mq_path, returns its descriptor
+ */
+static int ring_open(const char *mq_path, int perm_flag)
+{
+	struct ase_ring_t *ring;
+	int fd;
+	int i;
+
+	fd = open(mq_path, O_RDWR);
+	if (fd == -1)
+		return -1;
+
+	ring = mmap(NULL, sizeof(struct ase_ring_t), PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != ASE_RING_MAGIC) {
+		ASE_ERR("IPC %s is not an ASE ring\n", mq_path);
+		munmap(ring, sizeof(struct ase_ring_t));
+		close(fd);
+		return -1;
+	}
+
+	for (i = 0; i < ASE_MQ_INSTANCES; i++) {
+		if (ring_map[i].ring == NULL) {
+			ring_map[i].fd = fd;
+			ring_map[i].ring = ring;
+			ring_map[i].nonblock = (perm_flag & O_NONBLOCK) != 0;
+			pthread_mutex_init(&ring_map[i].send_lock, NULL);
+			return fd;
+		}
+	}
+
+	ASE_ERR("Too many IPC rings open\n");
+	munmap(ring, sizeof(struct ase_ring_t));
+	close(fd);
+	return -1;
+}
+
+
+/*
+ * ring_send : Copy a message into the next slot, waking a sleeping
+ *             receiver. Waits while the ring is full. Threads sending
+ *             on the same ring, e.g. concurrent buffer allocations,
+ *             take turns on send_lock.
+ */
+static void ring_send(struct ase_ring_t *ring, pthread_mutex_t *send_lock,
+		      const char *str, int size)
+{
+	uint32_t head;
+	struct ase_ring_slot_t *slot;
+
+	if ((size < 0) || (size > ASE_MQ_MSGSIZE)) {
+		ASE_ERR("IPC message of %d bytes does not fit a ring slot\n",
+			size);
+		return;
+	}
+
+	pthread_mutex_lock(send_lock);
+	head = ring->head;
+
+	while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+	       == ASE_RING_SLOTS)
+		usleep(1);
+
+	slot = &ring->slot[head & (ASE_RING_SLOTS - 1)];
+	ase_memcpy(slot->data, str, size);
+	slot->len = size;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(send_lock);
+
+	// Pairs with the fence in ring_recv(), so either the receiver sees
+	// the new head or this sees it waiting
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (ring->waiting)
+		ring_futex(&ring->head, FUTEX_WAKE, 1, NULL);
+}
+
+
+/*
+ * ring_recv : Copy the oldest message out. A non-blocking receiver (the
+ *             simulator) polls; others spin briefly, then sleep on the
+ *             futex.
+ */
+static int ring_recv(struct ase_ring_t *ring, bool nonblock, char *str,
+		     int size)
+{
+	uint32_t tail = ring->tail;
+	struct ase_ring_slot_t *slot;
+	const struct timespec nap = { 0, 10 * 1000 * 1000 };
+	int spins = 0;
+
+	// The sender cannot run while a single CPU spins
+	if (ring_spins < 0)
+		ring_spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ?
+			ASE_RING_SPINS : 0;
+
+	while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+		if (nonblock)
+			return ASE_MSG_ABSENT;
+
+		if (spins++ < ring_spins) {
+			__builtin_ia32_pause();
+			continue;
+		}
+
+		ring->waiting = 1;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (ring->head == tail)
+			ring_futex(&ring->head, FUTEX_WAIT, tail, &nap);
+		ring->waiting = 0;
+
+		// Blocking reads of the pipe transport are cancellation
+		// points, keep the watcher threads cancellable
+		pthread_testcancel();
+		spins = 0;
+	}
+
+	slot = &ring->slot[tail & (ASE_RING_SLOTS - 1)];
+	ase_memcpy(str, slot->data,
+		   ((int)slot->len < size) ? (int)slot->len : size);
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return ASE_MSG_PRESENT;
+}
+
+
 /*
  * ipc_init: Initialize IPC messaging structure
  *           DOES not create or open the IPC, simply initializes the structures
@@ -118,6 +343,9 @@ void ipc_init(void)
 
 	int ipc_iter;
 
+	// Transport requested for this session
+	ase_ipc_transport = ase_calc_ipc_transport();
+
 	// Initialize named pipe array
 	for (ipc_iter = 0; ipc_iter < ASE_MQ_INSTANCES; ipc_iter++) {
 		// Set name
@@ -166,7 +394,10 @@ void mqueue_create(char *mq_name_suffix)
 	snprintf(mq_path, ASE_FILEPATH_LEN, "%s/%s", ase_workdir_path,
 		 mq_name_suffix);
 
-	ret = mkfifo(mq_path, S_IRUSR | S_IWUSR);
+	if (ase_ipc_transport == ASE_IPC_RING)
+		ret = ring_create(mq_path);
+	else
+		ret = mkfifo(mq_path, S_IRUSR | S_IWUSR);
 	if (ret == -1) {
 		ASE_ERR("Error creating IPC %s\n", mq_path);
 		ASE_ERR("Consider re-compiling OPAE libraries !\n");
@@ -192,6 +423,8 @@ void mqueue_create(char *mq_name_suffix)
  *   proceed. This may not be possible in an ASE environment.
  * - This may be solved by having a dummy reader the WRONLY fifo, then
  *   close it after ASE's real fd is created successfully.
+ * - A regular file is a shared memory ring created by the simulator, so
+ *   the application follows whichever transport the simulator chose.
  *
  */
 int mqueue_open(char *mq_name, int perm_flag)
@@ -200,11 +433,31 @@ int mqueue_open(char *mq_name, int perm_flag)
 
 	int mq;
 	char *mq_path;
+	struct stat mq_stat;
 
 	mq_path = ase_malloc(ASE_FILEPATH_LEN);
 	snprintf(mq_path, ASE_FILEPATH_LEN, "%s/%s", ase_workdir_path,
 		 mq_name);
 
+	if ((stat(mq_path, &mq_stat) == 0) && S_ISREG(mq_stat.st_mode)) {
+		ase_ipc_transport = ASE_IPC_RING;
+		mq = ring_open(mq_path, perm_flag);
+		if (mq == -1) {
+			ASE_ERR("Error opening IPC %s\n", mq_path);
+#ifdef SIM_SIDE
+			ase_error_report("open", errno, ASE_OS_FOPEN_ERR);
+			start_simkill_countdown();
+#else
+			perror("open");
+			exit(1);
+#endif
+		}
+		free(mq_path);
+		FUNC_CALL_EXIT;
+		return mq;
+	}
+	ase_ipc_transport = ASE_IPC_FIFO;
+
 	// Dummy function to open WRITE only MQs
 	// Named pipe requires non-blocking write-only move on from here
 	// only when reader is ready.
@@ -250,6 +503,15 @@ void mqueue_close(int mq)
 	FUNC_CALL_ENTRY;
 
 	int ret;
+	int i;
+
+	i = ring_lookup(mq);
+	if (i >= 0) {
+		munmap(ring_map[i].ring, sizeof(struct ase_ring_t));
+		ring_map[i].ring = NULL;
+		pthread_mutex_destroy(&ring_map[i].send_lock);
+	}
+
 	ret = close(mq);
 	if (ret == -1) {
 #ifdef SIM_SIDE
@@ -301,6 +563,16 @@ void mqueue_send(int mq, const char *str, int size)
 	FUNC_CALL_ENTRY;
 
 	int ret_tx;
+	int i;
+
+	i = ring_lookup(mq);
+	if (i >= 0) {
+		ring_send(ring_map[i].ring, &ring_map[i].send_lock, str,
+			  size);
+		FUNC_CALL_EXIT;
+		return;
+	}
+
 	ret_tx = write(mq, (void *) str, size);
 
 	if ((ret_tx == 0) || (ret_tx != size)) {
@@ -323,6 +595,14 @@ int mqueue_recv(int mq, char *str, int size)
 	FUNC_CALL_ENTRY;
 
 	int ret;
+	int i;
+
+	i = ring_lookup(mq);
+	if (i >= 0) {
+		FUNC_CALL_EXIT;
+		return ring_recv(ring_map[i].ring, ring_map[i].nonblock, str,
+				 size);
+	}
 
 	ret = read(mq, str, size);
 	FUNC_CALL_EXIT;
@@ -31,6 +31,7 @@
  * - Interface to page table
  */
 #include "ase_common.h"
+#include "ase_trace.h"
 
 //const int NUM_DS = 10;
 
@@ -1025,6 +1026,15 @@ int ase_init(void)
 
 	// Evaluate ase_workdir_path
 	ase_eval_session_directory();
+
+	// Binary transaction trace, replaces per-transaction text logging
+	if (cfg->enable_binary_trace != 0) {
+		char trace_path[ASE_FILEPATH_LEN];
+
+		snprintf(trace_path, ASE_FILEPATH_LEN, "%s/%s",
+			 ase_workdir_path, ASE_TRACE_FILENAME);
+		ase_trace_open(trace_path);
+	}
 	// Evaluate IPCs
 	ipc_init();
 
@@ -1071,7 +1081,9 @@ int ase_init(void)
 #endif
 
 	// Set up message queues
-	ASE_MSG("Creating Messaging IPCs...\n");
+	ASE_MSG("Creating Messaging IPCs (%s)...\n",
+		(ase_ipc_transport == ASE_IPC_RING) ?
+		"shared memory rings" : "named pipes");
 	int ipc_iter;
 	for (ipc_iter = 0; ipc_iter < ASE_MQ_INSTANCES; ipc_iter++)
 		mqueue_create(mq_array[ipc_iter].name);
@@ -1246,6 +1258,9 @@ void start_simkill_countdown(void)
 	if (fp_workspace_log != NULL) {
 		fclose(fp_workspace_log);
 	}
+
+	// Flush binary trace
+	ase_trace_close();
 #ifdef ASE_DEBUG
 	if (fp_memaccess_log != NULL) {
 		fclose(fp_memaccess_log);
@@ -1266,6 +1281,11 @@ void start_simkill_countdown(void)
 	ASE_INFO("Simulation generated log files\n");
 	ASE_INFO
 		("        Transactions file       | $ASE_WORKDIR/ccip_transactions.tsv\n");
+	if (cfg->enable_binary_trace != 0) {
+		ASE_INFO
+			("        Binary trace            | $ASE_WORKDIR/%s\n",
+			 ASE_TRACE_FILENAME);
+	}
 	ASE_INFO
 		("        Workspaces info         | $ASE_WORKDIR/workspace_info.log\n");
 	if (access(ccip_sniffer_file_statpath, F_OK) != -1) {
@@ -1377,6 +1397,11 @@ void parse_ase_cfg_line(char *filename, char *line, float *f_usrclk)
 						cfg->phys_memory_available_gb = value;
 					}
 				}
+			} else if (ase_strncmp(parameter, "ENABLE_BINARY_TRACE", 19) == 0) {
+				pch = strtok_r(NULL, "", &saveptr);
+				if (pch != NULL) {
+					cfg->enable_binary_trace = atoi(pch);
+				}
 			} else {
 				ASE_INFO_2("In config file %s, Parameter type %s is unidentified \n",
 							 filename, parameter);
@@ -1418,6 +1443,7 @@ void ase_config_parse(char *filename)
 	cfg->enable_cl_view = 1;
 	cfg->usr_tps = DEFAULT_USR_CLK_TPS;
 	cfg->phys_memory_available_gb = 256;
+	cfg->enable_binary_trace = 0;
 
 	// Fclk Mhz
 	f_usrclk = DEFAULT_USR_CLK_MHZ;
@@ -1554,6 +1580,10 @@ void ase_config_parse(char *filename)
 	ASE_INFO_2("Amount of physical memory  ... %d GB\n",
 		   cfg->phys_memory_available_gb);
 
+	// Binary trace
+	if (cfg->enable_binary_trace != 0)
+		ASE_INFO_2("ASE Binary trace           ... ENABLED\n");
+
 	// Transfer data to hardware (for simulation only)
 	ase_config_dex(cfg);
 
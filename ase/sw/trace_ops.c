@@ -0,0 +1,219 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+// **************************************************************************
+/*
+ * Module Info: Binary CCI-P transaction trace writer
+ *
+ * ccip_logger calls ase_trace_ccip() once per transaction. Records are
+ * appended to a chunk in memory; full chunks are handed to a writer
+ * thread, so the simulator never waits on the disk unless every chunk is
+ * queued.
+ */
+
+#include "ase_common.h"
+#include "ase_trace.h"
+
+#define ASE_TRACE_CHUNK_SIZE  (1024*1024)
+#define ASE_TRACE_CHUNKS      8
+
+static struct {
+	FILE *fp;
+	pthread_t writer_tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *chunk[ASE_TRACE_CHUNKS];
+	uint32_t fill[ASE_TRACE_CHUNKS];
+	int cur;		// Chunk being filled by the simulator
+	int wr;			// Oldest chunk queued for the writer
+	int queued;		// Chunks queued for the writer
+	bool stop;
+} trace;
+
+
+/*
+ * ase_trace_writer : Thread writing queued chunks out in order
+ */
+static void *ase_trace_writer(void *arg)
+{
+	int idx;
+
+	UNUSED_PARAM(arg);
+
+	pthread_mutex_lock(&trace.lock);
+	while (1) {
+		while ((trace.queued == 0) && !trace.stop)
+			pthread_cond_wait(&trace.cond, &trace.lock);
+		if (trace.queued == 0)
+			break;
+
+		idx = trace.wr;
+		pthread_mutex_unlock(&trace.lock);
+
+		if (fwrite(trace.chunk[idx], 1, trace.fill[idx], trace.fp)
+		    != trace.fill[idx])
+			ASE_ERR("Binary trace write failed\n");
+
+		pthread_mutex_lock(&trace.lock);
+		trace.fill[idx] = 0;
+		trace.wr = (trace.wr + 1) % ASE_TRACE_CHUNKS;
+		trace.queued--;
+		pthread_cond_broadcast(&trace.cond);
+	}
+	pthread_mutex_unlock(&trace.lock);
+
+	return NULL;
+}
+
+
+/*
+ * ase_trace_submit : Queue the current chunk, wait for a free one
+ */
+static void ase_trace_submit(void)
+{
+	pthread_mutex_lock(&trace.lock);
+	trace.queued++;
+	pthread_cond_broadcast(&trace.cond);
+	while (trace.queued == ASE_TRACE_CHUNKS)
+		pthread_cond_wait(&trace.cond, &trace.lock);
+	trace.cur = (trace.wr + trace.queued) % ASE_TRACE_CHUNKS;
+	pthread_mutex_unlock(&trace.lock);
+}
+
+
+/*
+ * ase_trace_open : Start a binary trace at path
+ */
+void ase_trace_open(const char *path)
+{
+	struct ase_trace_file_hdr hdr;
+	int i;
+
+	if (trace.fp != NULL)
+		return;
+
+	trace.fp = fopen(path, "w");
+	if (trace.fp == NULL) {
+		ASE_ERR("Binary trace %s could not be opened, tracing disabled\n",
+			path);
+		return;
+	}
+
+	ase_memset(&hdr, 0, sizeof(hdr));
+	ase_memcpy(hdr.magic, ASE_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = ASE_TRACE_VERSION;
+	hdr.time_unit_ps = 1;	// ASE runs with a 1ps timescale
+	fwrite(&hdr, sizeof(hdr), 1, trace.fp);
+
+	for (i = 0; i < ASE_TRACE_CHUNKS; i++) {
+		trace.chunk[i] = ase_malloc(ASE_TRACE_CHUNK_SIZE);
+		trace.fill[i] = 0;
+	}
+	trace.cur = 0;
+	trace.wr = 0;
+	trace.queued = 0;
+	trace.stop = false;
+
+	pthread_mutex_init(&trace.lock, NULL);
+	pthread_cond_init(&trace.cond, NULL);
+	if (pthread_create(&trace.writer_tid, NULL, &ase_trace_writer,
+			   NULL) != 0) {
+		ASE_ERR("Binary trace writer could not be started, tracing disabled\n");
+		for (i = 0; i < ASE_TRACE_CHUNKS; i++)
+			free(trace.chunk[i]);
+		fclose(trace.fp);
+		trace.fp = NULL;
+		return;
+	}
+
+	ASE_INFO_2("Binary transaction trace   ... %s\n", path);
+}
+
+
+/*
+ * ase_trace_close : Flush the trace and stop the writer
+ */
+void ase_trace_close(void)
+{
+	int i;
+
+	if (trace.fp == NULL)
+		return;
+
+	pthread_mutex_lock(&trace.lock);
+	if (trace.fill[trace.cur] != 0)
+		trace.queued++;
+	trace.stop = true;
+	pthread_cond_broadcast(&trace.cond);
+	pthread_mutex_unlock(&trace.lock);
+	pthread_join(trace.writer_tid, NULL);
+
+	fclose(trace.fp);
+	trace.fp = NULL;
+	for (i = 0; i < ASE_TRACE_CHUNKS; i++)
+		free(trace.chunk[i]);
+}
+
+
+/*
+ * ase_trace_ccip : Append one transaction record (DPI import)
+ * - addr is recorded for requests only
+ */
+void ase_trace_ccip(long long tstamp, int kind, int vc, int mdata, int cl,
+		    int flags, long long addr)
+{
+	struct ase_trace_rec_addr rec;
+	uint16_t len;
+
+	if (trace.fp == NULL)
+		return;
+
+	switch (kind) {
+	case ASE_TRACE_RD_REQ:
+	case ASE_TRACE_WR_REQ:
+	case ASE_TRACE_MMIO_RD_REQ:
+	case ASE_TRACE_MMIO_WR_REQ:
+		len = sizeof(struct ase_trace_rec_addr);
+		rec.addr = (uint64_t) addr;
+		break;
+	default:
+		len = sizeof(struct ase_trace_rec);
+		break;
+	}
+
+	rec.hdr.len = len;
+	rec.hdr.kind = (uint8_t) kind;
+	rec.hdr.vc = (uint8_t) vc;
+	rec.hdr.mdata = (uint16_t) mdata;
+	rec.hdr.cl = (uint8_t) cl;
+	rec.hdr.flags = (uint8_t) flags;
+	rec.hdr.time = (uint64_t) tstamp;
+
+	if (trace.fill[trace.cur] + len > ASE_TRACE_CHUNK_SIZE)
+		ase_trace_submit();
+
+	ase_memcpy(trace.chunk[trace.cur] + trace.fill[trace.cur], &rec, len);
+	trace.fill[trace.cur] += len;
+}
@@ -56,7 +56,8 @@ set(ASESW_FILE_LIST
   ${ASE_SERVER_SRC}/mqueue_ops.c
   ${ASE_SERVER_SRC}/error_report.c
   ${ASE_SERVER_SRC}/linked_list_ops.c
-  ${ASE_SERVER_SRC}/randomness_control.c)
+  ${ASE_SERVER_SRC}/randomness_control.c
+  ${ASE_SERVER_SRC}/trace_ops.c)
 
 ############################################################################
 ## Define DPI C code #######################################################
@@ -107,6 +107,10 @@ function(Build_Test_Target Target_Name Target_LIB)
                 unit/gtBuffer.cpp
                 unit/gtReconf.cpp
                 unit/gtMockErrInj.cpp
+                unit/gtWsidList.cpp
+                unit/gtEnumFilter.cpp
+                unit/gtTokenList.cpp
+                unit/gtEventDaemon.cpp
                 function/gtCxxEnumerate.cpp
                 function/gtCxxEvents.cpp
                 function/gtCxxOpenClose.cpp
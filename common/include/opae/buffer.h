@@ -129,6 +129,100 @@ fpga_result fpgaReleaseBuffer(fpga_handle handle, uint64_t wsid);
 fpga_result fpgaGetIOAddress(fpga_handle handle, uint64_t wsid,
 			     uint64_t *ioaddr);
 
+/**
+ * Translate a virtual address within a shared buffer to its IO address
+ *
+ * Unlike fpgaGetIOAddress(), `va` may point anywhere inside a buffer
+ * previously returned by fpgaPrepareBuffer(), not only to its start. The
+ * returned IO address is the buffer's base IO address plus the offset of
+ * `va` into the buffer.
+ *
+ * The lookup takes O(log n) time in the number of shared buffers and may be
+ * called concurrently from several threads without serializing on the
+ * handle.
+ *
+ * @param[in]  handle   Handle to previously opened accelerator resource
+ * @param[in]  va       Virtual address within a shared buffer
+ * @param[out] ioaddr   Pointer to memory where the IO address will be returned
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if invalid parameters were
+ * provided. FPGA_NOT_FOUND if `va` does not lie within a shared buffer.
+ */
+fpga_result fpgaGetIOAddressFromVA(fpga_handle handle, void *va,
+				   uint64_t *ioaddr);
+
+/**
+ * Create a pool of shared buffers
+ *
+ * Pins `num_regions` memory regions of `region_size` bytes each using
+ * fpgaPrepareBuffer(), so the regions are backed by huge pages as described
+ * there. Small buffers are then carved out of these regions by
+ * fpgaPoolAlloc() without further system calls. When the regions run out,
+ * the pool grows by preparing additional regions.
+ *
+ * The pool keeps a reference to `handle`; it must be destroyed with
+ * fpgaDestroyBufferPool() before the handle is closed.
+ *
+ * @param[in]  handle      Handle to previously opened accelerator resource
+ * @param[in]  region_size Size of each pinned region in bytes; a non-zero
+ *                         multiple of 64 KiB. 0 selects 2 MiB.
+ * @param[in]  num_regions Number of regions to pin up front (may be 0)
+ * @param[in]  flags       Flags passed to fpgaPrepareBuffer() for each
+ *                         region; any of FPGA_BUF_PAGE_2M, FPGA_BUF_PAGE_1G,
+ *                         FPGA_BUF_FALLBACK and FPGA_BUF_NUMA_LOCAL
+ * @param[out] pool        Pointer to the created pool
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if invalid parameters were
+ * provided. FPGA_NO_MEMORY if the pool or its regions could not be allocated.
+ */
+fpga_result fpgaCreateBufferPool(fpga_handle handle, uint64_t region_size,
+				 uint32_t num_regions, int flags,
+				 fpga_buffer_pool *pool);
+
+/**
+ * Destroy a pool of shared buffers
+ *
+ * Releases all pinned regions of the pool. Buffers allocated from the pool
+ * become invalid. No other thread may use the pool concurrently.
+ *
+ * @param[in, out] pool    Pointer to the pool to destroy; set to NULL
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if `pool` is not a valid
+ * pool.
+ */
+fpga_result fpgaDestroyBufferPool(fpga_buffer_pool *pool);
+
+/**
+ * Allocate a buffer from a pool
+ *
+ * Returns a buffer of at least `len` bytes together with its IO address.
+ * The IO address is aligned to the buffer size rounded up to a power of two
+ * (at least one 64-byte cache line); the virtual address has the same
+ * alignment when the pool regions are backed by huge pages. Allocations are served from a cache owned by the calling thread
+ * and take neither the handle lock nor, usually, the pool lock.
+ *
+ * @param[in]  pool        Pool created by fpgaCreateBufferPool()
+ * @param[in]  len         Requested length in bytes; at most 64 KiB
+ * @param[out] buf_addr    Pointer to where the buffer address is returned
+ * @param[out] ioaddr      Pointer to where the buffer IO address is
+ *                         returned; may be NULL
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if invalid parameters were
+ * provided or `len` is larger than 64 KiB. FPGA_NO_MEMORY if the pool could
+ * not grow.
+ */
+fpga_result fpgaPoolAlloc(fpga_buffer_pool pool, uint64_t len,
+			  void **buf_addr, uint64_t *ioaddr);
+
+/**
+ * Return a buffer to a pool
+ *
+ * The buffer may be freed from any thread, not only the one that
+ * allocated it.
+ *
+ * @param[in]  pool        Pool the buffer was allocated from
+ * @param[in]  buf_addr    Address returned by fpgaPoolAlloc()
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if `buf_addr` was not
+ * allocated from `pool`.
+ */
+fpga_result fpgaPoolFree(fpga_buffer_pool pool, void *buf_addr);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
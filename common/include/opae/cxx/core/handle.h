@@ -29,6 +29,7 @@
 
 #include <opae/cxx/core/token.h>
 #include <opae/enum.h>
+#include <opae/mmio.h>
 #include <opae/types.h>
 
 namespace opae {
@@ -125,6 +126,49 @@ class handle {
    */
   void write_csr64(uint64_t offset, uint64_t value, uint32_t csr_space = 0);
 
+  /**
+   * @brief Write several CSRs belonging to a resource associated
+   * with a handle in one call.
+   *
+   * The writes are validated as a whole and issued in order. See
+   * fpgaWriteMMIOv().
+   *
+   * @param[in] ops The offset, width and value of each register write.
+   * @param[in] csr_space The CSR space to write to. Default is 0.
+   *
+   */
+  void write_csrs(const std::vector<fpga_mmio_op> &ops,
+                  uint32_t csr_space = 0);
+
+  /**
+   * @brief Read several CSRs belonging to a resource associated
+   * with a handle in one call.
+   *
+   * The reads are validated as a whole and issued in order. See
+   * fpgaReadMMIOv().
+   *
+   * @param[in,out] ops The offset and width of each register read.
+   * The value read is stored in the value member of each element.
+   * @param[in] csr_space The CSR space to read from. Default is 0.
+   *
+   */
+  void read_csrs(std::vector<fpga_mmio_op> &ops, uint32_t csr_space = 0) const;
+
+  /**
+   * @brief Read and write several CSRs belonging to a resource
+   * associated with a handle in one call.
+   *
+   * Elements with FPGA_MMIO_READ set are reads, all others writes. The
+   * accesses are validated as a whole and issued in order. See
+   * fpgaMMIOv().
+   *
+   * @param[in,out] ops The offset, width and flags of each register
+   * access. Reads store the value read in the value member.
+   * @param[in] csr_space The CSR space to access. Default is 0.
+   *
+   */
+  void access_csrs(std::vector<fpga_mmio_op> &ops, uint32_t csr_space = 0);
+
   /** Retrieve a pointer to the MMIO region.
    * @param[in] offset The byte offset to add to MMIO base.
    * @param[in] csr_space The desired CSR space. Default is 0.
@@ -102,6 +102,53 @@ fpga_result fpgaEnumerate(const fpga_properties *filters,
 			  uint32_t num_filters, fpga_token *tokens,
 			  uint32_t max_tokens, uint32_t *num_matches);
 
+/**
+ * Enable the process-wide enumeration cache
+ *
+ * By default, every fpgaEnumerate() call scans sysfs. With the cache
+ * enabled, the device tree is scanned once and later calls are answered
+ * from memory. The cache is invalidated when the kernel reports an FPGA or
+ * PCI device change (netlink uevent), when fpgaReconfigureSlot() succeeds in
+ * this process, after `ttl_ms` milliseconds if non-zero, and by
+ * fpgaEnumerateCacheInvalidate().
+ *
+ * @note Partial reconfiguration done by another process does not generate a
+ * uevent, so the reported AFU IDs may be stale until the TTL expires or the
+ * cache is invalidated. Setting the environment variable LIBOPAE_ENUM_CACHE
+ * to a TTL in milliseconds enables the cache when the library is loaded.
+ *
+ * @param[in] ttl_ms       Maximum age of the cache in milliseconds, or 0 to
+ *                         rely on uevents and explicit invalidation only.
+ * @returns                FPGA_OK on success.
+ *                         FPGA_EXCEPTION if an internal error occurred.
+ */
+fpga_result fpgaEnumerateCacheEnable(uint32_t ttl_ms);
+
+/**
+ * Disable the process-wide enumeration cache
+ *
+ * fpgaEnumerate() goes back to scanning sysfs on every call.
+ *
+ * @returns                FPGA_OK on success.
+ *                         FPGA_EXCEPTION if an internal error occurred.
+ */
+fpga_result fpgaEnumerateCacheDisable(void);
+
+/**
+ * Invalidate the process-wide enumeration cache
+ *
+ * The next fpgaEnumerate() call rescans sysfs. This also drops the device
+ * attributes (vendor/device ID, bitstream ID, ...) that the library caches
+ * for fpgaGetProperties() whether or not the enumeration cache is enabled.
+ * Attributes that are fixed for the lifetime of a device are also read
+ * again whenever fpgaEnumerate() scans sysfs. Setting the environment
+ * variable LIBOPAE_SYSFS_CACHE to 0 disables that attribute cache.
+ *
+ * @returns                FPGA_OK on success.
+ *                         FPGA_EXCEPTION if an internal error occurred.
+ */
+fpga_result fpgaEnumerateCacheInvalidate(void);
+
 /**
  * Clone a fpga_token object
  *
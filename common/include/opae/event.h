@@ -149,6 +149,55 @@ fpga_result fpgaUnregisterEvent(fpga_handle handle,
 					     fpga_event_type event_type,
 					     fpga_event_handle event_handle);
 
+/**
+ * Map the event ring published by the FPGA daemon
+ *
+ * fpgad appends a record to a shared memory ring for every error it decodes
+ * and every power or AP state transition it observes. Once the ring is
+ * mapped, fpgaReadEventRing() consumes records without system calls and
+ * without re-reading sysfs. Readers do not hold back the daemon: a reader
+ * that falls more than a ring's worth of records behind loses the oldest
+ * ones. Event handles registered with fpgaRegisterEvent() remain the way
+ * to wait for new records.
+ *
+ * A newly opened ring starts with the oldest record still retained.
+ *
+ * @param[out] ring     Pointer to the ring handle to initialize.
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if `ring` is NULL.
+ * FPGA_NO_DAEMON if fpgad is not running. FPGA_NOT_SUPPORTED if the
+ * daemon does not publish an event ring. FPGA_NO_MEMORY if the handle
+ * could not be allocated. FPGA_EXCEPTION if the ring could not be mapped.
+ */
+fpga_result fpgaOpenEventRing(fpga_event_ring *ring);
+
+/**
+ * Read records from the event ring
+ *
+ * Copies up to `max_records` records published since the previous call
+ * into `records`, oldest first.
+ *
+ * @param[in]  ring        Ring opened with fpgaOpenEventRing().
+ * @param[out] records     Array of at least `max_records` records.
+ * @param[in]  max_records Size of the `records` array.
+ * @param[out] num_records Number of records returned.
+ * @param[out] lost        Number of records that were overwritten before
+ *                         they could be read. May be NULL.
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if `ring`, `records` or
+ * `num_records` is invalid.
+ */
+fpga_result fpgaReadEventRing(fpga_event_ring ring,
+			      struct fpga_event_record *records,
+			      uint32_t max_records, uint32_t *num_records,
+			      uint64_t *lost);
+
+/**
+ * Unmap the event ring
+ *
+ * @param[in] ring  Pointer to the ring handle to close.
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if `ring` is invalid.
+ */
+fpga_result fpgaCloseEventRing(fpga_event_ring *ring);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
@@ -118,6 +118,100 @@ fpga_result fpgaReadMMIO32(fpga_handle handle,
 			   uint32_t mmio_num,
 			   uint64_t offset, uint32_t *value);
 
+/**
+ * Flags for an element of a vectored MMIO access
+ */
+enum fpga_mmio_op_flags {
+	/** Complete all preceding accesses of the vector before this one */
+	FPGA_MMIO_FENCE = (1u << 0),
+	/** Read into `value` instead of writing it (fpgaMMIOv() only) */
+	FPGA_MMIO_READ = (1u << 1)
+};
+
+/**
+ * One register access of a vectored MMIO operation
+ *
+ * Used with fpgaMMIOv(), fpgaWriteMMIOv() and fpgaReadMMIOv() to access
+ * several CSRs of one MMIO space in a single call.
+ */
+typedef struct {
+	uint64_t offset;   /**< Byte offset into MMIO space */
+	uint64_t value;    /**< Value to write, or value read */
+	uint32_t width;    /**< Access width in bytes (4 or 8) */
+	uint32_t flags;    /**< Bitwise OR of fpga_mmio_op_flags */
+} fpga_mmio_op;
+
+/**
+ * Write a vector of values to MMIO space
+ *
+ * This function will perform the writes described by `ops`, in order, to
+ * MMIO space of the target object. The handle and all elements are
+ * validated before the first write is issued, so a vector containing an
+ * invalid element has no effect. An element with FPGA_MMIO_FENCE set is
+ * not issued before all preceding writes of the vector have completed.
+ *
+ * @param[in]  handle   Handle to previously opened accelerator resource
+ * @param[in]  mmio_num Number of MMIO space to access
+ * @param[in]  ops      Array of writes to perform
+ * @param[in]  num_ops  Number of elements in `ops`
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if any of the supplied
+ * parameters is invalid, including a misaligned, out-of-bounds or
+ * unsupported-width element. FPGA_EXCEPTION if an internal exception
+ * occurred while trying to access the handle.
+ */
+fpga_result fpgaWriteMMIOv(fpga_handle handle,
+			   uint32_t mmio_num,
+			   const fpga_mmio_op *ops, uint32_t num_ops);
+
+/**
+ * Read a vector of values from MMIO space
+ *
+ * This function will perform the reads described by `ops`, in order, from
+ * MMIO space of the target object, storing each result in the `value`
+ * field of the respective element. The handle and all elements are
+ * validated before the first read is issued. An element with
+ * FPGA_MMIO_FENCE set is not issued before all preceding reads of the
+ * vector have completed.
+ *
+ * @param[in]     handle   Handle to previously opened accelerator resource
+ * @param[in]     mmio_num Number of MMIO space to access
+ * @param[in,out] ops      Array of reads to perform
+ * @param[in]     num_ops  Number of elements in `ops`
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if any of the supplied
+ * parameters is invalid, including a misaligned, out-of-bounds or
+ * unsupported-width element. FPGA_EXCEPTION if an internal exception
+ * occurred while trying to access the handle.
+ */
+fpga_result fpgaReadMMIOv(fpga_handle handle,
+			  uint32_t mmio_num,
+			  fpga_mmio_op *ops, uint32_t num_ops);
+
+/**
+ * Perform a vector of reads and writes on MMIO space
+ *
+ * This function will perform the accesses described by `ops`, in order,
+ * on MMIO space of the target object. Elements with FPGA_MMIO_READ set
+ * are reads and store their result in the `value` field; all others are
+ * writes. The handle and all elements are validated before the first
+ * access is issued. An element with FPGA_MMIO_FENCE set is not issued
+ * before all preceding accesses of the vector have completed, so that
+ * e.g. a group of writes can be followed by reads of their effect.
+ *
+ * fpgaWriteMMIOv() and fpgaReadMMIOv() ignore FPGA_MMIO_READ.
+ *
+ * @param[in]     handle   Handle to previously opened accelerator resource
+ * @param[in]     mmio_num Number of MMIO space to access
+ * @param[in,out] ops      Array of accesses to perform
+ * @param[in]     num_ops  Number of elements in `ops`
+ * @returns FPGA_OK on success. FPGA_INVALID_PARAM if any of the supplied
+ * parameters is invalid, including a misaligned, out-of-bounds or
+ * unsupported-width element. FPGA_EXCEPTION if an internal exception
+ * occurred while trying to access the handle.
+ */
+fpga_result fpgaMMIOv(fpga_handle handle,
+		      uint32_t mmio_num,
+		      fpga_mmio_op *ops, uint32_t num_ops);
+
 /**
  * Map MMIO space
  *
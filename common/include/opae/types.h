@@ -159,6 +159,47 @@ typedef struct {
  */
 typedef void *fpga_event_handle;
 
+/** Handle to a pool of shared buffers
+ *
+ * A buffer pool pins a small number of large memory regions for use by an
+ * accelerator once, and sub-allocates small buffers from them without
+ * further system calls. See fpgaCreateBufferPool().
+ *
+ * After use, `fpga_buffer_pool` objects should be destroyed using
+ * fpgaDestroyBufferPool(), which also releases the pinned regions.
+ */
+typedef void *fpga_buffer_pool;
+
+/** Handle to the event ring published by the FPGA daemon
+ *
+ * fpgad publishes decoded error and power state records to a shared memory
+ * ring. Any number of processes can map the ring and read these records
+ * without system calls. See fpgaOpenEventRing().
+ *
+ * After use, `fpga_event_ring` objects should be closed using
+ * fpgaCloseEventRing() to unmap the ring.
+ */
+typedef void *fpga_event_ring;
+
+/** Record read from an `fpga_event_ring`
+ *
+ * For FPGA_EVENT_ERROR records, `reg` is the sysfs error register, `name`
+ * the error field from the daemon's error table and `value` the field
+ * value. For FPGA_EVENT_POWER_THERMAL records, `value` is the new power
+ * or AP state reported by `reg`.
+ */
+#define FPGA_EVENT_RECORD_REG_MAX  128
+#define FPGA_EVENT_RECORD_NAME_MAX 64
+struct fpga_event_record {
+	uint64_t sequence;                     /** position in the ring */
+	uint64_t timestamp;                    /** CLOCK_REALTIME, in ns */
+	fpga_event_type type;                  /** kind of event */
+	int socket;                            /** FPGA socket */
+	uint64_t value;                        /** field or state value */
+	char reg[FPGA_EVENT_RECORD_REG_MAX];   /** sysfs register path */
+	char name[FPGA_EVENT_RECORD_NAME_MAX]; /** register field name */
+};
+
 /** Information about an error register
  *
  * This data structure captures information about an error register exposed by
@@ -118,10 +118,25 @@ typedef enum {
  * Buffer flags
  *
  * These flags can be passed to the fpgaPrepareBuffer() function.
+ *
+ * Without any of the FPGA_BUF_PAGE_* flags, buffers larger than 2 MiB are
+ * backed by 1 GiB huge pages, buffers larger than 4 KiB by 2 MiB huge pages
+ * and smaller buffers by 4 KiB pages. At most one FPGA_BUF_PAGE_* flag may
+ * be given to choose the page size explicitly.
  */
 enum fpga_buffer_flags {
 	FPGA_BUF_PREALLOCATED = (1u << 0), /**< Use existing buffer */
-	FPGA_BUF_QUIET = (1u << 1)         /**< Suppress error messages */
+	FPGA_BUF_QUIET = (1u << 1),        /**< Suppress error messages */
+	FPGA_BUF_PAGE_4K = (1u << 2),      /**< Back with 4 KiB pages */
+	FPGA_BUF_PAGE_2M = (1u << 3),      /**< Back with 2 MiB huge pages */
+	FPGA_BUF_PAGE_1G = (1u << 4),      /**< Back with 1 GiB huge pages */
+	FPGA_BUF_FALLBACK = (1u << 5),     /**< Use the next smaller page size
+					        if no pages of the chosen size
+					        are free */
+	FPGA_BUF_NUMA_LOCAL = (1u << 6),   /**< Prefer memory on the NUMA node
+					        the FPGA is attached to */
+	FPGA_BUF_PACK = (1u << 7)          /**< Share huge pages between
+					        buffers smaller than a page */
 };
 
 /**
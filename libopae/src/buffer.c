@@ -37,9 +37,11 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include "safe_string/safe_string.h"
 
 /* Others */
 #define KB 1024
@@ -70,43 +72,146 @@
 #endif
 
 
+#define FPGA_BUF_PAGE_MASK \
+	(FPGA_BUF_PAGE_4K | FPGA_BUF_PAGE_2M | FPGA_BUF_PAGE_1G)
+
+#define FPGA_BUF_VALID_FLAGS                                    \
+	(FPGA_BUF_PREALLOCATED | FPGA_BUF_QUIET | FPGA_BUF_PAGE_MASK | \
+	 FPGA_BUF_FALLBACK | FPGA_BUF_NUMA_LOCAL | FPGA_BUF_PACK)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define MAX_NUMA_NODES 1024
+
+/* Supported page sizes, largest first (the FPGA_BUF_FALLBACK order) */
+static const struct buffer_page {
+	int flag;
+	uint64_t size;
+	int mmap_flags;
+	const char *name;
+} buffer_pages[] = {
+	{ FPGA_BUF_PAGE_1G, 1 * GB, FLAGS_1G, "1 GiB huge pages" },
+	{ FPGA_BUF_PAGE_2M, 2 * MB, FLAGS_2M, "2 MiB huge pages" },
+	{ FPGA_BUF_PAGE_4K, 4 * KB, FLAGS_4K, "4 KiB pages" },
+};
+
+#define NUM_BUFFER_PAGES (sizeof(buffer_pages) / sizeof(buffer_pages[0]))
+
+/*
+ * Pick the page size for a buffer: the one requested by a
+ * FPGA_BUF_PAGE_* flag, or else the default policy. Buffers > 2M use
+ * 1G-hugepages to ensure pages are contiguous.
+ */
+static uint32_t buffer_page_index(uint64_t len, int flags)
+{
+	uint32_t i;
+
+	for (i = 0; i < NUM_BUFFER_PAGES; ++i) {
+		if (flags & buffer_pages[i].flag)
+			return i;
+	}
+
+	if (len > 2 * MB)
+		return 0;
+	if (len > 4 * KB)
+		return 1;
+	return 2;
+}
+
+static inline uint64_t buffer_round_up(uint64_t len, uint64_t size)
+{
+	return (len + size - 1) & ~(size - 1);
+}
+
+/*
+ * NUMA node the FPGA is attached to, or -1 if unknown. Uses the PCIe
+ * device's numa_node and falls back to the FME socket_id.
+ */
+static int buffer_numa_node(struct _fpga_handle *_handle)
+{
+	struct _fpga_token *_token = (struct _fpga_token *)_handle->token;
+	char spath[SYSFS_PATH_MAX];
+	uint8_t socket_id = 0;
+	int node = -1;
+
+	snprintf_s_s(spath, SYSFS_PATH_MAX, "%s/../device/numa_node",
+		     _token->sysfspath);
+	if (sysfs_read_int(spath, &node) == FPGA_OK && node >= 0)
+		return node;
+
+	if (sysfs_get_socket_id(_token->instance, &socket_id) == FPGA_OK)
+		return socket_id;
+
+	return -1;
+}
+
+/*
+ * Prefer memory on the given node for the not yet faulted range
+ * [addr, addr + len). Placement is best effort; failure is not fatal.
+ */
+static void buffer_bind_node(void *addr, uint64_t len, int node, int flags)
+{
+	unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+	const unsigned long bits = 8 * sizeof(unsigned long);
+
+	if (node < 0 || node >= MAX_NUMA_NODES)
+		return;
+
+	memset_s(nodemask, sizeof(nodemask), 0);
+	nodemask[node / bits] = 1UL << (node % bits);
+
+	if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, nodemask,
+		    MAX_NUMA_NODES, 0) && !(flags & FPGA_BUF_QUIET)) {
+		FPGA_MSG("mbind to node %d failed: %s", node, strerror(errno));
+	}
+}
+
 /*
  * Allocate (mmap) new buffer
+ * On success, the FPGA_BUF_PAGE_* bits of *flags are replaced by the page
+ * size actually used, which buffer_release() needs.
  */
-static fpga_result buffer_allocate(void **addr, uint64_t len, int flags)
+static fpga_result buffer_allocate(void **addr, uint64_t len, int *flags,
+				   int node)
 {
 	void *addr_local = NULL;
-
-	UNUSED_PARAM(flags);
+	uint32_t i;
 
 	ASSERT_NOT_NULL(addr);
 
-	/* ! FPGA_BUF_PREALLOCATED, allocate memory using huge pages
-	   For buffer > 2M, use 1G-hugepage to ensure pages are
-	   contiguous */
-	if (len > 2 * MB)
-		addr_local = mmap(ADDR, len, PROTECTION, FLAGS_1G, 0, 0);
-	else if (len > 4 * KB)
-		addr_local = mmap(ADDR, len, PROTECTION, FLAGS_2M, 0, 0);
-	else
-		addr_local = mmap(ADDR, len, PROTECTION, FLAGS_4K, 0, 0);
-	if (addr_local == MAP_FAILED) {
+	i = buffer_page_index(len, *flags);
+
+	for (;;) {
+		addr_local = mmap(ADDR, len, PROTECTION,
+				  buffer_pages[i].mmap_flags, 0, 0);
+		if (addr_local != MAP_FAILED)
+			break;
+
+		/* EINVAL: no huge pages of this size configured */
+		if ((*flags & FPGA_BUF_FALLBACK) &&
+		    (errno == ENOMEM || errno == EINVAL) &&
+		    i + 1 < NUM_BUFFER_PAGES) {
+			++i;
+			continue;
+		}
+
 		if (errno == ENOMEM) {
-			if (len > 2 * MB)
-				FPGA_MSG("Could not allocate buffer (no free 1 "
-					 "GiB huge pages)");
-			if (len > 4 * KB)
-				FPGA_MSG("Could not allocate buffer (no free 2 "
-					 "MiB huge pages)");
-			else
-				FPGA_MSG("Could not allocate buffer (out of "
-					 "memory)");
+			FPGA_MSG("Could not allocate buffer (no free %s)",
+				 buffer_pages[i].name);
 			return FPGA_NO_MEMORY;
 		}
 		FPGA_MSG("FPGA buffer mmap failed: %s", strerror(errno));
 		return FPGA_INVALID_PARAM;
 	}
 
+	if (*flags & FPGA_BUF_NUMA_LOCAL)
+		buffer_bind_node(addr_local,
+				 buffer_round_up(len, buffer_pages[i].size),
+				 node, *flags);
+
+	*flags = (*flags & ~FPGA_BUF_PAGE_MASK) | buffer_pages[i].flag;
 	*addr = addr_local;
 	return FPGA_OK;
 }
@@ -114,26 +219,15 @@ static fpga_result buffer_allocate(void **addr, uint64_t len, int flags)
 /*
  * Release (unmap) allocated buffer
  */
-static fpga_result buffer_release(void *addr, uint64_t len)
+static fpga_result buffer_release(void *addr, uint64_t len, int flags)
 {
 	/* If the buffer allocation was backed by hugepages, then
 	 * len must be rounded up to the nearest hugepage size,
-	 * otherwise munmap will fail.
-	 *
-	 * Buffer with size larger than 2MB is backed by 1GB page(s),
-	 * round up the size to the nearest GB boundary.
-	 *
-	 * Buffer with size smaller than 2MB but larger than 4KB is
-	 * backed by a 2MB pages, round up the size to 2MB.
-	 *
-	 * Buffer with size smaller than 4KB is backed by a 4KB page,
-	 * and its size is already 4KB aligned.
+	 * otherwise munmap will fail. buffer_allocate() recorded
+	 * the page size used in flags.
 	 */
-
-	if (len > 2 * MB)
-		len = (len + (1 * GB - 1)) & (~(1 * GB - 1));
-	else if (len > 4 * KB)
-		len = 2 * MB;
+	len = buffer_round_up(len,
+			      buffer_pages[buffer_page_index(len, flags)].size);
 
 	if (munmap(addr, len)) {
 		FPGA_MSG("FPGA buffer munmap failed: %s",
@@ -144,6 +238,175 @@ static fpga_result buffer_release(void *addr, uint64_t len)
 	return FPGA_OK;
 }
 
+/* Length of the longest run of clear bits in used[] starting at bit */
+static uint64_t packed_run(const uint64_t *used, uint64_t bit, uint64_t nbits)
+{
+	uint64_t end = bit;
+
+	while (end < nbits && !(used[end / 64] & (1UL << (end % 64))))
+		++end;
+	return end - bit;
+}
+
+static void packed_mark(uint64_t *used, uint64_t bit, uint64_t n, bool set)
+{
+	for (; n; --n, ++bit) {
+		if (set)
+			used[bit / 64] |= 1UL << (bit % 64);
+		else
+			used[bit / 64] &= ~(1UL << (bit % 64));
+	}
+}
+
+/*
+ * Allocate a buffer smaller than a page from a huge page shared with
+ * other FPGA_BUF_PACK buffers, choosing the smallest free range that
+ * fits (best fit). Called with the handle lock held.
+ */
+static fpga_result buffer_allocate_packed(struct _fpga_handle *_handle,
+					  void **addr, uint64_t len,
+					  int *flags, int node)
+{
+	uint32_t i = buffer_page_index(len, *flags);
+	int key = buffer_pages[i].flag | (*flags & FPGA_BUF_NUMA_LOCAL);
+	uint64_t n = len / (4 * KB);
+	struct _fpga_packed_page *p;
+	struct _fpga_packed_page *best = NULL;
+	uint64_t best_bit = 0;
+	uint64_t best_run = UINT64_MAX;
+	fpga_result result;
+
+	for (p = _handle->packed_pages; p; p = p->next) {
+		uint64_t nbits = p->size / (4 * KB);
+		uint64_t bit = 0;
+
+		if (p->flags != key || nbits - p->n_used < n)
+			continue;
+
+		while (bit < nbits) {
+			uint64_t run;
+
+			if (!(bit % 64) && p->used[bit / 64] == UINT64_MAX) {
+				bit += 64;
+				continue;
+			}
+
+			run = packed_run(p->used, bit, nbits);
+
+			if (run >= n && run < best_run) {
+				best = p;
+				best_bit = bit;
+				best_run = run;
+			}
+			bit += run + 1;
+		}
+	}
+
+	if (!best) {
+		int page_flags = (*flags & ~FPGA_BUF_PAGE_MASK) |
+				 buffer_pages[i].flag;
+		void *page_addr = NULL;
+
+		best = calloc(1, sizeof(struct _fpga_packed_page));
+		if (!best) {
+			FPGA_MSG("Failed to allocate memory");
+			return FPGA_NO_MEMORY;
+		}
+
+		best->used = calloc(buffer_pages[i].size / (4 * KB * 64),
+				    sizeof(uint64_t));
+		if (!best->used) {
+			FPGA_MSG("Failed to allocate memory");
+			free(best);
+			return FPGA_NO_MEMORY;
+		}
+
+		/* May fall back to smaller pages; the range stays shareable */
+		result = buffer_allocate(&page_addr, buffer_pages[i].size,
+					 &page_flags, node);
+		if (result != FPGA_OK) {
+			free(best->used);
+			free(best);
+			return result;
+		}
+
+		best->addr = (uint8_t *)page_addr;
+		best->size = buffer_pages[i].size;
+		best->flags = key;
+		best->next = _handle->packed_pages;
+		_handle->packed_pages = best;
+		best_bit = 0;
+	}
+
+	packed_mark(best->used, best_bit, n, true);
+	best->n_used += n;
+
+	*flags = (*flags & ~FPGA_BUF_PAGE_MASK) | buffer_pages[i].flag;
+	*addr = best->addr + best_bit * 4 * KB;
+	return FPGA_OK;
+}
+
+/*
+ * Return a packed buffer to its huge page, unmapping the page when it
+ * is no longer used. Called with the handle lock held.
+ */
+static fpga_result buffer_release_packed(struct _fpga_handle *_handle,
+					 void *addr, uint64_t len)
+{
+	struct _fpga_packed_page **pp;
+	struct _fpga_packed_page *p;
+	fpga_result result = FPGA_OK;
+
+	for (pp = &_handle->packed_pages; *pp; pp = &(*pp)->next) {
+		p = *pp;
+		if ((uint8_t *)addr >= p->addr &&
+		    (uint8_t *)addr < p->addr + p->size)
+			break;
+	}
+
+	if (!*pp) {
+		FPGA_MSG("Packed buffer not found");
+		return FPGA_INVALID_PARAM;
+	}
+
+	packed_mark(p->used, ((uint8_t *)addr - p->addr) / (4 * KB),
+		    len / (4 * KB), false);
+	p->n_used -= len / (4 * KB);
+
+	if (!p->n_used) {
+		if (munmap(p->addr, p->size)) {
+			FPGA_MSG("FPGA buffer munmap failed: %s",
+				 strerror(errno));
+			result = FPGA_INVALID_PARAM;
+		}
+		*pp = p->next;
+		free(p->used);
+		free(p);
+	}
+
+	return result;
+}
+
+/* Release a buffer allocated by fpgaPrepareBuffer(), packed or not */
+static fpga_result buffer_free(struct _fpga_handle *_handle, void *addr,
+			       uint64_t len, int flags)
+{
+	if (flags & FPGA_BUF_PACK)
+		return buffer_release_packed(_handle, addr, len);
+	return buffer_release(addr, len, flags);
+}
+
+void free_packed_pages(struct _fpga_handle *_handle)
+{
+	while (_handle->packed_pages) {
+		struct _fpga_packed_page *p = _handle->packed_pages;
+
+		_handle->packed_pages = p->next;
+		free(p->used);
+		free(p);
+	}
+}
+
 fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 					   void **buf_addr, uint64_t *wsid,
 					   int flags)
@@ -157,6 +420,7 @@ fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 	bool quiet = (flags & FPGA_BUF_QUIET);
 
 	uint64_t pg_size;
+	int node = -1;
 
 	result = handle_check_and_lock(_handle);
 	if (result)
@@ -169,12 +433,25 @@ fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 		goto out_unlock;
 	}
 
-	if (flags & (~(FPGA_BUF_PREALLOCATED | FPGA_BUF_QUIET))) {
+	if (flags & ~FPGA_BUF_VALID_FLAGS) {
 		FPGA_MSG("Unrecognized flags");
 		result = FPGA_INVALID_PARAM;
 		goto out_unlock;
 	}
 
+	/* At most one page size; placement flags need an allocation */
+	if ((flags & FPGA_BUF_PAGE_MASK) & ((flags & FPGA_BUF_PAGE_MASK) - 1)) {
+		FPGA_MSG("Conflicting page size flags");
+		result = FPGA_INVALID_PARAM;
+		goto out_unlock;
+	}
+
+	if (preallocated && (flags & ~(FPGA_BUF_PREALLOCATED | FPGA_BUF_QUIET))) {
+		FPGA_MSG("Allocation flags given for preallocated buffer");
+		result = FPGA_INVALID_PARAM;
+		goto out_unlock;
+	}
+
 	pg_size = (uint64_t) sysconf(_SC_PAGE_SIZE);
 
 	if (preallocated) {
@@ -223,7 +500,19 @@ fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 			len = pg_size + (len & ~(pg_size - 1));
 		}
 
-		result = buffer_allocate(&addr, len, flags);
+		if (flags & FPGA_BUF_NUMA_LOCAL)
+			node = buffer_numa_node(_handle);
+
+		/* Only buffers smaller than their page can share one */
+		if ((flags & FPGA_BUF_PACK) &&
+		    len >= buffer_pages[buffer_page_index(len, flags)].size)
+			flags &= ~FPGA_BUF_PACK;
+
+		if (flags & FPGA_BUF_PACK)
+			result = buffer_allocate_packed(_handle, &addr, len,
+							&flags, node);
+		else
+			result = buffer_allocate(&addr, len, &flags, node);
 		if (result != FPGA_OK) {
 			goto out_unlock;
 		}
@@ -239,7 +528,7 @@ fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 	/* Dispatch ioctl command */
 	if (ioctl(_handle->fddev, FPGA_PORT_DMA_MAP, &dma_map) != 0) {
 		if (!preallocated) {
-			buffer_release(addr, len);
+			buffer_free(_handle, addr, len, flags);
 		}
 
 		if (!quiet) {
@@ -264,7 +553,7 @@ fpga_result __FPGA_API__ fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
 		      0,
 		      flags)) {
 		if (!preallocated) {
-			buffer_release(addr, len);
+			buffer_free(_handle, addr, len, flags);
 		}
 
 		FPGA_MSG("Failed to add workspace id %lu", *wsid);
@@ -323,7 +612,7 @@ fpga_result __FPGA_API__ fpgaReleaseBuffer(fpga_handle handle, uint64_t wsid)
 	/* Dispatch ioctl command */
 	if (ioctl(_handle->fddev, FPGA_PORT_DMA_UNMAP, &dma_unmap) != 0) {
 		if (!preallocated) {
-			buffer_release(buf_addr, len);
+			buffer_free(_handle, buf_addr, len, wm->flags);
 		}
 
 		FPGA_MSG("FPGA_PORT_DMA_UNMAP ioctl failed: %s",
@@ -336,7 +625,7 @@ fpga_result __FPGA_API__ fpgaReleaseBuffer(fpga_handle handle, uint64_t wsid)
 	 * preallocated), we need to unmap it here. Otherwise (if it was
 	 * preallocated) the mapping needs to stay intact. */
 	if (!preallocated) {
-		result = buffer_release(buf_addr, len);
+		result = buffer_free(_handle, buf_addr, len, wm->flags);
 		if (result != FPGA_OK) {
 			FPGA_MSG("Buffer release failed");
 			goto ws_free;
@@ -383,4 +672,26 @@ fpga_result __FPGA_API__ fpgaGetIOAddress(fpga_handle handle, uint64_t wsid,
 		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
 	}
 	return result;
-}
\ No newline at end of file
+}
+
+fpga_result __FPGA_API__ fpgaGetIOAddressFromVA(fpga_handle handle, void *va,
+						uint64_t *ioaddr)
+{
+	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
+
+	ASSERT_NOT_NULL(_handle);
+	ASSERT_NOT_NULL(ioaddr);
+
+	/* The range index has its own lock; don't serialize on the handle. */
+	if (_handle->magic != FPGA_HANDLE_MAGIC) {
+		FPGA_MSG("Invalid handle object");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (!wsid_find_phys_by_va(_handle->wsid_root, (uint64_t) va, ioaddr)) {
+		FPGA_MSG("Address not within a shared buffer");
+		return FPGA_NOT_FOUND;
+	}
+
+	return FPGA_OK;
+}
@@ -0,0 +1,613 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "opae/access.h"
+#include "opae/buffer.h"
+#include "opae/utils.h"
+#include "common_int.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Buffers are handed out from per-thread caches without any locking. A
+ * thread cache refills from (and flushes to) the pool's shared free lists
+ * in batches under the pool lock. The shared lists in turn are fed by
+ * carving slabs out of pinned regions, and new regions are prepared only
+ * when all existing slabs are in use.
+ */
+
+#define FPGA_POOL_DEFAULT_REGION (2UL * 1024 * 1024)
+#define FPGA_POOL_BATCH_MAX      32
+
+/* Number of chunks moved between a thread cache and the shared list */
+static inline uint32_t pool_batch(uint32_t c)
+{
+	uint32_t per_slab = 1U << (FPGA_POOL_NUM_CLASSES - 1 - c);
+
+	return per_slab < FPGA_POOL_BATCH_MAX ? per_slab : FPGA_POOL_BATCH_MAX;
+}
+
+static inline uint64_t pool_class_size(uint32_t c)
+{
+	return 1UL << (c + FPGA_POOL_MIN_SHIFT);
+}
+
+static inline uint32_t pool_class_of(uint64_t len)
+{
+	uint32_t c = 0;
+
+	while (pool_class_size(c) < len)
+		++c;
+	return c;
+}
+
+static inline fpga_result pool_check(struct _fpga_buffer_pool *_pool)
+{
+	ASSERT_NOT_NULL(_pool);
+
+	if (_pool->magic != FPGA_BUFFER_POOL_MAGIC) {
+		FPGA_MSG("Invalid buffer pool object");
+		return FPGA_INVALID_PARAM;
+	}
+
+	return FPGA_OK;
+}
+
+/* Region containing addr, or NULL. Safe without the pool lock. */
+static struct _fpga_pool_region *pool_find_region(struct _fpga_buffer_pool *_pool,
+						  uint8_t *addr)
+{
+	uint32_t n = __atomic_load_n(&_pool->n_regions, __ATOMIC_ACQUIRE);
+	uint32_t i;
+
+	for (i = 0; i < n; ++i) {
+		struct _fpga_pool_region *r = &_pool->regions[i];
+
+		if (addr >= r->base && (uint64_t)(addr - r->base) < r->len)
+			return r;
+	}
+
+	return NULL;
+}
+
+/* Offset of the first slab aligned IO address at or after iova */
+static inline uint64_t pool_slab_off(uint64_t iova)
+{
+	return (FPGA_POOL_SLAB_SIZE - (iova & (FPGA_POOL_SLAB_SIZE - 1))) &
+	       (FPGA_POOL_SLAB_SIZE - 1);
+}
+
+/* Prepare len bytes for region r. Pool lock must be held. */
+static fpga_result pool_prepare_region(struct _fpga_buffer_pool *_pool,
+				       struct _fpga_pool_region *r,
+				       uint64_t len)
+{
+	void *addr = NULL;
+	fpga_result result;
+
+	result = fpgaPrepareBuffer(_pool->handle, len, &addr, &r->wsid,
+				   _pool->flags);
+	if (result != FPGA_OK)
+		return result;
+
+	result = fpgaGetIOAddress(_pool->handle, r->wsid, &r->iova);
+	if (result != FPGA_OK) {
+		fpgaReleaseBuffer(_pool->handle, r->wsid);
+		return result;
+	}
+
+	r->base = (uint8_t *)addr;
+	r->len = len;
+	r->slab_off = pool_slab_off(r->iova);
+	r->n_slabs = (len - r->slab_off) / FPGA_POOL_SLAB_SIZE;
+	return FPGA_OK;
+}
+
+/* Pin one more region. Pool lock must be held. */
+static fpga_result pool_add_region(struct _fpga_buffer_pool *_pool)
+{
+	struct _fpga_pool_region *r;
+	uint64_t n_slabs = _pool->region_size / FPGA_POOL_SLAB_SIZE;
+	fpga_result result;
+
+	if (_pool->n_regions == FPGA_POOL_MAX_REGIONS) {
+		FPGA_MSG("Buffer pool region limit reached");
+		return FPGA_NO_MEMORY;
+	}
+
+	r = &_pool->regions[_pool->n_regions];
+
+	r->slab_class = calloc(n_slabs, sizeof(uint8_t));
+	if (!r->slab_class) {
+		FPGA_MSG("Failed to allocate memory");
+		return FPGA_NO_MEMORY;
+	}
+
+	result = pool_prepare_region(_pool, r, _pool->region_size);
+	if (result != FPGA_OK)
+		goto out_free;
+
+	/*
+	 * Chunks are aligned by their IO address. Small pages need not be
+	 * slab aligned in IO space, so pin one more slab to keep all of
+	 * region_size usable.
+	 */
+	if (r->n_slabs < n_slabs) {
+		fpgaReleaseBuffer(_pool->handle, r->wsid);
+		result = pool_prepare_region(_pool, r, _pool->region_size +
+					     FPGA_POOL_SLAB_SIZE);
+		if (result != FPGA_OK)
+			goto out_free;
+	}
+
+	r->n_slabs = n_slabs;
+	r->n_slabs_used = 0;
+
+	__atomic_store_n(&_pool->n_regions, _pool->n_regions + 1,
+			 __ATOMIC_RELEASE);
+	return FPGA_OK;
+
+out_free:
+	free(r->slab_class);
+	r->slab_class = NULL;
+	return result;
+}
+
+/*
+ * Assign a fresh slab to size class c and put its chunks on the shared
+ * free list. Pool lock must be held.
+ */
+static fpga_result pool_carve_slab(struct _fpga_buffer_pool *_pool, uint32_t c)
+{
+	struct _fpga_pool_region *r = NULL;
+	uint64_t size = pool_class_size(c);
+	uint64_t slab;
+	uint8_t *base;
+	uint64_t off;
+	uint32_t i;
+	fpga_result result;
+
+	for (i = 0; i < _pool->n_regions; ++i) {
+		if (_pool->regions[i].n_slabs_used <
+		    _pool->regions[i].n_slabs) {
+			r = &_pool->regions[i];
+			break;
+		}
+	}
+
+	if (!r) {
+		result = pool_add_region(_pool);
+		if (result != FPGA_OK)
+			return result;
+		r = &_pool->regions[_pool->n_regions - 1];
+	}
+
+	slab = r->n_slabs_used;
+	r->slab_class[slab] = (uint8_t)c;
+	__atomic_store_n(&r->n_slabs_used, slab + 1, __ATOMIC_RELEASE);
+
+	/* Push back to front, so the list starts at the lowest address */
+	base = r->base + r->slab_off + slab * FPGA_POOL_SLAB_SIZE;
+	for (off = FPGA_POOL_SLAB_SIZE; off > 0; off -= size) {
+		struct _fpga_pool_chunk *chunk =
+			(struct _fpga_pool_chunk *)(base + off - size);
+
+		chunk->next = _pool->free_list[c];
+		_pool->free_list[c] = chunk;
+	}
+
+	return FPGA_OK;
+}
+
+/* Move all chunks of tc back to the shared lists. Pool lock must be held. */
+static void pool_tcache_flush(struct _fpga_buffer_pool *_pool,
+			      struct _fpga_pool_tcache *tc)
+{
+	uint32_t c;
+
+	for (c = 0; c < FPGA_POOL_NUM_CLASSES; ++c) {
+		while (tc->head[c]) {
+			struct _fpga_pool_chunk *chunk = tc->head[c];
+
+			tc->head[c] = chunk->next;
+			chunk->next = _pool->free_list[c];
+			_pool->free_list[c] = chunk;
+		}
+		tc->count[c] = 0;
+	}
+}
+
+/* pthread key destructor: runs when a thread that used the pool exits */
+static void pool_tcache_release(void *arg)
+{
+	struct _fpga_pool_tcache *tc = (struct _fpga_pool_tcache *)arg;
+	struct _fpga_buffer_pool *_pool = tc->pool;
+	int err;
+
+	if (pthread_mutex_lock(&_pool->lock)) {
+		FPGA_MSG("Failed to lock mutex");
+		return;
+	}
+
+	pool_tcache_flush(_pool, tc);
+
+	if (tc->prev)
+		tc->prev->next = tc->next;
+	else
+		_pool->tcaches = tc->next;
+	if (tc->next)
+		tc->next->prev = tc->prev;
+
+	err = pthread_mutex_unlock(&_pool->lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+	}
+
+	free(tc);
+}
+
+static struct _fpga_pool_tcache *pool_get_tcache(struct _fpga_buffer_pool *_pool)
+{
+	struct _fpga_pool_tcache *tc;
+	int err;
+
+	tc = (struct _fpga_pool_tcache *)pthread_getspecific(_pool->tcache_key);
+	if (tc)
+		return tc;
+
+	tc = calloc(1, sizeof(struct _fpga_pool_tcache));
+	if (!tc) {
+		FPGA_MSG("Failed to allocate memory");
+		return NULL;
+	}
+	tc->pool = _pool;
+
+	if (pthread_mutex_lock(&_pool->lock)) {
+		FPGA_MSG("Failed to lock mutex");
+		free(tc);
+		return NULL;
+	}
+
+	tc->next = _pool->tcaches;
+	if (tc->next)
+		tc->next->prev = tc;
+	_pool->tcaches = tc;
+
+	err = pthread_mutex_unlock(&_pool->lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+	}
+
+	if (pthread_setspecific(_pool->tcache_key, tc)) {
+		FPGA_MSG("Failed to set thread cache");
+		pool_tcache_release(tc);
+		return NULL;
+	}
+
+	return tc;
+}
+
+/* Refill tc's list for class c from the shared list, carving if needed */
+static fpga_result pool_tcache_refill(struct _fpga_buffer_pool *_pool,
+				      struct _fpga_pool_tcache *tc,
+				      uint32_t c)
+{
+	fpga_result result = FPGA_OK;
+	uint32_t batch = pool_batch(c);
+	int err;
+
+	if (pthread_mutex_lock(&_pool->lock)) {
+		FPGA_MSG("Failed to lock mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	if (!_pool->free_list[c]) {
+		result = pool_carve_slab(_pool, c);
+		if (result != FPGA_OK)
+			goto out_unlock;
+	}
+
+	while (batch-- && _pool->free_list[c]) {
+		struct _fpga_pool_chunk *chunk = _pool->free_list[c];
+
+		_pool->free_list[c] = chunk->next;
+		chunk->next = tc->head[c];
+		tc->head[c] = chunk;
+		++tc->count[c];
+	}
+
+out_unlock:
+	err = pthread_mutex_unlock(&_pool->lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+	}
+	return result;
+}
+
+/* Return one batch of tc's list for class c to the shared list */
+static void pool_tcache_trim(struct _fpga_buffer_pool *_pool,
+			     struct _fpga_pool_tcache *tc,
+			     uint32_t c)
+{
+	uint32_t batch = pool_batch(c);
+	int err;
+
+	if (pthread_mutex_lock(&_pool->lock)) {
+		FPGA_MSG("Failed to lock mutex");
+		return;
+	}
+
+	while (batch--) {
+		struct _fpga_pool_chunk *chunk = tc->head[c];
+
+		tc->head[c] = chunk->next;
+		--tc->count[c];
+		chunk->next = _pool->free_list[c];
+		_pool->free_list[c] = chunk;
+	}
+
+	err = pthread_mutex_unlock(&_pool->lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+	}
+}
+
+fpga_result __FPGA_API__ fpgaCreateBufferPool(fpga_handle handle,
+					      uint64_t region_size,
+					      uint32_t num_regions,
+					      int flags,
+					      fpga_buffer_pool *pool)
+{
+	struct _fpga_buffer_pool *_pool;
+	pthread_mutexattr_t mattr;
+	fpga_result result = FPGA_OK;
+	uint32_t i;
+
+	ASSERT_NOT_NULL(handle);
+	ASSERT_NOT_NULL(pool);
+
+	if (flags & ~(FPGA_BUF_PAGE_2M | FPGA_BUF_PAGE_1G |
+		      FPGA_BUF_FALLBACK | FPGA_BUF_NUMA_LOCAL)) {
+		FPGA_MSG("Unrecognized flags");
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (!region_size)
+		region_size = FPGA_POOL_DEFAULT_REGION;
+
+	if (region_size % FPGA_POOL_SLAB_SIZE) {
+		FPGA_MSG("Region size is not a multiple of %lu",
+			 FPGA_POOL_SLAB_SIZE);
+		return FPGA_INVALID_PARAM;
+	}
+
+	if (num_regions > FPGA_POOL_MAX_REGIONS) {
+		FPGA_MSG("Too many regions");
+		return FPGA_INVALID_PARAM;
+	}
+
+	_pool = calloc(1, sizeof(struct _fpga_buffer_pool));
+	if (!_pool) {
+		FPGA_MSG("Failed to allocate memory for pool");
+		return FPGA_NO_MEMORY;
+	}
+
+	if (pthread_mutexattr_init(&mattr)) {
+		FPGA_MSG("Failed to init pool mutex attributes");
+		result = FPGA_EXCEPTION;
+		goto out_free;
+	}
+
+	if (pthread_mutex_init(&_pool->lock, &mattr)) {
+		FPGA_MSG("Failed to init pool mutex");
+		pthread_mutexattr_destroy(&mattr);
+		result = FPGA_EXCEPTION;
+		goto out_free;
+	}
+
+	pthread_mutexattr_destroy(&mattr);
+
+	if (pthread_key_create(&_pool->tcache_key, pool_tcache_release)) {
+		FPGA_MSG("Failed to create thread cache key");
+		result = FPGA_EXCEPTION;
+		goto out_destroy_mutex;
+	}
+
+	_pool->handle = handle;
+	_pool->region_size = region_size;
+	_pool->flags = flags;
+
+	for (i = 0; i < num_regions; ++i) {
+		result = pool_add_region(_pool);
+		if (result != FPGA_OK)
+			goto out_release;
+	}
+
+	_pool->magic = FPGA_BUFFER_POOL_MAGIC;
+	*pool = (fpga_buffer_pool)_pool;
+	return FPGA_OK;
+
+out_release:
+	for (i = 0; i < _pool->n_regions; ++i) {
+		fpgaReleaseBuffer(handle, _pool->regions[i].wsid);
+		free(_pool->regions[i].slab_class);
+	}
+	pthread_key_delete(_pool->tcache_key);
+out_destroy_mutex:
+	pthread_mutex_destroy(&_pool->lock);
+out_free:
+	free(_pool);
+	return result;
+}
+
+fpga_result __FPGA_API__ fpgaDestroyBufferPool(fpga_buffer_pool *pool)
+{
+	struct _fpga_buffer_pool *_pool;
+	fpga_result result = FPGA_OK;
+	uint32_t i;
+
+	ASSERT_NOT_NULL(pool);
+
+	_pool = (struct _fpga_buffer_pool *)*pool;
+
+	result = pool_check(_pool);
+	if (result)
+		return result;
+
+	_pool->magic = FPGA_INVALID_MAGIC;
+
+	/* Deleting the key keeps exiting threads from touching the pool */
+	pthread_key_delete(_pool->tcache_key);
+
+	while (_pool->tcaches) {
+		struct _fpga_pool_tcache *tc = _pool->tcaches;
+
+		_pool->tcaches = tc->next;
+		free(tc);
+	}
+
+	for (i = 0; i < _pool->n_regions; ++i) {
+		if (fpgaReleaseBuffer(_pool->handle,
+				      _pool->regions[i].wsid) != FPGA_OK) {
+			FPGA_MSG("Failed to release pool region");
+			result = FPGA_EXCEPTION;
+		}
+		free(_pool->regions[i].slab_class);
+	}
+
+	if (pthread_mutex_destroy(&_pool->lock))
+		FPGA_MSG("Failed to destroy pool mutex");
+
+	free(_pool);
+	*pool = NULL;
+	return result;
+}
+
+fpga_result __FPGA_API__ fpgaPoolAlloc(fpga_buffer_pool pool, uint64_t len,
+				       void **buf_addr, uint64_t *ioaddr)
+{
+	struct _fpga_buffer_pool *_pool = (struct _fpga_buffer_pool *)pool;
+	struct _fpga_pool_tcache *tc;
+	struct _fpga_pool_chunk *chunk;
+	fpga_result result;
+	uint32_t c;
+
+	result = pool_check(_pool);
+	if (result)
+		return result;
+
+	ASSERT_NOT_NULL(buf_addr);
+
+	if (!len || len > FPGA_POOL_SLAB_SIZE) {
+		FPGA_MSG("Invalid pool allocation length %lu", len);
+		return FPGA_INVALID_PARAM;
+	}
+
+	tc = pool_get_tcache(_pool);
+	if (!tc)
+		return FPGA_NO_MEMORY;
+
+	c = pool_class_of(len);
+	if (!tc->head[c]) {
+		result = pool_tcache_refill(_pool, tc, c);
+		if (result != FPGA_OK)
+			return result;
+	}
+
+	chunk = tc->head[c];
+	tc->head[c] = chunk->next;
+	--tc->count[c];
+
+	if (ioaddr) {
+		struct _fpga_pool_region *r =
+			pool_find_region(_pool, (uint8_t *)chunk);
+
+		*ioaddr = r->iova + ((uint8_t *)chunk - r->base);
+	}
+
+	*buf_addr = chunk;
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaPoolFree(fpga_buffer_pool pool, void *buf_addr)
+{
+	struct _fpga_buffer_pool *_pool = (struct _fpga_buffer_pool *)pool;
+	struct _fpga_pool_region *r;
+	struct _fpga_pool_tcache *tc;
+	struct _fpga_pool_chunk *chunk;
+	fpga_result result;
+	uint64_t off;
+	uint64_t slab;
+	uint32_t c;
+
+	result = pool_check(_pool);
+	if (result)
+		return result;
+
+	r = pool_find_region(_pool, (uint8_t *)buf_addr);
+	if (!r) {
+		FPGA_MSG("Buffer not allocated from this pool");
+		return FPGA_INVALID_PARAM;
+	}
+
+	off = (uint8_t *)buf_addr - r->base;
+	if (off < r->slab_off) {
+		FPGA_MSG("Buffer not allocated from this pool");
+		return FPGA_INVALID_PARAM;
+	}
+
+	off -= r->slab_off;
+	slab = off / FPGA_POOL_SLAB_SIZE;
+	if (slab >= __atomic_load_n(&r->n_slabs_used, __ATOMIC_ACQUIRE)) {
+		FPGA_MSG("Buffer not allocated from this pool");
+		return FPGA_INVALID_PARAM;
+	}
+
+	c = r->slab_class[slab];
+	if (off & (pool_class_size(c) - 1)) {
+		FPGA_MSG("Buffer address is not the start of a pool buffer");
+		return FPGA_INVALID_PARAM;
+	}
+
+	tc = pool_get_tcache(_pool);
+	if (!tc)
+		return FPGA_NO_MEMORY;
+
+	chunk = (struct _fpga_pool_chunk *)buf_addr;
+	chunk->next = tc->head[c];
+	tc->head[c] = chunk;
+
+	if (++tc->count[c] > 2 * pool_batch(c))
+		pool_tcache_trim(_pool, tc, c);
+
+	return FPGA_OK;
+}
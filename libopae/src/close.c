@@ -31,6 +31,7 @@
 #include <opae/access.h>
 #include "common_int.h"
 #include "wsid_list_int.h"
+#include "event_int.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -49,6 +50,7 @@ fpga_result __FPGA_API__ fpgaClose(fpga_handle handle)
 	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
 	fpga_result result = FPGA_OK;
 	int err = 0;
+	uint32_t i;
 
 	result = handle_check_and_lock(_handle);
 	if (result)
@@ -63,12 +65,18 @@ fpga_result __FPGA_API__ fpgaClose(fpga_handle handle)
 		return FPGA_INVALID_PARAM;
 	}
 
+	// withdraw lock-free MMIO mappings before they are unmapped
+	for (i = 0; i < FPGA_MMIO_FAST_REGIONS; ++i)
+		__atomic_store_n(&_handle->mmio_fast[i].base, NULL,
+				 __ATOMIC_RELEASE);
+
 	wsid_tracker_cleanup(_handle->wsid_root, NULL);
 	wsid_tracker_cleanup(_handle->mmio_root, unmap_mmio_region);
+	free_packed_pages(_handle);
 	free_umsg_buffer(handle);
 	close(_handle->fddev);
-	if (_handle->fdfpgad >= 0)
-		close(_handle->fdfpgad);
+	if (_handle->fpgad_events)
+		event_daemon_release((uint64_t)(uintptr_t)_handle);
 
 	// invalidate magic (just in case)
 	_handle->magic = FPGA_INVALID_MAGIC;
@@ -75,6 +75,9 @@ fpga_result prop_check_and_lock(struct _fpga_properties *prop);
 fpga_result handle_check_and_lock(struct _fpga_handle *handle);
 fpga_result event_handle_check_and_lock(struct _fpga_event_handle *eh);
 
+/* Free the handle's bookkeeping of huge pages shared by packed buffers */
+void free_packed_pages(struct _fpga_handle *handle);
+
 #define UNUSED_PARAM(x) ((void)x)
 
 #endif // ___FPGA_COMMON_INT_H__
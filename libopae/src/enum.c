@@ -36,46 +36,29 @@
 #include "opae/utils.h"
 #include "error_int.h"
 #include "properties_int.h"
+#include "enum_int.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 /* mutex to protect global data structures */
 extern pthread_mutex_t global_lock;
 
-struct dev_list {
-	char sysfspath[SYSFS_PATH_MAX];
-	char devpath[DEV_PATH_MAX];
-	fpga_objtype objtype;
-	fpga_guid guid;
-	uint16_t segment;
-	uint8_t bus;
-	uint8_t device;
-	uint8_t function;
-	uint8_t socket_id;
-	uint16_t vendor_id;
-	uint16_t device_id;
-
-	uint32_t fpga_num_slots;
-	uint64_t fpga_bitstream_id;
-	fpga_version fpga_bbs_version;
-
-	fpga_accelerator_state accelerator_state;
-	uint32_t accelerator_num_mmios;
-	uint32_t accelerator_num_irqs;
-	struct dev_list *next;
-	struct dev_list *parent;
-	struct dev_list *fme;
-};
-
-static bool matches_filter(const struct dev_list *attr,
-			   const fpga_properties filter)
+/*
+ * Capture the selection criteria of filter in e. Returns false if the
+ * filter can never match anything.
+ */
+static bool filter_entry_init(struct filter_entry *e,
+			      const fpga_properties filter)
 {
 	struct _fpga_properties *_filter = (struct _fpga_properties *)filter;
 	bool res = true;
@@ -86,29 +69,68 @@ static bool matches_filter(const struct dev_list *attr,
 		return false;
 	}
 
+	e->valid_fields = _filter->valid_fields;
+
 	if (FIELD_VALID(_filter, FPGA_PROPERTY_PARENT)) {
 		struct _fpga_token *_parent_tok =
 			(struct _fpga_token *)_filter->parent;
-		char spath[SYSFS_PATH_MAX];
-		char *p;
-		int device_instance;
-
-		if (FPGA_ACCELERATOR != attr->objtype) {
-			res = false; // Only accelerator can have a parent
-			goto out_unlock;
-		}
 
 		if (NULL == _parent_tok) {
 			res = false; // Reject search based on NULL parent token
 			goto out_unlock;
 		}
 
+		strncpy_s(e->parent_path, sizeof(e->parent_path),
+			  _parent_tok->sysfspath, SYSFS_PATH_MAX - 1);
+	}
+
+	e->objtype = _filter->objtype;
+	e->segment = _filter->segment;
+	e->bus = _filter->bus;
+	e->device = _filter->device;
+	e->function = _filter->function;
+	e->socket_id = _filter->socket_id;
+	memcpy_s(e->guid, sizeof(fpga_guid), _filter->guid, sizeof(fpga_guid));
+	e->object_id = _filter->object_id;
+	e->vendor_id = _filter->vendor_id;
+	e->device_id = _filter->device_id;
+	e->num_errors = _filter->num_errors;
+
+	if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJTYPE)
+	    && (FPGA_DEVICE == _filter->objtype)) {
+		e->num_slots = _filter->u.fpga.num_slots;
+		e->bbs_id = _filter->u.fpga.bbs_id;
+		e->bbs_version = _filter->u.fpga.bbs_version;
+	} else if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJTYPE)
+		   && (FPGA_ACCELERATOR == _filter->objtype)) {
+		e->state = _filter->u.accelerator.state;
+		e->num_mmio = _filter->u.accelerator.num_mmio;
+		e->num_interrupts = _filter->u.accelerator.num_interrupts;
+	}
+
+out_unlock:
+	err = pthread_mutex_unlock(&_filter->lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	}
+	return res;
+}
+
+static bool filter_entry_match(const struct filter_entry *e,
+			       const struct dev_list *attr)
+{
+	if (FIELD_VALID(e, FPGA_PROPERTY_PARENT)) {
+		char spath[SYSFS_PATH_MAX];
+		char *p;
+		int device_instance;
+
+		if (FPGA_ACCELERATOR != attr->objtype)
+			return false; // Only accelerator can have a parent
+
 		p = strrchr(attr->sysfspath, '.');
 
-		if (NULL == p) {
-			res = false;
-			goto out_unlock;
-		}
+		if (NULL == p)
+			return false;
 
 		device_instance = (int)strtoul(p + 1, NULL, 10);
 
@@ -116,186 +138,248 @@ static bool matches_filter(const struct dev_list *attr,
 			      SYSFS_FPGA_CLASS_PATH SYSFS_FME_PATH_FMT,
 			      device_instance, device_instance);
 
-		if (strcmp(spath, _parent_tok->sysfspath)) {
-			res = false;
-			goto out_unlock;
-		}
-	}
-
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJTYPE)) {
-		if (_filter->objtype != attr->objtype) {
-			res = false;
-			goto out_unlock;
-		}
-	}
-
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_SEGMENT)) {
-		if (_filter->segment != attr->segment) {
-			res = false;
-			goto out_unlock;
-		}
+		if (strcmp(spath, e->parent_path))
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_BUS)) {
-		if (_filter->bus != attr->bus) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_OBJTYPE)) {
+		if (e->objtype != attr->objtype)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_DEVICE)) {
-		if (_filter->device != attr->device) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_SEGMENT)) {
+		if (e->segment != attr->segment)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_FUNCTION)) {
-		if (_filter->function != attr->function) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_BUS)) {
+		if (e->bus != attr->bus)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_SOCKETID)) {
-		if (_filter->socket_id != attr->socket_id) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_DEVICE)) {
+		if (e->device != attr->device)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_GUID)) {
-		if (0 != memcmp(attr->guid, _filter->guid, sizeof(fpga_guid))) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_FUNCTION)) {
+		if (e->function != attr->function)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJECTID)) {
-		uint64_t objid;
-		fpga_result result;
-		result = sysfs_objectid_from_path(attr->sysfspath, &objid);
-		if (result != FPGA_OK || _filter->object_id != objid) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_SOCKETID)) {
+		if (e->socket_id != attr->socket_id)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_VENDORID)) {
-		if (_filter->vendor_id != attr->vendor_id) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_GUID)) {
+		if (0 != memcmp(attr->guid, e->guid, sizeof(fpga_guid)))
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_DEVICEID)) {
-		if (_filter->device_id != attr->device_id) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_VENDORID)) {
+		if (e->vendor_id != attr->vendor_id)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_NUM_ERRORS)) {
-		uint32_t errors;
-		char errpath[SYSFS_PATH_MAX];
-
-		snprintf_s_s(errpath, SYSFS_PATH_MAX, "%s/errors", attr->sysfspath);
-		errors = count_error_files(errpath);
-		if (errors != _filter->num_errors) {
-			res = false;
-			goto out_unlock;
-		}
+	if (FIELD_VALID(e, FPGA_PROPERTY_DEVICEID)) {
+		if (e->device_id != attr->device_id)
+			return false;
 	}
 
-	if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJTYPE)
-	    && (FPGA_DEVICE == _filter->objtype)) {
+	if (FIELD_VALID(e, FPGA_PROPERTY_OBJTYPE)
+	    && (FPGA_DEVICE == e->objtype)) {
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_NUM_SLOTS)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_NUM_SLOTS)) {
 			if ((FPGA_DEVICE != attr->objtype)
-			    || (attr->fpga_num_slots
-				!= _filter->u.fpga.num_slots)) {
-				res = false;
-				goto out_unlock;
-			}
+			    || (attr->fpga_num_slots != e->num_slots))
+				return false;
 		}
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_BBSID)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_BBSID)) {
 			if ((FPGA_DEVICE != attr->objtype)
-			    || (attr->fpga_bitstream_id
-				!= _filter->u.fpga.bbs_id)) {
-				res = false;
-				goto out_unlock;
-			}
+			    || (attr->fpga_bitstream_id != e->bbs_id))
+				return false;
 		}
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_BBSVERSION)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_BBSVERSION)) {
 			if ((FPGA_DEVICE != attr->objtype)
 			    || (attr->fpga_bbs_version.major
-				!= _filter->u.fpga.bbs_version.major)
+				!= e->bbs_version.major)
 			    || (attr->fpga_bbs_version.minor
-				!= _filter->u.fpga.bbs_version.minor)
+				!= e->bbs_version.minor)
 			    || (attr->fpga_bbs_version.patch
-				!= _filter->u.fpga.bbs_version.patch)) {
-				res = false;
-				goto out_unlock;
-			}
+				!= e->bbs_version.patch))
+				return false;
 		}
 
-	} else if (FIELD_VALID(_filter, FPGA_PROPERTY_OBJTYPE)
-		   && (FPGA_ACCELERATOR == _filter->objtype)) {
+	} else if (FIELD_VALID(e, FPGA_PROPERTY_OBJTYPE)
+		   && (FPGA_ACCELERATOR == e->objtype)) {
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_ACCELERATOR_STATE)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_ACCELERATOR_STATE)) {
 			if ((FPGA_ACCELERATOR != attr->objtype)
-			    || (attr->accelerator_state
-				!= _filter->u.accelerator.state)) {
-				res = false;
-				goto out_unlock;
-			}
+			    || (attr->accelerator_state != e->state))
+				return false;
 		}
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_NUM_MMIO)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_NUM_MMIO)) {
 			if ((FPGA_ACCELERATOR != attr->objtype)
-			    || (attr->accelerator_num_mmios
-				!= _filter->u.accelerator.num_mmio)) {
-				res = false;
-				goto out_unlock;
-			}
+			    || (attr->accelerator_num_mmios != e->num_mmio))
+				return false;
 		}
 
-		if (FIELD_VALID(_filter, FPGA_PROPERTY_NUM_INTERRUPTS)) {
+		if (FIELD_VALID(e, FPGA_PROPERTY_NUM_INTERRUPTS)) {
 			if ((FPGA_ACCELERATOR != attr->objtype)
 			    || (attr->accelerator_num_irqs
-				!= _filter->u.accelerator.num_interrupts)) {
-				res = false;
-				goto out_unlock;
-			}
+				!= e->num_interrupts))
+				return false;
 		}
 	}
 
-out_unlock:
-	err = pthread_mutex_unlock(&_filter->lock);
-	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	// The criteria below go back to sysfs, so they are checked last.
+	if (FIELD_VALID(e, FPGA_PROPERTY_OBJECTID)) {
+		uint64_t objid;
+		fpga_result result;
+		result = sysfs_objectid_from_path(attr->sysfspath, &objid);
+		if (result != FPGA_OK || e->object_id != objid)
+			return false;
 	}
-	return res;
+
+	if (FIELD_VALID(e, FPGA_PROPERTY_NUM_ERRORS)) {
+		uint32_t errors;
+		char errpath[SYSFS_PATH_MAX];
+
+		snprintf_s_s(errpath, SYSFS_PATH_MAX, "%s/errors",
+			     attr->sysfspath);
+		errors = count_error_files(errpath);
+		if (errors != e->num_errors)
+			return false;
+	}
+
+	return true;
+}
+
+static inline uint32_t guid_hash(const fpga_guid guid)
+{
+	uint64_t lo, hi, h;
+
+	memcpy(&lo, guid, sizeof(lo));
+	memcpy(&hi, guid + sizeof(lo), sizeof(hi));
+
+	h = lo ^ (hi * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 29;
+	return (uint32_t)h;
 }
 
-static bool matches_filters(const struct dev_list *attr,
-			    const fpga_properties *filter, uint32_t num_filter)
+fpga_result filter_set_compile(const fpga_properties *filters,
+			       uint32_t num_filters, struct filter_set *set)
 {
 	uint32_t i;
+	uint32_t num_guids = 0;
+	uint32_t num_buckets = 1;
+
+	memset_s(set, sizeof(*set), 0);
+
+	if (!num_filters) { // no filter == match everything
+		set->match_all = true;
+		return FPGA_OK;
+	}
+
+	set->entries = calloc(num_filters, sizeof(struct filter_entry));
+	if (NULL == set->entries) {
+		FPGA_MSG("Failed to allocate memory for filters");
+		return FPGA_NO_MEMORY;
+	}
+
+	for (i = 0; i < num_filters; ++i) {
+		struct filter_entry *e = &set->entries[set->num_entries];
+
+		if (!filter_entry_init(e, filters[i]))
+			continue;
+
+		if (FIELD_VALID(e, FPGA_PROPERTY_GUID))
+			++num_guids;
+		if (FIELD_VALID(e, FPGA_PROPERTY_ACCELERATOR_STATE))
+			set->uses_state = true;
+		++set->num_entries;
+	}
 
-	if (!num_filter) // no filter == match everything
+	if (num_guids) {
+		while (num_buckets < 2 * num_guids)
+			num_buckets <<= 1;
+
+		set->buckets = calloc(num_buckets, sizeof(struct filter_entry *));
+		if (NULL == set->buckets) {
+			FPGA_MSG("Failed to allocate memory for filters");
+			filter_set_free(set);
+			return FPGA_NO_MEMORY;
+		}
+		set->bucket_mask = num_buckets - 1;
+	}
+
+	for (i = 0; i < set->num_entries; ++i) {
+		struct filter_entry *e = &set->entries[i];
+		struct filter_entry **chain;
+
+		if (FIELD_VALID(e, FPGA_PROPERTY_GUID))
+			chain = &set->buckets[guid_hash(e->guid)
+					      & set->bucket_mask];
+		else if (FIELD_VALID(e, FPGA_PROPERTY_OBJTYPE)
+			 && e->objtype < FILTER_ANY_OBJTYPE)
+			chain = &set->unindexed[e->objtype];
+		else if (FIELD_VALID(e, FPGA_PROPERTY_PARENT))
+			chain = &set->unindexed[FPGA_ACCELERATOR];
+		else
+			chain = &set->unindexed[FILTER_ANY_OBJTYPE];
+
+		e->next = *chain;
+		*chain = e;
+	}
+
+	return FPGA_OK;
+}
+
+/* true if attr matches any of the filters in set */
+bool filter_set_match(const struct filter_set *set,
+		      const struct dev_list *attr)
+{
+	const struct filter_entry *e;
+
+	if (set->match_all)
 		return true;
 
-	for (i = 0; i < num_filter; ++i) {
-		if (matches_filter(attr, filter[i])) {
-			return true;
+	if (set->buckets) {
+		for (e = set->buckets[guid_hash(attr->guid) & set->bucket_mask];
+		     NULL != e; e = e->next) {
+			if (filter_entry_match(e, attr))
+				return true;
+		}
+	}
+
+	if (attr->objtype < FILTER_ANY_OBJTYPE) {
+		for (e = set->unindexed[attr->objtype]; NULL != e; e = e->next) {
+			if (filter_entry_match(e, attr))
+				return true;
 		}
 	}
+
+	for (e = set->unindexed[FILTER_ANY_OBJTYPE]; NULL != e; e = e->next) {
+		if (filter_entry_match(e, attr))
+			return true;
+	}
+
 	return false;
 }
 
+void filter_set_free(struct filter_set *set)
+{
+	free(set->buckets);
+	free(set->entries);
+	memset_s(set, sizeof(*set), 0);
+}
+
 static struct dev_list *add_dev(const char *sysfspath, const char *devpath,
 				struct dev_list *parent)
 {
@@ -404,6 +488,18 @@ static fpga_result enum_fme(const char *sysfspath, const char *name,
 	return FPGA_OK;
 }
 
+/* An AFU is unassigned if we are able to open its device node */
+static fpga_accelerator_state accelerator_state(const char *devpath)
+{
+	int res = open(devpath, O_RDWR);
+
+	if (-1 == res)
+		return FPGA_ACCELERATOR_ASSIGNED;
+
+	close(res);
+	return FPGA_ACCELERATOR_UNASSIGNED;
+}
+
 static fpga_result enum_afu(const char *sysfspath, const char *name,
 			    struct dev_list *parent)
 {
@@ -421,7 +517,6 @@ static fpga_result enum_afu(const char *sysfspath, const char *name,
 
 	if (!S_ISDIR(stats.st_mode))
 		return FPGA_OK;
-	int res;
 
 	snprintf_s_s(dpath, sizeof(dpath), FPGA_DEV_PATH "/%s", name);
 
@@ -440,13 +535,7 @@ static fpga_result enum_afu(const char *sysfspath, const char *name,
 	pdev->vendor_id = parent->vendor_id;
 	pdev->device_id = parent->device_id;
 
-	res = open(pdev->devpath, O_RDWR);
-	if (-1 == res) {
-		pdev->accelerator_state = FPGA_ACCELERATOR_ASSIGNED;
-	} else {
-		close(res);
-		pdev->accelerator_state = FPGA_ACCELERATOR_UNASSIGNED;
-	}
+	pdev->accelerator_state = accelerator_state(pdev->devpath);
 
 	// FIXME: not to rely on hard-coded constants.
 	pdev->accelerator_num_mmios = 2;
@@ -626,6 +715,380 @@ bool include_afu(const fpga_properties *filters, uint32_t num_filters)
 	return false;
 }
 
+/* Scan SYSFS_FPGA_CLASS_PATH into a list of devices hanging off head */
+static fpga_result enum_scan(struct dev_list *head, bool include_port)
+{
+	fpga_result result = FPGA_NOT_FOUND;
+	DIR *dir = NULL;
+	struct dirent *dirent = NULL;
+	char sysfspath[SYSFS_PATH_MAX];
+
+	// A device may have been replaced (FIM update, driver reload) since
+	// its attributes were last read.
+	sysfs_cache_revalidate();
+
+	// Find the top-level FPGA devices.
+	dir = opendir(SYSFS_FPGA_CLASS_PATH);
+	if (NULL == dir) {
+		FPGA_MSG("can't find %s (no driver?)", SYSFS_FPGA_CLASS_PATH);
+		return FPGA_NO_DRIVER;
+	}
+
+	while ((dirent = readdir(dir)) != NULL) {
+		if (!strcmp(dirent->d_name, "."))
+			continue;
+		if (!strcmp(dirent->d_name, ".."))
+			continue;
+
+		snprintf_s_ss(sysfspath, sizeof(sysfspath), "%s/%s",
+			      SYSFS_FPGA_CLASS_PATH, dirent->d_name);
+
+		result = enum_top_dev(sysfspath, head, include_port);
+		if (result != FPGA_OK)
+			break;
+	}
+
+	closedir(dir);
+
+	return result;
+}
+
+static void enum_free_list(struct dev_list *head)
+{
+	struct dev_list *lptr;
+
+	for (lptr = head->next; NULL != lptr;) {
+		struct dev_list *trash = lptr;
+		lptr = lptr->next;
+		free(trash);
+	}
+	head->next = NULL;
+}
+
+/* Report tok as a match if dev matches any of the filters */
+static void enum_match(const struct dev_list *dev, struct _fpga_token *tok,
+		       const struct filter_set *set, fpga_token *tokens,
+		       uint32_t max_tokens, uint32_t *num_matches)
+{
+	// FIXME: should check contents of filter for token magic
+	if (filter_set_match(set, dev)) {
+		if (*num_matches < max_tokens) {
+			if (fpgaCloneToken(tok, &tokens[*num_matches])
+			    != FPGA_OK) {
+				// FIXME: should we error out here?
+				FPGA_MSG("Error cloning token");
+			}
+		}
+		++(*num_matches);
+	}
+}
+
+/*
+ * Process-wide enumeration cache
+ *
+ * When enabled, the device tree is scanned once into a flat array of
+ * dev_list entries (parent/fme pointing into the same array) together with
+ * their tokens, and fpgaEnumerate() answers from memory. The cache is
+ * dropped when a kernel uevent for an FPGA or PCI device arrives, when the
+ * optional TTL expires, on fpgaReconfigureSlot() and on explicit
+ * invalidation. Accelerator state (whether another process has the AFU
+ * open) is volatile, so it is probed again whenever a filter asks for it.
+ */
+static struct {
+	pthread_mutex_t lock;
+	bool enabled;
+	bool valid;
+	uint32_t ttl_ms;
+	struct timespec stamp;
+	int uevent_fd;
+	uint32_t num_devs;
+	struct dev_list *devs;
+	struct _fpga_token **toks;
+} enum_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.uevent_fd = -1,
+};
+
+static void enum_cache_drop(void)
+{
+	free(enum_cache.devs);
+	free(enum_cache.toks);
+	enum_cache.devs = NULL;
+	enum_cache.toks = NULL;
+	enum_cache.num_devs = 0;
+	enum_cache.valid = false;
+
+	// whatever invalidates the device tree also invalidates attributes
+	sysfs_cache_flush();
+}
+
+static int enum_cache_uevent_open(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		FPGA_MSG("uevent socket failed: %s", strerror(errno));
+		return -1;
+	}
+
+	memset_s(&addr, sizeof(addr), 0);
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; // kernel uevents
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		FPGA_MSG("uevent bind failed: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Drain pending uevents. Returns true if any of them may change the
+ * device tree: a kernel message is "action@devpath\0KEY=value\0...".
+ */
+static bool enum_cache_uevent_pending(int fd)
+{
+	char buf[4096];
+	bool changed = false;
+	ssize_t n;
+
+	while ((n = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT)) != 0) {
+		char *p;
+
+		if (n < 0) {
+			// overrun: events were lost, assume the worst
+			if (errno == ENOBUFS)
+				changed = true;
+			break;
+		}
+
+		buf[n] = '\0';
+		for (p = buf; p < buf + n; p += strlen(p) + 1) {
+			if (strstr(p, "fpga") || !strcmp(p, "SUBSYSTEM=pci")) {
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	return changed;
+}
+
+static bool enum_cache_expired(void)
+{
+	struct timespec now;
+	uint64_t elapsed_ms;
+
+	if (!enum_cache.ttl_ms)
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ms = (now.tv_sec - enum_cache.stamp.tv_sec) * 1000 +
+		     (now.tv_nsec - enum_cache.stamp.tv_nsec) / 1000000;
+
+	return elapsed_ms >= enum_cache.ttl_ms;
+}
+
+/* Rescan sysfs into the cache. Cache lock must be held. */
+static fpga_result enum_cache_fill(void)
+{
+	fpga_result result;
+	struct dev_list head;
+	struct dev_list *lptr;
+	uint32_t n = 0;
+	uint32_t i;
+	uint32_t j;
+
+	memset_s(&head, sizeof(head), 0);
+
+	result = enum_scan(&head, true);
+	if (result != FPGA_OK) {
+		FPGA_MSG("No FPGA resources found");
+		goto out_free;
+	}
+
+	for (lptr = head.next; NULL != lptr; lptr = lptr->next)
+		++n;
+
+	enum_cache.devs = calloc(n ? n : 1, sizeof(struct dev_list));
+	enum_cache.toks = calloc(n ? n : 1, sizeof(struct _fpga_token *));
+	if (!enum_cache.devs || !enum_cache.toks) {
+		FPGA_MSG("Failed to allocate enumeration cache");
+		result = FPGA_NO_MEMORY;
+		goto out_drop;
+	}
+
+	for (i = 0, lptr = head.next; NULL != lptr; lptr = lptr->next, ++i)
+		enum_cache.devs[i] = *lptr;
+
+	// Re-point parent/fme links into the array
+	for (i = 0; i < n; ++i) {
+		struct dev_list *dev = &enum_cache.devs[i];
+		struct dev_list *parent = NULL;
+		struct dev_list *fme = NULL;
+
+		for (j = 0, lptr = head.next; NULL != lptr;
+		     lptr = lptr->next, ++j) {
+			if (lptr == dev->parent)
+				parent = &enum_cache.devs[j];
+			if (lptr == dev->fme)
+				fme = &enum_cache.devs[j];
+		}
+
+		dev->parent = parent;
+		dev->fme = fme;
+		dev->next = NULL;
+	}
+
+	for (i = 0; i < n; ++i) {
+		struct dev_list *dev = &enum_cache.devs[i];
+
+		if (!strnlen_s(dev->devpath, sizeof(dev->devpath)))
+			continue;
+
+		// propagate the socket_id field.
+		if (dev->parent) {
+			dev->socket_id = dev->parent->socket_id;
+			dev->fme = dev->parent->fme;
+		}
+
+		enum_cache.toks[i] = token_add(dev->sysfspath, dev->devpath);
+		if (NULL == enum_cache.toks[i]) {
+			FPGA_MSG("Failed to allocate memory for token");
+			result = FPGA_NO_MEMORY;
+			goto out_drop;
+		}
+	}
+
+	enum_cache.num_devs = n;
+	enum_cache.valid = true;
+	clock_gettime(CLOCK_MONOTONIC, &enum_cache.stamp);
+	goto out_free;
+
+out_drop:
+	enum_cache_drop();
+out_free:
+	enum_free_list(&head);
+	return result;
+}
+
+static fpga_result enum_cached(const struct filter_set *set,
+			       fpga_token *tokens, uint32_t max_tokens,
+			       uint32_t *num_matches)
+{
+	fpga_result result = FPGA_OK;
+	uint32_t i;
+	int err;
+
+	if (pthread_mutex_lock(&enum_cache.lock)) {
+		FPGA_MSG("Failed to lock enumeration cache mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	if (enum_cache.valid &&
+	    ((enum_cache.uevent_fd >= 0 &&
+	      enum_cache_uevent_pending(enum_cache.uevent_fd)) ||
+	     enum_cache_expired()))
+		enum_cache_drop();
+
+	if (!enum_cache.valid) {
+		result = enum_cache_fill();
+		if (result != FPGA_OK)
+			goto out_unlock;
+	}
+
+	for (i = 0; i < enum_cache.num_devs; ++i) {
+		struct dev_list *dev = &enum_cache.devs[i];
+
+		if (!enum_cache.toks[i])
+			continue;
+
+		if (set->uses_state && FPGA_ACCELERATOR == dev->objtype)
+			dev->accelerator_state =
+				accelerator_state(dev->devpath);
+
+		enum_match(dev, enum_cache.toks[i], set, tokens, max_tokens,
+			   num_matches);
+	}
+
+out_unlock:
+	err = pthread_mutex_unlock(&enum_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	}
+	return result;
+}
+
+fpga_result __FPGA_API__ fpgaEnumerateCacheEnable(uint32_t ttl_ms)
+{
+	int err;
+
+	if (pthread_mutex_lock(&enum_cache.lock)) {
+		FPGA_MSG("Failed to lock enumeration cache mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	if (!enum_cache.enabled) {
+		// Without uevents, changes are only noticed through the TTL
+		enum_cache.uevent_fd = enum_cache_uevent_open();
+		enum_cache.enabled = true;
+	}
+
+	enum_cache.ttl_ms = ttl_ms;
+	enum_cache_drop();
+
+	err = pthread_mutex_unlock(&enum_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	}
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaEnumerateCacheDisable(void)
+{
+	int err;
+
+	if (pthread_mutex_lock(&enum_cache.lock)) {
+		FPGA_MSG("Failed to lock enumeration cache mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	if (enum_cache.uevent_fd >= 0)
+		close(enum_cache.uevent_fd);
+	enum_cache.uevent_fd = -1;
+	enum_cache.enabled = false;
+	enum_cache_drop();
+
+	err = pthread_mutex_unlock(&enum_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	}
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaEnumerateCacheInvalidate(void)
+{
+	int err;
+
+	if (pthread_mutex_lock(&enum_cache.lock)) {
+		FPGA_MSG("Failed to lock enumeration cache mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	enum_cache_drop();
+
+	err = pthread_mutex_unlock(&enum_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+	}
+	return FPGA_OK;
+}
+
 fpga_result __FPGA_API__ fpgaEnumerate(const fpga_properties *filters,
 				       uint32_t num_filters, fpga_token *tokens,
 				       uint32_t max_tokens,
@@ -633,11 +1096,9 @@ fpga_result __FPGA_API__ fpgaEnumerate(const fpga_properties *filters,
 {
 	fpga_result result = FPGA_NOT_FOUND;
 
-	DIR *dir = NULL;
-	struct dirent *dirent = NULL;
-	char sysfspath[SYSFS_PATH_MAX];
 	struct dev_list head;
 	struct dev_list *lptr;
+	struct filter_set set;
 
 	if (NULL == num_matches) {
 		FPGA_MSG("num_matches is NULL");
@@ -663,34 +1124,22 @@ fpga_result __FPGA_API__ fpgaEnumerate(const fpga_properties *filters,
 
 	*num_matches = 0;
 
-	memset_s(&head, sizeof(head), 0);
-
-	// Find the top-level FPGA devices.
-	dir = opendir(SYSFS_FPGA_CLASS_PATH);
-	if (NULL == dir) {
-		FPGA_MSG("can't find %s (no driver?)", SYSFS_FPGA_CLASS_PATH);
-		return FPGA_NO_DRIVER;
-	}
-
-	while ((dirent = readdir(dir)) != NULL) {
-		if (!strcmp(dirent->d_name, "."))
-			continue;
-		if (!strcmp(dirent->d_name, ".."))
-			continue;
-
-		snprintf_s_ss(sysfspath, sizeof(sysfspath), "%s/%s",
-			      SYSFS_FPGA_CLASS_PATH, dirent->d_name);
+	result = filter_set_compile(filters, num_filters, &set);
+	if (result != FPGA_OK)
+		return result;
 
-		result = enum_top_dev(sysfspath, &head, include_afu(filters, num_filters));
-		if (result != FPGA_OK)
-			break;
+	if (enum_cache.enabled) {
+		result = enum_cached(&set, tokens, max_tokens, num_matches);
+		filter_set_free(&set);
+		return result;
 	}
 
-	closedir(dir);
+	memset_s(&head, sizeof(head), 0);
 
+	result = enum_scan(&head, include_afu(filters, num_filters));
 	if (result != FPGA_OK) {
 		FPGA_MSG("No FPGA resources found");
-		return result;
+		goto out_free_trash;
 	}
 
 	/* create and populate token data structures */
@@ -715,26 +1164,13 @@ fpga_result __FPGA_API__ fpgaEnumerate(const fpga_properties *filters,
 			goto out_free_trash;
 		}
 
-		// FIXME: should check contents of filter for token magic
-		if (matches_filters(lptr, filters, num_filters)) {
-			if (*num_matches < max_tokens) {
-				if (fpgaCloneToken(_tok, &tokens[*num_matches])
-				    != FPGA_OK) {
-					// FIXME: should we error out here?
-					FPGA_MSG("Error cloning token");
-				}
-			}
-			++(*num_matches);
-		}
+		enum_match(lptr, _tok, &set, tokens, max_tokens,
+			   num_matches);
 	}
 
 out_free_trash:
-	/* FIXME: should this live in a separate function? */
-	for (lptr = head.next; NULL != lptr;) {
-		struct dev_list *trash = lptr;
-		lptr = lptr->next;
-		free(trash);
-	}
+	enum_free_list(&head);
+	filter_set_free(&set);
 
 	return result;
 }
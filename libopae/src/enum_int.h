@@ -0,0 +1,114 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef __FPGA_ENUM_INT_H__
+#define __FPGA_ENUM_INT_H__
+
+#include "opae/types.h"
+#include "types_int.h"
+
+struct dev_list {
+	char sysfspath[SYSFS_PATH_MAX];
+	char devpath[DEV_PATH_MAX];
+	fpga_objtype objtype;
+	fpga_guid guid;
+	uint16_t segment;
+	uint8_t bus;
+	uint8_t device;
+	uint8_t function;
+	uint8_t socket_id;
+	uint16_t vendor_id;
+	uint16_t device_id;
+
+	uint32_t fpga_num_slots;
+	uint64_t fpga_bitstream_id;
+	fpga_version fpga_bbs_version;
+
+	fpga_accelerator_state accelerator_state;
+	uint32_t accelerator_num_mmios;
+	uint32_t accelerator_num_irqs;
+	struct dev_list *next;
+	struct dev_list *parent;
+	struct dev_list *fme;
+};
+
+/*
+ * A filter as captured once per fpgaEnumerate() call. The selection
+ * criteria are copied out of the fpga_properties object under its lock,
+ * so matching devices against it needs no locking at all.
+ */
+struct filter_entry {
+	uint64_t valid_fields;
+	char parent_path[SYSFS_PATH_MAX];
+	fpga_objtype objtype;
+	uint16_t segment;
+	uint8_t bus;
+	uint8_t device;
+	uint8_t function;
+	uint8_t socket_id;
+	fpga_guid guid;
+	uint64_t object_id;
+	uint16_t vendor_id;
+	uint16_t device_id;
+	uint32_t num_errors;
+
+	uint32_t num_slots;
+	uint64_t bbs_id;
+	fpga_version bbs_version;
+
+	fpga_accelerator_state state;
+	uint32_t num_mmio;
+	uint32_t num_interrupts;
+	struct filter_entry *next;
+};
+
+/* index into filter_set.unindexed for filters without a GUID */
+#define FILTER_ANY_OBJTYPE 2
+
+/*
+ * Compiled form of a filter array. Filters that select on a GUID are
+ * chained into a hash table keyed by that GUID; the remaining ones are
+ * kept in short lists per object type. A device is then only tested
+ * against the filters that can possibly match it.
+ */
+struct filter_set {
+	bool match_all;
+	bool uses_state;
+	uint32_t num_entries;
+	struct filter_entry *entries;
+	uint32_t bucket_mask;
+	struct filter_entry **buckets;
+	struct filter_entry *unindexed[FILTER_ANY_OBJTYPE + 1];
+};
+
+fpga_result filter_set_compile(const fpga_properties *filters,
+			       uint32_t num_filters, struct filter_set *set);
+bool filter_set_match(const struct filter_set *set,
+		      const struct dev_list *attr);
+void filter_set_free(struct filter_set *set);
+
+#endif // __FPGA_ENUM_INT_H__
@@ -33,6 +33,8 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 
 #include "safe_string/safe_string.h"
@@ -41,58 +43,8 @@
 #include "opae/properties.h"
 #include "types_int.h"
 #include "intel-fpga.h"
-
-#define EVENT_SOCKET_NAME     "/tmp/fpga_event_socket"
-#define EVENT_SOCKET_NAME_LEN 23
-#define MAX_PATH_LEN 256
-
-enum request_type {
-	REGISTER_EVENT = 0,
-	UNREGISTER_EVENT = 1
-};
-
-struct event_request {
-	enum request_type type;
-	fpga_event_type event;
-	char device[MAX_PATH_LEN];
-};
-
-fpga_result send_event_request(int conn_socket, int fd, struct event_request *req)
-{
-	struct msghdr mh;
-	struct cmsghdr *cmh;
-	struct iovec iov[1];
-	char buf[CMSG_SPACE(sizeof(int))];
-	ssize_t n;
-	int *fd_ptr;
-
-	/* set up ancillary data message header */
-	iov[0].iov_base = req;
-	iov[0].iov_len = sizeof(*req);
-	memset_s(buf, sizeof(buf), 0x0);
-	mh.msg_name = NULL;
-	mh.msg_namelen = 0;
-	mh.msg_iov = iov;
-	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
-	mh.msg_control = buf;
-	mh.msg_controllen = CMSG_LEN(sizeof(int));
-	mh.msg_flags = 0;
-	cmh = CMSG_FIRSTHDR(&mh);
-	cmh->cmsg_len = CMSG_LEN(sizeof(int));
-	cmh->cmsg_level = SOL_SOCKET;
-	cmh->cmsg_type = SCM_RIGHTS;
-	fd_ptr = (int *)CMSG_DATA(cmh);
-	*fd_ptr = fd;
-	/* send ancillary data */
-	n = sendmsg(conn_socket, &mh, 0);
-	if (n < 0) {
-		FPGA_ERR("sendmsg failed: %s", strerror(errno));
-		return FPGA_EXCEPTION;
-	}
-
-	return FPGA_OK;
-
-}
+#include "event_ring.h"
+#include "event_int.h"
 
 static fpga_result send_fme_event_request(fpga_handle handle,
 	fpga_event_handle event_handle, int fme_operation)
@@ -371,117 +323,70 @@ static fpga_result driver_unregister_event(fpga_handle handle,
 	}
 }
 
-static fpga_result daemon_register_event(fpga_handle handle,
-					 fpga_event_type event_type,
-					 fpga_event_handle event_handle,
-					 uint32_t flags)
+static fpga_result daemon_event_request(struct _fpga_handle *_handle,
+					enum event_op op,
+					fpga_event_type event_type,
+					int fd)
 {
-	int fd = FILE_DESCRIPTOR(event_handle);
-	fpga_result result = FPGA_OK;
-	struct sockaddr_un addr;
-	struct event_request req;
-	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
 	struct _fpga_token *_token = (struct _fpga_token *)_handle->token;
+	struct event_batch_entry entry;
+	fpga_result result;
+	fpga_result res;
 	errno_t e;
 
-	UNUSED_PARAM(flags);
-
-	if (_handle->fdfpgad < 0) {
-
-		/* connect to event socket */
-		_handle->fdfpgad = socket(AF_UNIX, SOCK_STREAM, 0);
-		if (_handle->fdfpgad < 0) {
-			FPGA_ERR("socket: %s", strerror(errno));
-			return FPGA_EXCEPTION;
-		}
-
-		addr.sun_family = AF_UNIX;
-		e = strncpy_s(addr.sun_path, sizeof(addr.sun_path),
-				EVENT_SOCKET_NAME, EVENT_SOCKET_NAME_LEN);
-		if (EOK != e) {
-			FPGA_ERR("strncpy_s failed");
-			return FPGA_EXCEPTION;
-		}
-
-		if (connect(_handle->fdfpgad, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-			FPGA_DBG("connect: %s", strerror(errno));
-			result = FPGA_NO_DAEMON;
-			goto out_close_conn;
-		}
-
-	}
+	memset_s(&entry, sizeof(entry), 0);
+	entry.op = op;
+	entry.event = event_type;
+	entry.owner = (uint64_t)(uintptr_t)_handle;
 
-	/* create event registration request */
-	req.type = REGISTER_EVENT;
-	req.event = event_type;
-
-	e = strncpy_s(req.device, sizeof(req.device),
-			_token->sysfspath, sizeof(_token->sysfspath));
+	e = strncpy_s(entry.device, sizeof(entry.device),
+			_token->sysfspath, sizeof(entry.device) - 1);
 	if (EOK != e) {
 		FPGA_ERR("strncpy_s failed");
-		result = FPGA_EXCEPTION;
-		goto out_close_conn;
+		return FPGA_EXCEPTION;
 	}
 
-	req.device[sizeof(req.device)-1] = '\0';
+	result = event_daemon_request(&entry, &fd, 1, &res);
+	if (result != FPGA_OK)
+		return result;
 
-	/* send event packet */
-	result = send_event_request(_handle->fdfpgad, fd, &req);
-	if (result != FPGA_OK) {
-		FPGA_ERR("send_event_request failed");
-		goto out_close_conn;
-	}
+	return res;
+}
 
-	return result;
+static fpga_result daemon_register_event(fpga_handle handle,
+					 fpga_event_type event_type,
+					 fpga_event_handle event_handle,
+					 uint32_t flags)
+{
+	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
+	fpga_result result;
+
+	UNUSED_PARAM(flags);
+
+	result = daemon_event_request(_handle, EVENT_OP_REGISTER, event_type,
+				      FILE_DESCRIPTOR(event_handle));
+	if (result == FPGA_OK)
+		++_handle->fpgad_events;
 
-out_close_conn:
-	close(_handle->fdfpgad);
-	_handle->fdfpgad = -1;
 	return result;
 }
 
 static fpga_result daemon_unregister_event(fpga_handle handle,
 					   fpga_event_type event_type)
 {
-	fpga_result result = FPGA_OK;
-
 	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
-	struct _fpga_token *_token = (struct _fpga_token *)_handle->token;
-
-	struct event_request req;
-	ssize_t n;
-	errno_t e;
+	fpga_result result;
 
-	if (_handle->fdfpgad < 0) {
-		FPGA_MSG("No fpgad connection");
+	if (!_handle->fpgad_events) {
+		FPGA_MSG("No events registered with fpgad");
 		return FPGA_INVALID_PARAM;
 	}
 
-	req.type = UNREGISTER_EVENT;
-	req.event = event_type;
-
-	e = strncpy_s(req.device, sizeof(req.device),
-			_token->sysfspath, sizeof(_token->sysfspath));
-	if (EOK != e) {
-		FPGA_ERR("strncpy_s failed");
-		result = FPGA_EXCEPTION;
-		goto out_close_conn;
-	}
-
-	req.device[sizeof(req.device)-1] = '\0';
-
-	n = send(_handle->fdfpgad, &req, sizeof(req), 0);
-	if (n < 0) {
-		FPGA_ERR("send : %s", strerror(errno));
-		result = FPGA_EXCEPTION;
-		goto out_close_conn;
-	}
-
-	return result;
+	result = daemon_event_request(_handle, EVENT_OP_UNREGISTER, event_type,
+				      -1);
+	if (result == FPGA_OK)
+		--_handle->fpgad_events;
 
-out_close_conn:
-	close(_handle->fdfpgad);
-	_handle->fdfpgad = -1;
 	return result;
 }
 
@@ -727,3 +632,260 @@ out_unlock_handle:
 
 	return result;
 }
+
+static fpga_result ring_check_and_lock(struct _fpga_event_ring *r)
+{
+	ASSERT_NOT_NULL(r);
+
+	if (pthread_mutex_lock(&r->lock)) {
+		FPGA_MSG("Failed to lock mutex");
+		return FPGA_EXCEPTION;
+	}
+
+	if (r->magic != FPGA_EVENT_RING_MAGIC) {
+		FPGA_MSG("Invalid event ring object");
+		int err = pthread_mutex_unlock(&r->lock);
+		if (err)
+			FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+		return FPGA_INVALID_PARAM;
+	}
+
+	return FPGA_OK;
+}
+
+/*
+ * Ask fpgad for the memfd backing its event ring.
+ */
+static fpga_result daemon_get_event_ring(int *ring_fd)
+{
+	struct event_request req;
+	struct msghdr mh;
+	struct cmsghdr *cmh;
+	struct iovec iov[1];
+	char buf[CMSG_SPACE(sizeof(int))];
+	uint32_t version = 0;
+	struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+	fpga_result result = FPGA_OK;
+	ssize_t n;
+	int sock;
+
+	sock = event_daemon_connect();
+	if (sock < 0)
+		return FPGA_NO_DAEMON;
+
+	/* older daemons ignore the request rather than reply */
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+		FPGA_MSG("setsockopt: %s", strerror(errno));
+
+	memset_s(&req, sizeof(req), 0);
+	req.type = GET_EVENT_RING;
+
+	n = send(sock, &req, sizeof(req), MSG_NOSIGNAL);
+	if (n < 0) {
+		FPGA_ERR("send failed: %s", strerror(errno));
+		result = FPGA_EXCEPTION;
+		goto out_close;
+	}
+
+	iov[0].iov_base = &version;
+	iov[0].iov_len = sizeof(version);
+	memset_s(buf, sizeof(buf), 0);
+	mh.msg_name = NULL;
+	mh.msg_namelen = 0;
+	mh.msg_iov = iov;
+	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
+	mh.msg_control = buf;
+	mh.msg_controllen = sizeof(buf);
+	mh.msg_flags = 0;
+
+	n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+	if (n < (ssize_t)sizeof(version)) {
+		FPGA_MSG("fpgad did not send an event ring");
+		result = FPGA_NOT_SUPPORTED;
+		goto out_close;
+	}
+
+	cmh = CMSG_FIRSTHDR(&mh);
+	if (!cmh || cmh->cmsg_level != SOL_SOCKET ||
+	    cmh->cmsg_type != SCM_RIGHTS) {
+		FPGA_MSG("fpgad has no event ring");
+		result = FPGA_NOT_SUPPORTED;
+		goto out_close;
+	}
+
+	*ring_fd = *((int *)CMSG_DATA(cmh));
+
+	if (version != EVENT_RING_VERSION) {
+		FPGA_MSG("unsupported event ring version %u", version);
+		close(*ring_fd);
+		result = FPGA_NOT_SUPPORTED;
+	}
+
+out_close:
+	close(sock);
+	return result;
+}
+
+fpga_result __FPGA_API__ fpgaOpenEventRing(fpga_event_ring *ring)
+{
+	struct _fpga_event_ring *_r;
+	const struct event_ring *er;
+	fpga_result result;
+	struct stat st;
+	void *addr;
+	uint64_t head;
+	int fd = -1;
+
+	ASSERT_NOT_NULL(ring);
+
+	result = daemon_get_event_ring(&fd);
+	if (result)
+		return result;
+
+	if (fstat(fd, &st) < 0 ||
+	    (size_t)st.st_size < sizeof(struct event_ring)) {
+		FPGA_ERR("invalid event ring");
+		close(fd);
+		return FPGA_EXCEPTION;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	/* the mapping keeps the ring alive */
+	close(fd);
+	if (addr == MAP_FAILED) {
+		FPGA_ERR("mmap: %s", strerror(errno));
+		return FPGA_EXCEPTION;
+	}
+
+	er = (const struct event_ring *)addr;
+	if (__atomic_load_n(&er->magic, __ATOMIC_ACQUIRE) != EVENT_RING_MAGIC ||
+	    er->slot_size != sizeof(struct event_ring_slot) ||
+	    !er->num_slots || (er->num_slots & (er->num_slots - 1)) ||
+	    (size_t)st.st_size < EVENT_RING_SIZE(er->num_slots)) {
+		FPGA_ERR("invalid event ring");
+		result = FPGA_EXCEPTION;
+		goto out_unmap;
+	}
+
+	_r = malloc(sizeof(*_r));
+	if (!_r) {
+		FPGA_ERR("Could not allocate memory for event ring");
+		result = FPGA_NO_MEMORY;
+		goto out_unmap;
+	}
+
+	if (pthread_mutex_init(&_r->lock, NULL)) {
+		FPGA_MSG("Failed to initialize event ring mutex");
+		free(_r);
+		result = FPGA_EXCEPTION;
+		goto out_unmap;
+	}
+
+	/* start with the oldest record still in the ring */
+	head = __atomic_load_n(&er->head, __ATOMIC_ACQUIRE);
+	_r->cursor = head > er->num_slots ? head - er->num_slots : 0;
+	_r->ring = er;
+	_r->size = st.st_size;
+	_r->magic = FPGA_EVENT_RING_MAGIC;
+
+	*ring = (fpga_event_ring)_r;
+	return FPGA_OK;
+
+out_unmap:
+	munmap(addr, st.st_size);
+	return result;
+}
+
+fpga_result __FPGA_API__ fpgaReadEventRing(fpga_event_ring ring,
+					   struct fpga_event_record *records,
+					   uint32_t max_records,
+					   uint32_t *num_records,
+					   uint64_t *lost)
+{
+	struct _fpga_event_ring *_r = (struct _fpga_event_ring *)ring;
+	const struct event_ring *er;
+	const struct event_ring_slot *slot;
+	fpga_result result;
+	uint64_t dropped = 0;
+	uint64_t head;
+	uint64_t seq;
+	uint32_t n = 0;
+	int err;
+
+	ASSERT_NOT_NULL(records);
+	ASSERT_NOT_NULL(num_records);
+
+	result = ring_check_and_lock(_r);
+	if (result)
+		return result;
+
+	er = _r->ring;
+	head = __atomic_load_n(&er->head, __ATOMIC_ACQUIRE);
+
+	if (head - _r->cursor > er->num_slots) {
+		dropped += head - er->num_slots - _r->cursor;
+		_r->cursor = head - er->num_slots;
+	}
+
+	while (n < max_records && _r->cursor < head) {
+		slot = &er->slots[_r->cursor & (er->num_slots - 1)];
+
+		/*
+		 * A sequence number other than cursor + 1 before or after
+		 * the copy means the writer has lapped us on this slot.
+		 */
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == _r->cursor + 1) {
+			records[n] = slot->rec;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+				++n;
+			else
+				++dropped;
+		} else {
+			++dropped;
+		}
+
+		++_r->cursor;
+	}
+
+	*num_records = n;
+	if (lost)
+		*lost = dropped;
+
+	err = pthread_mutex_unlock(&_r->lock);
+	if (err)
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaCloseEventRing(fpga_event_ring *ring)
+{
+	struct _fpga_event_ring *_r;
+	fpga_result result;
+	int err;
+
+	ASSERT_NOT_NULL(ring);
+
+	_r = (struct _fpga_event_ring *)*ring;
+
+	result = ring_check_and_lock(_r);
+	if (result)
+		return result;
+
+	munmap((void *)_r->ring, _r->size);
+	_r->magic = FPGA_INVALID_MAGIC;
+
+	err = pthread_mutex_unlock(&_r->lock);
+	if (err)
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+
+	err = pthread_mutex_destroy(&_r->lock);
+	if (err)
+		FPGA_ERR("pthread_mutex_destroy() failed: %s", strerror(err));
+
+	free(_r);
+	*ring = NULL;
+	return FPGA_OK;
+}
@@ -0,0 +1,827 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * event_daemon.c : process-wide connection to the FPGA daemon (fpgad)
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "common_int.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "safe_string/safe_string.h"
+
+#include "event_int.h"
+
+/* a batch waiting for its acknowledgment */
+struct pending_batch {
+	uint32_t id;
+	bool done;
+	fpga_result result;
+	struct event_batch_response rsp;
+	struct pending_batch *next;
+};
+
+/*
+ * Connection of one owner to an fpgad that predates the batch protocol.
+ * Version 1 requests don't say which handle they come from, so every
+ * owner gets a connection of its own, as every handle used to.
+ */
+struct v1_conn {
+	uint64_t owner;
+	int sock;
+	struct v1_conn *next;
+};
+
+/*
+ * A registration acknowledged by fpgad. fpgad forgets all registrations
+ * of a connection when it closes, so they are replayed over the next
+ * one. fd is our own duplicate of the eventfd.
+ */
+struct registration {
+	struct event_batch_entry entry;
+	int fd;
+	struct registration *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int sock;
+	/* protocol spoken by fpgad, 0 until probed */
+	uint32_t version;
+	uint32_t next_id;
+	/* a thread is reading responses outside of the lock */
+	bool reading;
+	struct pending_batch *pending;
+	struct v1_conn *v1;
+	struct registration *regs;
+} conn = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.sock = -1,
+	.version = 0,
+	.next_id = 1,
+	.reading = false,
+	.pending = NULL,
+	.v1 = NULL,
+	.regs = NULL
+};
+
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void v1_close_all(void);
+static void reg_clear(void);
+
+/* registrations belong to the parent's connection */
+static void conn_atfork_child(void)
+{
+	if (conn.sock >= 0)
+		close(conn.sock);
+	conn.sock = -1;
+	conn.version = 0;
+	conn.reading = false;
+	conn.pending = NULL;
+	v1_close_all();
+	reg_clear();
+	pthread_mutex_init(&conn.lock, NULL);
+	pthread_cond_init(&conn.cond, NULL);
+}
+
+static void conn_register_atfork(void)
+{
+	pthread_atfork(NULL, NULL, conn_atfork_child);
+}
+
+int event_daemon_connect(void)
+{
+	struct sockaddr_un addr;
+	const char *name;
+	int sock;
+	errno_t e;
+
+	name = getenv("LIBOPAE_EVENT_SOCKET");
+	if (!name || !*name)
+		name = EVENT_SOCKET_NAME;
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		FPGA_ERR("socket: %s", strerror(errno));
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	e = strncpy_s(addr.sun_path, sizeof(addr.sun_path),
+			name, sizeof(addr.sun_path) - 1);
+	if (EOK != e) {
+		FPGA_ERR("strncpy_s failed");
+		close(sock);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		FPGA_DBG("connect: %s", strerror(errno));
+		e = errno;
+		close(sock);
+		errno = e;
+		return -1;
+	}
+
+	return sock;
+}
+
+/*
+ * Fail all pending batches and close the connection.
+ * Call with conn.lock held and no thread reading.
+ */
+static void conn_drop(fpga_result result)
+{
+	struct pending_batch *p;
+
+	if (conn.sock >= 0) {
+		close(conn.sock);
+		conn.sock = -1;
+	}
+	/* fpgad may have been replaced by then */
+	conn.version = 0;
+
+	for (p = conn.pending ; p ; p = p->next) {
+		p->result = result;
+		p->done = true;
+	}
+	conn.pending = NULL;
+
+	pthread_cond_broadcast(&conn.cond);
+}
+
+/* call with conn.lock held */
+static void conn_unlink(struct pending_batch *batch)
+{
+	struct pending_batch **pp;
+
+	for (pp = &conn.pending ; *pp ; pp = &(*pp)->next) {
+		if (*pp == batch) {
+			*pp = batch->next;
+			break;
+		}
+	}
+}
+
+static fpga_result conn_send(int sock, uint32_t id,
+			     const struct event_batch_entry *entries,
+			     const int *fds, uint32_t count)
+{
+	struct event_batch_header hdr;
+	struct msghdr mh;
+	struct cmsghdr *cmh;
+	struct iovec iov[2];
+	char buf[CMSG_SPACE(EVENT_BATCH_MAX * sizeof(int))];
+	uint32_t nfds = 0;
+	uint32_t i;
+	ssize_t n;
+
+	for (i = 0 ; i < count ; ++i)
+		if (entries[i].op == EVENT_OP_REGISTER)
+			++nfds;
+
+	hdr.type = EVENT_BATCH;
+	hdr.version = EVENT_PROTOCOL_VERSION;
+	hdr.id = id;
+	hdr.count = count;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *)entries;
+	iov[1].iov_len = count * sizeof(*entries);
+	memset_s(buf, sizeof(buf), 0);
+	mh.msg_name = NULL;
+	mh.msg_namelen = 0;
+	mh.msg_iov = iov;
+	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
+	mh.msg_control = NULL;
+	mh.msg_controllen = 0;
+	mh.msg_flags = 0;
+
+	if (nfds) {
+		mh.msg_control = buf;
+		mh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		cmh = CMSG_FIRSTHDR(&mh);
+		cmh->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		cmh->cmsg_level = SOL_SOCKET;
+		cmh->cmsg_type = SCM_RIGHTS;
+		memcpy_s(CMSG_DATA(cmh), nfds * sizeof(int),
+			 fds, nfds * sizeof(int));
+	}
+
+	n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+	if (n < 0) {
+		FPGA_ERR("sendmsg failed: %s", strerror(errno));
+		return FPGA_EXCEPTION;
+	}
+
+	if ((size_t)n != sizeof(hdr) + count * sizeof(*entries)) {
+		FPGA_ERR("short send to fpgad");
+		return FPGA_EXCEPTION;
+	}
+
+	return FPGA_OK;
+}
+
+static fpga_result conn_receive(int sock, struct event_batch_response *rsp)
+{
+	struct pollfd pfd = { .fd = sock, .events = POLLIN, .revents = 0 };
+	ssize_t n;
+	int res;
+
+	do {
+		res = poll(&pfd, 1, EVENT_ACK_TIMEOUT_MS);
+	} while (res < 0 && errno == EINTR);
+
+	if (res < 0) {
+		FPGA_ERR("poll: %s", strerror(errno));
+		return FPGA_EXCEPTION;
+	}
+
+	if (!res) {
+		FPGA_MSG("fpgad did not acknowledge request");
+		return FPGA_NOT_SUPPORTED;
+	}
+
+	do {
+		n = recv(sock, rsp, sizeof(*rsp), MSG_WAITALL);
+	} while (n < 0 && errno == EINTR);
+
+	if (n != (ssize_t)sizeof(*rsp)) {
+		FPGA_MSG("lost connection to fpgad");
+		return FPGA_EXCEPTION;
+	}
+
+	if (rsp->version != EVENT_PROTOCOL_VERSION) {
+		FPGA_MSG("fpgad speaks protocol version %u", rsp->version);
+		return FPGA_NOT_SUPPORTED;
+	}
+
+	return FPGA_OK;
+}
+
+/* call with conn.lock held and reading set */
+static void conn_dispatch(const struct event_batch_response *rsp)
+{
+	struct pending_batch *p;
+
+	for (p = conn.pending ; p ; p = p->next)
+		if (p->id == rsp->id)
+			break;
+
+	if (!p) {
+		FPGA_MSG("unexpected fpgad response %u", rsp->id);
+		return;
+	}
+
+	conn_unlink(p);
+	p->rsp = *rsp;
+	p->result = FPGA_OK;
+	p->done = true;
+}
+
+/*
+ * Find out whether fpgad acknowledges batches, by sending an empty one.
+ * An fpgad that predates them takes it for a version 1 request of an
+ * unknown type and ignores it, where a real batch would be misparsed.
+ * Call with conn.lock held and no thread reading.
+ */
+static fpga_result conn_probe(void)
+{
+	struct event_batch_response rsp;
+	uint32_t id = conn.next_id++;
+	fpga_result res;
+
+	res = conn_send(conn.sock, id, NULL, NULL, 0);
+	if (!res)
+		res = conn_receive(conn.sock, &rsp);
+
+	if (res == FPGA_NOT_SUPPORTED) {
+		FPGA_MSG("falling back to fpgad protocol version 1");
+		close(conn.sock);
+		conn.sock = -1;
+		conn.version = 1;
+		return FPGA_OK;
+	}
+
+	if (!res && (rsp.id != id || rsp.count)) {
+		FPGA_MSG("unexpected fpgad response %u", rsp.id);
+		res = FPGA_EXCEPTION;
+	}
+
+	if (res) {
+		conn_drop(res);
+		return res;
+	}
+
+	conn.version = EVENT_PROTOCOL_VERSION;
+	return FPGA_OK;
+}
+
+/* call with conn.lock held */
+static struct v1_conn **v1_find(uint64_t owner)
+{
+	struct v1_conn **pp;
+
+	for (pp = &conn.v1 ; *pp ; pp = &(*pp)->next)
+		if ((*pp)->owner == owner)
+			break;
+
+	return pp;
+}
+
+/* fpgad drops the registrations of the connection; call with conn.lock held */
+static void v1_close(struct v1_conn **pp)
+{
+	struct v1_conn *c = *pp;
+
+	*pp = c->next;
+	close(c->sock);
+	free(c);
+}
+
+static void v1_close_all(void)
+{
+	while (conn.v1)
+		v1_close(&conn.v1);
+}
+
+static fpga_result v1_send(int sock, const struct event_batch_entry *entry,
+			   int fd)
+{
+	struct event_request req;
+	struct msghdr mh;
+	struct cmsghdr *cmh;
+	struct iovec iov[1];
+	char buf[CMSG_SPACE(sizeof(int))];
+	ssize_t n;
+
+	memset_s(&req, sizeof(req), 0);
+	req.type = (entry->op == EVENT_OP_REGISTER) ?
+		REGISTER_EVENT : UNREGISTER_EVENT;
+	req.event = entry->event;
+	memcpy_s(req.device, sizeof(req.device),
+		 entry->device, sizeof(entry->device));
+	req.device[sizeof(req.device)-1] = '\0';
+
+	iov[0].iov_base = &req;
+	iov[0].iov_len = sizeof(req);
+	memset_s(buf, sizeof(buf), 0);
+	mh.msg_name = NULL;
+	mh.msg_namelen = 0;
+	mh.msg_iov = iov;
+	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
+	mh.msg_control = NULL;
+	mh.msg_controllen = 0;
+	mh.msg_flags = 0;
+
+	if (fd >= 0) {
+		mh.msg_control = buf;
+		mh.msg_controllen = CMSG_LEN(sizeof(int));
+		cmh = CMSG_FIRSTHDR(&mh);
+		cmh->cmsg_len = CMSG_LEN(sizeof(int));
+		cmh->cmsg_level = SOL_SOCKET;
+		cmh->cmsg_type = SCM_RIGHTS;
+		memcpy_s(CMSG_DATA(cmh), sizeof(int), &fd, sizeof(int));
+	}
+
+	n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+	if (n != (ssize_t)sizeof(req)) {
+		FPGA_ERR("sendmsg failed: %s", strerror(errno));
+		return FPGA_EXCEPTION;
+	}
+
+	return FPGA_OK;
+}
+
+/*
+ * Carry out a batch with version 1 requests, which fpgad does not
+ * acknowledge. Call with conn.lock held.
+ */
+static void v1_request(const struct event_batch_entry *entries,
+		       const int *fds, uint32_t count,
+		       fpga_result *results)
+{
+	const struct event_batch_entry *entry;
+	struct v1_conn **pp;
+	struct v1_conn *c;
+	uint32_t next_fd = 0;
+	uint32_t i;
+	int fd;
+
+	for (i = 0 ; i < count ; ++i) {
+		entry = &entries[i];
+		pp = v1_find(entry->owner);
+		fd = -1;
+
+		switch (entry->op) {
+
+		case EVENT_OP_REGISTER:
+			fd = fds[next_fd++];
+			if (!*pp) {
+				c = malloc(sizeof(*c));
+				if (!c) {
+					results[i] = FPGA_NO_MEMORY;
+					continue;
+				}
+				c->sock = event_daemon_connect();
+				if (c->sock < 0) {
+					free(c);
+					results[i] = FPGA_NO_DAEMON;
+					continue;
+				}
+				c->owner = entry->owner;
+				c->next = conn.v1;
+				conn.v1 = c;
+				pp = &conn.v1;
+			}
+			break;
+
+		case EVENT_OP_UNREGISTER:
+			if (!*pp) {
+				results[i] = FPGA_INVALID_PARAM;
+				continue;
+			}
+			break;
+
+		case EVENT_OP_UNREGISTER_ALL:
+			if (*pp)
+				v1_close(pp);
+			results[i] = FPGA_OK;
+			continue;
+
+		default:
+			results[i] = FPGA_INVALID_PARAM;
+			continue;
+		}
+
+		results[i] = v1_send((*pp)->sock, entry, fd);
+		if (results[i] != FPGA_OK)
+			v1_close(pp);
+	}
+}
+
+/* call with conn.lock held */
+static void reg_unlink(struct registration *reg)
+{
+	struct registration **pp;
+
+	for (pp = &conn.regs ; *pp ; pp = &(*pp)->next) {
+		if (*pp == reg) {
+			*pp = reg->next;
+			close(reg->fd);
+			free(reg);
+			return;
+		}
+	}
+}
+
+/* call with conn.lock held */
+static void reg_remove_owner(uint64_t owner)
+{
+	struct registration **pp = &conn.regs;
+	struct registration *reg;
+
+	while (*pp) {
+		reg = *pp;
+		if (reg->entry.owner == owner) {
+			*pp = reg->next;
+			close(reg->fd);
+			free(reg);
+		} else {
+			pp = &reg->next;
+		}
+	}
+}
+
+static void reg_clear(void)
+{
+	while (conn.regs)
+		reg_unlink(conn.regs);
+}
+
+/*
+ * Track the entries of a batch that fpgad carried out. Unregistering
+ * releases the first matching registration, as it does in fpgad.
+ * Call with conn.lock held.
+ */
+static void reg_update(const struct event_batch_entry *entries,
+		       const int *fds, uint32_t count,
+		       const fpga_result *results)
+{
+	const struct event_batch_entry *entry;
+	struct registration *reg;
+	uint32_t next_fd = 0;
+	uint32_t i;
+	int fd;
+
+	for (i = 0 ; i < count ; ++i) {
+		entry = &entries[i];
+
+		switch (entry->op) {
+
+		case EVENT_OP_REGISTER:
+			fd = fds[next_fd++];
+			if (results[i] != FPGA_OK)
+				break;
+
+			reg = malloc(sizeof(*reg));
+			if (!reg) {
+				FPGA_MSG("registration will not survive a "
+					 "reconnect: out of memory");
+				break;
+			}
+			reg->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+			if (reg->fd < 0) {
+				FPGA_MSG("registration will not survive a "
+					 "reconnect: %s", strerror(errno));
+				free(reg);
+				break;
+			}
+			reg->entry = *entry;
+			reg->next = conn.regs;
+			conn.regs = reg;
+			break;
+
+		case EVENT_OP_UNREGISTER:
+			if (results[i] != FPGA_OK)
+				break;
+
+			for (reg = conn.regs ; reg ; reg = reg->next) {
+				if (reg->entry.owner == entry->owner &&
+				    reg->entry.event == entry->event &&
+				    !strncmp(reg->entry.device, entry->device,
+					     sizeof(entry->device)))
+					break;
+			}
+			if (reg)
+				reg_unlink(reg);
+			break;
+
+		case EVENT_OP_UNREGISTER_ALL:
+			reg_remove_owner(entry->owner);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Register everything in conn.regs over a connection that was just
+ * opened. Registrations that fpgad refuses now are dropped and reported.
+ * Call with conn.lock held and no thread reading.
+ */
+static fpga_result conn_replay(void)
+{
+	struct registration *batch[EVENT_BATCH_MAX];
+	struct event_batch_entry entries[EVENT_BATCH_MAX];
+	int fds[EVENT_BATCH_MAX];
+	fpga_result results[EVENT_BATCH_MAX];
+	struct event_batch_response rsp;
+	struct registration *reg = conn.regs;
+	fpga_result res = FPGA_OK;
+	uint32_t count;
+	uint32_t id;
+	uint32_t i;
+
+	while (reg) {
+		for (count = 0 ; reg && count < EVENT_BATCH_MAX ;
+		     reg = reg->next, ++count) {
+			batch[count] = reg;
+			entries[count] = reg->entry;
+			fds[count] = reg->fd;
+		}
+
+		if (conn.version == 1) {
+			v1_request(entries, fds, count, results);
+		} else {
+			id = conn.next_id++;
+			res = conn_send(conn.sock, id, entries, fds, count);
+			if (!res)
+				res = conn_receive(conn.sock, &rsp);
+			if (!res && (rsp.id != id || rsp.count != count)) {
+				FPGA_MSG("unexpected fpgad response %u",
+					 rsp.id);
+				res = FPGA_EXCEPTION;
+			}
+			if (res) {
+				conn_drop(res);
+				return res;
+			}
+			for (i = 0 ; i < count ; ++i)
+				results[i] = (fpga_result)rsp.result[i];
+		}
+
+		for (i = 0 ; i < count ; ++i) {
+			if (results[i] == FPGA_OK)
+				continue;
+			FPGA_ERR("lost fpgad registration of event %u on %s: %s",
+				 batch[i]->entry.event, batch[i]->entry.device,
+				 fpgaErrStr(results[i]));
+			reg_unlink(batch[i]);
+		}
+	}
+
+	return FPGA_OK;
+}
+
+/*
+ * Connect to fpgad, find out its protocol and restore the registrations
+ * of a previous connection. Call with conn.lock held and no thread
+ * reading.
+ */
+static fpga_result conn_open(void)
+{
+	fpga_result res;
+
+	conn.sock = event_daemon_connect();
+	if (conn.sock < 0)
+		return FPGA_NO_DAEMON;
+
+	res = conn_probe();
+	if (res)
+		return res;
+
+	return conn_replay();
+}
+
+fpga_result event_daemon_request(const struct event_batch_entry *entries,
+				 const int *fds, uint32_t count,
+				 fpga_result *results)
+{
+	struct pending_batch batch;
+	struct event_batch_response rsp;
+	fpga_result res;
+	uint32_t i;
+	int sock;
+	int err;
+
+	ASSERT_NOT_NULL(entries);
+	ASSERT_NOT_NULL(results);
+
+	if (!count || count > EVENT_BATCH_MAX)
+		return FPGA_INVALID_PARAM;
+
+	pthread_once(&atfork_once, conn_register_atfork);
+
+	err = pthread_mutex_lock(&conn.lock);
+	if (err) {
+		FPGA_ERR("pthread_mutex_lock() failed: %s", strerror(err));
+		return FPGA_EXCEPTION;
+	}
+
+	if ((conn.version != 1) && (conn.sock < 0)) {
+		res = conn_open();
+		if (res)
+			goto out_unlock;
+	}
+
+	if (conn.version == 1) {
+		v1_request(entries, fds, count, results);
+		reg_update(entries, fds, count, results);
+		res = FPGA_OK;
+		goto out_unlock;
+	}
+
+	batch.id = conn.next_id++;
+	batch.done = false;
+	batch.result = FPGA_OK;
+
+	res = conn_send(conn.sock, batch.id, entries, fds, count);
+	if (res) {
+		if (conn.reading)
+			shutdown(conn.sock, SHUT_RDWR); // reader drops it
+		else
+			conn_drop(res);
+		goto out_restore;
+	}
+
+	batch.next = conn.pending;
+	conn.pending = &batch;
+
+	while (!batch.done) {
+		if (conn.reading) {
+			pthread_cond_wait(&conn.cond, &conn.lock);
+			continue;
+		}
+
+		/* read responses for everyone until ours arrives */
+		conn.reading = true;
+		sock = conn.sock;
+		pthread_mutex_unlock(&conn.lock);
+
+		res = conn_receive(sock, &rsp);
+
+		pthread_mutex_lock(&conn.lock);
+		conn.reading = false;
+
+		if (res)
+			conn_drop(res);
+		else
+			conn_dispatch(&rsp);
+
+		pthread_cond_broadcast(&conn.cond);
+	}
+
+	res = batch.result;
+	if (!res) {
+		if (batch.rsp.count != count) {
+			FPGA_ERR("fpgad answered %u of %u requests",
+				 batch.rsp.count, count);
+			res = FPGA_EXCEPTION;
+		} else {
+			for (i = 0 ; i < count ; ++i)
+				results[i] = (fpga_result)batch.rsp.result[i];
+			reg_update(entries, fds, count, results);
+		}
+	}
+
+out_restore:
+	/*
+	 * This request failed with the connection, which took the
+	 * registrations of every handle with it. Restore them now rather
+	 * than at the next request, which may never come.
+	 */
+	if (res && conn.regs && (conn.version != 1) && (conn.sock < 0) &&
+	    !conn.reading)
+		conn_open();
+
+out_unlock:
+	err = pthread_mutex_unlock(&conn.lock);
+	if (err)
+		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+
+	return res;
+}
+
+void event_daemon_release(uint64_t owner)
+{
+	struct event_batch_entry entry;
+	fpga_result result;
+
+	memset_s(&entry, sizeof(entry), 0);
+	entry.op = EVENT_OP_UNREGISTER_ALL;
+	entry.owner = owner;
+
+	if (event_daemon_request(&entry, NULL, 1, &result) != FPGA_OK)
+		FPGA_MSG("failed to release fpgad registrations");
+
+	/* the owner is gone, never replay its registrations */
+	pthread_mutex_lock(&conn.lock);
+	reg_remove_owner(owner);
+	pthread_mutex_unlock(&conn.lock);
+}
+
+void event_daemon_disconnect(void)
+{
+	pthread_mutex_lock(&conn.lock);
+
+	if (conn.reading)
+		shutdown(conn.sock, SHUT_RDWR); // reader drops it
+	else
+		conn_drop(FPGA_EXCEPTION);
+
+	v1_close_all();
+	reg_clear();
+	conn.version = 0;
+
+	pthread_mutex_unlock(&conn.lock);
+}
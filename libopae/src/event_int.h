@@ -0,0 +1,84 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __FPGA_EVENT_INT_H__
+#define __FPGA_EVENT_INT_H__
+
+#include "opae/types.h"
+#include "event_protocol.h"
+
+#define EVENT_SOCKET_NAME "/tmp/fpga_event_socket"
+/* how long to wait for fpgad to acknowledge a batch */
+#define EVENT_ACK_TIMEOUT_MS 1000
+
+/*
+ * Open a new connection to fpgad. The socket is EVENT_SOCKET_NAME unless
+ * overridden by the LIBOPAE_EVENT_SOCKET environment variable (see the
+ * -s option of fpgad).
+ *
+ * @returns the connected socket, or -1 with errno set.
+ */
+int event_daemon_connect(void);
+
+/*
+ * Send one batch of requests over the process-wide fpgad connection and
+ * wait for its acknowledgment. Other threads may have batches in flight
+ * at the same time; whichever thread is waiting reads the responses and
+ * hands them to their senders.
+ *
+ * @param[in]  entries  1 to EVENT_BATCH_MAX requests.
+ * @param[in]  fds      The eventfds of the EVENT_OP_REGISTER entries, in
+ *                      entry order.
+ * @param[in]  count    Number of entries.
+ * @param[out] results  Outcome of each entry; valid if FPGA_OK is
+ *                      returned.
+ * A new connection is probed first. If fpgad does not acknowledge
+ * batches, the entries are sent as version 1 requests instead, over one
+ * connection per owner. fpgad does not answer those, so their results
+ * only tell whether they were sent.
+ *
+ * Successful registrations are remembered until they are unregistered.
+ * fpgad drops all registrations of a connection that fails, so they are
+ * registered again over the new connection, which is opened right away.
+ *
+ * @returns FPGA_OK if the batch was acknowledged (or sent, to a version 1
+ * fpgad). FPGA_NO_DAEMON if fpgad is not running. FPGA_NOT_SUPPORTED if
+ * fpgad stopped acknowledging. FPGA_EXCEPTION if the connection failed.
+ */
+fpga_result event_daemon_request(const struct event_batch_entry *entries,
+				 const int *fds, uint32_t count,
+				 fpga_result *results);
+
+/* Drop every registration made on behalf of owner. */
+void event_daemon_release(uint64_t owner);
+
+/*
+ * Close the process-wide connection and forget all registrations, which
+ * fpgad drops as well.
+ */
+void event_daemon_disconnect(void);
+
+#endif // __FPGA_EVENT_INT_H__
@@ -0,0 +1,98 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * Requests understood by fpgad on its event socket.
+ *
+ * Version 1 clients send one struct event_request per message, passing
+ * the eventfd of a REGISTER_EVENT request with SCM_RIGHTS, and get no
+ * reply (GET_EVENT_RING excepted).
+ *
+ * Version 2 clients send a struct event_batch_header followed by `count`
+ * struct event_batch_entry in one message, with the eventfds of all
+ * EVENT_OP_REGISTER entries attached in entry order. fpgad acknowledges
+ * each batch with a struct event_batch_response carrying the same id, so
+ * a client may have several batches in flight on one connection.
+ *
+ * Both request kinds start with the request type, which is how fpgad
+ * tells them apart.
+ */
+
+#ifndef __FPGA_EVENT_PROTOCOL_H__
+#define __FPGA_EVENT_PROTOCOL_H__
+
+#include <stdint.h>
+#include "opae/types.h"
+
+#define EVENT_DEVICE_MAX 256
+
+enum request_type {
+	REGISTER_EVENT = 0,
+	UNREGISTER_EVENT = 1,
+	GET_EVENT_RING = 2,
+	EVENT_BATCH = 3
+};
+
+struct event_request {
+	enum request_type type;
+	fpga_event_type event;
+	char device[EVENT_DEVICE_MAX];
+};
+
+#define EVENT_PROTOCOL_VERSION 2
+/* entries (and eventfds) per batch */
+#define EVENT_BATCH_MAX 32
+
+struct event_batch_header {
+	enum request_type type;		/* EVENT_BATCH */
+	uint32_t version;
+	uint32_t id;
+	uint32_t count;
+};
+
+enum event_op {
+	EVENT_OP_REGISTER = 0,
+	EVENT_OP_UNREGISTER = 1,
+	/* drop every registration of `owner` on this connection */
+	EVENT_OP_UNREGISTER_ALL = 2
+};
+
+struct event_batch_entry {
+	uint32_t op;
+	fpga_event_type event;
+	/* distinguishes handles sharing one connection */
+	uint64_t owner;
+	char device[EVENT_DEVICE_MAX];
+};
+
+struct event_batch_response {
+	uint32_t version;
+	uint32_t id;
+	uint32_t count;
+	int32_t result[EVENT_BATCH_MAX];	/* fpga_result per entry */
+};
+
+#endif // __FPGA_EVENT_PROTOCOL_H__
@@ -0,0 +1,68 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * Layout of the event ring shared between fpgad (the only writer) and any
+ * number of libopae readers. The ring lives in a memfd that fpgad hands
+ * out over its event socket; readers map it read-only.
+ *
+ * Each slot carries a sequence number acting as a per-slot seqlock: the
+ * writer clears it, fills in the record, then publishes seq = n + 1 for
+ * the n-th record and finally advances head. A reader accepts a slot only
+ * if it sees the expected sequence number both before and after copying
+ * the record.
+ */
+
+#ifndef __FPGA_EVENT_RING_H__
+#define __FPGA_EVENT_RING_H__
+
+#include <stdint.h>
+#include "opae/types.h"
+
+#define EVENT_RING_MAGIC   0x4650474145565247 /* FPGAEVRG */
+#define EVENT_RING_VERSION 1
+/* must be a power of 2 */
+#define EVENT_RING_SLOTS   256
+
+struct event_ring_slot {
+	uint64_t seq;
+	struct fpga_event_record rec;
+} __attribute__((aligned(64)));
+
+struct event_ring {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t num_slots;
+	uint32_t slot_size;
+	/* next sequence number to be written, on its own cache line */
+	uint64_t head __attribute__((aligned(64)));
+	struct event_ring_slot slots[] __attribute__((aligned(64)));
+};
+
+#define EVENT_RING_SIZE(n) \
+	(sizeof(struct event_ring) + (n) * sizeof(struct event_ring_slot))
+
+#endif // __FPGA_EVENT_RING_H__
@@ -30,6 +30,7 @@
 
 #include "common_int.h"
 #include "token_list_int.h"
+#include "opae/enum.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -97,11 +98,23 @@ static void fpga_init(void)
 
 	if (g_logfile == NULL)
 		g_logfile = stdout;
+
+	/* opt in to the enumeration cache, value is the TTL in ms */
+	s = getenv("LIBOPAE_ENUM_CACHE");
+	if (s)
+		fpgaEnumerateCacheEnable((uint32_t)strtoul(s, NULL, 0));
+
+	/* opt out of the sysfs attribute cache */
+	s = getenv("LIBOPAE_SYSFS_CACHE");
+	if (s && !strtoul(s, NULL, 0))
+		sysfs_cache_enable(false);
 }
 
 __attribute__((destructor))
 static void fpga_release(void)
 {
+	fpgaEnumerateCacheDisable();
+	sysfs_cache_flush();
 	token_cleanup();
 
 	if (g_logfile != NULL && g_logfile != stdout) {
@@ -29,6 +29,7 @@
 #endif // HAVE_CONFIG_H
 
 #include "opae/access.h"
+#include "opae/mmio.h"
 #include "opae/utils.h"
 #include "common_int.h"
 #include "intel-fpga.h"
@@ -185,6 +186,41 @@ static fpga_result map_mmio_region(fpga_handle handle, uint32_t mmio_num)
 	return FPGA_OK;
 }
 
+/*
+ * Publish a mapped region so that later accesses can bypass the handle lock.
+ * Caller must hold the handle lock.
+ */
+static void mmio_fast_publish(struct _fpga_handle *_handle,
+			      uint32_t mmio_num,
+			      struct wsid_map *wm)
+{
+	struct _fpga_mmio_region *region;
+
+	if (mmio_num >= FPGA_MMIO_FAST_REGIONS)
+		return;
+
+	region = &_handle->mmio_fast[mmio_num];
+	if (__atomic_load_n(&region->base, __ATOMIC_RELAXED))
+		return;
+
+	region->len = wm->len;
+	__atomic_store_n(&region->base, (uint8_t *)wm->offset, __ATOMIC_RELEASE);
+}
+
+/*
+ * Withdraw a published region before it is unmapped.
+ * Caller must hold the handle lock.
+ */
+static void mmio_fast_unpublish(struct _fpga_handle *_handle,
+				uint32_t mmio_num)
+{
+	if (mmio_num >= FPGA_MMIO_FAST_REGIONS)
+		return;
+
+	__atomic_store_n(&_handle->mmio_fast[mmio_num].base, NULL,
+			 __ATOMIC_RELEASE);
+}
+
 /* Lazy mapping of MMIO region (only map if not already mapped) */
 static fpga_result find_or_map_wm(fpga_handle handle, uint32_t mmio_num,
 				struct wsid_map **wm_out)
@@ -207,41 +243,59 @@ static fpga_result find_or_map_wm(fpga_handle handle, uint32_t mmio_num,
 		}
 	}
 
+	mmio_fast_publish(_handle, mmio_num, wm);
+
 	*wm_out = wm;
 	return FPGA_OK;
 }
 
-fpga_result __FPGA_API__ fpgaWriteMMIO32(fpga_handle handle,
-					 uint32_t mmio_num,
-					 uint64_t offset,
-					 uint32_t value)
+static inline bool mmio_in_bounds(uint64_t len, uint64_t offset,
+				  uint64_t width)
 {
+	return (width <= len) && (offset <= len - width);
+}
 
+/*
+ * Resolve mmio_num to the base address and length of the mapped region.
+ *
+ * Once a region has been mapped its base is published in
+ * handle->mmio_fast[], and the lookup takes no lock. Otherwise take the
+ * handle lock, map the region and publish it.
+ * Unmapping or closing the handle while other threads still access the
+ * region is not supported, as with pointers from fpgaMapMMIO().
+ */
+static fpga_result mmio_get_region(struct _fpga_handle *_handle,
+				   uint32_t mmio_num,
+				   uint8_t **base,
+				   uint64_t *len)
+{
 	int err;
-	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
 	struct wsid_map *wm = NULL;
 	fpga_result result = FPGA_OK;
 
-	if (offset % sizeof(uint32_t) != 0) {
-		FPGA_MSG("Misaligned MMIO access");
-		return FPGA_INVALID_PARAM;
+	ASSERT_NOT_NULL(_handle);
+
+	if (mmio_num < FPGA_MMIO_FAST_REGIONS &&
+	    _handle->magic == FPGA_HANDLE_MAGIC) {
+		struct _fpga_mmio_region *region = &_handle->mmio_fast[mmio_num];
+
+		*base = __atomic_load_n(&region->base, __ATOMIC_ACQUIRE);
+		if (*base) {
+			*len = region->len;
+			return FPGA_OK;
+		}
 	}
 
 	result = handle_check_and_lock(_handle);
 	if (result)
 		return result;
 
-	result = find_or_map_wm(handle, mmio_num, &wm);
+	result = find_or_map_wm(_handle, mmio_num, &wm);
 	if (result)
 		goto out_unlock;
 
-	if (offset > wm->len) {
-		FPGA_MSG("offset out of bounds");
-		result = FPGA_INVALID_PARAM;
-		goto out_unlock;
-	}
-
-	*((volatile uint32_t *) ((uint8_t *)wm->offset + offset)) = value;
+	*base = (uint8_t *)wm->offset;
+	*len = wm->len;
 
 out_unlock:
 	err = pthread_mutex_unlock(&_handle->lock);
@@ -251,82 +305,130 @@ out_unlock:
 	return result;
 }
 
-fpga_result __FPGA_API__ fpgaReadMMIO32(fpga_handle handle,
-					uint32_t mmio_num,
-					uint64_t offset,
-					uint32_t *value)
+/* Resolve (mmio_num, offset) to the address of a CSR of the given width. */
+static fpga_result mmio_get_addr(struct _fpga_handle *_handle,
+				 uint32_t mmio_num,
+				 uint64_t offset,
+				 uint64_t width,
+				 volatile void **addr)
 {
-	int err;
-	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
-	struct wsid_map *wm = NULL;
-	fpga_result result = FPGA_OK;
+	uint8_t *base = NULL;
+	uint64_t len = 0;
+	fpga_result result;
 
-	if (offset % sizeof(uint32_t) != 0) {
+	if (offset % width != 0) {
 		FPGA_MSG("Misaligned MMIO access");
 		return FPGA_INVALID_PARAM;
 	}
 
-	result = handle_check_and_lock(_handle);
+	result = mmio_get_region(_handle, mmio_num, &base, &len);
 	if (result)
 		return result;
 
-	result = find_or_map_wm(handle, mmio_num, &wm);
-	if (result)
-		goto out_unlock;
-
-	if (offset > wm->len) {
+	if (!mmio_in_bounds(len, offset, width)) {
 		FPGA_MSG("offset out of bounds");
-		result = FPGA_INVALID_PARAM;
-		goto out_unlock;
+		return FPGA_INVALID_PARAM;
 	}
 
-	*value = *((volatile uint32_t *) ((uint8_t *)wm->offset + offset));
+	*addr = base + offset;
+	return FPGA_OK;
+}
 
-out_unlock:
-	err = pthread_mutex_unlock(&_handle->lock);
-	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+/* Validate every element of a vectored access against the region length. */
+static fpga_result mmio_check_ops(const fpga_mmio_op *ops,
+				  uint32_t num_ops,
+				  uint64_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].width != sizeof(uint32_t) &&
+		    ops[i].width != sizeof(uint64_t)) {
+			FPGA_MSG("Invalid MMIO access width %u at element %u",
+				 ops[i].width, i);
+			return FPGA_INVALID_PARAM;
+		}
+
+		if (ops[i].offset % ops[i].width != 0) {
+			FPGA_MSG("Misaligned MMIO access at element %u", i);
+			return FPGA_INVALID_PARAM;
+		}
+
+		if (!mmio_in_bounds(len, ops[i].offset, ops[i].width)) {
+			FPGA_MSG("offset out of bounds at element %u", i);
+			return FPGA_INVALID_PARAM;
+		}
 	}
-	return result;
+
+	return FPGA_OK;
 }
 
-fpga_result __FPGA_API__ fpgaWriteMMIO64(fpga_handle handle,
+static inline void mmio_write_op(uint8_t *base, const fpga_mmio_op *op)
+{
+	if (op->width == sizeof(uint64_t))
+		*((volatile uint64_t *)(base + op->offset)) = op->value;
+	else
+		*((volatile uint32_t *)(base + op->offset)) =
+			(uint32_t)op->value;
+}
+
+static inline uint64_t mmio_read_op(uint8_t *base, const fpga_mmio_op *op)
+{
+	if (op->width == sizeof(uint64_t))
+		return *((volatile uint64_t *)(base + op->offset));
+	else
+		return *((volatile uint32_t *)(base + op->offset));
+}
+
+fpga_result __FPGA_API__ fpgaWriteMMIO32(fpga_handle handle,
 					 uint32_t mmio_num,
 					 uint64_t offset,
-					 uint64_t value)
+					 uint32_t value)
 {
-	int err;
-	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
-	struct wsid_map *wm = NULL;
-	fpga_result result = FPGA_OK;
-
-	if (offset % sizeof(uint64_t) != 0) {
-		FPGA_MSG("Misaligned MMIO access");
-		return FPGA_INVALID_PARAM;
-	}
+	volatile void *addr = NULL;
+	fpga_result result;
 
-	result = handle_check_and_lock(_handle);
+	result = mmio_get_addr((struct _fpga_handle *)handle, mmio_num,
+			       offset, sizeof(uint32_t), &addr);
 	if (result)
 		return result;
 
-	result = find_or_map_wm(handle, mmio_num, &wm);
+	*((volatile uint32_t *)addr) = value;
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaReadMMIO32(fpga_handle handle,
+					uint32_t mmio_num,
+					uint64_t offset,
+					uint32_t *value)
+{
+	volatile void *addr = NULL;
+	fpga_result result;
+
+	result = mmio_get_addr((struct _fpga_handle *)handle, mmio_num,
+			       offset, sizeof(uint32_t), &addr);
 	if (result)
-		goto out_unlock;
+		return result;
 
-	if (offset > wm->len) {
-		FPGA_MSG("offset out of bounds");
-		result = FPGA_INVALID_PARAM;
-		goto out_unlock;
-	}
+	*value = *((volatile uint32_t *)addr);
+	return FPGA_OK;
+}
 
-	*((volatile uint64_t *) ((uint8_t *)wm->offset + offset)) = value;
+fpga_result __FPGA_API__ fpgaWriteMMIO64(fpga_handle handle,
+					 uint32_t mmio_num,
+					 uint64_t offset,
+					 uint64_t value)
+{
+	volatile void *addr = NULL;
+	fpga_result result;
 
-out_unlock:
-	err = pthread_mutex_unlock(&_handle->lock);
-	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
-	}
-	return result;
+	result = mmio_get_addr((struct _fpga_handle *)handle, mmio_num,
+			       offset, sizeof(uint64_t), &addr);
+	if (result)
+		return result;
+
+	*((volatile uint64_t *)addr) = value;
+	return FPGA_OK;
 }
 
 fpga_result __FPGA_API__ fpgaReadMMIO64(fpga_handle handle,
@@ -334,38 +436,112 @@ fpga_result __FPGA_API__ fpgaReadMMIO64(fpga_handle handle,
 					uint64_t offset,
 					uint64_t *value)
 {
-	int err;
-	struct _fpga_handle *_handle = (struct _fpga_handle *) handle;
-	struct wsid_map *wm = NULL;
-	fpga_result result = FPGA_OK;
+	volatile void *addr = NULL;
+	fpga_result result;
 
-	if (offset % sizeof(uint64_t) != 0) {
-		FPGA_MSG("Misaligned MMIO access");
-		return FPGA_INVALID_PARAM;
+	result = mmio_get_addr((struct _fpga_handle *)handle, mmio_num,
+			       offset, sizeof(uint64_t), &addr);
+	if (result)
+		return result;
+
+	*value = *((volatile uint64_t *)addr);
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaWriteMMIOv(fpga_handle handle,
+					 uint32_t mmio_num,
+					 const fpga_mmio_op *ops,
+					 uint32_t num_ops)
+{
+	uint8_t *base = NULL;
+	uint64_t len = 0;
+	fpga_result result;
+	uint32_t i;
+
+	ASSERT_NOT_NULL(ops);
+
+	result = mmio_get_region((struct _fpga_handle *)handle, mmio_num,
+				 &base, &len);
+	if (result)
+		return result;
+
+	result = mmio_check_ops(ops, num_ops, len);
+	if (result)
+		return result;
+
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].flags & FPGA_MMIO_FENCE)
+			__sync_synchronize();
+
+		mmio_write_op(base, &ops[i]);
 	}
 
-	result = handle_check_and_lock(_handle);
+	return FPGA_OK;
+}
+
+fpga_result __FPGA_API__ fpgaReadMMIOv(fpga_handle handle,
+					uint32_t mmio_num,
+					fpga_mmio_op *ops,
+					uint32_t num_ops)
+{
+	uint8_t *base = NULL;
+	uint64_t len = 0;
+	fpga_result result;
+	uint32_t i;
+
+	ASSERT_NOT_NULL(ops);
+
+	result = mmio_get_region((struct _fpga_handle *)handle, mmio_num,
+				 &base, &len);
 	if (result)
 		return result;
 
-	result = find_or_map_wm(handle, mmio_num, &wm);
+	result = mmio_check_ops(ops, num_ops, len);
 	if (result)
-		goto out_unlock;
+		return result;
 
-	if (offset > wm->len) {
-		FPGA_MSG("offset out of bounds");
-		result = FPGA_INVALID_PARAM;
-		goto out_unlock;
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].flags & FPGA_MMIO_FENCE)
+			__sync_synchronize();
+
+		ops[i].value = mmio_read_op(base, &ops[i]);
 	}
 
-	*value = *((volatile uint64_t *) ((uint8_t *)wm->offset + offset));
+	return FPGA_OK;
+}
 
-out_unlock:
-	err = pthread_mutex_unlock(&_handle->lock);
-	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+fpga_result __FPGA_API__ fpgaMMIOv(fpga_handle handle,
+				   uint32_t mmio_num,
+				   fpga_mmio_op *ops,
+				   uint32_t num_ops)
+{
+	uint8_t *base = NULL;
+	uint64_t len = 0;
+	fpga_result result;
+	uint32_t i;
+
+	ASSERT_NOT_NULL(ops);
+
+	result = mmio_get_region((struct _fpga_handle *)handle, mmio_num,
+				 &base, &len);
+	if (result)
+		return result;
+
+	result = mmio_check_ops(ops, num_ops, len);
+	if (result)
+		return result;
+
+	for (i = 0; i < num_ops; ++i) {
+		if (ops[i].flags & FPGA_MMIO_FENCE)
+			__sync_synchronize();
+
+		if (ops[i].flags & FPGA_MMIO_READ)
+			ops[i].value = mmio_read_op(base, &ops[i]);
+		else
+			mmio_write_op(base, &ops[i]);
 	}
-	return result;
+
+	return FPGA_OK;
 }
 
 fpga_result __FPGA_API__ fpgaMapMMIO(fpga_handle handle,
@@ -417,6 +593,8 @@ fpga_result __FPGA_API__ fpgaUnmapMMIO(fpga_handle handle,
 		goto out_unlock;
 	}
 
+	mmio_fast_unpublish(_handle, mmio_num);
+
 	/* Unmap UAFU MMIO */
 	mmio_ptr = (void *) wm->offset;
 	if (munmap((void *) mmio_ptr, wm->len)) {
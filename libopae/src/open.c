@@ -84,13 +84,13 @@ fpga_result __FPGA_API__ fpgaOpen(fpga_token token, fpga_handle *handle, int fla
 
 	_handle->token = token;
 
-	_handle->fdfpgad = -1;
+	_handle->fpgad_events = 0;
 
 	// Init MMIO table
 	_handle->mmio_root = wsid_tracker_init(4);
 
-	// Init workspace table
-	_handle->wsid_root = wsid_tracker_init(16384);
+	// Init workspace table (grows as buffers are added)
+	_handle->wsid_root = wsid_tracker_init(1024);
 
 	// Open resources in exclusive mode unless FPGA_OPEN_SHARED is given
 	open_flags = O_RDWR | ((flags & FPGA_OPEN_SHARED) ? 0 : O_EXCL);
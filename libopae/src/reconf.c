@@ -433,6 +433,9 @@ fpga_result __FPGA_API__ fpgaReconfigureSlot(fpga_handle fpga,
 		}
 	}
 
+	// the slot's AFU ID has changed (or is unknown after an error)
+	fpgaEnumerateCacheInvalidate();
+
 	// PR error
 	error.csr = port_pr.status;
 
@@ -29,6 +29,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
@@ -45,71 +46,123 @@
 #include "common_int.h"
 
 //
-// sysfs access (read/write) functions
+// sysfs attribute cache
+//
+// Attributes are opened once and re-read with pread() at offset 0, which
+// makes sysfs call the attribute's show() method again, so volatile values
+// stay current without an open()/close() pair per read. Attributes that
+// cannot change while the device exists are read once and served from
+// memory afterwards, until the next sysfs scan drops them with
+// sysfs_cache_revalidate(). The whole cache is flushed by
+// sysfs_cache_flush(), which runs whenever the enumeration cache is
+// invalidated (uevents, TTL, reconfiguration, explicit invalidation).
 //
 
-fpga_result sysfs_read_int(const char *path, int *i)
-{
+#define SYSFS_CACHE_BUCKETS 128
+#define SYSFS_CACHE_MAX_FDS 256
+
+struct sysfs_attr {
+	char path[SYSFS_PATH_MAX];
+	uint64_t hash;
 	int fd;
-	int res;
-	char buf[SYSFS_PATH_MAX];
-	int b;
+	bool immutable;
+	// contents of an immutable attribute, without the trailing newline
+	char value[SYSFS_PATH_MAX];
+	struct sysfs_attr *next;
+};
+
+static struct {
+	pthread_rwlock_t lock;
+	bool disabled;
+	uint32_t num_fds;
+	struct sysfs_attr *buckets[SYSFS_CACHE_BUCKETS];
+} sysfs_cache = {
+	.lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+/* attributes whose value is fixed for the lifetime of the device */
+static const char * const sysfs_immutable_attrs[] = {
+	"vendor",
+	"device",
+	FPGA_SYSFS_BITSTREAM_ID,
+	"bitstream_metadata",
+	FPGA_SYSFS_NUM_SLOTS,
+	FPGA_SYSFS_SOCKET_ID,
+	NULL
+};
+
+static bool sysfs_attr_immutable(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	int i;
 
-	if (path == NULL) {
-		FPGA_ERR("Invalid input path");
-		return FPGA_INVALID_PARAM;
+	name = name ? name + 1 : path;
+
+	for (i = 0; sysfs_immutable_attrs[i]; ++i) {
+		if (!strcmp(name, sysfs_immutable_attrs[i]))
+			return true;
 	}
+	return false;
+}
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		FPGA_MSG("open(%s) failed", path);
-		return FPGA_NOT_FOUND;
+static uint64_t sysfs_path_hash(const char *path)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*path) {
+		h ^= (uint8_t)*path++;
+		h *= 0x100000001b3ULL;
 	}
+	return h;
+}
 
-	if ((off_t)-1 == lseek(fd, 0, SEEK_SET)) {
-		FPGA_MSG("seek failed");
-		goto out_close;
+/* must be called with sysfs_cache.lock held (either side) */
+static struct sysfs_attr *sysfs_attr_find(const char *path, uint64_t hash)
+{
+	struct sysfs_attr *a;
+
+	for (a = sysfs_cache.buckets[hash % SYSFS_CACHE_BUCKETS];
+	     NULL != a; a = a->next) {
+		if (a->hash == hash && !strcmp(a->path, path))
+			return a;
 	}
+	return NULL;
+}
 
-	b = 0;
+/*
+ * Read the contents of fd into buf (at most len - 1 bytes), starting at
+ * offset 0, and erase the trailing newline.
+ */
+static fpga_result sysfs_pread_fd(int fd, const char *path, char *buf,
+				  size_t len)
+{
+	ssize_t res;
+	size_t b = 0;
 
 	do {
-		res = read(fd, buf+b, sizeof(buf)-b);
+		res = pread(fd, buf + b, len - 1 - b, b);
 		if (res <= 0) {
 			FPGA_MSG("Read from %s failed", path);
-			goto out_close;
+			return FPGA_NOT_FOUND;
 		}
 		b += res;
-		if (((unsigned)b > sizeof(buf)) || (b <= 0)) {
-			FPGA_MSG("Unexpected size reading from %s", path);
-			goto out_close;
-		}
-	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && (unsigned)b < sizeof(buf));
+	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && b < len - 1);
 
 	// erase \n
-	buf[b-1] = 0;
+	if (buf[b-1] == '\n')
+		buf[b-1] = 0;
+	else
+		buf[b] = 0;
 
-	*i = atoi(buf);
-
-	close(fd);
 	return FPGA_OK;
-
-out_close:
-	close(fd);
-	return FPGA_NOT_FOUND;
 }
 
-fpga_result sysfs_read_u32(const char *path, uint32_t *u)
+/* read path without going through the cache */
+static fpga_result sysfs_read_uncached(const char *path, char *buf,
+				       size_t len)
 {
+	fpga_result res;
 	int fd;
-	int res;
-	char buf[SYSFS_PATH_MAX];
-	int b;
-
-	if (path == NULL) {
-		FPGA_ERR("Invalid input path");
-		return FPGA_INVALID_PARAM;
-	}
 
 	fd = open(path, O_RDONLY);
 	if (fd < 0) {
@@ -117,47 +170,284 @@ fpga_result sysfs_read_u32(const char *path, uint32_t *u)
 		return FPGA_NOT_FOUND;
 	}
 
-	if ((off_t)-1 == lseek(fd, 0, SEEK_SET)) {
-		FPGA_MSG("seek failed");
-		goto out_close;
+	res = sysfs_pread_fd(fd, path, buf, len);
+
+	close(fd);
+	return res;
+}
+
+static void sysfs_attr_unlink(struct sysfs_attr *attr)
+{
+	struct sysfs_attr **pa = &sysfs_cache.buckets[attr->hash
+						      % SYSFS_CACHE_BUCKETS];
+
+	while (*pa && *pa != attr)
+		pa = &(*pa)->next;
+	if (*pa)
+		*pa = attr->next;
+
+	if (attr->fd >= 0) {
+		close(attr->fd);
+		--sysfs_cache.num_fds;
 	}
+	free(attr);
+}
 
-	b = 0;
+/* open path, read it, and add it to the cache */
+static fpga_result sysfs_attr_add(const char *path, uint64_t hash,
+				  char *buf, size_t len)
+{
+	struct sysfs_attr *attr;
+	fpga_result res;
+	int err;
+
+	if (pthread_rwlock_wrlock(&sysfs_cache.lock)) {
+		FPGA_MSG("Failed to lock sysfs cache");
+		return sysfs_read_uncached(path, buf, len);
+	}
+
+	// somebody may have added it while we were unlocked
+	attr = sysfs_attr_find(path, hash);
+	if (attr) {
+		if (attr->immutable)
+			res = strncpy_s(buf, len, attr->value,
+					sizeof(attr->value)) ?
+				FPGA_EXCEPTION : FPGA_OK;
+		else
+			res = sysfs_pread_fd(attr->fd, path, buf, len);
+		goto out_unlock;
+	}
 
-	do {
-		res = read(fd, buf+b, sizeof(buf)-b);
-		if (res <= 0) {
-			FPGA_MSG("Read from %s failed", path);
-			goto out_close;
-		}
-		b += res;
-		if (((unsigned)b > sizeof(buf)) || (b <= 0)) {
-			FPGA_MSG("Unexpected size reading from %s", path);
-			goto out_close;
+	if (sysfs_cache.num_fds >= SYSFS_CACHE_MAX_FDS) {
+		res = sysfs_read_uncached(path, buf, len);
+		goto out_unlock;
+	}
+
+	attr = calloc(1, sizeof(struct sysfs_attr));
+	if (!attr) {
+		res = sysfs_read_uncached(path, buf, len);
+		goto out_unlock;
+	}
+
+	attr->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (attr->fd < 0) {
+		FPGA_MSG("open(%s) failed", path);
+		free(attr);
+		res = FPGA_NOT_FOUND;
+		goto out_unlock;
+	}
+
+	res = sysfs_pread_fd(attr->fd, path, buf, len);
+	if (FPGA_OK != res) {
+		close(attr->fd);
+		free(attr);
+		goto out_unlock;
+	}
+
+	strncpy_s(attr->path, sizeof(attr->path), path, SYSFS_PATH_MAX - 1);
+	attr->hash = hash;
+	attr->immutable = sysfs_attr_immutable(path);
+
+	if (attr->immutable) {
+		// the value is all we need from now on
+		strncpy_s(attr->value, sizeof(attr->value), buf,
+			  sizeof(attr->value) - 1);
+		close(attr->fd);
+		attr->fd = -1;
+	} else {
+		++sysfs_cache.num_fds;
+	}
+
+	attr->next = sysfs_cache.buckets[hash % SYSFS_CACHE_BUCKETS];
+	sysfs_cache.buckets[hash % SYSFS_CACHE_BUCKETS] = attr;
+
+out_unlock:
+	err = pthread_rwlock_unlock(&sysfs_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
+	}
+	return res;
+}
+
+/* drop path from the cache, e.g. because its fd went stale */
+static void sysfs_attr_drop(const char *path, uint64_t hash)
+{
+	struct sysfs_attr *attr;
+	int err;
+
+	if (pthread_rwlock_wrlock(&sysfs_cache.lock)) {
+		FPGA_MSG("Failed to lock sysfs cache");
+		return;
+	}
+
+	attr = sysfs_attr_find(path, hash);
+	if (attr)
+		sysfs_attr_unlink(attr);
+
+	err = pthread_rwlock_unlock(&sysfs_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
+	}
+}
+
+/*
+ * Read the contents of the sysfs attribute at path into buf, without the
+ * trailing newline.
+ */
+static fpga_result sysfs_read_attr(const char *path, char *buf, size_t len)
+{
+	struct sysfs_attr *attr;
+	fpga_result res = FPGA_NOT_FOUND;
+	bool found = false;
+	uint64_t hash;
+	int err;
+
+	if (__atomic_load_n(&sysfs_cache.disabled, __ATOMIC_RELAXED))
+		return sysfs_read_uncached(path, buf, len);
+
+	hash = sysfs_path_hash(path);
+
+	if (pthread_rwlock_rdlock(&sysfs_cache.lock)) {
+		FPGA_MSG("Failed to lock sysfs cache");
+		return sysfs_read_uncached(path, buf, len);
+	}
+
+	attr = sysfs_attr_find(path, hash);
+	if (attr) {
+		found = true;
+		if (attr->immutable)
+			res = strncpy_s(buf, len, attr->value,
+					sizeof(attr->value)) ?
+				FPGA_EXCEPTION : FPGA_OK;
+		else
+			res = sysfs_pread_fd(attr->fd, path, buf, len);
+	}
+
+	err = pthread_rwlock_unlock(&sysfs_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
+	}
+
+	if (!found)
+		return sysfs_attr_add(path, hash, buf, len);
+
+	if (FPGA_OK != res) {
+		// The attribute may have gone away and come back (device
+		// removal, driver reload). Forget the old fd and try again.
+		sysfs_attr_drop(path, hash);
+		return sysfs_read_uncached(path, buf, len);
+	}
+
+	return res;
+}
+
+void sysfs_cache_flush(void)
+{
+	struct sysfs_attr *attr;
+	uint32_t i;
+	int err;
+
+	if (pthread_rwlock_wrlock(&sysfs_cache.lock)) {
+		FPGA_MSG("Failed to lock sysfs cache");
+		return;
+	}
+
+	for (i = 0; i < SYSFS_CACHE_BUCKETS; ++i) {
+		while ((attr = sysfs_cache.buckets[i]) != NULL)
+			sysfs_attr_unlink(attr);
+	}
+
+	err = pthread_rwlock_unlock(&sysfs_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
+	}
+}
+
+/*
+ * Forget the values of immutable attributes, so that a device found by a
+ * new scan is not described with the values of the one it replaced.
+ */
+void sysfs_cache_revalidate(void)
+{
+	struct sysfs_attr *attr;
+	struct sysfs_attr *next;
+	uint32_t i;
+	int err;
+
+	if (pthread_rwlock_wrlock(&sysfs_cache.lock)) {
+		FPGA_MSG("Failed to lock sysfs cache");
+		return;
+	}
+
+	for (i = 0; i < SYSFS_CACHE_BUCKETS; ++i) {
+		for (attr = sysfs_cache.buckets[i]; attr; attr = next) {
+			next = attr->next;
+			if (attr->immutable)
+				sysfs_attr_unlink(attr);
 		}
-	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && (unsigned)b < sizeof(buf));
+	}
 
-	// erase \n
-	buf[b-1] = 0;
+	err = pthread_rwlock_unlock(&sysfs_cache.lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
+	}
+}
 
-	*u = strtoul(buf, NULL, 0);
+void sysfs_cache_enable(bool enable)
+{
+	__atomic_store_n(&sysfs_cache.disabled, !enable, __ATOMIC_RELAXED);
+	if (!enable)
+		sysfs_cache_flush();
+}
+
+//
+// sysfs access (read/write) functions
+//
+
+fpga_result sysfs_read_int(const char *path, int *i)
+{
+	fpga_result res;
+	char buf[SYSFS_PATH_MAX];
+
+	if (path == NULL) {
+		FPGA_ERR("Invalid input path");
+		return FPGA_INVALID_PARAM;
+	}
+
+	res = sysfs_read_attr(path, buf, sizeof(buf));
+	if (FPGA_OK != res)
+		return res;
+
+	*i = atoi(buf);
 
-	close(fd);
 	return FPGA_OK;
+}
 
-out_close:
-	close(fd);
-	return FPGA_NOT_FOUND;
+fpga_result sysfs_read_u32(const char *path, uint32_t *u)
+{
+	fpga_result res;
+	char buf[SYSFS_PATH_MAX];
+
+	if (path == NULL) {
+		FPGA_ERR("Invalid input path");
+		return FPGA_INVALID_PARAM;
+	}
+
+	res = sysfs_read_attr(path, buf, sizeof(buf));
+	if (FPGA_OK != res)
+		return res;
+
+	*u = strtoul(buf, NULL, 0);
+
+	return FPGA_OK;
 }
 
 // read tuple separated by 'sep' character
 fpga_result sysfs_read_u32_pair(const char *path, uint32_t *u1, uint32_t *u2,
 				 char sep)
 {
-	int fd;
-	int res;
+	fpga_result res;
 	char buf[SYSFS_PATH_MAX];
-	int b;
 	char *c;
 	uint32_t x1, x2;
 
@@ -171,106 +461,46 @@ fpga_result sysfs_read_u32_pair(const char *path, uint32_t *u1, uint32_t *u2,
 		return FPGA_INVALID_PARAM;
 	}
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		FPGA_MSG("open(%s) failed", path);
-		return FPGA_NOT_FOUND;
-	}
-
-	if ((off_t)-1 == lseek(fd, 0, SEEK_SET)) {
-		FPGA_MSG("seek failed");
-		goto out_close;
-	}
-
-	b = 0;
-
-	do {
-		res = read(fd, buf+b, sizeof(buf)-b);
-		if (res <= 0) {
-			FPGA_MSG("Read from %s failed", path);
-			goto out_close;
-		}
-		b += res;
-		if (((unsigned)b > sizeof(buf)) || (b <= 0)) {
-			FPGA_MSG("Unexpected size reading from %s", path);
-			goto out_close;
-		}
-	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && (unsigned)b < sizeof(buf));
-
-	// erase \n
-	buf[b-1] = 0;
+	res = sysfs_read_attr(path, buf, sizeof(buf));
+	if (FPGA_OK != res)
+		return res;
 
 	// read first value
 	x1 = strtoul(buf, &c, 0);
 	if (*c != sep) {
 		FPGA_MSG("couldn't find separation character '%c' in '%s'", sep, path);
-		goto out_close;
+		return FPGA_NOT_FOUND;
 	}
 	// read second value
 	x2 = strtoul(c+1, &c, 0);
 	if (*c != '\0') {
 		FPGA_MSG("unexpected character '%c' in '%s'", *c, path);
-		goto out_close;
+		return FPGA_NOT_FOUND;
 	}
 
 	*u1 = x1;
 	*u2 = x2;
 
-	close(fd);
 	return FPGA_OK;
-
-out_close:
-	close(fd);
-	return FPGA_NOT_FOUND;
 }
 
 fpga_result __FIXME_MAKE_VISIBLE__ sysfs_read_u64(const char *path, uint64_t *u)
 {
-	int fd                     = -1;
-	int res                    = 0;
+	fpga_result res;
 	char buf[SYSFS_PATH_MAX]   = {0};
-	int b                      = 0;
 
 	if (path == NULL) {
 		FPGA_ERR("Invalid input path");
 		return FPGA_INVALID_PARAM;
 	}
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		FPGA_MSG("open(%s) failed", path);
-		return FPGA_NOT_FOUND;
-	}
-
-	if ((off_t)-1 == lseek(fd, 0, SEEK_SET)) {
-		FPGA_MSG("seek failed");
-		goto out_close;
-	}
-
-	do {
-		res = read(fd, buf+b, sizeof(buf)-b);
-		if (res <= 0) {
-			FPGA_MSG("Read from %s failed", path);
-			goto out_close;
-		}
-		b += res;
-		if (((unsigned)b > sizeof(buf)) || (b <= 0)) {
-			FPGA_MSG("Unexpected size reading from %s", path);
-			goto out_close;
-		}
-	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && (unsigned)b < sizeof(buf));
-
-	// erase \n
-	buf[b-1] = 0;
+	res = sysfs_read_attr(path, buf, sizeof(buf));
+	if (FPGA_OK != res)
+		return res;
 
 	*u = strtoull(buf, NULL, 0);
 
-	close(fd);
 	return FPGA_OK;
-
-out_close:
-	close(fd);
-	return FPGA_NOT_FOUND;
 }
 
 fpga_result __FIXME_MAKE_VISIBLE__ sysfs_write_u64(const char *path, uint64_t u)
@@ -323,10 +553,8 @@ out_close:
 
 fpga_result sysfs_read_guid(const char *path, fpga_guid guid)
 {
-	int fd;
-	int res;
+	fpga_result res;
 	char buf[SYSFS_PATH_MAX];
-	int b;
 
 	int i;
 	char tmp;
@@ -337,34 +565,9 @@ fpga_result sysfs_read_guid(const char *path, fpga_guid guid)
 		return FPGA_INVALID_PARAM;
 	}
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		FPGA_MSG("open(%s) failed", path);
-		return FPGA_NOT_FOUND;
-	}
-
-	if ((off_t)-1 == lseek(fd, 0, SEEK_SET)) {
-		FPGA_MSG("seek failed");
-		goto out_close;
-	}
-
-	b = 0;
-
-	do {
-		res = read(fd, buf+b, sizeof(buf)-b);
-		if (res <= 0) {
-			FPGA_MSG("Read from %s failed", path);
-			goto out_close;
-		}
-		b += res;
-		if (((unsigned)b > sizeof(buf)) || (b <= 0)) {
-			FPGA_MSG("Unexpected size reading from %s", path);
-			goto out_close;
-		}
-	} while (buf[b-1] != '\n' && buf[b-1] != '\0' && (unsigned)b < sizeof(buf));
-
-	// erase \n
-	buf[b-1] = 0;
+	res = sysfs_read_attr(path, buf, sizeof(buf));
+	if (FPGA_OK != res)
+		return res;
 
 	for (i = 0 ; i < 32 ; i += 2) {
 		tmp = buf[i+2];
@@ -377,12 +580,7 @@ fpga_result sysfs_read_guid(const char *path, fpga_guid guid)
 		buf[i+2] = tmp;
 	}
 
-	close(fd);
 	return FPGA_OK;
-
-out_close:
-	close(fd);
-	return FPGA_NOT_FOUND;
 }
 
 //
@@ -28,6 +28,7 @@
 #define __FPGA_SYSFS_INT_H__
 
 #include <opae/types.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #define SYSFS_PATH_MAX 256
@@ -85,4 +86,11 @@ fpga_result sysfs_deviceid_from_path(const char *sysfspath,
 fpga_result sysfs_objectid_from_path(const char *sysfspath,
 				     uint64_t *object_id);
 
+/*
+ * sysfs attribute cache
+ */
+void sysfs_cache_flush(void);
+void sysfs_cache_revalidate(void);
+void sysfs_cache_enable(bool enable);
+
 #endif // ___FPGA_SYSFS_INT_H__
@@ -29,6 +29,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -38,13 +39,112 @@
 
 #include "token_list_int.h"
 
-/* global list of tokens we've seen */
-static struct token_map *token_root;
-/* mutex to protect global data structures */
-extern pthread_mutex_t global_lock;
+/*
+ * Global registry of tokens we've seen, hashed on sysfspath.
+ *
+ * Lookups (the common case once a process has enumerated) only take the
+ * read side of token_lock, so concurrent fpgaEnumerate() calls don't
+ * serialize. New tokens are built outside the lock and inserted under the
+ * write side; if another thread won the race, its entry is returned and
+ * ours is discarded.
+ */
+#define TOKEN_MIN_BUCKETS 64
+
+static struct {
+	struct token_map **buckets;
+	uint32_t mask;
+	uint32_t count;
+} token_table;
+
+static pthread_rwlock_t token_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* FNV-1a over the sysfs path */
+static uint64_t token_hash(const char *sysfspath)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < SYSFS_PATH_MAX && sysfspath[i]; ++i) {
+		h ^= (uint8_t)sysfspath[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* must be called with token_lock held (either side) */
+static struct token_map *token_find(uint64_t hash, const char *sysfspath,
+				    const char *devpath)
+{
+	struct token_map *tmp;
+
+	if (!token_table.buckets)
+		return NULL;
+
+	for (tmp = token_table.buckets[hash & token_table.mask];
+	     NULL != tmp; tmp = tmp->next) {
+		if (tmp->hash != hash)
+			continue;
+		if (0 != strncmp(sysfspath, tmp->_token.sysfspath,
+				 SYSFS_PATH_MAX))
+			continue;
+		if (devpath && 0 != strncmp(devpath, tmp->_token.devpath,
+					    DEV_PATH_MAX))
+			continue;
+		return tmp;
+	}
+	return NULL;
+}
+
+/* must be called with the write side of token_lock held */
+static bool token_grow(void)
+{
+	uint32_t n = token_table.buckets ? (token_table.mask + 1) * 2
+					 : TOKEN_MIN_BUCKETS;
+	struct token_map **buckets;
+	uint32_t i;
+
+	buckets = calloc(n, sizeof(struct token_map *));
+	if (!buckets)
+		return false;
+
+	if (token_table.buckets) {
+		for (i = 0; i <= token_table.mask; ++i) {
+			struct token_map *tmp = token_table.buckets[i];
+
+			while (tmp) {
+				struct token_map *next = tmp->next;
+
+				tmp->next = buckets[tmp->hash & (n - 1)];
+				buckets[tmp->hash & (n - 1)] = tmp;
+				tmp = next;
+			}
+		}
+		free(token_table.buckets);
+	}
+
+	token_table.buckets = buckets;
+	token_table.mask = n - 1;
+	return true;
+}
+
+static void token_free(struct token_map *tmp)
+{
+	struct error_list *p = tmp->_token.errors;
+
+	// free error list
+	while (p) {
+		struct error_list *q = p->next;
+		free(p);
+		p = q;
+	}
+
+	// invalidate magic (just in case)
+	tmp->_token.magic = FPGA_INVALID_MAGIC;
+	free(tmp);
+}
 
 /**
- * @brief Add entry to linked list for tokens
+ * @brief Add entry to the token registry
  *	Will allocate memory (which is freed by token_cleanup())
  *
  * @param sysfspath
@@ -55,9 +155,11 @@ extern pthread_mutex_t global_lock;
 struct _fpga_token *token_add(const char *sysfspath, const char *devpath)
 {
 	struct token_map *tmp;
+	struct token_map *found;
 	errno_t e;
 	int err = 0;
 	uint32_t num = 0;
+	uint64_t hash;
 	char *endptr = NULL;
 	const char *ptr = strrchr(sysfspath, '.');
 
@@ -74,34 +176,27 @@ struct _fpga_token *token_add(const char *sysfspath, const char *devpath)
 		return NULL;
 	}
 
-	if (pthread_mutex_lock(&global_lock)) {
-		FPGA_MSG("Failed to lock global mutex");
+	hash = token_hash(sysfspath);
+
+	if (pthread_rwlock_rdlock(&token_lock)) {
+		FPGA_MSG("Failed to lock token registry");
 		return NULL;
 	}
 
 	/* Prevent duplicate entries. */
-	for (tmp = token_root ; NULL != tmp ; tmp = tmp->next) {
-		if ((0 == strncmp(sysfspath, tmp->_token.sysfspath,
-						SYSFS_PATH_MAX)) &&
-				(0 == strncmp(devpath, tmp->_token.devpath,
-					      DEV_PATH_MAX))) {
-			err = pthread_mutex_unlock(&global_lock);
-			if (err) {
-				FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
-			}
-			return &tmp->_token;
-		}
+	found = token_find(hash, sysfspath, devpath);
+
+	err = pthread_rwlock_unlock(&token_lock);
+	if (err) {
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
 	}
 
+	if (found)
+		return &found->_token;
+
 	tmp = malloc(sizeof(struct token_map));
-	if (!tmp) {
-		err = pthread_mutex_unlock(&global_lock);
-		if (err) {
-			FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
-		}
+	if (!tmp)
 		return NULL;
-	}
-
 
 	/* populate error list */
 	tmp->_token.errors = NULL;
@@ -114,6 +209,7 @@ struct _fpga_token *token_add(const char *sysfspath, const char *devpath)
 
 	/* assign the instance num from above */
 	tmp->_token.instance = num;
+	tmp->hash = hash;
 
 	/* deep copy token data */
 	e = strncpy_s(tmp->_token.sysfspath, sizeof(tmp->_token.sysfspath),
@@ -130,22 +226,45 @@ struct _fpga_token *token_add(const char *sysfspath, const char *devpath)
 		goto out_free;
 	}
 
-	tmp->next = token_root;
-	token_root = tmp;
+	if (pthread_rwlock_wrlock(&token_lock)) {
+		FPGA_MSG("Failed to lock token registry");
+		goto out_free;
+	}
+
+	/* somebody may have added it while we were unlocked */
+	found = token_find(hash, sysfspath, devpath);
+	if (found) {
+		token_free(tmp);
+		tmp = found;
+		goto out_unlock;
+	}
+
+	if (token_table.count >= token_table.mask + 1 || !token_table.buckets) {
+		if (!token_grow() && !token_table.buckets) {
+			FPGA_MSG("Failed to allocate token registry");
+			err = pthread_rwlock_unlock(&token_lock);
+			if (err) {
+				FPGA_ERR("pthread_rwlock_unlock() failed: %S",
+					 strerror(err));
+			}
+			goto out_free;
+		}
+	}
 
-	err = pthread_mutex_unlock(&global_lock);
+	tmp->next = token_table.buckets[hash & token_table.mask];
+	token_table.buckets[hash & token_table.mask] = tmp;
+	++token_table.count;
+
+out_unlock:
+	err = pthread_rwlock_unlock(&token_lock);
 	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
 	}
 
 	return &tmp->_token;
 
 out_free:
-	free(tmp);
-	err = pthread_mutex_unlock(&global_lock);
-	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
-	}
+	token_free(tmp);
 	return NULL;
 }
 
@@ -178,82 +297,57 @@ struct _fpga_token *token_get_parent(struct _fpga_token *_t)
 			SYSFS_FPGA_CLASS_PATH SYSFS_FME_PATH_FMT,
 			device_instance, device_instance);
 
-	if (pthread_mutex_lock(&global_lock)) {
-		FPGA_MSG("Failed to lock global mutex");
+	if (pthread_rwlock_rdlock(&token_lock)) {
+		FPGA_MSG("Failed to lock token registry");
 		return NULL;
 	}
 
-	for (itr = token_root ; NULL != itr ; itr = itr->next) {
-		if (0 == strncmp(spath, itr->_token.sysfspath,
-					SYSFS_PATH_MAX)) {
-			err = pthread_mutex_unlock(&global_lock);
-			if (err) {
-				FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
-			}
-			return &itr->_token;
-		}
-	}
+	itr = token_find(token_hash(spath), spath, NULL);
 
-	err = pthread_mutex_unlock(&global_lock);
+	err = pthread_rwlock_unlock(&token_lock);
 	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %S", strerror(err));
+		FPGA_ERR("pthread_rwlock_unlock() failed: %S", strerror(err));
 	}
 
-	return NULL;
+	return itr ? &itr->_token : NULL;
 }
 
 /*
- * Clean up remaining entries in linked list
+ * Clean up the token registry
  * Will delete all remaining entries
  */
 void token_cleanup(void)
 {
 	int err = 0;
-	struct error_list *p;
+	uint32_t i;
 
-	err = pthread_mutex_lock(&global_lock);
+	err = pthread_rwlock_wrlock(&token_lock);
 	if (err) {
-		FPGA_ERR("pthread_mutex_lock() failed: %s", strerror(err));
+		FPGA_ERR("pthread_rwlock_wrlock() failed: %s", strerror(err));
 		return;
 	}
 
-	if (!token_root)
+	if (!token_table.buckets)
 		goto out_unlock;
 
-	while (token_root->next) {
-		struct token_map *tmp = token_root;
-		token_root = token_root->next;
+	for (i = 0; i <= token_table.mask; ++i) {
+		struct token_map *tmp = token_table.buckets[i];
 
-		// free error list
-		p = tmp->_token.errors;
-		while (p) {
-			struct error_list *q = p->next;
-			free(p);
-			p = q;
+		while (tmp) {
+			struct token_map *next = tmp->next;
+			token_free(tmp);
+			tmp = next;
 		}
-
-		// invalidate magic (just in case)
-		tmp->_token.magic = FPGA_INVALID_MAGIC;
-		free(tmp);
-	}
-
-	// free error list
-	p = token_root->_token.errors;
-	while (p) {
-		struct error_list *q = p->next;
-		free(p);
-		p = q;
 	}
 
-	// invalidate magic (just in case)
-	token_root->_token.magic = FPGA_INVALID_MAGIC;
-	free(token_root);
-
-	token_root = NULL;
+	free(token_table.buckets);
+	token_table.buckets = NULL;
+	token_table.mask = 0;
+	token_table.count = 0;
 
 out_unlock:
-	err = pthread_mutex_unlock(&global_lock);
+	err = pthread_rwlock_unlock(&token_lock);
 	if (err) {
-		FPGA_ERR("pthread_mutex_unlock() failed: %s", strerror(err));
+		FPGA_ERR("pthread_rwlock_unlock() failed: %s", strerror(err));
 	}
 }
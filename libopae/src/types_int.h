@@ -87,6 +87,10 @@
 #define FPGA_PROPERTY_MAGIC 0x4650474150524f50
 //FPGA event handle magid (FPGAEVNT)
 #define FPGA_EVENT_HANDLE_MAGIC 0x4650474145564e54
+// FPGA buffer pool magic (FPGAPOOL)
+#define FPGA_BUFFER_POOL_MAGIC 0x46504741504f4f4c
+// FPGA event ring magic (FPGAEVRH)
+#define FPGA_EVENT_RING_MAGIC 0x4650474145565248
 // FPGA invalid magic (FPGAINVL)
 #define FPGA_INVALID_MAGIC  0x46504741494e564c
 
@@ -97,6 +101,9 @@
 //Get file descriptor from event handle
 #define FILE_DESCRIPTOR(eh) (((struct _fpga_event_handle *)eh)->fd)
 
+// Number of MMIO regions served by the lock-free access path
+#define FPGA_MMIO_FAST_REGIONS 4
+
 /** System-wide unique FPGA resource identifier */
 struct _fpga_token {
 	uint32_t instance;
@@ -106,18 +113,43 @@ struct _fpga_token {
 	struct error_list *errors;
 };
 
+/*
+ * Mapped MMIO region published for lock-free CSR access.
+ * base is written last (release) and read first (acquire), so a reader
+ * that sees a non-NULL base also sees the matching len.
+ */
+struct _fpga_mmio_region {
+	uint8_t *base;
+	uint64_t len;
+};
+
+/*
+ * Huge page shared by several buffers prepared with FPGA_BUF_PACK.
+ * used has one bit per 4 KiB page of the huge page.
+ */
+struct _fpga_packed_page {
+	uint8_t *addr;
+	uint64_t size;
+	int flags;                      // FPGA_BUF_PAGE_* and FPGA_BUF_NUMA_LOCAL
+	uint64_t n_used;                // 4 KiB pages in use
+	uint64_t *used;
+	struct _fpga_packed_page *next;
+};
+
 /** Process-wide unique FPGA handle */
 struct _fpga_handle {
 	pthread_mutex_t lock;
 	uint64_t magic;
 	fpga_token token;
 	int fddev;                      // file descriptor for the device.
-	int fdfpgad;                    // file descriptor for the event daemon.
+	uint32_t fpgad_events;          // events registered through the event daemon.
 	struct wsid_tracker *wsid_root; // wsid information (list)
 	struct wsid_tracker *mmio_root; // MMIO information (list)
+	struct _fpga_mmio_region mmio_fast[FPGA_MMIO_FAST_REGIONS]; // published MMIO maps
 	void *umsg_virt;	        // umsg Virtual Memory pointer
 	uint64_t umsg_size;	        // umsg Virtual Memory Size
 	uint64_t *umsg_iova;	        // umsg IOVA from driver
+	struct _fpga_packed_page *packed_pages; // huge pages shared by buffers
 };
 
 /** Object property struct
@@ -187,7 +219,92 @@ struct _fpga_event_handle {
 };
 
 /*
- * Global list to store wsid/physptr/length vectors
+ * Read-only mapping of the event ring published by fpgad. The cursor is
+ * the sequence number of the next record to read.
+ */
+struct event_ring;
+struct _fpga_event_ring {
+	pthread_mutex_t lock;
+	uint64_t magic;
+	const struct event_ring *ring;
+	size_t size;
+	uint64_t cursor;
+};
+
+/*
+ * Buffer pool size classes are powers of two from one cache line
+ * (FPGA_POOL_MIN_SHIFT) up to one slab (FPGA_POOL_MAX_SHIFT). Regions are
+ * carved into slabs, each of which serves a single size class.
+ */
+#define FPGA_POOL_MIN_SHIFT   6
+#define FPGA_POOL_MAX_SHIFT   16
+#define FPGA_POOL_NUM_CLASSES (FPGA_POOL_MAX_SHIFT - FPGA_POOL_MIN_SHIFT + 1)
+#define FPGA_POOL_SLAB_SIZE   (1UL << FPGA_POOL_MAX_SHIFT)
+#define FPGA_POOL_MAX_REGIONS 64
+
+/*
+ * Free chunk of a buffer pool; the link is stored in the chunk itself
+ */
+struct _fpga_pool_chunk {
+	struct _fpga_pool_chunk *next;
+};
+
+/*
+ * Pinned memory region of a buffer pool. Slabs start slab_off bytes into
+ * the region, where the IO address is slab aligned.
+ */
+struct _fpga_pool_region {
+	uint8_t  *base;
+	uint64_t  len;
+	uint64_t  iova;
+	uint64_t  wsid;
+	uint64_t  slab_off;
+	uint64_t  n_slabs;
+	uint64_t  n_slabs_used;
+	uint8_t  *slab_class;   // size class of each slab (valid if < n_slabs_used)
+};
+
+/*
+ * Per-thread cache of free chunks, one list per size class
+ */
+struct _fpga_pool_tcache {
+	struct _fpga_buffer_pool *pool;
+	struct _fpga_pool_tcache *next;   // all caches of the pool
+	struct _fpga_pool_tcache *prev;
+	struct _fpga_pool_chunk  *head[FPGA_POOL_NUM_CLASSES];
+	uint32_t                  count[FPGA_POOL_NUM_CLASSES];
+};
+
+/*
+ * Pool of sub-allocated shared buffers. lock protects the regions' slab
+ * bookkeeping, the shared free lists and the tcache list; it is only taken
+ * when a thread cache needs refilling or flushing. n_regions is published
+ * with release semantics after the region is fully set up.
+ */
+struct _fpga_buffer_pool {
+	pthread_mutex_t lock;
+	uint64_t magic;
+	fpga_handle handle;
+	uint64_t region_size;
+	int flags;                      // fpgaPrepareBuffer() flags for regions
+	pthread_key_t tcache_key;
+	struct _fpga_pool_tcache *tcaches;
+	struct _fpga_pool_chunk *free_list[FPGA_POOL_NUM_CLASSES];
+	uint32_t n_regions;
+	struct _fpga_pool_region regions[FPGA_POOL_MAX_REGIONS];
+};
+
+/*
+ * Links of a wsid_map in a secondary index chain
+ * (all entries sharing the same index key)
+ */
+struct wsid_link {
+	struct wsid_map *prev;
+	struct wsid_map *next;
+};
+
+/*
+ * Tracked wsid/physptr/length vector
  */
 struct wsid_map {
 	uint64_t         wsid;
@@ -197,24 +314,82 @@ struct wsid_map {
 	uint64_t         offset;
 	uint32_t         index;
 	int              flags;
-	struct wsid_map *next;
+	struct wsid_map *next;       // free list link while unused
+	struct wsid_link index_link; // entries with the same index
+	struct wsid_link addr_link;  // entries with the same addr
+};
+
+/*
+ * Open-addressing hash table slot; wm == NULL marks an empty slot
+ */
+struct wsid_slot {
+	uint64_t         key;
+	struct wsid_map *wm;
+};
+
+/*
+ * Open-addressing (linear probing) hash table from a 64-bit key to a
+ * wsid_map. n_slots is a power of two.
+ */
+struct wsid_hash {
+	uint64_t          n_slots;
+	uint64_t          n_used;
+	struct wsid_slot *slots;
+};
+
+/*
+ * Block of wsid_map entries, allocated together
+ */
+#define WSID_SLAB_ENTRIES 256
+struct wsid_slab {
+	struct wsid_slab *next;
+	struct wsid_map   entries[WSID_SLAB_ENTRIES];
+};
+
+/*
+ * Virtual address range of a tracked buffer and its IO address
+ */
+struct wsid_range {
+	uint64_t addr;
+	uint64_t len;
+	uint64_t phys;
+};
+
+/*
+ * Array of wsid_ranges sorted by addr, for virtual to IO address
+ * translation. Has its own rwlock so that lookups may run concurrently
+ * with each other without taking the handle lock.
+ */
+struct wsid_ranges {
+	pthread_rwlock_t   lock;
+	uint64_t           n_ranges;
+	uint64_t           capacity;
+	struct wsid_range *ranges;
 };
 
 /*
- * Hash table to store wsid_maps
+ * Hash tables to store wsid_maps, keyed by wsid, with secondary indices
+ * by index (MMIO region number) and by virtual address, plus an
+ * interval index over the buffer address ranges
  */
 struct wsid_tracker {
-	uint64_t          n_hash_buckets;
-	struct wsid_map **table;
+	struct wsid_hash  by_wsid;
+	struct wsid_hash  by_index;
+	struct wsid_hash  by_addr;
+	struct wsid_ranges by_range;
+	struct wsid_slab *slabs;
+	struct wsid_map  *free_list;
 };
 
 /*
- * Global list to store tokens received during enumeration
+ * Global registry to store tokens received during enumeration
  * Since tokens as seen by the API are only void*, we need to keep the actual
- * structs somewhere.
+ * structs somewhere. Entries are chained into hash buckets keyed on the
+ * sysfspath and live until token_cleanup().
  */
 struct token_map {
 	struct _fpga_token _token;
+	uint64_t hash;
 	struct token_map *next;
 };
 
@@ -28,59 +28,375 @@
 #include <config.h>
 #endif // HAVE_CONFIG_H
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include "wsid_list_int.h"
 
 /*
  * The code here assumes the caller handles any required mutexes.
- * The logic here is not thread safe on its own.
+ * The logic here is not thread safe on its own. The one exception is
+ * the address range index, which has its own rwlock so that
+ * wsid_find_phys_by_va() may be called without the caller's lock.
  */
 
+/* Grow a hash table once it is more than 3/4 full */
+#define WSID_HASH_FULL(h) (((h)->n_used + 1) * 4 > (h)->n_slots * 3)
+
+#define WSID_LINK(wm, link_off) \
+	((struct wsid_link *)((char *)(wm) + (link_off)))
+
+/**
+ * @brief 64-bit mixing function (splitmix64 finalizer)
+ * @param key
+ *
+ * @return hash of key
+ */
+static inline uint64_t wsid_mix(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+static bool wsid_hash_init(struct wsid_hash *h, uint64_t n_slots)
+{
+	uint64_t n = 1;
+
+	while (n < n_slots)
+		n <<= 1;
+
+	h->slots = calloc(n, sizeof(struct wsid_slot));
+	if (!h->slots)
+		return false;
+
+	h->n_slots = n;
+	h->n_used = 0;
+	return true;
+}
+
+/**
+ * @brief Find the slot holding key
+ * @param h
+ * @param key
+ *
+ * @return slot, or NULL if key is not in the table
+ */
+static struct wsid_slot *wsid_hash_find(struct wsid_hash *h, uint64_t key)
+{
+	uint64_t mask = h->n_slots - 1;
+	uint64_t i = wsid_mix(key) & mask;
+
+	while (h->slots[i].wm) {
+		if (h->slots[i].key == key)
+			return &h->slots[i];
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/* Place key in the first free slot of its probe sequence */
+static void wsid_hash_place(struct wsid_hash *h, uint64_t key,
+			    struct wsid_map *wm)
+{
+	uint64_t mask = h->n_slots - 1;
+	uint64_t i = wsid_mix(key) & mask;
+
+	while (h->slots[i].wm)
+		i = (i + 1) & mask;
+
+	h->slots[i].key = key;
+	h->slots[i].wm = wm;
+	h->n_used += 1;
+}
+
+static bool wsid_hash_grow(struct wsid_hash *h)
+{
+	struct wsid_hash bigger;
+	uint64_t i;
+
+	if (!wsid_hash_init(&bigger, h->n_slots * 2))
+		return false;
+
+	for (i = 0; i < h->n_slots; ++i) {
+		if (h->slots[i].wm)
+			wsid_hash_place(&bigger, h->slots[i].key,
+					h->slots[i].wm);
+	}
+
+	free(h->slots);
+	*h = bigger;
+	return true;
+}
+
+/**
+ * @brief Insert key, which must not already be in the table
+ *        Grows the table as needed.
+ * @param h
+ * @param key
+ * @param wm
+ *
+ * @return true if success, false otherwise
+ */
+static bool wsid_hash_insert(struct wsid_hash *h, uint64_t key,
+			     struct wsid_map *wm)
+{
+	if (WSID_HASH_FULL(h) && !wsid_hash_grow(h))
+		return false;
+
+	wsid_hash_place(h, key, wm);
+	return true;
+}
+
+/**
+ * @brief Remove a slot, shifting back later entries of the probe sequence
+ *        so that no tombstones are needed.
+ * @param h
+ * @param slot
+ */
+static void wsid_hash_remove(struct wsid_hash *h, struct wsid_slot *slot)
+{
+	uint64_t mask = h->n_slots - 1;
+	uint64_t hole = slot - h->slots;
+	uint64_t i = hole;
+
+	for (;;) {
+		uint64_t home;
+
+		i = (i + 1) & mask;
+		if (!h->slots[i].wm)
+			break;
+
+		/* move entry i into the hole unless its home lies
+		 * cyclically in (hole, i] */
+		home = wsid_mix(h->slots[i].key) & mask;
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			h->slots[hole] = h->slots[i];
+			hole = i;
+		}
+	}
+
+	h->slots[hole].wm = NULL;
+	h->slots[hole].key = 0;
+	h->n_used -= 1;
+}
+
+/**
+ * @brief Add wm to the chain of entries sharing key in a secondary index
+ * @param h
+ * @param key
+ * @param wm
+ * @param link_off offset of the wsid_link member of struct wsid_map
+ *
+ * @return true if success, false otherwise
+ */
+static bool wsid_index_add(struct wsid_hash *h, uint64_t key,
+			   struct wsid_map *wm, size_t link_off)
+{
+	struct wsid_slot *slot = wsid_hash_find(h, key);
+
+	WSID_LINK(wm, link_off)->prev = NULL;
+
+	if (slot) {
+		WSID_LINK(wm, link_off)->next = slot->wm;
+		WSID_LINK(slot->wm, link_off)->prev = wm;
+		slot->wm = wm;
+		return true;
+	}
+
+	WSID_LINK(wm, link_off)->next = NULL;
+	return wsid_hash_insert(h, key, wm);
+}
+
+/**
+ * @brief Unlink wm from the chain of entries sharing key
+ * @param h
+ * @param key
+ * @param wm
+ * @param link_off offset of the wsid_link member of struct wsid_map
+ */
+static void wsid_index_del(struct wsid_hash *h, uint64_t key,
+			   struct wsid_map *wm, size_t link_off)
+{
+	struct wsid_link *link = WSID_LINK(wm, link_off);
+
+	if (link->next)
+		WSID_LINK(link->next, link_off)->prev = link->prev;
+
+	if (link->prev) {
+		WSID_LINK(link->prev, link_off)->next = link->next;
+	} else {
+		struct wsid_slot *slot = wsid_hash_find(h, key);
+
+		if (!slot)
+			return;
+		if (link->next)
+			slot->wm = link->next;
+		else
+			wsid_hash_remove(h, slot);
+	}
+}
+
+/**
+ * @brief Take an entry from the free list, allocating a new slab if needed
+ * @param root
+ *
+ * @return entry, or NULL on allocation failure
+ */
+static struct wsid_map *wsid_map_alloc(struct wsid_tracker *root)
+{
+	struct wsid_map *wm;
+
+	if (!root->free_list) {
+		struct wsid_slab *slab = malloc(sizeof(struct wsid_slab));
+		int i;
+
+		if (!slab)
+			return NULL;
+
+		for (i = WSID_SLAB_ENTRIES - 1; i >= 0; --i) {
+			slab->entries[i].next = root->free_list;
+			root->free_list = &slab->entries[i];
+		}
+
+		slab->next = root->slabs;
+		root->slabs = slab;
+	}
+
+	wm = root->free_list;
+	root->free_list = wm->next;
+	return wm;
+}
+
+static void wsid_map_free(struct wsid_tracker *root, struct wsid_map *wm)
+{
+	wm->next = root->free_list;
+	root->free_list = wm;
+}
+
+/* Index of the first range that starts above addr */
+static uint64_t wsid_range_upper(const struct wsid_ranges *r, uint64_t addr)
+{
+	uint64_t lo = 0;
+	uint64_t hi = r->n_ranges;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (r->ranges[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static bool wsid_range_add(struct wsid_ranges *r,
+			   uint64_t addr,
+			   uint64_t len,
+			   uint64_t phys)
+{
+	bool res = true;
+	uint64_t i;
+
+	if (!len)
+		return true;
+
+	pthread_rwlock_wrlock(&r->lock);
+
+	if (r->n_ranges == r->capacity) {
+		uint64_t capacity = r->capacity ? r->capacity * 2 : 16;
+		struct wsid_range *tmp = realloc(r->ranges,
+					capacity * sizeof(struct wsid_range));
+		if (!tmp) {
+			res = false;
+			goto out_unlock;
+		}
+		r->ranges = tmp;
+		r->capacity = capacity;
+	}
+
+	/* Insert after any range with the same start, so the newest wins */
+	i = wsid_range_upper(r, addr);
+	memmove(&r->ranges[i + 1], &r->ranges[i],
+		(r->n_ranges - i) * sizeof(struct wsid_range));
+	r->ranges[i].addr = addr;
+	r->ranges[i].len  = len;
+	r->ranges[i].phys = phys;
+	++r->n_ranges;
+
+out_unlock:
+	pthread_rwlock_unlock(&r->lock);
+	return res;
+}
+
+static void wsid_range_del(struct wsid_ranges *r,
+			   uint64_t addr,
+			   uint64_t len,
+			   uint64_t phys)
+{
+	uint64_t i;
+
+	if (!len)
+		return;
+
+	pthread_rwlock_wrlock(&r->lock);
+
+	i = wsid_range_upper(r, addr);
+	while (i > 0 && r->ranges[i - 1].addr == addr) {
+		--i;
+		if (r->ranges[i].len == len && r->ranges[i].phys == phys) {
+			memmove(&r->ranges[i], &r->ranges[i + 1],
+				(r->n_ranges - i - 1) *
+				sizeof(struct wsid_range));
+			--r->n_ranges;
+			break;
+		}
+	}
+
+	pthread_rwlock_unlock(&r->lock);
+}
+
 /**
  * @brief Initialize a wsid tracker hash table
- * @param n_hash_buckets
+ * @param n_hash_buckets initial capacity; the table grows past it as needed
  *
  * @return
  */
 struct wsid_tracker *wsid_tracker_init(uint32_t n_hash_buckets)
 {
-	if (!n_hash_buckets || (n_hash_buckets > 16384))
+	if (!n_hash_buckets)
 		return NULL;
 
-	struct wsid_tracker *root = malloc(sizeof(struct wsid_tracker));
+	struct wsid_tracker *root = calloc(1, sizeof(struct wsid_tracker));
 	if (!root)
 		return NULL;
 
-	root->n_hash_buckets = n_hash_buckets;
-	root->table = calloc(n_hash_buckets, sizeof(struct wsid_map *));
-	if (!root->table) {
+	if (!wsid_hash_init(&root->by_wsid, n_hash_buckets) ||
+	    !wsid_hash_init(&root->by_index, 4) ||
+	    !wsid_hash_init(&root->by_addr, n_hash_buckets)) {
+		free(root->by_wsid.slots);
+		free(root->by_index.slots);
+		free(root->by_addr.slots);
 		free(root);
 		return NULL;
 	}
 
-	return root;
-}
+	pthread_rwlock_init(&root->by_range.lock, NULL);
 
-/**
- * @brief Map WSID to hash bucket index
- * @param root
- * @param wsid
- *
- * @return bucket index
- */
-static inline uint32_t wsid_hash(struct wsid_tracker *root, uint64_t wsid)
-{
-	uint64_t h = wsid % 17659;
-	return h % root->n_hash_buckets;
+	return root;
 }
 
-
 /**
  * @brief Add entry to WSID tracker
- *        Will allocate memory (which is freed by wsid_del() or
- *        wsid_tracker_cleanup())
+ *        Will allocate memory (which is freed by wsid_tracker_cleanup())
  * @param root
  * @param wsid
  * @param addr
@@ -99,8 +415,7 @@ bool wsid_add(struct wsid_tracker *root,
 	      uint64_t index,
 	      int flags)
 {
-	uint32_t idx = wsid_hash(root, wsid);
-	struct wsid_map *tmp = malloc(sizeof(struct wsid_map));
+	struct wsid_map *tmp = wsid_map_alloc(root);
 
 	if (!tmp)
 		return false;
@@ -112,10 +427,35 @@ bool wsid_add(struct wsid_tracker *root,
 	tmp->offset = offset;
 	tmp->index  = index;
 	tmp->flags  = flags;
-	tmp->next   = root->table[idx];
+	tmp->next   = NULL;
+
+	if (!wsid_hash_insert(&root->by_wsid, wsid, tmp))
+		goto out_free;
+
+	if (!wsid_index_add(&root->by_index, tmp->index, tmp,
+			    offsetof(struct wsid_map, index_link)))
+		goto out_del_wsid;
+
+	if (!wsid_index_add(&root->by_addr, addr, tmp,
+			    offsetof(struct wsid_map, addr_link)))
+		goto out_del_index;
+
+	if (!wsid_range_add(&root->by_range, addr, len, phys))
+		goto out_del_addr;
 
-	root->table[idx] = tmp;
 	return true;
+
+out_del_addr:
+	wsid_index_del(&root->by_addr, addr, tmp,
+		       offsetof(struct wsid_map, addr_link));
+out_del_index:
+	wsid_index_del(&root->by_index, tmp->index, tmp,
+		       offsetof(struct wsid_map, index_link));
+out_del_wsid:
+	wsid_hash_remove(&root->by_wsid, wsid_hash_find(&root->by_wsid, wsid));
+out_free:
+	wsid_map_free(root, tmp);
+	return false;
 }
 
 /**
@@ -128,34 +468,26 @@ bool wsid_add(struct wsid_tracker *root,
  */
 bool wsid_del(struct wsid_tracker *root, uint64_t wsid)
 {
-	uint32_t idx = wsid_hash(root, wsid);
-	struct wsid_map *tmp = root->table[idx];
+	struct wsid_slot *slot = wsid_hash_find(&root->by_wsid, wsid);
+	struct wsid_map *tmp;
 
-	if (!tmp)
-		return false; /* empty list */
-
-	if (tmp->wsid == wsid) { /* first entry */
-		root->table[idx] = root->table[idx]->next;
-		free(tmp);
-		return true;
-	}
-
-	while (tmp->next && tmp->next->wsid != wsid) { /* find */
-		tmp = tmp->next;
-	}
-
-	if (!tmp->next)
+	if (!slot)
 		return false; /* not found */
 
-	struct wsid_map *tmp2 = tmp->next;
-	tmp->next = tmp->next->next;
-	free(tmp2);
+	tmp = slot->wm;
+	wsid_hash_remove(&root->by_wsid, slot);
+	wsid_index_del(&root->by_index, tmp->index, tmp,
+		       offsetof(struct wsid_map, index_link));
+	wsid_index_del(&root->by_addr, tmp->addr, tmp,
+		       offsetof(struct wsid_map, addr_link));
+	wsid_range_del(&root->by_range, tmp->addr, tmp->len, tmp->phys);
+	wsid_map_free(root, tmp);
 
 	return true;
 }
 
 /**
- * @brief Clean up remaining entries in linked list
+ * @brief Clean up remaining entries in tracker
  *        Will delete all remaining entries
  *
  * @param root
@@ -163,29 +495,34 @@ bool wsid_del(struct wsid_tracker *root, uint64_t wsid)
 void wsid_tracker_cleanup(struct wsid_tracker *root,
 			  void (*clean)(struct wsid_map *))
 {
-	uint32_t idx;
+	uint64_t idx;
 
 	if (!root)
 		return;
 
-	for (idx = 0; idx < root->n_hash_buckets; idx += 1) {
-		struct wsid_map *tmp = root->table[idx];
-
-		while (tmp) {
-			struct wsid_map *tmp2 = tmp->next;
-			if (clean)
-				clean(tmp);
-			free(tmp);
-			tmp = tmp2;
+	if (clean) {
+		for (idx = 0; idx < root->by_wsid.n_slots; idx += 1) {
+			if (root->by_wsid.slots[idx].wm)
+				clean(root->by_wsid.slots[idx].wm);
 		}
 	}
 
-	free(root->table);
+	while (root->slabs) {
+		struct wsid_slab *tmp = root->slabs->next;
+		free(root->slabs);
+		root->slabs = tmp;
+	}
+
+	free(root->by_wsid.slots);
+	free(root->by_index.slots);
+	free(root->by_addr.slots);
+	pthread_rwlock_destroy(&root->by_range.lock);
+	free(root->by_range.ranges);
 	free(root);
 }
 
 /**
- * @ brief Find entry in linked list
+ * @ brief Find entry by wsid
  *
  * @param root
  * @param wsid
@@ -194,17 +531,14 @@ void wsid_tracker_cleanup(struct wsid_tracker *root,
  */
 struct wsid_map *wsid_find(struct wsid_tracker *root, uint64_t wsid)
 {
-	uint32_t idx = wsid_hash(root, wsid);
-	struct wsid_map *tmp = root->table[idx];
-
-	while (tmp && tmp->wsid != wsid)
-		tmp = tmp->next;
+	struct wsid_slot *slot = wsid_hash_find(&root->by_wsid, wsid);
 
-	return tmp;
+	return slot ? slot->wm : NULL;
 }
 
 /**
- * @ brief Find entry in linked list
+ * @ brief Find entry by index
+ *        If several entries share the index, returns the newest one.
  *
  * @param root
  * @param index
@@ -213,21 +547,53 @@ struct wsid_map *wsid_find(struct wsid_tracker *root, uint64_t wsid)
  */
 struct wsid_map *wsid_find_by_index(struct wsid_tracker *root, uint32_t index)
 {
-    /*
-     * The hash table isn't set up for finding by index, but this search is
-     * used only for MMIO spaces, which should have a small number of entries.
-     */
-	uint32_t idx;
-	for (idx = 0; idx < root->n_hash_buckets; idx += 1) {
-		struct wsid_map *tmp = root->table[idx];
+	struct wsid_slot *slot = wsid_hash_find(&root->by_index, index);
 
-		while (tmp && tmp->index != index)
-			tmp = tmp->next;
+	return slot ? slot->wm : NULL;
+}
 
-		if (tmp)
-			return tmp;
-	}
+/**
+ * @ brief Find entry by (start) virtual address
+ *        If several entries share the address, returns the newest one.
+ *
+ * @param root
+ * @param addr
+ *
+ * @return
+ */
+struct wsid_map *wsid_find_by_addr(struct wsid_tracker *root, uint64_t addr)
+{
+	struct wsid_slot *slot = wsid_hash_find(&root->by_addr, addr);
 
-	return NULL;
+	return slot ? slot->wm : NULL;
 }
 
+/**
+ * @brief Translate a virtual address inside a tracked buffer
+ *        Takes the range index read lock only, so concurrent callers
+ *        do not serialize. O(log n) in the number of buffers.
+ *
+ * @param root
+ * @param va    any address within [addr, addr + len) of a buffer
+ * @param phys  returns the IO address corresponding to va
+ *
+ * @return true if va lies within a tracked buffer, false otherwise
+ */
+bool wsid_find_phys_by_va(struct wsid_tracker *root, uint64_t va,
+			  uint64_t *phys)
+{
+	struct wsid_ranges *r = &root->by_range;
+	bool found = false;
+	uint64_t i;
+
+	pthread_rwlock_rdlock(&r->lock);
+
+	i = wsid_range_upper(r, va);
+	if (i > 0 && va - r->ranges[i - 1].addr < r->ranges[i - 1].len) {
+		*phys = r->ranges[i - 1].phys + (va - r->ranges[i - 1].addr);
+		found = true;
+	}
+
+	pthread_rwlock_unlock(&r->lock);
+	return found;
+}
@@ -49,5 +49,8 @@ uint64_t wsid_gen(void);
 
 struct wsid_map *wsid_find(struct wsid_tracker *root, uint64_t wsid);
 struct wsid_map *wsid_find_by_index(struct wsid_tracker *root, uint32_t index);
+struct wsid_map *wsid_find_by_addr(struct wsid_tracker *root, uint64_t addr);
+bool wsid_find_phys_by_va(struct wsid_tracker *root, uint64_t va,
+			  uint64_t *phys);
 
 #endif // ___FPGA_COMMON_INT_H__
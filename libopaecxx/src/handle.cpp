@@ -109,6 +109,24 @@ void handle::write_csr64(uint64_t offset, uint64_t value, uint32_t csr_space) {
   ASSERT_FPGA_OK(fpgaWriteMMIO64(handle_, csr_space, offset, value));
 }
 
+void handle::write_csrs(const std::vector<fpga_mmio_op> &ops,
+                        uint32_t csr_space) {
+  ASSERT_FPGA_OK(fpgaWriteMMIOv(handle_, csr_space, ops.data(),
+                                static_cast<uint32_t>(ops.size())));
+}
+
+void handle::read_csrs(std::vector<fpga_mmio_op> &ops,
+                       uint32_t csr_space) const {
+  ASSERT_FPGA_OK(fpgaReadMMIOv(handle_, csr_space, ops.data(),
+                               static_cast<uint32_t>(ops.size())));
+}
+
+void handle::access_csrs(std::vector<fpga_mmio_op> &ops,
+                         uint32_t csr_space) {
+  ASSERT_FPGA_OK(fpgaMMIOv(handle_, csr_space, ops.data(),
+                           static_cast<uint32_t>(ops.size())));
+}
+
 uint8_t *handle::mmio_ptr(uint64_t offset, uint32_t csr_space) const {
   uint8_t *base = nullptr;
 
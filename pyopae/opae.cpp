@@ -145,7 +145,11 @@ PYBIND11_MODULE(_opae, m) {
       .def("write_csr32", &handle::write_csr32, handle_doc_write_csr32(),
            py::arg("offset"), py::arg("value"), py::arg("csr_space") = 0)
       .def("write_csr64", &handle::write_csr64, handle_doc_write_csr64(),
-           py::arg("offset"), py::arg("value"), py::arg("csr_space") = 0);
+           py::arg("offset"), py::arg("value"), py::arg("csr_space") = 0)
+      .def("write_csrs", handle_write_csrs, handle_doc_write_csrs(),
+           py::arg("writes"), py::arg("csr_space") = 0)
+      .def("read_csrs", handle_read_csrs, handle_doc_read_csrs(),
+           py::arg("reads"), py::arg("csr_space") = 0);
 
   // define shared_buffer class
   m.def("allocate_shared_buffer", shared_buffer_allocate,
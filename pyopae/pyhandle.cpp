@@ -173,3 +173,60 @@ const char *handle_doc_write_csr64() {
       csr_space: The CSR space to write from. Default is 0.
   )opaedoc";
 }
+
+const char *handle_doc_write_csrs() {
+  return R"opaedoc(
+    Write several CSRs belonging to a resource associated with a handle
+    in one call. The writes are validated as a whole and issued in order.
+    Args:
+      writes: A list of (offset, value, width) tuples, where width is the
+              register size in bytes (4 or 8).
+      csr_space: The CSR space to write to. Default is 0.
+  )opaedoc";
+}
+
+void handle_write_csrs(
+    handle::ptr_t hnd,
+    const std::vector<std::tuple<uint64_t, uint64_t, uint32_t>> &writes,
+    uint32_t csr_space) {
+  std::vector<fpga_mmio_op> ops(writes.size());
+  for (size_t i = 0; i < writes.size(); ++i) {
+    ops[i].offset = std::get<0>(writes[i]);
+    ops[i].value = std::get<1>(writes[i]);
+    ops[i].width = std::get<2>(writes[i]);
+    ops[i].flags = 0;
+  }
+  hnd->write_csrs(ops, csr_space);
+}
+
+const char *handle_doc_read_csrs() {
+  return R"opaedoc(
+    Read several CSRs belonging to a resource associated with a handle
+    in one call. The reads are validated as a whole and issued in order.
+    Args:
+      reads: A list of (offset, width) tuples, where width is the
+             register size in bytes (4 or 8).
+      csr_space: The CSR space to read from. Default is 0.
+    Returns:
+      A list with the value read from each register.
+  )opaedoc";
+}
+
+std::vector<uint64_t> handle_read_csrs(
+    handle::ptr_t hnd, const std::vector<std::tuple<uint64_t, uint32_t>> &reads,
+    uint32_t csr_space) {
+  std::vector<fpga_mmio_op> ops(reads.size());
+  for (size_t i = 0; i < reads.size(); ++i) {
+    ops[i].offset = std::get<0>(reads[i]);
+    ops[i].value = 0;
+    ops[i].width = std::get<1>(reads[i]);
+    ops[i].flags = 0;
+  }
+  hnd->read_csrs(ops, csr_space);
+
+  std::vector<uint64_t> values(ops.size());
+  for (size_t i = 0; i < ops.size(); ++i) {
+    values[i] = ops[i].value;
+  }
+  return values;
+}
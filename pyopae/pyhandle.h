@@ -29,6 +29,9 @@
 #include <opae/cxx/core/handle.h>
 #include <pybind11/pybind11.h>
 
+#include <tuple>
+#include <vector>
+
 const char *handle_doc_open();
 opae::fpga::types::handle::ptr_t handle_open(
     opae::fpga::types::token::ptr_t tok, int flags = 0);
@@ -52,3 +55,15 @@ const char *handle_doc_read_csr64();
 const char *handle_doc_write_csr32();
 const char *handle_doc_write_csr64();
 
+const char *handle_doc_write_csrs();
+void handle_write_csrs(
+    opae::fpga::types::handle::ptr_t hnd,
+    const std::vector<std::tuple<uint64_t, uint64_t, uint32_t>> &writes,
+    uint32_t csr_space = 0);
+
+const char *handle_doc_read_csrs();
+std::vector<uint64_t> handle_read_csrs(
+    opae::fpga::types::handle::ptr_t hnd,
+    const std::vector<std::tuple<uint64_t, uint32_t>> &reads,
+    uint32_t csr_space = 0);
+
@@ -292,6 +292,13 @@ class TestHandle(unittest.TestCase):
         read_value = self.handle.read_csr64(offset)
         assert read_value == write_value
 
+    def test_mmio_vectored(self):
+        self.handle.write_csrs([(0x100, 0xc0de, 4), (0x108, 0xc0ffee, 8)])
+        assert self.handle.read_csrs([(0x100, 4), (0x108, 8)]) == \
+            [0xc0de, 0xc0ffee]
+        with self.assertRaises(RuntimeError):
+            self.handle.write_csrs([(0x100, 0, 4), (0x102, 0, 4)])
+
     def test_close_mmio(self):
         self.handle.close()
         assert not self.handle
@@ -0,0 +1,145 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+
+/*
+ * Enumeration benchmark
+ *
+ * Compares the cost of fpgaEnumerate scanning sysfs on every call
+ * against answering from the enumeration cache, for all objects and for
+ * accelerators only. The miss column invalidates the cache before each
+ * call, so it is the cost of a rescan that refills it.
+ *
+ * Run it with the mock driver preloaded to measure without a card.
+ *
+ * Usage: enum-bench [iterations]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <opae/fpga.h>
+
+#define BENCH_DEFAULT_ITERATIONS 1000
+#define BENCH_MAX_TOKENS         16
+
+enum bench_mode {
+	BENCH_COLD,
+	BENCH_MISS,
+	BENCH_CACHED
+};
+
+/*
+ * run : enumerate count times and return the average cost of one
+ *       fpgaEnumerate (including destroying its tokens) in microseconds
+ */
+static double run(fpga_properties *filter, uint32_t num_filters,
+		  uint64_t count, enum bench_mode mode)
+{
+	fpga_token tokens[BENCH_MAX_TOKENS];
+	uint32_t num_matches = 0;
+	struct timespec start;
+	struct timespec end;
+	fpga_result res;
+	uint64_t i;
+	uint32_t j;
+
+	if (mode == BENCH_COLD)
+		res = fpgaEnumerateCacheDisable();
+	else
+		res = fpgaEnumerateCacheEnable(0);
+	if (res != FPGA_OK)
+		return 0.0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0 ; i < count ; ++i) {
+		if (mode == BENCH_MISS)
+			fpgaEnumerateCacheInvalidate();
+		res = fpgaEnumerate(filter, num_filters, tokens,
+				    BENCH_MAX_TOKENS, &num_matches);
+		if (res != FPGA_OK) {
+			fprintf(stderr, "fpgaEnumerate failed: %s\n",
+				fpgaErrStr(res));
+			return 0.0;
+		}
+		if (num_matches > BENCH_MAX_TOKENS)
+			num_matches = BENCH_MAX_TOKENS;
+		for (j = 0 ; j < num_matches ; ++j)
+			fpgaDestroyToken(&tokens[j]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	fpgaEnumerateCacheDisable();
+
+	return ((end.tv_sec - start.tv_sec) * 1e6 +
+		(end.tv_nsec - start.tv_nsec) / 1e3) / count;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count = BENCH_DEFAULT_ITERATIONS;
+	fpga_properties filter = NULL;
+	uint32_t num_matches = 0;
+	fpga_result res;
+	int ret = 1;
+
+	if (argc > 1)
+		count = strtoull(argv[1], NULL, 0);
+	if (!count) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	res = fpgaGetProperties(NULL, &filter);
+	if (res == FPGA_OK)
+		res = fpgaPropertiesSetObjectType(filter, FPGA_ACCELERATOR);
+	if (res == FPGA_OK)
+		res = fpgaEnumerate(NULL, 0, NULL, 0, &num_matches);
+	if (res == FPGA_OK && num_matches == 0)
+		res = FPGA_NOT_FOUND;
+	if (res != FPGA_OK) {
+		fprintf(stderr, "nothing to enumerate: %s\n",
+			fpgaErrStr(res));
+		goto out;
+	}
+
+	printf("fpgaEnumerate cost over %" PRIu64 " calls (usec)\n", count);
+	printf("%-14s %10s %10s %10s\n", "filter", "sysfs", "miss", "cached");
+	printf("%-14s %10.1f %10.1f %10.1f\n", "none",
+	       run(NULL, 0, count, BENCH_COLD),
+	       run(NULL, 0, count, BENCH_MISS),
+	       run(NULL, 0, count, BENCH_CACHED));
+	printf("%-14s %10.1f %10.1f %10.1f\n", "accelerator",
+	       run(&filter, 1, count, BENCH_COLD),
+	       run(&filter, 1, count, BENCH_MISS),
+	       run(&filter, 1, count, BENCH_CACHED));
+	ret = 0;
+
+out:
+	if (filter)
+		fpgaDestroyProperties(&filter);
+	return ret;
+}
@@ -0,0 +1,264 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+
+/*
+ * fpgad registration benchmark
+ *
+ * Compares the rate of event registrations sent to fpgad over a new
+ * connection each (as when every handle opened its own), over the
+ * process-wide connection one at a time, and in full batches.
+ *
+ * Requests go to a stand-in for fpgad in this process, which answers
+ * every entry with FPGA_OK, so that only the transport is measured.
+ * Each registration is followed by its unregistration.
+ *
+ * Usage: event-daemon-bench [registrations]
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <opae/fpga.h>
+
+#include "event_int.h"
+
+#define BENCH_DEFAULT_REGISTRATIONS 4096
+#define BENCH_DEVICE "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-port.0"
+
+enum bench_mode {
+	BENCH_CONNECTION,
+	BENCH_SHARED,
+	BENCH_BATCHED
+};
+
+/*
+ * serve : answer the batches of one client connection
+ */
+static void *serve(void *p)
+{
+	int conn = (int)(intptr_t)p;
+	struct event_batch_header hdr;
+	struct event_batch_entry entries[EVENT_BATCH_MAX];
+	struct event_batch_response rsp;
+	char buf[CMSG_SPACE(EVENT_BATCH_MAX * sizeof(int))];
+	struct cmsghdr *cmh;
+	struct msghdr mh;
+	struct iovec iov;
+	size_t len;
+	uint32_t i;
+	int n;
+
+	for (;;) {
+		iov.iov_base = &hdr;
+		iov.iov_len = sizeof(hdr);
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = buf;
+		mh.msg_controllen = sizeof(buf);
+
+		if (recvmsg(conn, &mh, MSG_WAITALL) != sizeof(hdr))
+			break;
+		for (cmh = CMSG_FIRSTHDR(&mh) ; cmh ;
+		     cmh = CMSG_NXTHDR(&mh, cmh)) {
+			n = (cmh->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (i = 0 ; i < (uint32_t)n ; ++i)
+				close(((int *)CMSG_DATA(cmh))[i]);
+		}
+
+		if (hdr.type != EVENT_BATCH || hdr.count > EVENT_BATCH_MAX)
+			break;
+		len = hdr.count * sizeof(entries[0]);
+		if (len && recv(conn, entries, len, MSG_WAITALL) != (ssize_t)len)
+			break;
+
+		memset(&rsp, 0, sizeof(rsp));
+		rsp.version = EVENT_PROTOCOL_VERSION;
+		rsp.id = hdr.id;
+		rsp.count = hdr.count;
+		for (i = 0 ; i < hdr.count ; ++i)
+			rsp.result[i] = FPGA_OK;
+
+		if (send(conn, &rsp, sizeof(rsp), MSG_NOSIGNAL) != sizeof(rsp))
+			break;
+	}
+
+	close(conn);
+	return NULL;
+}
+
+/*
+ * acceptor : stand-in for fpgad, one thread per client connection
+ */
+static void *acceptor(void *p)
+{
+	int sock = (int)(intptr_t)p;
+	pthread_t thread;
+	int conn;
+
+	while ((conn = accept(sock, NULL, NULL)) >= 0) {
+		if (pthread_create(&thread, NULL, serve,
+				   (void *)(intptr_t)conn)) {
+			close(conn);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return NULL;
+}
+
+/*
+ * fake_fpgad : listen on path and point libopae at it
+ */
+static int fake_fpgad(const char *path)
+{
+	struct sockaddr_un addr;
+	pthread_t thread;
+	int sock;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, SOMAXCONN) ||
+	    pthread_create(&thread, NULL, acceptor, (void *)(intptr_t)sock)) {
+		close(sock);
+		return -1;
+	}
+	pthread_detach(thread);
+
+	setenv("LIBOPAE_EVENT_SOCKET", path, 1);
+	return 0;
+}
+
+/*
+ * run : send count registrations, each followed by its unregistration,
+ *       and return the number of registrations per second
+ */
+static double run(enum bench_mode mode, uint64_t count, int efd)
+{
+	struct event_batch_entry entries[EVENT_BATCH_MAX];
+	fpga_result results[EVENT_BATCH_MAX];
+	int fds[EVENT_BATCH_MAX / 2];
+	uint32_t per_request = mode == BENCH_BATCHED ? EVENT_BATCH_MAX : 2;
+	struct timespec start;
+	struct timespec end;
+	fpga_result res;
+	uint64_t i;
+	uint32_t j;
+
+	for (j = 0 ; j < EVENT_BATCH_MAX ; ++j) {
+		memset(&entries[j], 0, sizeof(entries[j]));
+		entries[j].op = j % 2 ? EVENT_OP_UNREGISTER :
+			EVENT_OP_REGISTER;
+		entries[j].event = FPGA_EVENT_ERROR;
+		entries[j].owner = j / 2;
+		strncpy(entries[j].device, BENCH_DEVICE,
+			sizeof(entries[j].device) - 1);
+	}
+	for (j = 0 ; j < EVENT_BATCH_MAX / 2 ; ++j)
+		fds[j] = efd;
+
+	event_daemon_disconnect();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0 ; i < count ; i += per_request / 2) {
+		if (mode == BENCH_CONNECTION)
+			event_daemon_disconnect();
+		res = event_daemon_request(entries, fds, per_request,
+					   results);
+		if (res == FPGA_OK && results[0] != FPGA_OK)
+			res = results[0];
+		if (res != FPGA_OK) {
+			fprintf(stderr, "request failed: %s\n",
+				fpgaErrStr(res));
+			return 0.0;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return i / ((end.tv_sec - start.tv_sec) +
+		    (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count = BENCH_DEFAULT_REGISTRATIONS;
+	char path[64];
+	int efd;
+	int ret = 1;
+
+	if (argc > 1)
+		count = strtoull(argv[1], NULL, 0);
+	if (count < EVENT_BATCH_MAX / 2) {
+		fprintf(stderr, "Usage: %s [registrations]\n", argv[0]);
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "/tmp/opae_event_bench.%d", getpid());
+	if (fake_fpgad(path)) {
+		fprintf(stderr, "can't listen on %s: %s\n", path,
+			strerror(errno));
+		return 1;
+	}
+
+	efd = eventfd(0, 0);
+	if (efd < 0) {
+		fprintf(stderr, "eventfd failed: %s\n", strerror(errno));
+		goto out_unlink;
+	}
+
+	printf("fpgad registrations of %" PRIu64 " events (per sec)\n",
+	       count);
+	printf("%-24s %12.0f\n", "connection each",
+	       run(BENCH_CONNECTION, count, efd));
+	printf("%-24s %12.0f\n", "shared connection",
+	       run(BENCH_SHARED, count, efd));
+	printf("batches of %-13d %12.0f\n", EVENT_BATCH_MAX / 2,
+	       run(BENCH_BATCHED, count, efd));
+	ret = 0;
+
+	event_daemon_disconnect();
+	close(efd);
+out_unlink:
+	unlink(path);
+	return ret;
+}
@@ -0,0 +1,298 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+
+/*
+ * fpgad event fan-out benchmark
+ *
+ * Registers FPGA_EVENT_ERROR for the first accelerator from many
+ * clients, each on its own connection to fpgad as separate processes
+ * would be, raises a port error and reports how long after the error
+ * each client's eventfd became readable. The first notification waits
+ * for fpgad's next poll of the errors file; the spread from first to last
+ * is the cost of the fan-out itself.
+ *
+ * The error is cleared on exit. fpgad has to see it cleared before the
+ * next run can raise it again, so leave a few seconds between runs.
+ *
+ * Needs a running fpgad. Without a card, run both fpgad and the
+ * benchmark with the mock driver preloaded; the error is then raised in
+ * the mock sysfs tree.
+ *
+ * Usage: event-fanout-bench [clients]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <opae/fpga.h>
+
+#include "types_int.h"
+#include "event_int.h"
+
+#define BENCH_DEFAULT_CLIENTS 128
+#define BENCH_TIMEOUT_MS      10000
+#define BENCH_ERROR_CSR       0x1 /* TxCh0Overflow */
+
+struct client {
+	int sock;
+	int efd;
+};
+
+static double now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * write_errors : store value to the port errors file
+ */
+static int write_errors(const char *path, uint64_t value)
+{
+	char buf[32];
+	int len;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+
+	len = snprintf(buf, sizeof(buf), "0x%" PRIx64 "\n", value);
+	if (write(fd, buf, len) != len) {
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/*
+ * client_register : connect one client to fpgad and register its eventfd
+ *                   for errors on device
+ */
+static fpga_result client_register(struct client *c, uint32_t id,
+				   const char *device)
+{
+	struct {
+		struct event_batch_header hdr;
+		struct event_batch_entry entry;
+	} req;
+	struct event_batch_response rsp;
+	char buf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &req, sizeof(req) };
+	struct msghdr mh;
+	struct cmsghdr *cmh;
+
+	c->efd = eventfd(0, 0);
+	if (c->efd < 0)
+		return FPGA_EXCEPTION;
+	c->sock = event_daemon_connect();
+	if (c->sock < 0)
+		return FPGA_NO_DAEMON;
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.type = EVENT_BATCH;
+	req.hdr.version = EVENT_PROTOCOL_VERSION;
+	req.hdr.id = id;
+	req.hdr.count = 1;
+	req.entry.op = EVENT_OP_REGISTER;
+	req.entry.event = FPGA_EVENT_ERROR;
+	req.entry.owner = id;
+	snprintf(req.entry.device, sizeof(req.entry.device), "%s", device);
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = buf;
+	mh.msg_controllen = sizeof(buf);
+	cmh = CMSG_FIRSTHDR(&mh);
+	cmh->cmsg_len = CMSG_LEN(sizeof(int));
+	cmh->cmsg_level = SOL_SOCKET;
+	cmh->cmsg_type = SCM_RIGHTS;
+	memcpy(CMSG_DATA(cmh), &c->efd, sizeof(int));
+
+	if (sendmsg(c->sock, &mh, 0) != sizeof(req))
+		return FPGA_EXCEPTION;
+	if (recv(c->sock, &rsp, sizeof(rsp), MSG_WAITALL) != sizeof(rsp))
+		return FPGA_EXCEPTION;
+	if (rsp.id != id || rsp.count != 1)
+		return FPGA_EXCEPTION;
+
+	return (fpga_result)rsp.result[0];
+}
+
+/*
+ * fanout : raise an error and fill latency[] with the time in msec
+ *          until each client was notified
+ */
+static int fanout(struct client *clients, struct pollfd *pfds,
+		  double *latency, uint32_t num, const char *errors)
+{
+	uint32_t notified = 0;
+	uint64_t count;
+	double start;
+	uint32_t i;
+
+	for (i = 0 ; i < num ; ++i) {
+		pfds[i].fd = clients[i].efd;
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+	}
+
+	start = now_msec();
+	if (write_errors(errors, BENCH_ERROR_CSR)) {
+		fprintf(stderr, "can't write %s: %s\n", errors,
+			strerror(errno));
+		return -1;
+	}
+
+	while (notified < num) {
+		if (poll(pfds, num, BENCH_TIMEOUT_MS) <= 0) {
+			fprintf(stderr, "%u of %u clients notified\n",
+				notified, num);
+			break;
+		}
+
+		for (i = 0 ; i < num ; ++i) {
+			if (pfds[i].fd < 0 || !pfds[i].revents)
+				continue;
+			latency[notified++] = now_msec() - start;
+			if (read(pfds[i].fd, &count, sizeof(count)) < 0)
+				fprintf(stderr, "read failed: %s\n",
+					strerror(errno));
+			pfds[i].fd = -1; /* ignored by poll() from now on */
+		}
+	}
+
+	write_errors(errors, 0);
+	return notified == num ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t num = BENCH_DEFAULT_CLIENTS;
+	fpga_properties filter = NULL;
+	fpga_token token = NULL;
+	uint32_t num_matches = 0;
+	struct client *clients = NULL;
+	struct pollfd *pfds = NULL;
+	double *latency = NULL;
+	const char *device;
+	char errors[SYSFS_PATH_MAX + sizeof("/errors/errors")];
+	fpga_result res;
+	uint32_t i;
+	int ret = 1;
+
+	if (argc > 1)
+		num = strtoul(argv[1], NULL, 0);
+	if (!num) {
+		fprintf(stderr, "Usage: %s [clients]\n", argv[0]);
+		return 1;
+	}
+
+	res = fpgaGetProperties(NULL, &filter);
+	if (res == FPGA_OK)
+		res = fpgaPropertiesSetObjectType(filter, FPGA_ACCELERATOR);
+	if (res == FPGA_OK)
+		res = fpgaEnumerate(&filter, 1, &token, 1, &num_matches);
+	if (res == FPGA_OK && num_matches == 0)
+		res = FPGA_NOT_FOUND;
+	if (res != FPGA_OK) {
+		fprintf(stderr, "no accelerator to raise errors on: %s\n",
+			fpgaErrStr(res));
+		goto out;
+	}
+	device = ((struct _fpga_token *)token)->sysfspath;
+	snprintf(errors, sizeof(errors), "%s/errors/errors", device);
+
+	clients = calloc(num, sizeof(*clients));
+	pfds = calloc(num, sizeof(*pfds));
+	latency = calloc(num, sizeof(*latency));
+	if (!clients || !pfds || !latency) {
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+	for (i = 0 ; i < num ; ++i)
+		clients[i].sock = clients[i].efd = -1;
+
+	for (i = 0 ; i < num ; ++i) {
+		res = client_register(&clients[i], i, device);
+		if (res != FPGA_OK) {
+			fprintf(stderr, "client %u not registered: %s\n", i,
+				fpgaErrStr(res));
+			goto out;
+		}
+	}
+
+	if (fanout(clients, pfds, latency, num, errors))
+		goto out;
+
+	qsort(latency, num, sizeof(*latency), cmp_double);
+	printf("error notification of %u clients (msec)\n", num);
+	printf("%-10s %10.3f\n", "first", latency[0]);
+	printf("%-10s %10.3f\n", "median", latency[num / 2]);
+	printf("%-10s %10.3f\n", "last", latency[num - 1]);
+	printf("%-10s %10.3f\n", "spread", latency[num - 1] - latency[0]);
+	ret = 0;
+
+out:
+	/* fpgad drops the registrations of closed connections */
+	if (clients) {
+		for (i = 0 ; i < num ; ++i) {
+			if (clients[i].sock >= 0)
+				close(clients[i].sock);
+			if (clients[i].efd >= 0)
+				close(clients[i].efd);
+		}
+	}
+	free(latency);
+	free(pfds);
+	free(clients);
+	if (token)
+		fpgaDestroyToken(&token);
+	if (filter)
+		fpgaDestroyProperties(&filter);
+	return ret;
+}
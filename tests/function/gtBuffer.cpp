@@ -33,6 +33,9 @@
 #include <algorithm>
 #include <deque>
 #include <random>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -130,6 +133,382 @@ TEST(LibopaecBufCommonMOCKHW, PrepRel4K01) {
   ASSERT_EQ(FPGA_OK, fpgaClose(h));
 }
 
+/**
+ * @test       IOAddressFromVA01
+ *
+ * @brief      When the parameters are valid and the drivers are loaded:
+ *             fpgaGetIOAddressFromVA must translate any address inside a
+ *             prepared buffer to the buffer's IO address plus the offset,
+ *             also when called from several threads, and must return
+ *             FPGA_NOT_FOUND for addresses outside of any buffer.
+ *
+ */
+TEST(LibopaecBufCommonMOCKHW, IOAddressFromVA01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  const uint64_t buf_len = 4 * 4096;
+  const int num_bufs = 8;
+  uint8_t* buf_addr[num_bufs];
+  uint64_t wsid[num_bufs];
+  uint64_t iova[num_bufs];
+  uint64_t ioaddr = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  // Multi-page buffers without depending on hugepages
+  for (int i = 0; i < num_bufs; ++i) {
+    buf_addr[i] = (uint8_t*)mmap(NULL, buf_len, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, (void*)buf_addr[i]);
+    ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, buf_len, (void**)&buf_addr[i],
+                                         &wsid[i], FPGA_BUF_PREALLOCATED));
+    ASSERT_EQ(FPGA_OK, fpgaGetIOAddress(h, wsid[i], &iova[i]));
+  }
+
+  auto check = [&]() {
+    uint64_t io = 0;
+    for (int i = 0; i < num_bufs; ++i) {
+      for (uint64_t off : {(uint64_t)0, (uint64_t)1, (uint64_t)4095,
+                           (uint64_t)8192, buf_len - 1}) {
+        EXPECT_EQ(FPGA_OK, fpgaGetIOAddressFromVA(h, buf_addr[i] + off, &io));
+        EXPECT_EQ(iova[i] + off, io);
+      }
+    }
+  };
+
+  check();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back(check);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            fpgaGetIOAddressFromVA(NULL, buf_addr[0], &ioaddr));
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            fpgaGetIOAddressFromVA(h, buf_addr[0], NULL));
+  EXPECT_EQ(FPGA_NOT_FOUND, fpgaGetIOAddressFromVA(h, NULL, &ioaddr));
+
+  // Released buffers must no longer translate
+  for (int i = 0; i < num_bufs; ++i) {
+    EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wsid[i]));
+    EXPECT_EQ(FPGA_NOT_FOUND,
+              fpgaGetIOAddressFromVA(h, buf_addr[i] + 1, &ioaddr));
+    munmap(buf_addr[i], buf_len);
+  }
+
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       PrepFlags01
+ *
+ * @brief      fpgaPrepareBuffer must reject conflicting page size flags
+ *             and allocation flags combined with FPGA_BUF_PREALLOCATED,
+ *             honour FPGA_BUF_PAGE_4K, and with FPGA_BUF_FALLBACK succeed
+ *             even when no huge pages of the requested size are free.
+ *
+ */
+TEST(LibopaecBufCommonMOCKHW, PrepFlags01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  uint64_t* buf_addr = NULL;
+  uint64_t wsid = 1;
+  uint64_t local[512];
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            fpgaPrepareBuffer(h, 4096, (void**)&buf_addr, &wsid,
+                              FPGA_BUF_PAGE_4K | FPGA_BUF_PAGE_2M));
+
+  buf_addr = local;
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            fpgaPrepareBuffer(h, 4096, (void**)&buf_addr, &wsid,
+                              FPGA_BUF_PREALLOCATED | FPGA_BUF_PAGE_2M));
+
+  // Explicit small pages for a buffer that would default to 2 MiB pages
+  buf_addr = NULL;
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, 16 * 1024, (void**)&buf_addr,
+                                       &wsid, FPGA_BUF_PAGE_4K));
+  memset(buf_addr, 0, 16 * 1024);
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wsid));
+
+  // Ask for 1 GiB pages, settle for whatever is available
+  buf_addr = NULL;
+  ASSERT_EQ(FPGA_OK,
+            fpgaPrepareBuffer(h, 16 * 1024, (void**)&buf_addr, &wsid,
+                              FPGA_BUF_PAGE_1G | FPGA_BUF_FALLBACK |
+                              FPGA_BUF_NUMA_LOCAL | FPGA_BUF_QUIET));
+  memset(buf_addr, 0, 16 * 1024);
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wsid));
+
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       PrepPack01
+ *
+ * @brief      Buffers prepared with FPGA_BUF_PACK must share a huge page
+ *             without overlapping, and a freed range must be reused for
+ *             the best fitting later request.
+ *
+ */
+TEST(LibopaecBufCommonMOCKHW, PrepPack01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  const int flags = FPGA_BUF_PACK | FPGA_BUF_PAGE_2M | FPGA_BUF_FALLBACK;
+  const uint64_t page = 2 * 1024 * 1024;
+  uint8_t* a = NULL;
+  uint8_t* b = NULL;
+  uint8_t* c = NULL;
+  uint8_t* d = NULL;
+  uint64_t wa, wb, wc, wd;
+  uint64_t ioaddr = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, 8192, (void**)&a, &wa, flags));
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, 16384, (void**)&b, &wb, flags));
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, 8192, (void**)&c, &wc, flags));
+
+  // All three live in the same page, back to back
+  EXPECT_EQ(a + 8192, b);
+  EXPECT_EQ(b + 16384, c);
+  EXPECT_LT((uint64_t)(c - a), page);
+  memset(a, 1, 8192);
+  memset(b, 2, 16384);
+  memset(c, 3, 8192);
+  EXPECT_EQ(FPGA_OK, fpgaGetIOAddressFromVA(h, b + 100, &ioaddr));
+
+  // The 16 KiB hole left by b is the best fit for 12 KiB
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wb));
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, 12288, (void**)&d, &wd, flags));
+  EXPECT_EQ(b, d);
+  EXPECT_EQ(1, a[8191]);
+  EXPECT_EQ(3, c[0]);
+
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wa));
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wc));
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wd));
+
+  // A buffer of a full page or more is not packed
+  a = NULL;
+  ASSERT_EQ(FPGA_OK, fpgaPrepareBuffer(h, page, (void**)&a, &wa, flags));
+  EXPECT_EQ(FPGA_OK, fpgaReleaseBuffer(h, wa));
+
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       Pool01
+ *
+ * @brief      When the parameters are valid and the drivers are loaded:
+ *             fpgaPoolAlloc must return distinct buffers with size-aligned
+ *             IO addresses matching fpgaGetIOAddressFromVA, and
+ *             must reuse buffers returned with fpgaPoolFree.
+ *
+ */
+TEST(LibopaecBufCommonALL, Pool01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  fpga_buffer_pool pool = NULL;
+  std::vector<void*> bufs;
+  std::set<void*> unique;
+  void* buf = NULL;
+  uint64_t ioaddr = 0;
+  uint64_t expected = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+  ASSERT_EQ(FPGA_OK, fpgaCreateBufferPool(h, 0, 1, 0, &pool));
+
+  for (uint64_t len : {(uint64_t)1, (uint64_t)64, (uint64_t)65,
+                       (uint64_t)1000, (uint64_t)4096, (uint64_t)65536}) {
+    uint64_t align = 64;
+    while (align < len) align <<= 1;
+
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(FPGA_OK, fpgaPoolAlloc(pool, len, &buf, &ioaddr));
+      EXPECT_EQ(0, ioaddr & (align - 1));
+      EXPECT_EQ(FPGA_OK, fpgaGetIOAddressFromVA(h, buf, &expected));
+      EXPECT_EQ(expected, ioaddr);
+      memset(buf, 0xa5, len);
+      EXPECT_TRUE(unique.insert(buf).second);
+      bufs.push_back(buf);
+    }
+  }
+
+  for (auto b : bufs) {
+    EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, b));
+  }
+
+  // Freed buffers are handed out again
+  ASSERT_EQ(FPGA_OK, fpgaPoolAlloc(pool, 64, &buf, NULL));
+  EXPECT_NE(unique.end(), unique.find(buf));
+  EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, buf));
+
+  EXPECT_EQ(FPGA_OK, fpgaDestroyBufferPool(&pool));
+  EXPECT_EQ(NULL, pool);
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       Pool02
+ *
+ * @brief      fpgaCreateBufferPool, fpgaPoolAlloc and fpgaPoolFree must
+ *             reject invalid parameters with FPGA_INVALID_PARAM.
+ *
+ */
+TEST(LibopaecBufCommonALL, Pool02) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  fpga_buffer_pool pool = NULL;
+  void* buf = NULL;
+  uint64_t local = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaCreateBufferPool(NULL, 0, 1, 0, &pool));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaCreateBufferPool(h, 0, 1, 0, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaCreateBufferPool(h, 0, 1, 1, &pool));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaCreateBufferPool(h, 4096, 1, 0, &pool));
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            fpgaCreateBufferPool(h, 0, 1000, 0, &pool));
+
+  ASSERT_EQ(FPGA_OK, fpgaCreateBufferPool(h, 0, 0, 0, &pool));
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolAlloc(NULL, 64, &buf, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolAlloc(pool, 64, NULL, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolAlloc(pool, 0, &buf, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolAlloc(pool, 65537, &buf, NULL));
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolFree(pool, &local));
+
+  // Grows from zero regions on demand
+  ASSERT_EQ(FPGA_OK, fpgaPoolAlloc(pool, 128, &buf, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaPoolFree(pool, (uint8_t*)buf + 64));
+  EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, buf));
+
+  EXPECT_EQ(FPGA_OK, fpgaDestroyBufferPool(&pool));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaDestroyBufferPool(&pool));
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       Pool03
+ *
+ * @brief      When several threads allocate from the same pool and free
+ *             buffers allocated by other threads, no buffer is handed out
+ *             twice.
+ *
+ */
+TEST(LibopaecBufCommonALL, Pool03) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  fpga_buffer_pool pool = NULL;
+  const int num_threads = 4;
+  const int per_thread = 2000;
+  std::vector<std::vector<void*>> bufs(num_threads);
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+  ASSERT_EQ(FPGA_OK, fpgaCreateBufferPool(h, 0, 1, 0, &pool));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      void* buf = NULL;
+      for (int i = 0; i < per_thread; ++i) {
+        EXPECT_EQ(FPGA_OK, fpgaPoolAlloc(pool, 256, &buf, NULL));
+        *(int*)buf = t;
+        bufs[t].push_back(buf);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  std::set<void*> unique;
+  for (int t = 0; t < num_threads; ++t) {
+    for (auto b : bufs[t]) {
+      EXPECT_TRUE(unique.insert(b).second);
+      EXPECT_EQ(t, *(int*)b);
+    }
+  }
+
+  // Free each thread's buffers from another thread, then allocate again
+  threads.clear();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      void* buf = NULL;
+      for (auto b : bufs[(t + 1) % num_threads]) {
+        EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, b));
+      }
+      for (int i = 0; i < per_thread; ++i) {
+        EXPECT_EQ(FPGA_OK, fpgaPoolAlloc(pool, 256, &buf, NULL));
+        EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, buf));
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(FPGA_OK, fpgaDestroyBufferPool(&pool));
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       Pool04
+ *
+ * @brief      When the pool regions fall back to small pages, whose IO
+ *             address need not be slab aligned, every slab of a region
+ *             is still usable and buffers of one slab have slab-aligned
+ *             IO addresses.
+ *
+ */
+TEST(LibopaecBufCommonALL, Pool04) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h;
+  fpga_buffer_pool pool = NULL;
+  const uint64_t slab = 65536;
+  void* bufs[4];
+  uint64_t ioaddr = 0;
+  uint64_t expected = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+  ASSERT_EQ(FPGA_OK, fpgaCreateBufferPool(h, 2 * slab, 2, FPGA_BUF_FALLBACK,
+                                          &pool));
+
+  for (auto& b : bufs) {
+    ASSERT_EQ(FPGA_OK, fpgaPoolAlloc(pool, slab, &b, &ioaddr));
+    EXPECT_EQ(0, ioaddr & (slab - 1));
+    EXPECT_EQ(FPGA_OK, fpgaGetIOAddressFromVA(h, b, &expected));
+    EXPECT_EQ(expected, ioaddr);
+    memset(b, 0x5a, slab);
+  }
+
+  for (auto b : bufs) {
+    EXPECT_EQ(FPGA_OK, fpgaPoolFree(pool, b));
+  }
+
+  EXPECT_EQ(FPGA_OK, fpgaDestroyBufferPool(&pool));
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
 /**
  * @test       PrepPre0B
  *
@@ -118,3 +118,63 @@ TEST_F(LibopaecppMMIOCommonALL_f1, mmio_07) {
   ++p;
   EXPECT_EQ(nlb0_afu_id_h, *p);
 }
+
+/**
+ * @test mmio_08
+ * Given an open accelerator handle object<br>
+ * for the NLB0 accelerator,<br>
+ * When I call handle::read_csrs() with csr_space 0<br>
+ * Then I can access the NLB0 DFH contents in one call.
+ */
+TEST_F(LibopaecppMMIOCommonALL_f1, mmio_08) {
+  std::vector<fpga_mmio_op> ops = {
+    { 0,  0, 8, 0 },
+    { 8,  0, 8, 0 },
+    { 16, 0, 8, 0 },
+  };
+  accel_->read_csrs(ops);
+  EXPECT_EQ(nlb0_dfh,      ops[0].value);
+  EXPECT_EQ(nlb0_afu_id_l, ops[1].value);
+  EXPECT_EQ(nlb0_afu_id_h, ops[2].value);
+}
+
+/**
+ * @test mmio_09
+ * Given an open accelerator handle object<br>
+ * When I call handle::write_csrs() with a misaligned element<br>
+ * Then an exception of type opae::fpga::types::invalid_param is thrown<br>
+ * And none of the writes is performed.
+ */
+TEST_F(LibopaecppMMIOCommonALL_f1, mmio_09) {
+  accel_->write_csr64(0x100, 0);
+  std::vector<fpga_mmio_op> ops = {
+    { 0x100, 0xc0ffee, 8, 0 },
+    { 0x104, 0xbeef,   8, 0 },
+  };
+  EXPECT_THROW(accel_->write_csrs(ops), invalid_param);
+  EXPECT_EQ(0, accel_->read_csr64(0x100));
+
+  ops[1].offset = 0x108;
+  ops[1].flags = FPGA_MMIO_FENCE;
+  accel_->write_csrs(ops);
+  EXPECT_EQ(0xc0ffee, accel_->read_csr64(0x100));
+  EXPECT_EQ(0xbeef, accel_->read_csr64(0x108));
+}
+
+/**
+ * @test mmio_10
+ * Given an open accelerator handle object<br>
+ * When I call handle::access_csrs() with writes followed by reads<br>
+ * Then the reads return the values just written.
+ */
+TEST_F(LibopaecppMMIOCommonALL_f1, mmio_10) {
+  std::vector<fpga_mmio_op> ops = {
+    { 0x100, 0xc0ffee, 8, 0 },
+    { 0x108, 0xbeef,   8, 0 },
+    { 0x100, 0,        8, FPGA_MMIO_READ | FPGA_MMIO_FENCE },
+    { 0x108, 0,        8, FPGA_MMIO_READ },
+  };
+  accel_->access_csrs(ops);
+  EXPECT_EQ(0xc0ffee, ops[2].value);
+  EXPECT_EQ(0xbeef, ops[3].value);
+}
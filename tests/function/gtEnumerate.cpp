@@ -26,6 +26,10 @@
 
 #include "opae/fpga.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "common_test.h"
 #include "gtest/gtest.h"
 #include "types_int.h"
@@ -1067,3 +1071,103 @@ TEST_F(LibopaecEnumFCommonALL, enum_034) {
   EXPECT_EQ(0, m_NumMatches);
 #endif
 }
+
+#ifndef BUILD_ASE
+/**
+ * @test       enum_cache_01
+ *
+ * @brief      With the enumeration cache enabled, fpgaEnumerate returns
+ *             the same tokens as a sysfs scan for a range of filters,
+ *             and keeps doing so after invalidation.
+ */
+TEST_F(LibopaecEnumFCommonALL, enum_cache_01) {
+  auto enumerate = [&](fpga_objtype *type, uint32_t max) {
+    std::vector<std::string> paths;
+    std::vector<fpga_token> toks(max, nullptr);
+    uint32_t n = 0;
+
+    EXPECT_EQ(FPGA_OK, fpgaClearProperties(m_Properties));
+    if (type) {
+      EXPECT_EQ(FPGA_OK, fpgaPropertiesSetObjectType(m_Properties, *type));
+    }
+    EXPECT_EQ(FPGA_OK, fpgaEnumerate(&m_Properties, 1, toks.data(), max, &n));
+    for (uint32_t i = 0; i < std::min(n, max); ++i) {
+      paths.push_back(((struct _fpga_token *)toks[i])->sysfspath);
+      EXPECT_EQ(FPGA_OK, fpgaDestroyToken(&toks[i]));
+    }
+    std::sort(paths.begin(), paths.end());
+    paths.push_back(std::to_string(n));
+    return paths;
+  };
+  fpga_objtype dev = FPGA_DEVICE;
+  fpga_objtype acc = FPGA_ACCELERATOR;
+
+  auto all = enumerate(nullptr, 16);
+  auto devs = enumerate(&dev, 16);
+  auto accs = enumerate(&acc, 16);
+  ASSERT_GT(all.size(), 1);
+
+  ASSERT_EQ(FPGA_OK, fpgaEnumerateCacheEnable(0));
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(all, enumerate(nullptr, 16));
+    EXPECT_EQ(devs, enumerate(&dev, 16));
+    EXPECT_EQ(accs, enumerate(&acc, 16));
+    EXPECT_EQ(FPGA_OK, fpgaEnumerateCacheInvalidate());
+  }
+
+  // Accelerator state is re-probed rather than served stale
+  EXPECT_EQ(FPGA_OK, fpgaClearProperties(m_Properties));
+  EXPECT_EQ(FPGA_OK, fpgaPropertiesSetObjectType(m_Properties, acc));
+  EXPECT_EQ(FPGA_OK, fpgaPropertiesSetAcceleratorState(
+                         m_Properties, FPGA_ACCELERATOR_UNASSIGNED));
+  EXPECT_EQ(FPGA_OK, fpgaEnumerate(&m_Properties, 1, NULL, 0, &m_NumMatches));
+  uint32_t unassigned = m_NumMatches;
+  EXPECT_EQ(FPGA_OK, fpgaEnumerateCacheDisable());
+  EXPECT_EQ(FPGA_OK, fpgaEnumerate(&m_Properties, 1, NULL, 0, &m_NumMatches));
+  EXPECT_EQ(m_NumMatches, unassigned);
+}
+
+class LibopaecEnumFCommonMOCK : public LibopaecEnumFCommonALL {};
+
+/**
+ * @test       enum_cache_02
+ *
+ * @brief      With the enumeration cache enabled, a second fpgaEnumerate
+ *             is answered from the cache: a socket_id changed in the mock
+ *             sysfs tree goes unnoticed until fpgaEnumerateCacheInvalidate
+ *             forces a rescan.
+ */
+TEST_F(LibopaecEnumFCommonMOCK, enum_cache_02) {
+  const char *socket_id =
+      "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-fme.0/socket_id";
+
+  auto count = [&](uint8_t socket) {
+    EXPECT_EQ(FPGA_OK, fpgaClearProperties(m_Properties));
+    EXPECT_EQ(FPGA_OK, fpgaPropertiesSetObjectType(m_Properties, FPGA_DEVICE));
+    EXPECT_EQ(FPGA_OK, fpgaPropertiesSetSocketID(m_Properties, socket));
+    EXPECT_EQ(FPGA_OK,
+              fpgaEnumerate(&m_Properties, 1, NULL, 0, &m_NumMatches));
+    return m_NumMatches;
+  };
+
+  ASSERT_EQ(FPGA_OK, fpgaEnumerateCacheEnable(0));
+  uint32_t devs = count(0);
+  ASSERT_GT(devs, 0u);
+  EXPECT_EQ(0u, count(1));
+
+  ASSERT_EQ(FPGA_OK, sysfs_write_64(socket_id, 1, DEC));
+
+  // served from the cache
+  EXPECT_EQ(devs, count(0));
+  EXPECT_EQ(0u, count(1));
+
+  // rescanned
+  EXPECT_EQ(FPGA_OK, fpgaEnumerateCacheInvalidate());
+  EXPECT_EQ(devs - 1, count(0));
+  EXPECT_EQ(1u, count(1));
+
+  EXPECT_EQ(FPGA_OK, sysfs_write_64(socket_id, 0, DEC));
+  EXPECT_EQ(FPGA_OK, fpgaEnumerateCacheDisable());
+  EXPECT_EQ(devs, count(0));
+}
+#endif
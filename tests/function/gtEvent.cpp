@@ -30,10 +30,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <vector>
 
 #include "common_test.h"
 #include "gtest/gtest.h"
 #include "types_int.h"
+#include "event_ring.h"
+extern "C" {
+#include "event_int.h"
+}
 
 using namespace common_test;
 using namespace std;
@@ -311,6 +318,226 @@ TEST_F(LibopaecEventFCommonMOCK, event_drv_06) {
                                          m_EventHandles[0]));
 }
 
+/**
+ * @test       event_fanout_01
+ *
+ * @brief      Load test for the fpgad event server: registers
+ *             FPGA_EVENT_ERROR from many fake clients, each on its own
+ *             connection as separate processes would be (well beyond
+ *             the old 41-client limit), raises a port error in the mock
+ *             sysfs tree and checks that every client is notified.
+ *
+ */
+TEST_F(LibopaecEventFCommonMOCK, event_fanout_01) {
+  const size_t num_clients = 128;
+  const char *errors =
+      "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-port.0/errors/errors";
+  uint64_t error_csr = 1UL << 0; // TxCh0Overflow
+  std::vector<int> socks(num_clients, -1);
+  std::vector<int> efds(num_clients, -1);
+  std::vector<struct pollfd> pfds(num_clients);
+  size_t notified = 0;
+  size_t i;
+
+  for (i = 0; i < num_clients; ++i) {
+    struct {
+      struct event_batch_header hdr;
+      struct event_batch_entry entry;
+    } req;
+    struct event_batch_response rsp;
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr mh;
+    struct cmsghdr *cmh;
+
+    efds[i] = eventfd(0, 0);
+    ASSERT_GE(efds[i], 0);
+    socks[i] = event_daemon_connect();
+    ASSERT_GE(socks[i], 0);
+
+    memset(&req, 0, sizeof(req));
+    req.hdr.type = EVENT_BATCH;
+    req.hdr.version = EVENT_PROTOCOL_VERSION;
+    req.hdr.id = i;
+    req.hdr.count = 1;
+    req.entry.op = EVENT_OP_REGISTER;
+    req.entry.event = FPGA_EVENT_ERROR;
+    req.entry.owner = i;
+    snprintf(req.entry.device, sizeof(req.entry.device), "%s",
+             m_AFUToken.sysfspath);
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = buf;
+    mh.msg_controllen = sizeof(buf);
+    cmh = CMSG_FIRSTHDR(&mh);
+    cmh->cmsg_len = CMSG_LEN(sizeof(int));
+    cmh->cmsg_level = SOL_SOCKET;
+    cmh->cmsg_type = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmh), &efds[i], sizeof(int));
+
+    ASSERT_EQ((ssize_t)sizeof(req), sendmsg(socks[i], &mh, 0));
+    ASSERT_EQ((ssize_t)sizeof(rsp), recv(socks[i], &rsp, sizeof(rsp),
+                                         MSG_WAITALL));
+    ASSERT_EQ(i, rsp.id);
+    ASSERT_EQ(1, rsp.count);
+    ASSERT_EQ(FPGA_OK, rsp.result[0]);
+
+    pfds[i].fd = efds[i];
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+  }
+
+  sysfs_write_64(errors, error_csr, HEX);
+
+  while (notified < num_clients) {
+    int res = poll(pfds.data(), num_clients, 10000);
+    ASSERT_GT(res, 0);
+
+    for (i = 0; i < num_clients; ++i) {
+      if (pfds[i].fd >= 0 && pfds[i].revents) {
+        uint64_t count = 0;
+        EXPECT_EQ(POLLIN, pfds[i].revents);
+        EXPECT_EQ((ssize_t)sizeof(count),
+                  read(efds[i], &count, sizeof(count)));
+        EXPECT_GT(count, 0UL);
+        pfds[i].fd = -1; // ignored by poll() from now on
+        ++notified;
+      }
+    }
+  }
+
+  sysfs_write_64(errors, 0, DEC);
+
+  // fpgad drops the registrations of closed connections
+  for (i = 0; i < num_clients; ++i) {
+    close(socks[i]);
+    close(efds[i]);
+  }
+}
+
+/**
+ * @test       event_ring_01
+ *
+ * @brief      When fpgad decodes an error, it publishes a record naming
+ *             the register and field to its event ring, which clients
+ *             read after being notified through their event handle.
+ *
+ */
+TEST_F(LibopaecEventFCommonMOCK, event_ring_01) {
+  const char *errors =
+      "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-port.0/errors/errors";
+  struct fpga_event_record recs[16];
+  fpga_event_ring ring = NULL;
+  struct pollfd poll_fd;
+  uint32_t num = 0;
+  uint64_t lost = 0;
+  bool found = false;
+  int fd = -1;
+
+  ASSERT_EQ(FPGA_OK, fpgaOpenEventRing(&ring));
+  // skip whatever earlier tests left behind
+  do {
+    ASSERT_EQ(FPGA_OK, fpgaReadEventRing(ring, recs, 16, &num, NULL));
+  } while (num);
+
+  ASSERT_EQ(FPGA_OK, fpgaRegisterEvent(m_AFUHandle, FPGA_EVENT_ERROR,
+                                       m_EventHandles[0], 0));
+  ASSERT_EQ(FPGA_OK, fpgaGetOSObjectFromEventHandle(m_EventHandles[0], &fd));
+
+  sysfs_write_64(errors, 1UL << 32, HEX); // MMIOTimedOut
+
+  poll_fd.fd = fd;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+  EXPECT_EQ(1, poll(&poll_fd, 1, 10000));
+
+  sysfs_write_64(errors, 0, DEC);
+
+  do {
+    ASSERT_EQ(FPGA_OK, fpgaReadEventRing(ring, recs, 16, &num, &lost));
+    EXPECT_EQ(0, lost);
+    for (uint32_t i = 0; i < num; ++i) {
+      if (recs[i].type == FPGA_EVENT_ERROR &&
+          strstr(recs[i].name, "MMIOTimedOut")) {
+        EXPECT_STREQ(errors, recs[i].reg);
+        EXPECT_EQ(0, recs[i].socket);
+        EXPECT_EQ(1, recs[i].value);
+        EXPECT_NE(0, recs[i].timestamp);
+        found = true;
+      }
+    }
+  } while (num);
+  EXPECT_TRUE(found);
+
+  EXPECT_EQ(FPGA_OK, fpgaUnregisterEvent(m_AFUHandle, FPGA_EVENT_ERROR,
+                                         m_EventHandles[0]));
+  EXPECT_EQ(FPGA_OK, fpgaCloseEventRing(&ring));
+  EXPECT_EQ(NULL, ring);
+}
+
+/**
+ * @test       event_ring_02
+ *
+ * @brief      fpgaReadEventRing() returns records in order, and reports
+ *             records overwritten before they were read as lost.
+ *
+ */
+TEST(LibopaecEventCommonALL, event_ring_02) {
+  const uint32_t slots = 8;
+  std::vector<uint64_t> mem(EVENT_RING_SIZE(slots) / sizeof(uint64_t) + 1);
+  struct event_ring *er = reinterpret_cast<struct event_ring *>(mem.data());
+  struct _fpga_event_ring r;
+  struct fpga_event_record recs[slots];
+  uint32_t num = 0;
+  uint64_t lost = 0;
+
+  er->magic = EVENT_RING_MAGIC;
+  er->num_slots = slots;
+  er->slot_size = sizeof(struct event_ring_slot);
+
+  auto publish = [&](uint64_t value) {
+    struct event_ring_slot *slot = &er->slots[er->head & (slots - 1)];
+    slot->rec.sequence = er->head;
+    slot->rec.value = value;
+    slot->seq = er->head + 1;
+    er->head++;
+  };
+
+  ASSERT_EQ(0, pthread_mutex_init(&r.lock, NULL));
+  r.magic = FPGA_EVENT_RING_MAGIC;
+  r.ring = er;
+  r.size = 0;
+  r.cursor = 0;
+
+  for (uint64_t i = 0; i < 3; ++i)
+    publish(i);
+  EXPECT_EQ(FPGA_OK, fpgaReadEventRing(&r, recs, slots, &num, &lost));
+  EXPECT_EQ(3, num);
+  EXPECT_EQ(0, lost);
+  for (uint32_t i = 0; i < num; ++i)
+    EXPECT_EQ(i, recs[i].value);
+
+  // lap the reader: the 5 oldest unread records are gone
+  for (uint64_t i = 3; i < 3 + slots + 5; ++i)
+    publish(i);
+  EXPECT_EQ(FPGA_OK, fpgaReadEventRing(&r, recs, slots, &num, &lost));
+  EXPECT_EQ(slots, num);
+  EXPECT_EQ(5, lost);
+  EXPECT_EQ(8, recs[0].value);
+  EXPECT_EQ(8, recs[0].sequence);
+
+  EXPECT_EQ(FPGA_OK, fpgaReadEventRing(&r, recs, slots, &num, NULL));
+  EXPECT_EQ(0, num);
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaReadEventRing(&r, NULL, slots, &num, NULL));
+  r.magic = FPGA_INVALID_MAGIC;
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaReadEventRing(&r, recs, slots, &num, NULL));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaCloseEventRing(NULL));
+  pthread_mutex_destroy(&r.lock);
+}
+
 /**
  * @test       event_drv_08
  *
@@ -28,10 +28,20 @@
 #include <opae/mmio.h>
 #include <sys/mman.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "common_test.h"
 #include "gtest/gtest.h"
 #include "types_int.h"
 
+#ifndef BUILD_ASE
+extern "C" {
+#include "wsid_list_int.h"
+}
+#endif
+
 #define CSR_SCRATCHPAD0 0x100
 //#define MAX_MMIO_SIZE  1024*256
 //#define MMIO_TEST_OFFSET 0x18  //skip first 24 bytes of DFH heder
@@ -47,11 +57,11 @@ using namespace common_test;
  * On hardware, the mmio map is a hash table.
  */
 static bool mmio_map_is_empty(struct wsid_tracker *root) {
-  if (!root || (root->n_hash_buckets == 0))
+  if (!root || (root->by_wsid.n_slots == 0))
     return true;
 
-  for (uint32_t i = 0; i < root->n_hash_buckets; i += 1) {
-    if (root->table[i])
+  for (uint64_t i = 0; i < root->by_wsid.n_slots; i += 1) {
+    if (root->by_wsid.slots[i].wm)
       return false;
   }
 
@@ -88,7 +98,7 @@ TEST(LibopaecMmioCommonALL, mmio_drv_positive_init_01) {
 #ifndef BUILD_ASE
   // On HW we build a hash table
   EXPECT_FALSE(((struct _fpga_handle*)h)->mmio_root == NULL);
-  EXPECT_FALSE(((struct _fpga_handle*)h)->mmio_root->n_hash_buckets == 0);
+  EXPECT_FALSE(((struct _fpga_handle*)h)->mmio_root->by_wsid.n_slots == 0);
 #endif
   EXPECT_TRUE(mmio_map_is_empty(((struct _fpga_handle*)h)->mmio_root));
   ASSERT_EQ(FPGA_OK, fpgaClose(h));
@@ -342,3 +352,163 @@ TEST(LibopaecMmioCommonALL, mmio_drv_negative_write32_read32_02) {
 #endif
   ASSERT_EQ(FPGA_OK, fpgaClose(h));
 }
+
+/**
+ * @test       mmio_drv_vectored_01
+ *
+ * @brief      When the parameters are valid and the drivers are loaded:
+ *             fpgaWriteMMIOv must write each element in order, and
+ *             fpgaReadMMIOv must return each element's value.
+ *             Both must fail without side effects for a NULL vector,
+ *             an unsupported width, a misaligned or an out-of-region
+ *             element.
+ *
+ */
+TEST(LibopaecMmioCommonALL, mmio_drv_vectored_01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h = NULL;
+  fpga_mmio_op ops[3] = {
+    { CSR_SCRATCHPAD0,     0x11223344,         4, 0 },
+    { CSR_SCRATCHPAD0 + 8, 0x5566778899aabbcc, 8, 0 },
+    { CSR_SCRATCHPAD0 + 4, 0xddeeff00,         4, FPGA_MMIO_FENCE },
+  };
+  uint64_t read_value = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  EXPECT_EQ(FPGA_OK, fpgaWriteMMIOv(h, 0, ops, 3));
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0, &read_value));
+  EXPECT_EQ(0xddeeff0011223344UL, read_value);
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0 + 8, &read_value));
+  EXPECT_EQ(0x5566778899aabbccUL, read_value);
+
+  for (int i = 0; i < 3; ++i) ops[i].value = 0;
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIOv(h, 0, ops, 3));
+  EXPECT_EQ(0x11223344UL, ops[0].value);
+  EXPECT_EQ(0x5566778899aabbccUL, ops[1].value);
+  EXPECT_EQ(0xddeeff00UL, ops[2].value);
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaWriteMMIOv(h, 0, NULL, 1));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaReadMMIOv(NULL, 0, ops, 3));
+
+  ops[0].value = 0;
+  ops[2].width = 2;
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaWriteMMIOv(h, 0, ops, 3));
+  ops[2].width = 8;
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaWriteMMIOv(h, 0, ops, 3));
+  ops[2].offset = MMIO_OUT_REGION_ADDRESS;
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaWriteMMIOv(h, 0, ops, 3));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaReadMMIOv(h, 0, ops, 3));
+
+  // the rejected vectors must not have written their first element
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0, &read_value));
+  EXPECT_EQ(0xddeeff0011223344UL, read_value);
+
+#ifndef BUILD_ASE
+  EXPECT_EQ(FPGA_OK, fpgaUnmapMMIO(h, 0));
+#endif
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+/**
+ * @test       mmio_drv_vectored_02
+ *
+ * @brief      When the parameters are valid and the drivers are loaded:
+ *             fpgaMMIOv must issue reads and writes of one vector in
+ *             order, so that reads after a fence see the preceding
+ *             writes and reads before a write see the old value.
+ *             An invalid element must reject the whole vector.
+ *
+ */
+TEST(LibopaecMmioCommonALL, mmio_drv_vectored_02) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h = NULL;
+  fpga_mmio_op ops[5] = {
+    { CSR_SCRATCHPAD0,     0x1111,         8, 0 },
+    { CSR_SCRATCHPAD0,     0,              8, FPGA_MMIO_READ },
+    { CSR_SCRATCHPAD0,     0x2222,         8, 0 },
+    { CSR_SCRATCHPAD0 + 8, 0x33333333,     4, 0 },
+    { CSR_SCRATCHPAD0,     0,              8,
+      FPGA_MMIO_READ | FPGA_MMIO_FENCE },
+  };
+  uint64_t read_value = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+
+  EXPECT_EQ(FPGA_OK, fpgaMMIOv(h, 0, ops, 5));
+  EXPECT_EQ(0x1111UL, ops[1].value);
+  EXPECT_EQ(0x2222UL, ops[4].value);
+  // writes keep their value
+  EXPECT_EQ(0x2222UL, ops[2].value);
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO32(h, 0, CSR_SCRATCHPAD0 + 8,
+                                    (uint32_t *)&read_value));
+  EXPECT_EQ(0x33333333UL, read_value);
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaMMIOv(h, 0, NULL, 1));
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaMMIOv(NULL, 0, ops, 5));
+
+  ops[0].value = 0;
+  ops[4].offset = CSR_SCRATCHPAD0 + 4;
+  EXPECT_EQ(FPGA_INVALID_PARAM, fpgaMMIOv(h, 0, ops, 5));
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0, &read_value));
+  EXPECT_EQ(0x2222UL, read_value);
+
+#ifndef BUILD_ASE
+  EXPECT_EQ(FPGA_OK, fpgaUnmapMMIO(h, 0));
+#endif
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+#ifndef BUILD_ASE
+
+#define MMIO_THREADS 4
+#define MMIO_THREAD_ACCESSES 10000
+
+/**
+ * @test       mmio_drv_threads_01
+ *
+ * @brief      When the MMIO region has been mapped once:
+ *             fpgaReadMMIO64 from several threads sharing the handle,
+ *             without the handle lock, returns the value written, and
+ *             fpgaUnmapMMIO withdraws the region.
+ *             tests/mmio_bench.c measures the per-access cost.
+ *
+ */
+TEST(LibopaecMmioCommonALL, mmio_drv_threads_01) {
+  struct _fpga_token _tok;
+  fpga_token tok = &_tok;
+  fpga_handle h = NULL;
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+  uint64_t value = 0;
+
+  token_for_afu0(&_tok);
+  ASSERT_EQ(FPGA_OK, fpgaOpen(tok, &h, 0));
+  ASSERT_EQ(FPGA_OK, fpgaWriteMMIO64(h, 0, CSR_SCRATCHPAD0, 0xc0ffee));
+
+  for (int t = 0; t < MMIO_THREADS; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < MMIO_THREAD_ACCESSES; ++i) {
+        uint64_t v = 0;
+        if (fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0, &v) != FPGA_OK ||
+            v != 0xc0ffee)
+          ++mismatches;
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(0, mismatches);
+  EXPECT_EQ(FPGA_OK, fpgaReadMMIO64(h, 0, CSR_SCRATCHPAD0, &value));
+  EXPECT_EQ(0xc0ffeeUL, value);
+
+  EXPECT_EQ(FPGA_OK, fpgaUnmapMMIO(h, 0));
+  EXPECT_NE(FPGA_OK, fpgaUnmapMMIO(h, 0));
+  ASSERT_EQ(FPGA_OK, fpgaClose(h));
+}
+
+#endif
@@ -0,0 +1,176 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * MMIO access benchmark
+ *
+ * Compares the cost of fpgaReadMMIO64 once the region is mapped against
+ * the previous access path, which took the handle lock and looked the
+ * region up in handle->mmio_root on every access, single threaded and
+ * with several threads polling the same handle.
+ *
+ * Opens the first accelerator found; run it with the mock driver
+ * preloaded to measure without a card.
+ *
+ * Usage: mmio-bench [accesses]
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <opae/fpga.h>
+
+#include "types_int.h"
+#include "wsid_list_int.h"
+
+#define BENCH_DEFAULT_ACCESSES 1000000
+#define BENCH_MAX_THREADS      4
+#define BENCH_SCRATCHPAD       0x100
+
+struct bench_arg {
+	fpga_handle handle;
+	uint64_t accesses;
+	int locked;
+};
+
+/*
+ * read_locked : previous register access path, for reference
+ */
+static uint64_t read_locked(fpga_handle handle, uint32_t mmio_num,
+			    uint64_t offset)
+{
+	struct _fpga_handle *_handle = (struct _fpga_handle *)handle;
+	struct wsid_map *wm;
+	uint64_t value;
+
+	pthread_mutex_lock(&_handle->lock);
+	wm = wsid_find_by_index(_handle->mmio_root, mmio_num);
+	value = *((volatile uint64_t *)((uint8_t *)wm->offset + offset));
+	pthread_mutex_unlock(&_handle->lock);
+
+	return value;
+}
+
+static void *bench_thread(void *p)
+{
+	struct bench_arg *arg = (struct bench_arg *)p;
+	uint64_t value;
+	uint64_t i;
+
+	for (i = 0 ; i < arg->accesses ; ++i) {
+		if (arg->locked)
+			read_locked(arg->handle, 0, BENCH_SCRATCHPAD);
+		else
+			fpgaReadMMIO64(arg->handle, 0, BENCH_SCRATCHPAD, &value);
+	}
+
+	return NULL;
+}
+
+/*
+ * run : spread count accesses over nthreads threads and return the
+ *       average wall-clock cost of one access in nanoseconds
+ */
+static double run(fpga_handle handle, int nthreads, uint64_t count,
+		  int locked)
+{
+	pthread_t threads[BENCH_MAX_THREADS];
+	struct bench_arg arg;
+	struct timespec start;
+	struct timespec end;
+	int i;
+
+	arg.handle = handle;
+	arg.accesses = count / nthreads;
+	arg.locked = locked;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0 ; i < nthreads ; ++i)
+		pthread_create(&threads[i], NULL, bench_thread, &arg);
+	for (i = 0 ; i < nthreads ; ++i)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		(end.tv_nsec - start.tv_nsec)) / (arg.accesses * nthreads);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count = BENCH_DEFAULT_ACCESSES;
+	fpga_properties filter = NULL;
+	fpga_token token = NULL;
+	fpga_handle handle = NULL;
+	uint32_t num_matches = 0;
+	fpga_result res;
+	int nthreads;
+	int ret = 1;
+
+	if (argc > 1)
+		count = strtoull(argv[1], NULL, 0);
+	if (count < BENCH_MAX_THREADS) {
+		fprintf(stderr, "Usage: %s [accesses]\n", argv[0]);
+		return 1;
+	}
+
+	res = fpgaGetProperties(NULL, &filter);
+	if (res == FPGA_OK)
+		res = fpgaPropertiesSetObjectType(filter, FPGA_ACCELERATOR);
+	if (res == FPGA_OK)
+		res = fpgaEnumerate(&filter, 1, &token, 1, &num_matches);
+	if (res == FPGA_OK && num_matches == 0)
+		res = FPGA_NOT_FOUND;
+	if (res == FPGA_OK)
+		res = fpgaOpen(token, &handle, 0);
+	/* maps the region, so that both paths find it */
+	if (res == FPGA_OK)
+		res = fpgaWriteMMIO64(handle, 0, BENCH_SCRATCHPAD, 0);
+	if (res != FPGA_OK) {
+		fprintf(stderr, "no accelerator to read from: %s\n",
+			fpgaErrStr(res));
+		goto out;
+	}
+
+	printf("MMIO read64 cost over %" PRIu64 " accesses (nsec)\n", count);
+	printf("%-10s %12s %12s\n", "threads", "lock-free", "locked");
+	for (nthreads = 1 ; nthreads <= BENCH_MAX_THREADS ; nthreads *= 2)
+		printf("%-10d %12.1f %12.1f\n", nthreads,
+		       run(handle, nthreads, count, 0),
+		       run(handle, nthreads, count, 1));
+	ret = 0;
+
+out:
+	if (handle)
+		fpgaClose(handle);
+	if (token)
+		fpgaDestroyToken(&token);
+	if (filter)
+		fpgaDestroyProperties(&filter);
+	return ret;
+}
@@ -574,6 +574,8 @@ int open(const char* pathname, int flags, ...) {
         /* call real open */
         FPGA_DBG("-> open(\"%s\", %i)", path, flags);
         fd = real_open(path, flags);
+        if (fd < 0)
+            return fd;
         /* store info */
         strncpy_s(mock_devs[fd].pathname, strlen(mock_devs[fd].pathname), path, MAX_STRLEN);
         mock_devs[fd].objtype = FPGA_DEVICE;
@@ -0,0 +1,239 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifdef __cplusplus
+
+extern "C" {
+#endif
+#include "opae/fpga.h"
+#include "enum_int.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "types_int.h"
+
+static void make_guid(fpga_guid guid, uint32_t n) {
+  memset(guid, 0, sizeof(fpga_guid));
+  guid[0] = 0xc0;
+  guid[12] = (n >> 24) & 0xff;
+  guid[13] = (n >> 16) & 0xff;
+  guid[14] = (n >> 8) & 0xff;
+  guid[15] = n & 0xff;
+}
+
+static std::vector<struct dev_list> make_devs(uint32_t count) {
+  std::vector<struct dev_list> devs(count);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    struct dev_list *d = &devs[i];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->sysfspath, sizeof(d->sysfspath),
+             "/sys/class/fpga/intel-fpga-dev.%u/intel-fpga-port.%u", i, i);
+    d->objtype = (i & 1) ? FPGA_ACCELERATOR : FPGA_DEVICE;
+    make_guid(d->guid, i);
+    d->bus = i & 0xff;
+    d->device_id = 0xbcc0;
+    d->accelerator_num_mmios = i % 3;
+    d->accelerator_state =
+        (i % 5) ? FPGA_ACCELERATOR_UNASSIGNED : FPGA_ACCELERATOR_ASSIGNED;
+  }
+  return devs;
+}
+
+static void destroy_filters(std::vector<fpga_properties> &filters) {
+  for (auto &f : filters) {
+    EXPECT_EQ(FPGA_OK, fpgaDestroyProperties(&f));
+  }
+  filters.clear();
+}
+
+/**
+* @test    filter_set_01
+* @brief   Tests: filter_set_compile, filter_set_match
+* @details An empty filter array matches every device.
+*/
+TEST(LibopaecEnumFilterCommonALL, filter_set_01) {
+  struct filter_set set;
+  auto devs = make_devs(16);
+
+  ASSERT_EQ(FPGA_OK, filter_set_compile(NULL, 0, &set));
+  EXPECT_TRUE(set.match_all);
+  for (auto &d : devs) {
+    EXPECT_TRUE(filter_set_match(&set, &d));
+  }
+  filter_set_free(&set);
+}
+
+/**
+* @test    filter_set_02
+* @brief   Tests: filter_set_compile, filter_set_match
+* @details Given many GUID filters, exactly the devices carrying one of
+*          the GUIDs match, and filters are captured at compile time.
+*/
+TEST(LibopaecEnumFilterCommonALL, filter_set_02) {
+  const uint32_t num_devs = 4096;
+  struct filter_set set;
+  std::vector<fpga_properties> filters;
+  auto devs = make_devs(num_devs);
+
+  // every third device, plus GUIDs that no device carries
+  for (uint32_t i = 0; i < num_devs + 300; i += 3) {
+    fpga_properties f = NULL;
+    fpga_guid guid;
+    ASSERT_EQ(FPGA_OK, fpgaGetProperties(NULL, &f));
+    make_guid(guid, i);
+    ASSERT_EQ(FPGA_OK, fpgaPropertiesSetGUID(f, guid));
+    filters.push_back(f);
+  }
+
+  ASSERT_EQ(FPGA_OK, filter_set_compile(filters.data(), filters.size(), &set));
+  EXPECT_EQ(filters.size(), set.num_entries);
+  EXPECT_FALSE(set.uses_state);
+
+  // changing a filter after compilation does not affect the set
+  ASSERT_EQ(FPGA_OK, fpgaPropertiesSetObjectType(filters[0], FPGA_ACCELERATOR));
+
+  for (uint32_t i = 0; i < num_devs; ++i) {
+    EXPECT_EQ(0 == i % 3, filter_set_match(&set, &devs[i])) << i;
+  }
+
+  filter_set_free(&set);
+  destroy_filters(filters);
+}
+
+/**
+* @test    filter_set_03
+* @brief   Tests: filter_set_compile, filter_set_match
+* @details A compiled set of mixed filters matches a device exactly when
+*          one of the filters, compiled on its own, matches it.
+*/
+TEST(LibopaecEnumFilterCommonALL, filter_set_03) {
+  const uint32_t num_devs = 512;
+  struct filter_set set;
+  std::vector<fpga_properties> filters;
+  std::mt19937 gen(1234);
+  auto devs = make_devs(num_devs);
+
+  for (int i = 0; i < 64; ++i) {
+    fpga_properties f = NULL;
+    ASSERT_EQ(FPGA_OK, fpgaGetProperties(NULL, &f));
+
+    uint32_t pick = gen();
+    if (pick & 1) {
+      fpga_objtype t = (pick & 2) ? FPGA_ACCELERATOR : FPGA_DEVICE;
+      ASSERT_EQ(FPGA_OK, fpgaPropertiesSetObjectType(f, t));
+      if (t == FPGA_ACCELERATOR && (pick & 4)) {
+        ASSERT_EQ(FPGA_OK, fpgaPropertiesSetNumMMIO(f, (pick >> 8) % 3));
+      }
+      if (t == FPGA_ACCELERATOR && (pick & 8)) {
+        ASSERT_EQ(FPGA_OK, fpgaPropertiesSetAcceleratorState(
+                               f, FPGA_ACCELERATOR_ASSIGNED));
+      }
+    }
+    if (pick & 16) {
+      fpga_guid guid;
+      make_guid(guid, (pick >> 12) % num_devs);
+      ASSERT_EQ(FPGA_OK, fpgaPropertiesSetGUID(f, guid));
+    } else {
+      ASSERT_EQ(FPGA_OK, fpgaPropertiesSetBus(f, (pick >> 20) & 0xff));
+    }
+    if (pick & 64) {
+      ASSERT_EQ(FPGA_OK, fpgaPropertiesSetDeviceID(
+                             f, (pick & 128) ? 0xbcc0 : 0x09c4));
+    }
+    filters.push_back(f);
+  }
+
+  ASSERT_EQ(FPGA_OK, filter_set_compile(filters.data(), filters.size(), &set));
+
+  std::vector<struct filter_set> singles(filters.size());
+  for (size_t i = 0; i < filters.size(); ++i) {
+    ASSERT_EQ(FPGA_OK, filter_set_compile(&filters[i], 1, &singles[i]));
+  }
+
+  uint32_t matched = 0;
+  for (auto &d : devs) {
+    bool any = false;
+    for (auto &s : singles) {
+      any = any || filter_set_match(&s, &d);
+    }
+    EXPECT_EQ(any, filter_set_match(&set, &d)) << d.sysfspath;
+    matched += any;
+  }
+  EXPECT_GT(matched, 0);
+  EXPECT_LT(matched, num_devs);
+
+  for (auto &s : singles) {
+    filter_set_free(&s);
+  }
+  filter_set_free(&set);
+  destroy_filters(filters);
+}
+
+/**
+* @test    filter_set_04
+* @brief   Tests: filter_set_compile, filter_set_match
+* @details A filter on a NULL parent token never matches, and a filter on
+*          a parent FME only matches accelerators below that FME.
+*/
+TEST(LibopaecEnumFilterCommonALL, filter_set_04) {
+  struct filter_set set;
+  struct _fpga_token fme;
+  fpga_properties f = NULL;
+  auto devs = make_devs(4);
+
+  memset(&fme, 0, sizeof(fme));
+  fme.magic = FPGA_TOKEN_MAGIC;
+  snprintf(fme.sysfspath, sizeof(fme.sysfspath),
+           SYSFS_FPGA_CLASS_PATH SYSFS_FME_PATH_FMT, 1, 1);
+
+  ASSERT_EQ(FPGA_OK, fpgaGetProperties(NULL, &f));
+  ASSERT_EQ(FPGA_OK, fpgaPropertiesSetParent(f, &fme));
+
+  ASSERT_EQ(FPGA_OK, filter_set_compile(&f, 1, &set));
+  EXPECT_FALSE(filter_set_match(&set, &devs[0]));
+  EXPECT_TRUE(filter_set_match(&set, &devs[1]));
+  EXPECT_FALSE(filter_set_match(&set, &devs[2]));
+  EXPECT_FALSE(filter_set_match(&set, &devs[3]));
+  filter_set_free(&set);
+
+  struct _fpga_properties *_f = (struct _fpga_properties *)f;
+  _f->parent = NULL;
+  ASSERT_EQ(FPGA_OK, filter_set_compile(&f, 1, &set));
+  EXPECT_EQ(0, set.num_entries);
+  EXPECT_FALSE(filter_set_match(&set, &devs[1]));
+  filter_set_free(&set);
+
+  EXPECT_EQ(FPGA_OK, fpgaDestroyProperties(&f));
+}
@@ -0,0 +1,485 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef __cplusplus
+
+extern "C" {
+#endif
+#include "event_int.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+/*
+ * In-process stand-in for fpgad speaking the version 2 event protocol.
+ * Each entry is answered with a result derived from its owner, so that
+ * tests can tell whether responses reach the right sender.
+ *
+ * With v1 set it behaves like an fpgad from before the batch protocol:
+ * it reads fixed size requests, ignores those it doesn't know and never
+ * answers.
+ */
+class FakeFpgad {
+ public:
+  FakeFpgad(bool v1 = false)
+      : accepts(0), entries(0), fds(0), registers(0), unregisters(0),
+        v1_(v1), closed_(0) {
+    snprintf(path_, sizeof(path_), "/tmp/opae_fake_fpgad.%d", getpid());
+    unlink(path_);
+
+    listen_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path_, sizeof(addr.sun_path) - 1);
+    bind(listen_, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listen_, SOMAXCONN);
+
+    acceptor_ = std::thread([this]() {
+      int conn;
+      while ((conn = accept(listen_, NULL, NULL)) >= 0) {
+        ++accepts;
+        std::lock_guard<std::mutex> guard(lock_);
+        conns_.push_back(conn);
+        if (v1_)
+          servers_.emplace_back(&FakeFpgad::serve_v1, this, conn);
+        else
+          servers_.emplace_back(&FakeFpgad::serve, this, conn);
+      }
+    });
+  }
+
+  ~FakeFpgad() {
+    shutdown(listen_, SHUT_RDWR);
+    acceptor_.join();
+    close(listen_);
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      for (int conn : conns_) shutdown(conn, SHUT_RDWR);
+    }
+    for (auto &t : servers_) t.join();
+    for (int conn : conns_) close(conn);
+    unlink(path_);
+  }
+
+  static fpga_result result_for(uint64_t owner) {
+    return static_cast<fpga_result>(owner % 4);
+  }
+
+  const char *path() const { return path_; }
+
+  // break all client connections, as an fpgad restart would
+  void drop() {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (int conn : conns_) shutdown(conn, SHUT_RDWR);
+  }
+
+  // wait until n connections were closed by the client and fully read
+  bool wait_closed(int n) {
+    std::unique_lock<std::mutex> guard(lock_);
+    return closed_cv_.wait_for(guard, std::chrono::seconds(5),
+                               [&]() { return closed_ >= n; });
+  }
+
+  std::atomic<int> accepts;
+  std::atomic<int> entries;
+  std::atomic<int> fds;
+  std::atomic<int> registers;
+  std::atomic<int> unregisters;
+
+ private:
+  void serve_v1(int conn) {
+    struct event_request req;
+    char buf[CMSG_SPACE(sizeof(int))];
+
+    for (;;) {
+      struct iovec iov = {&req, sizeof(req)};
+      struct msghdr mh;
+      memset(&mh, 0, sizeof(mh));
+      mh.msg_iov = &iov;
+      mh.msg_iovlen = 1;
+      mh.msg_control = buf;
+      mh.msg_controllen = sizeof(buf);
+
+      ssize_t n = recvmsg(conn, &mh, 0);
+      if (n <= 0) {
+        std::lock_guard<std::mutex> guard(lock_);
+        ++closed_;
+        closed_cv_.notify_all();
+        return;
+      }
+      for (struct cmsghdr *cmh = CMSG_FIRSTHDR(&mh); cmh;
+           cmh = CMSG_NXTHDR(&mh, cmh)) {
+        close(*(int *)CMSG_DATA(cmh));
+        ++fds;
+      }
+
+      if (n != sizeof(req)) continue;
+      if (req.type == REGISTER_EVENT) ++registers;
+      if (req.type == UNREGISTER_EVENT) ++unregisters;
+    }
+  }
+
+  void serve(int conn) {
+    struct event_batch_header hdr;
+    struct event_batch_entry batch[EVENT_BATCH_MAX];
+    char buf[CMSG_SPACE(EVENT_BATCH_MAX * sizeof(int))];
+
+    for (;;) {
+      struct iovec iov = {&hdr, sizeof(hdr)};
+      struct msghdr mh;
+      memset(&mh, 0, sizeof(mh));
+      mh.msg_iov = &iov;
+      mh.msg_iovlen = 1;
+      mh.msg_control = buf;
+      mh.msg_controllen = sizeof(buf);
+
+      if (recvmsg(conn, &mh, MSG_WAITALL) != sizeof(hdr)) return;
+      for (struct cmsghdr *cmh = CMSG_FIRSTHDR(&mh); cmh;
+           cmh = CMSG_NXTHDR(&mh, cmh)) {
+        int n = (cmh->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < n; ++i) close(((int *)CMSG_DATA(cmh))[i]);
+        fds += n;
+      }
+
+      if (hdr.type != EVENT_BATCH || hdr.count > EVENT_BATCH_MAX) return;
+      size_t len = hdr.count * sizeof(batch[0]);
+      // a zero length MSG_WAITALL recv would still wait for a byte
+      if (len && recv(conn, batch, len, MSG_WAITALL) != (ssize_t)len) return;
+
+      struct event_batch_response rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.version = EVENT_PROTOCOL_VERSION;
+      rsp.id = hdr.id;
+      rsp.count = hdr.count;
+      for (uint32_t i = 0; i < hdr.count; ++i)
+        rsp.result[i] = result_for(batch[i].owner);
+      entries += hdr.count;
+
+      if (send(conn, &rsp, sizeof(rsp), MSG_NOSIGNAL) != sizeof(rsp)) return;
+    }
+  }
+
+  bool v1_;
+  char path_[64];
+  int listen_;
+  std::mutex lock_;
+  std::condition_variable closed_cv_;
+  int closed_;
+  std::vector<int> conns_;
+  std::thread acceptor_;
+  std::vector<std::thread> servers_;
+};
+
+class LibopaecEventDaemonCommonALL : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    fake_ = new FakeFpgad();
+    setenv("LIBOPAE_EVENT_SOCKET", fake_->path(), 1);
+    event_daemon_disconnect();
+    efd_ = eventfd(0, 0);
+    ASSERT_GE(efd_, 0);
+  }
+
+  virtual void TearDown() {
+    event_daemon_disconnect();
+    unsetenv("LIBOPAE_EVENT_SOCKET");
+    delete fake_;
+    close(efd_);
+  }
+
+  static void make_entry(struct event_batch_entry *e, uint32_t op,
+                         uint64_t owner) {
+    memset(e, 0, sizeof(*e));
+    e->op = op;
+    e->event = FPGA_EVENT_ERROR;
+    e->owner = owner;
+    snprintf(e->device, sizeof(e->device),
+             "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-port.0");
+  }
+
+  FakeFpgad *fake_;
+  int efd_;
+};
+
+/**
+* @test    event_daemon_01
+* @brief   Tests: event_daemon_request
+* @details All requests of a process share one connection, and each is
+*          acknowledged with the result of its entry.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_01) {
+  struct event_batch_entry entry;
+  fpga_result result;
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    make_entry(&entry, EVENT_OP_REGISTER, i);
+    ASSERT_EQ(FPGA_OK, event_daemon_request(&entry, &efd_, 1, &result));
+    EXPECT_EQ(FakeFpgad::result_for(i), result);
+  }
+
+  EXPECT_EQ(1, fake_->accepts);
+  EXPECT_EQ(100, fake_->entries);
+  EXPECT_EQ(100, fake_->fds);
+
+  // a lost connection is re-established by the next request
+  event_daemon_disconnect();
+  make_entry(&entry, EVENT_OP_UNREGISTER_ALL, 0);
+  EXPECT_EQ(FPGA_OK, event_daemon_request(&entry, NULL, 1, &result));
+  EXPECT_EQ(2, fake_->accepts);
+
+  EXPECT_EQ(FPGA_INVALID_PARAM, event_daemon_request(&entry, NULL, 0, &result));
+  EXPECT_EQ(FPGA_INVALID_PARAM,
+            event_daemon_request(&entry, NULL, EVENT_BATCH_MAX + 1, &result));
+}
+
+/**
+* @test    event_daemon_02
+* @brief   Tests: event_daemon_request
+* @details A batch carries registrations for several owners, devices and
+*          event types in one message, with one eventfd per registration.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_02) {
+  struct event_batch_entry entries[EVENT_BATCH_MAX];
+  fpga_result results[EVENT_BATCH_MAX];
+  int fds[EVENT_BATCH_MAX];
+  int nfds = 0;
+
+  for (uint32_t i = 0; i < EVENT_BATCH_MAX; ++i) {
+    make_entry(&entries[i], i % 3 ? EVENT_OP_REGISTER : EVENT_OP_UNREGISTER,
+               i);
+    entries[i].event = i % 2 ? FPGA_EVENT_ERROR : FPGA_EVENT_POWER_THERMAL;
+    entries[i].device[strlen(entries[i].device) - 1] = '0' + (i % 2);
+    if (entries[i].op == EVENT_OP_REGISTER) fds[nfds++] = efd_;
+  }
+
+  ASSERT_EQ(FPGA_OK,
+            event_daemon_request(entries, fds, EVENT_BATCH_MAX, results));
+  for (uint32_t i = 0; i < EVENT_BATCH_MAX; ++i)
+    EXPECT_EQ(FakeFpgad::result_for(i), results[i]);
+
+  EXPECT_EQ(1, fake_->accepts);
+  EXPECT_EQ(EVENT_BATCH_MAX, fake_->entries);
+  EXPECT_EQ(nfds, fake_->fds);
+}
+
+/**
+* @test    event_daemon_03
+* @brief   Tests: event_daemon_request
+* @details Threads sharing the connection keep several batches in flight
+*          and each gets its own acknowledgment.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_03) {
+  const int num_threads = 8;
+  const int num_requests = 200;
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([this, t, &mismatches]() {
+      struct event_batch_entry entry;
+      fpga_result result;
+      for (int i = 0; i < num_requests; ++i) {
+        uint64_t owner = t * num_requests + i;
+        make_entry(&entry, EVENT_OP_REGISTER, owner);
+        if (event_daemon_request(&entry, &efd_, 1, &result) != FPGA_OK ||
+            result != FakeFpgad::result_for(owner))
+          ++mismatches;
+      }
+    });
+  }
+  for (auto &th : threads) th.join();
+
+  EXPECT_EQ(0, mismatches);
+  EXPECT_EQ(1, fake_->accepts);
+  EXPECT_EQ(num_threads * num_requests, fake_->entries);
+}
+
+/**
+* @test    event_daemon_04
+* @brief   Tests: event_daemon_request
+* @details Without a daemon, requests fail with FPGA_NO_DAEMON.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_04) {
+  struct event_batch_entry entry;
+  fpga_result result;
+
+  setenv("LIBOPAE_EVENT_SOCKET", "/tmp/opae_no_such_fpgad", 1);
+  event_daemon_disconnect();
+  make_entry(&entry, EVENT_OP_REGISTER, 0);
+  EXPECT_EQ(FPGA_NO_DAEMON, event_daemon_request(&entry, &efd_, 1, &result));
+}
+
+/**
+* @test    event_daemon_05
+* @brief   Tests: event_daemon_request
+* @details When fpgad does not acknowledge batches, requests fall back to
+*          version 1 messages, over one connection per owner. Closing
+*          that connection releases the owner's registrations.
+*/
+TEST(LibopaecEventDaemonCommonALL_v1, event_daemon_05) {
+  FakeFpgad fake(true);
+  struct event_batch_entry entry;
+  fpga_result result;
+  int efd = eventfd(0, 0);
+
+  ASSERT_GE(efd, 0);
+  setenv("LIBOPAE_EVENT_SOCKET", fake.path(), 1);
+  event_daemon_disconnect();
+
+  for (uint64_t owner = 1; owner <= 2; ++owner) {
+    memset(&entry, 0, sizeof(entry));
+    entry.op = EVENT_OP_REGISTER;
+    entry.event = FPGA_EVENT_ERROR;
+    entry.owner = owner;
+    snprintf(entry.device, sizeof(entry.device),
+             "/sys/class/fpga/intel-fpga-dev.0/intel-fpga-port.0");
+    ASSERT_EQ(FPGA_OK, event_daemon_request(&entry, &efd, 1, &result));
+    EXPECT_EQ(FPGA_OK, result);
+  }
+
+  entry.op = EVENT_OP_UNREGISTER;
+  entry.owner = 1;
+  EXPECT_EQ(FPGA_OK, event_daemon_request(&entry, NULL, 1, &result));
+  EXPECT_EQ(FPGA_OK, result);
+
+  // nothing registered for this owner
+  entry.owner = 3;
+  EXPECT_EQ(FPGA_OK, event_daemon_request(&entry, NULL, 1, &result));
+  EXPECT_EQ(FPGA_INVALID_PARAM, result);
+
+  entry.op = EVENT_OP_UNREGISTER_ALL;
+  entry.owner = 2;
+  EXPECT_EQ(FPGA_OK, event_daemon_request(&entry, NULL, 1, &result));
+  EXPECT_EQ(FPGA_OK, result);
+
+  event_daemon_disconnect();
+  unsetenv("LIBOPAE_EVENT_SOCKET");
+  close(efd);
+
+  // the probe connection, then one per owner
+  ASSERT_TRUE(fake.wait_closed(3));
+  EXPECT_EQ(3, fake.accepts);
+  EXPECT_EQ(2, fake.registers);
+  EXPECT_EQ(1, fake.unregisters);
+  EXPECT_EQ(2, fake.fds);
+}
+
+/**
+* @test    event_daemon_06
+* @brief   Tests: event_daemon_request
+* @details Registrations on a connection each, on the shared connection
+*          and in full batches all reach the daemon and are answered;
+*          only reconnecting opens new connections.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_06) {
+  const int num = 256;
+  struct event_batch_entry entries[EVENT_BATCH_MAX];
+  fpga_result results[EVENT_BATCH_MAX];
+  int fds[EVENT_BATCH_MAX];
+  int i, j;
+
+  for (i = 0; i < EVENT_BATCH_MAX; ++i) {
+    make_entry(&entries[i], EVENT_OP_REGISTER, 0);
+    fds[i] = efd_;
+  }
+
+  for (i = 0; i < num; ++i) {
+    event_daemon_disconnect();
+    ASSERT_EQ(FPGA_OK, event_daemon_request(entries, fds, 1, results));
+    EXPECT_EQ(FPGA_OK, results[0]);
+  }
+  EXPECT_EQ(num, fake_->accepts);
+
+  for (i = 0; i < num; ++i) {
+    ASSERT_EQ(FPGA_OK, event_daemon_request(entries, fds, 1, results));
+    EXPECT_EQ(FPGA_OK, results[0]);
+  }
+
+  for (i = 0; i < num; i += EVENT_BATCH_MAX) {
+    ASSERT_EQ(FPGA_OK, event_daemon_request(entries, fds, EVENT_BATCH_MAX,
+                                            results));
+    for (j = 0; j < EVENT_BATCH_MAX; ++j) EXPECT_EQ(FPGA_OK, results[j]);
+  }
+
+  EXPECT_EQ(num, fake_->accepts);
+  EXPECT_EQ(3 * num, fake_->entries);
+  EXPECT_EQ(3 * num, fake_->fds);
+}
+
+/**
+* @test    event_daemon_07
+* @brief   Tests: event_daemon_request
+* @details When the shared connection fails, the registrations fpgad
+*          accepted over it and that were not unregistered are made
+*          again over a new connection.
+*/
+TEST_F(LibopaecEventDaemonCommonALL, event_daemon_07) {
+  struct event_batch_entry entry;
+  fpga_result result;
+
+  // owner 1 is refused by the daemon
+  for (uint64_t owner : {0, 1, 4, 8}) {
+    make_entry(&entry, EVENT_OP_REGISTER, owner);
+    ASSERT_EQ(FPGA_OK, event_daemon_request(&entry, &efd_, 1, &result));
+  }
+  make_entry(&entry, EVENT_OP_UNREGISTER, 8);
+  ASSERT_EQ(FPGA_OK, event_daemon_request(&entry, NULL, 1, &result));
+  EXPECT_EQ(FPGA_OK, result);
+  EXPECT_EQ(5, fake_->entries);
+  EXPECT_EQ(4, fake_->fds);
+
+  fake_->drop();
+  make_entry(&entry, EVENT_OP_REGISTER, 12);
+  EXPECT_NE(FPGA_OK, event_daemon_request(&entry, &efd_, 1, &result));
+
+  // owners 0 and 4 were registered again
+  EXPECT_EQ(2, fake_->accepts);
+  EXPECT_EQ(7, fake_->entries);
+  EXPECT_EQ(6, fake_->fds);
+
+  ASSERT_EQ(FPGA_OK, event_daemon_request(&entry, &efd_, 1, &result));
+  EXPECT_EQ(FPGA_OK, result);
+  EXPECT_EQ(2, fake_->accepts);
+  EXPECT_EQ(8, fake_->entries);
+}
@@ -0,0 +1,132 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifdef __cplusplus
+
+extern "C" {
+#endif
+#include "token_list_int.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "types_int.h"
+
+#define TOKEN_TEST_BASE 9000
+#define TOKEN_TEST_COUNT 1000
+
+static void fme_path(char *buf, size_t len, int i) {
+  snprintf(buf, len, SYSFS_FPGA_CLASS_PATH SYSFS_FME_PATH_FMT, i, i);
+}
+
+static void port_path(char *buf, size_t len, int i) {
+  snprintf(buf, len, SYSFS_FPGA_CLASS_PATH SYSFS_AFU_PATH_FMT, i, i);
+}
+
+/**
+* @test    token_list_01
+* @brief   Tests: token_add, token_get_parent
+* @details Adding the same paths twice returns the same token, and an
+*          AFU token finds the FME token of the same device as parent.
+*/
+TEST(LibopaecTokenListCommonALL, token_list_01) {
+  char fme[SYSFS_PATH_MAX];
+  char port[SYSFS_PATH_MAX];
+  int i = TOKEN_TEST_BASE - 1;
+
+  fme_path(fme, sizeof(fme), i);
+  port_path(port, sizeof(port), i);
+
+  struct _fpga_token *afu = token_add(port, "/dev/intel-fpga-port.x");
+  ASSERT_NE(nullptr, afu);
+  EXPECT_EQ(FPGA_TOKEN_MAGIC, afu->magic);
+  EXPECT_EQ(i, afu->instance);
+  EXPECT_EQ(nullptr, token_get_parent(afu));
+
+  struct _fpga_token *dev = token_add(fme, "/dev/intel-fpga-fme.x");
+  ASSERT_NE(nullptr, dev);
+  EXPECT_EQ(dev, token_add(fme, "/dev/intel-fpga-fme.x"));
+  EXPECT_NE(dev, token_add(fme, "/dev/intel-fpga-fme.y"));
+  EXPECT_EQ(nullptr, token_get_parent(dev));
+
+  struct _fpga_token *parent = token_get_parent(afu);
+  ASSERT_NE(nullptr, parent);
+  EXPECT_STREQ(fme, parent->sysfspath);
+
+  EXPECT_EQ(nullptr, token_add("/sys/class/fpga/nodot", "/dev/null"));
+}
+
+/**
+* @test    token_list_02
+* @brief   Tests: token_add, token_get_parent
+* @details Threads racing to add the same set of paths all get the same
+*          token for each path, across growth of the registry.
+*/
+TEST(LibopaecTokenListCommonALL, token_list_02) {
+  const int num_threads = 8;
+  std::vector<std::vector<struct _fpga_token *>> seen(num_threads);
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([t, &seen]() {
+      char path[SYSFS_PATH_MAX];
+      for (int i = 0; i < TOKEN_TEST_COUNT; ++i) {
+        int n = (i + t * 97) % TOKEN_TEST_COUNT;
+        fme_path(path, sizeof(path), TOKEN_TEST_BASE + n);
+        seen[t].push_back(token_add(path, "/dev/intel-fpga-fme"));
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+
+  char path[SYSFS_PATH_MAX];
+  for (int i = 0; i < TOKEN_TEST_COUNT; ++i) {
+    fme_path(path, sizeof(path), TOKEN_TEST_BASE + i);
+    struct _fpga_token *tok = token_add(path, "/dev/intel-fpga-fme");
+    ASSERT_NE(nullptr, tok);
+    EXPECT_STREQ(path, tok->sysfspath);
+    for (int t = 0; t < num_threads; ++t) {
+      int idx = (i - t * 97 % TOKEN_TEST_COUNT + TOKEN_TEST_COUNT) %
+                TOKEN_TEST_COUNT;
+      EXPECT_EQ(tok, seen[t][idx]);
+    }
+
+    char port[SYSFS_PATH_MAX];
+    port_path(port, sizeof(port), TOKEN_TEST_BASE + i);
+    struct _fpga_token *afu = token_add(port, "/dev/intel-fpga-port");
+    ASSERT_NE(nullptr, afu);
+    EXPECT_EQ(tok, token_get_parent(afu));
+  }
+}
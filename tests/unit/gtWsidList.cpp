@@ -0,0 +1,181 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef __cplusplus
+
+extern "C" {
+#endif
+#include "wsid_list_int.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "types_int.h"
+
+#define WSID_COUNT 10000
+
+static int cleaned;
+
+static void count_clean(struct wsid_map *wm) {
+  (void)wm;
+  ++cleaned;
+}
+
+/**
+* @test    wsid_list_01
+* @brief   Tests: wsid_add, wsid_find, wsid_del
+* @details Entries added to a tracker can be found by wsid until they
+*          are deleted, and deleting an unknown wsid fails.
+*/
+TEST(LibopaecWsidListCommonALL, wsid_list_01) {
+  struct wsid_tracker *root = wsid_tracker_init(4);
+  ASSERT_NE(nullptr, root);
+
+  EXPECT_TRUE(wsid_add(root, 10, 0x1000, 0x2000, 4096, 0, 0, 0));
+  EXPECT_TRUE(wsid_add(root, 11, 0x3000, 0x4000, 4096, 0, 0, 0));
+
+  struct wsid_map *wm = wsid_find(root, 10);
+  ASSERT_NE(nullptr, wm);
+  EXPECT_EQ(0x1000, wm->addr);
+  EXPECT_EQ(0x2000, wm->phys);
+  EXPECT_EQ(nullptr, wsid_find(root, 12));
+
+  EXPECT_TRUE(wsid_del(root, 10));
+  EXPECT_EQ(nullptr, wsid_find(root, 10));
+  EXPECT_FALSE(wsid_del(root, 10));
+  ASSERT_NE(nullptr, wsid_find(root, 11));
+
+  cleaned = 0;
+  wsid_tracker_cleanup(root, count_clean);
+  EXPECT_EQ(1, cleaned);
+}
+
+/**
+* @test    wsid_list_02
+* @brief   Tests: wsid_tracker_init, wsid_add
+* @details A tracker grows past its initial capacity, including past the
+*          former 16384 bucket limit, and keeps every entry reachable.
+*/
+TEST(LibopaecWsidListCommonALL, wsid_list_02) {
+  EXPECT_EQ(nullptr, wsid_tracker_init(0));
+
+  struct wsid_tracker *root = wsid_tracker_init(2);
+  ASSERT_NE(nullptr, root);
+
+  for (uint64_t i = 0; i < 20000; ++i) {
+    ASSERT_TRUE(wsid_add(root, i, i * 4096, i, 4096, 0, 0, 0));
+  }
+  EXPECT_GT(root->by_wsid.n_slots, 20000);
+
+  for (uint64_t i = 0; i < 20000; i += 2) {
+    ASSERT_TRUE(wsid_del(root, i));
+  }
+  for (uint64_t i = 0; i < 20000; ++i) {
+    struct wsid_map *wm = wsid_find(root, i);
+    if (i % 2) {
+      ASSERT_NE(nullptr, wm);
+      EXPECT_EQ(i, wm->phys);
+    } else {
+      EXPECT_EQ(nullptr, wm);
+    }
+  }
+
+  wsid_tracker_cleanup(root, NULL);
+}
+
+/**
+* @test    wsid_list_03
+* @brief   Tests: wsid_find_by_index, wsid_find_by_addr
+* @details The secondary indices return an entry with the requested
+*          index or address, and follow deletions.
+*/
+TEST(LibopaecWsidListCommonALL, wsid_list_03) {
+  struct wsid_tracker *root = wsid_tracker_init(4);
+  ASSERT_NE(nullptr, root);
+
+  EXPECT_TRUE(wsid_add(root, 100, 0xa000, 0, 0x40000, 0xa000, 0, 0));
+  EXPECT_TRUE(wsid_add(root, 101, 0xb000, 0, 0x40000, 0xb000, 1, 0));
+  EXPECT_TRUE(wsid_add(root, 102, 0xc000, 0, 0x40000, 0xc000, 1, 0));
+
+  ASSERT_NE(nullptr, wsid_find_by_index(root, 0));
+  EXPECT_EQ(100, wsid_find_by_index(root, 0)->wsid);
+  ASSERT_NE(nullptr, wsid_find_by_index(root, 1));
+  EXPECT_EQ(nullptr, wsid_find_by_index(root, 2));
+
+  ASSERT_NE(nullptr, wsid_find_by_addr(root, 0xb000));
+  EXPECT_EQ(101, wsid_find_by_addr(root, 0xb000)->wsid);
+  EXPECT_EQ(nullptr, wsid_find_by_addr(root, 0xb008));
+
+  EXPECT_TRUE(wsid_del(root, 102));
+  ASSERT_NE(nullptr, wsid_find_by_index(root, 1));
+  EXPECT_EQ(101, wsid_find_by_index(root, 1)->wsid);
+  EXPECT_TRUE(wsid_del(root, 101));
+  EXPECT_EQ(nullptr, wsid_find_by_index(root, 1));
+  EXPECT_EQ(nullptr, wsid_find_by_addr(root, 0xb000));
+  EXPECT_TRUE(wsid_del(root, 100));
+  EXPECT_EQ(nullptr, wsid_find_by_index(root, 0));
+
+  wsid_tracker_cleanup(root, NULL);
+}
+
+/**
+* @test    wsid_list_04
+* @brief   Tests: wsid_add, wsid_find, wsid_del
+* @details Adds 10k wsids, as generated by wsid_gen(), to a tracker
+*          that has to grow well past its initial size, finds every one
+*          of them with its own mapping, then deletes them all.
+*/
+TEST(LibopaecWsidListCommonALL, wsid_list_04) {
+  std::vector<uint64_t> wsids(WSID_COUNT);
+  struct wsid_tracker *root = wsid_tracker_init(1024);
+  ASSERT_NE(nullptr, root);
+
+  for (auto &w : wsids) w = wsid_gen();
+
+  for (size_t i = 0; i < wsids.size(); ++i) {
+    ASSERT_TRUE(wsid_add(root, wsids[i], i * 4096, i * 4096, 4096, 0, 0, 0));
+  }
+  EXPECT_EQ((uint64_t)WSID_COUNT, root->by_wsid.n_used);
+
+  for (size_t i = 0; i < wsids.size(); ++i) {
+    struct wsid_map *wm = wsid_find(root, wsids[i]);
+    ASSERT_NE(nullptr, wm);
+    EXPECT_EQ(wsids[i], wm->wsid);
+    EXPECT_EQ(i * 4096, wm->phys);
+  }
+
+  for (size_t i = 0; i < wsids.size(); ++i) {
+    ASSERT_TRUE(wsid_del(root, wsids[i]));
+    EXPECT_EQ(nullptr, wsid_find(root, wsids[i]));
+  }
+
+  EXPECT_EQ(0, root->by_wsid.n_used);
+  wsid_tracker_cleanup(root, NULL);
+}
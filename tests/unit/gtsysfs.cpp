@@ -235,4 +235,108 @@ TEST(LibopaecsysfsCommonMOCKHW, fpga_sysfs_02) {
 	EXPECT_NE(result, FPGA_OK);
 
 	EXPECT_EQ(FPGA_OK, fpgaClose(h));
-}
\ No newline at end of file
+}
+
+static void write_attr(const std::string &path, const char *value) {
+	FILE *fp = fopen(path.c_str(), "w");
+	ASSERT_NE(nullptr, fp);
+	fputs(value, fp);
+	fclose(fp);
+}
+
+/**
+* @test    fpga_sysfs_03
+* @brief   Tests: sysfs_read_u64, sysfs_read_u32, sysfs_cache_flush
+* @details Volatile attributes are re-read on every call, immutable ones
+*          (e.g. bitstream_id) are served from the cache until it is
+*          flushed.
+*/
+TEST(LibopaecsysfsCommonMOCKHW, fpga_sysfs_03) {
+	char tmpl[] = "/tmp/gtsysfs-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(tmpl));
+	std::string dir(tmpl);
+	std::string errors = dir + "/errors";
+	std::string bsid = dir + "/" FPGA_SYSFS_BITSTREAM_ID;
+	uint64_t u64 = 0;
+	uint32_t u32 = 0;
+
+	write_attr(errors, "0x10\n");
+	write_attr(bsid, "0x1234\n");
+
+	for (int i = 0; i < 3; ++i) {
+		EXPECT_EQ(FPGA_OK, sysfs_read_u64(errors.c_str(), &u64));
+		EXPECT_EQ(0x10, u64);
+		EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+		EXPECT_EQ(0x1234, u64);
+	}
+
+	write_attr(errors, "0x2000\n");
+	write_attr(bsid, "0x5678\n");
+
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(errors.c_str(), &u64));
+	EXPECT_EQ(0x2000, u64);
+	EXPECT_EQ(FPGA_OK, sysfs_read_u32(errors.c_str(), &u32));
+	EXPECT_EQ(0x2000, u32);
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x1234, u64);
+
+	sysfs_cache_flush();
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x5678, u64);
+
+	// with the cache disabled, every read goes to the file
+	sysfs_cache_enable(false);
+	write_attr(bsid, "0x9abc\n");
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x9abc, u64);
+	sysfs_cache_enable(true);
+
+	unlink(errors.c_str());
+	unlink(bsid.c_str());
+	rmdir(dir.c_str());
+
+	EXPECT_NE(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	sysfs_cache_flush();
+}
+
+/**
+* @test    fpga_sysfs_04
+* @brief   Tests: sysfs_read_u64, sysfs_read_int, fpgaEnumerate
+* @details Immutable attributes are only immutable for the lifetime of a
+*          device: every sysfs scan by fpgaEnumerate reads them again,
+*          so a FIM update is seen without invalidating any cache.
+*/
+TEST(LibopaecsysfsCommonMOCKHW, fpga_sysfs_04) {
+	char tmpl[] = "/tmp/gtsysfs-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(tmpl));
+	std::string dir(tmpl);
+	std::string bsid = dir + "/" FPGA_SYSFS_BITSTREAM_ID;
+	std::string socket = dir + "/" FPGA_SYSFS_SOCKET_ID;
+	uint32_t num_matches = 0;
+	uint64_t u64 = 0;
+	int i = -1;
+
+	write_attr(bsid, "0x1234\n");
+	write_attr(socket, "0\n");
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x1234, u64);
+	EXPECT_EQ(FPGA_OK, sysfs_read_int(socket.c_str(), &i));
+	EXPECT_EQ(0, i);
+
+	write_attr(bsid, "0x5678\n");
+	write_attr(socket, "1\n");
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x1234, u64);
+
+	// the enumeration cache is disabled, so this rescans sysfs
+	fpgaEnumerate(NULL, 0, NULL, 0, &num_matches);
+	EXPECT_EQ(FPGA_OK, sysfs_read_u64(bsid.c_str(), &u64));
+	EXPECT_EQ(0x5678, u64);
+	EXPECT_EQ(FPGA_OK, sysfs_read_int(socket.c_str(), &i));
+	EXPECT_EQ(1, i);
+
+	unlink(bsid.c_str());
+	unlink(socket.c_str());
+	rmdir(dir.c_str());
+	sysfs_cache_flush();
+}
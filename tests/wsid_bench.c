@@ -0,0 +1,140 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+
+/*
+ * Workspace ID tracker benchmark
+ *
+ * Adds wsids as generated by wsid_gen() to a tracker that starts at the
+ * size libopae uses for buffers and has to grow, looks each of them up by
+ * wsid, by address and by an address inside the buffer, then deletes
+ * them, and reports the average cost of each operation.
+ *
+ * Usage: wsid-bench [wsids]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "types_int.h"
+#include "wsid_list_int.h"
+
+#define BENCH_DEFAULT_WSIDS 100000
+#define BENCH_BUCKETS       1024
+#define BENCH_PAGE          4096
+
+static double now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count = BENCH_DEFAULT_WSIDS;
+	struct wsid_tracker *root = NULL;
+	uint64_t *wsids = NULL;
+	uint64_t phys;
+	double t[5];
+	uint64_t i;
+	int ret = 1;
+
+	if (argc > 1)
+		count = strtoull(argv[1], NULL, 0);
+	if (!count) {
+		fprintf(stderr, "Usage: %s [wsids]\n", argv[0]);
+		return 1;
+	}
+
+	wsids = malloc(count * sizeof(*wsids));
+	root = wsid_tracker_init(BENCH_BUCKETS);
+	if (!wsids || !root) {
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+	for (i = 0 ; i < count ; ++i)
+		wsids[i] = wsid_gen();
+
+	t[0] = now_nsec();
+	for (i = 0 ; i < count ; ++i) {
+		if (!wsid_add(root, wsids[i], i * BENCH_PAGE, i * BENCH_PAGE,
+			      BENCH_PAGE, 0, i, 0)) {
+			fprintf(stderr, "wsid_add failed at %" PRIu64 "\n", i);
+			goto out;
+		}
+	}
+
+	t[1] = now_nsec();
+	for (i = 0 ; i < count ; ++i) {
+		if (!wsid_find(root, wsids[i])) {
+			fprintf(stderr, "wsid_find failed at %" PRIu64 "\n", i);
+			goto out;
+		}
+	}
+
+	t[2] = now_nsec();
+	for (i = 0 ; i < count ; ++i) {
+		if (!wsid_find_by_addr(root, i * BENCH_PAGE)) {
+			fprintf(stderr, "wsid_find_by_addr failed at %" PRIu64
+				"\n", i);
+			goto out;
+		}
+	}
+
+	t[3] = now_nsec();
+	for (i = 0 ; i < count ; ++i) {
+		if (!wsid_find_phys_by_va(root, i * BENCH_PAGE + 8, &phys)) {
+			fprintf(stderr, "wsid_find_phys_by_va failed at %"
+				PRIu64 "\n", i);
+			goto out;
+		}
+	}
+
+	t[4] = now_nsec();
+	for (i = 0 ; i < count ; ++i) {
+		if (!wsid_del(root, wsids[i])) {
+			fprintf(stderr, "wsid_del failed at %" PRIu64 "\n", i);
+			goto out;
+		}
+	}
+
+	printf("wsid tracker cost over %" PRIu64 " wsids (nsec)\n", count);
+	printf("%-22s %10.1f\n", "wsid_add", (t[1] - t[0]) / count);
+	printf("%-22s %10.1f\n", "wsid_find", (t[2] - t[1]) / count);
+	printf("%-22s %10.1f\n", "wsid_find_by_addr", (t[3] - t[2]) / count);
+	printf("%-22s %10.1f\n", "wsid_find_phys_by_va",
+	       (t[4] - t[3]) / count);
+	printf("%-22s %10.1f\n", "wsid_del", (now_nsec() - t[4]) / count);
+	ret = 0;
+
+out:
+	if (root)
+		wsid_tracker_cleanup(root, NULL);
+	free(wsids);
+	return ret;
+}
@@ -32,6 +32,8 @@
 #include "evt.h"
 #include "log.h"
 #include "config_int.h"
+#include "monitor.h"
+#include "ring.h"
 
 #include "safe_string/safe_string.h"
 
@@ -43,32 +45,31 @@ enum fpga_power_state {
 };
 
 
-static int read_event(char *sysfspath, uint64_t *value)
+/* last value of reg, or 0 if the file doesn't exist (e.g. single-socket) */
+static uint64_t read_event(struct monitor *m, int reg)
 {
-	struct stat st;
-	int i;
-	fpga_result res;
-
-	if (sysfspath == NULL || value == NULL) {
-		return -1;
-	}
-
-	i = stat(sysfspath, &st);
-	if (i != 0) {// file may not exist on single-socket.
+	if (!mon_reg_present(m, reg))
 		return 0;
-	}
 
-	res = sysfs_read_u64(sysfspath, value);
-	if (res != FPGA_OK) {
-		return -1;
-	}
+	return m->regs[reg].value;
+}
 
-	return 0;
+static void watch_ap_event(struct monitor *m, struct fpga_ap_event *event)
+{
+	snprintf_s_s(event->ap1_path, sizeof(event->ap1_path),
+		"%s/ap1_event", event->sysfsfile);
+	snprintf_s_s(event->ap2_path, sizeof(event->ap2_path),
+		"%s/ap2_event", event->sysfsfile);
+	snprintf_s_s(event->pwr_path, sizeof(event->pwr_path),
+		"%s/power_state", event->sysfsfile);
+
+	event->ap1_reg = mon_add_reg(m, event->ap1_path);
+	event->ap2_reg = mon_add_reg(m, event->ap2_path);
+	event->pwr_reg = mon_add_reg(m, event->pwr_path);
 }
 
-static int poll_ap_event(struct fpga_ap_event *event)
+static int poll_ap_event(struct monitor *m, struct fpga_ap_event *event)
 {
-	char sysfspath[SYSFS_PATH_MAX];
 	uint64_t ap1_event = 0;
 	uint64_t ap2_event = 0;
 	uint64_t pwr_state = 0;
@@ -78,36 +79,29 @@ static int poll_ap_event(struct fpga_ap_event *event)
 	}
 
 	// Read AP1 Event
-	snprintf_s_s(sysfspath, sizeof(sysfspath),
-		"%s/ap1_event", event->sysfsfile);
-
-	if (read_event(sysfspath, &ap1_event) != 0) {
-		return  -1;
-	}
+	ap1_event = read_event(m, event->ap1_reg);
 
 	if (event->ap1_last_event != AP1_STATE && ap1_event == 1) {
 		dlog("AP1 Triggered for socket %d\n", event->socket);
 	}
 
-	// Read AP2 Event
-	snprintf_s_s(sysfspath, sizeof(sysfspath),
-		"%s/ap2_event", event->sysfsfile);
+	if (ap1_event != event->ap1_last_event)
+		ring_publish(FPGA_EVENT_POWER_THERMAL, event->socket,
+			     event->ap1_path, "ap1_event", ap1_event);
 
-	if (read_event(sysfspath, &ap2_event) != 0) {
-		return -1;
-	}
+	// Read AP2 Event
+	ap2_event = read_event(m, event->ap2_reg);
 
 	if (event->ap2_last_event != 1 && ap2_event == 1) {
 		dlog("AP2 Triggered for socket %d\n", event->socket);
 	}
 
-	// Read FPGA power state
-	snprintf_s_s(sysfspath, sizeof(sysfspath),
-		"%s/power_state", event->sysfsfile);
+	if (ap2_event != event->ap2_last_event)
+		ring_publish(FPGA_EVENT_POWER_THERMAL, event->socket,
+			     event->ap2_path, "ap2_event", ap2_event);
 
-	if (read_event(sysfspath, &pwr_state) != 0) {
-		return -1;
-	}
+	// Read FPGA power state
+	pwr_state = read_event(m, event->pwr_reg);
 
 	if (event->pwr_last_state != 1 && pwr_state == AP1_STATE) {
 		dlog(" FPGA Power State changed to AP1 for socket %d\n",
@@ -123,6 +117,10 @@ static int poll_ap_event(struct fpga_ap_event *event)
 				event->socket);
 	}
 
+	if (pwr_state != event->pwr_last_state)
+		ring_publish(FPGA_EVENT_POWER_THERMAL, event->socket,
+			     event->pwr_path, "power_state", pwr_state);
+
 	event->ap1_last_event = ap1_event;
 	event->ap2_last_event = ap2_event;
 	event->pwr_last_state = pwr_state;
@@ -136,6 +134,8 @@ void *apevent_thread(void *thread_context)
 
 	struct fpga_ap_event apevt_socket1;
 	struct fpga_ap_event apevt_socket2;
+	struct monitor mon;
+	int changed;
 
 	memset_s(&apevt_socket1, sizeof(apevt_socket1), 0);
 	memset_s(&apevt_socket2, sizeof(apevt_socket2), 0);
@@ -146,16 +146,21 @@ void *apevent_thread(void *thread_context)
 	apevt_socket1.sysfsfile = SYSFS_PORT0;
 	apevt_socket2.sysfsfile = SYSFS_PORT1;
 
+	mon_init(&mon, c);
+	watch_ap_event(&mon, &apevt_socket1);
+	watch_ap_event(&mon, &apevt_socket2);
+
 	while (c->running) {
 		/* read AP event and power state */
+		changed = mon_read(&mon);
 
-		// AP event polling
-		if ((poll_ap_event(&apevt_socket1) < 0) ||
-			(poll_ap_event(&apevt_socket2) < 0))
-				return NULL;
+		if ((poll_ap_event(&mon, &apevt_socket1) < 0) ||
+			(poll_ap_event(&mon, &apevt_socket2) < 0))
+				break;
 
-		usleep(c->poll_interval_usec);
+		mon_wait(&mon, changed > 0);
 	}
 
+	mon_destroy(&mon);
 	return NULL;
 }
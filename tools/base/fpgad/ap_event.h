@@ -35,6 +35,12 @@ struct fpga_ap_event {
 	uint64_t ap1_last_event;
 	uint64_t ap2_last_event;
 	uint64_t pwr_last_state;
+	char ap1_path[SYSFS_PATH_MAX];
+	char ap2_path[SYSFS_PATH_MAX];
+	char pwr_path[SYSFS_PATH_MAX];
+	int ap1_reg;
+	int ap2_reg;
+	int pwr_reg;
 };
 
 void *apevent_thread(void *);
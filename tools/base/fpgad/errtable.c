@@ -32,15 +32,16 @@
 #include "evt.h"
 #include "log.h"
 #include "config_int.h"
+#include "monitor.h"
 
 #include "safe_string/safe_string.h"
 
 //#define  ACCELERATOR_IRQ(fil, field, l, hi)
-#define PORT_ERR(sock, fil, field, lo, hi)        { sock, fil, field, lo, hi, false, evt_notify_error        }
-#define  FME_ERR(sock, fil, field, lo, hi)        { sock, fil, field, lo, hi, false, evt_notify_error        }
-#define  AP6_ERR(sock, fil, field, lo, hi)        { sock, fil, field, lo, hi, false, evt_notify_ap6          }
-#define  AP6_NULL_ERR(sock, fil, field, lo, hi)   { sock, fil, field, lo, hi, false, evt_notify_ap6_and_null }
-#define TABLE_TERMINATOR                          { 0,    NULL, NULL, 0,  0,  false, NULL                    }
+#define PORT_ERR(sock, fil, field, lo, hi)        { .socket = sock, .sysfsfile = fil, .reg_field = field, .lowbit = lo, .highbit = hi, .callback = evt_notify_error        }
+#define  FME_ERR(sock, fil, field, lo, hi)        { .socket = sock, .sysfsfile = fil, .reg_field = field, .lowbit = lo, .highbit = hi, .callback = evt_notify_error        }
+#define  AP6_ERR(sock, fil, field, lo, hi)        { .socket = sock, .sysfsfile = fil, .reg_field = field, .lowbit = lo, .highbit = hi, .callback = evt_notify_ap6          }
+#define  AP6_NULL_ERR(sock, fil, field, lo, hi)   { .socket = sock, .sysfsfile = fil, .reg_field = field, .lowbit = lo, .highbit = hi, .callback = evt_notify_ap6_and_null }
+#define TABLE_TERMINATOR                          { .sysfsfile = NULL }
 
 struct fpga_err port_error_table_rev_1[] = {
 
@@ -303,57 +304,46 @@ static int log_fpga_error(struct fpga_err *e)
 	return 0;
 }
 
-static int poll_error(struct fpga_err *e)
+/*
+ * Register every error table row with the monitor
+ */
+static void watch_errors(struct monitor *m, struct fpga_err error_table[])
 {
-	int i;
-	int count = 0;
-
-	uint64_t err;
-	uint64_t mask;
-
-	struct stat st;
-
-	fpga_result res;
-
-	i = stat(e->sysfsfile, &st);
-	if (i != 0) // file may not exist on single-socket.
-		return 0;
-
-	err = 0;
-	res = sysfs_read_u64(e->sysfsfile, &err);
-	if (res != FPGA_OK) {
-		return -1;
-	}
-
-	mask = 0;
-	for (i = e->lowbit ; i <= e->highbit ; ++i)
-		mask |= 1ULL << i;
-
-	if (err & mask) {
-		count += log_fpga_error(e);
-	} else {
-		e->occurred = false;
-	}
+	unsigned i;
 
-	return count;
+	for (i = 0 ; error_table[i].sysfsfile ; ++i)
+		error_table[i].reg = mon_add_reg(m, error_table[i].sysfsfile);
 }
 
 /*
- * Poll all known error registers
+ * Check all known error fields against the last register values
  *
  * @returns number of (new) errors that were found
  */
-static int poll_errors(struct fpga_err error_table[])
+static int check_errors(struct monitor *m, struct fpga_err error_table[])
 {
 	unsigned i;
+	int j;
 	int errors = 0;
-	int res;
+
+	uint64_t mask;
 
 	for (i = 0 ; error_table[i].sysfsfile ; ++i) {
-		res = poll_error(&error_table[i]);
-		if (-1 == res)
-			return res;
-		errors += res;
+		struct fpga_err *e = &error_table[i];
+
+		if (!mon_reg_present(m, e->reg)) // file may not exist on single-socket.
+			continue;
+
+		mask = 0;
+		for (j = e->lowbit ; j <= e->highbit ; ++j)
+			mask |= 1ULL << j;
+
+		if (m->regs[e->reg].value & mask) {
+			e->value = (m->regs[e->reg].value & mask) >> e->lowbit;
+			errors += log_fpga_error(e);
+		} else {
+			e->occurred = false;
+		}
 	}
 
 	return errors;
@@ -368,6 +358,8 @@ void *logger_thread(void *thread_context)
 	uint64_t err_rev = 0;
 	struct fpga_err *port_error_table = port_error_table_rev_1;
 	struct fpga_err *fme_error_table  = fme_error_table_rev_1;
+	struct monitor mon;
+	int changed;
 
 	/*
 	 * Check the errors/revision sysfs file to determine
@@ -423,14 +415,25 @@ void *logger_thread(void *thread_context)
 		goto out_exit;
 	}
 
+	/*
+	 * Each distinct error register is read once per cycle, no matter how
+	 * many table rows describe its fields. Reads happen when the driver
+	 * notifies a register file, or when the (adaptive) polling interval
+	 * expires.
+	 */
+	mon_init(&mon, c);
+	watch_errors(&mon, port_error_table);
+	watch_errors(&mon, fme_error_table);
+
 	while (c->running) {
-		/* read port error */
-		if ((poll_errors(port_error_table) < 0) ||
-		    (poll_errors(fme_error_table) < 0))
-			return NULL;
-		usleep(c->poll_interval_usec);
+		changed = mon_read(&mon);
+		check_errors(&mon, port_error_table);
+		check_errors(&mon, fme_error_table);
+		mon_wait(&mon, changed > 0);
 	}
 
+	mon_destroy(&mon);
+
 out_exit:
 	return NULL;
 }
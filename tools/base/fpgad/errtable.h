@@ -60,6 +60,8 @@ struct fpga_err {
 	int highbit;
 	bool occurred;
 	void (*callback)(const struct fpga_err *);
+	int reg;	// index of sysfsfile in the logger's monitor
+	uint64_t value;	// field value when the error was last seen
 };
 
 int daemonize(void (*hndlr)(int, siginfo_t *, void *), mode_t, const char *);
@@ -28,41 +28,44 @@
 #include "srv.h"
 #include "log.h"
 #include "ap6.h"
+#include "ring.h"
 
 #include "safe_string/safe_string.h"
 
 static void evt_notify_error_callback(struct client_event_registry *r,
 			const struct fpga_err *e)
 {
-	if ((FPGA_EVENT_ERROR == r->event) &&
-		!strncmp(e->sysfsfile, r->device, strnlen_s(r->device, sizeof(r->device)))) {
-		dlog("event: FPGA_EVENT_ERROR\n");
-		if (write(r->fd, &r->data, sizeof(r->data)) < 0)
-			dlog("write: %s\n", strerror(errno));
-		r->data++;
-	}
+	UNUSED_PARAM(e);
+	dlog("event: FPGA_EVENT_ERROR\n");
+	if (write(r->fd, &r->data, sizeof(r->data)) < 0)
+		dlog("write: %s\n", strerror(errno));
+	r->data++;
 }
 
 void evt_notify_error(const struct fpga_err *e)
 {
-	for_each_registered_event(evt_notify_error_callback, e);
+	ring_publish(FPGA_EVENT_ERROR, e->socket, e->sysfsfile, e->reg_field,
+		     e->value);
+	for_each_registered_event(FPGA_EVENT_ERROR,
+				  evt_notify_error_callback, e);
 }
 
 static void evt_notify_ap6_callback(struct client_event_registry *r,
 			const struct fpga_err *e)
 {
-	if ((FPGA_EVENT_POWER_THERMAL == r->event) &&
-		!strncmp(e->sysfsfile, r->device, strnlen_s(r->device, sizeof(r->device)))) {
-		dlog("event: FPGA_EVENT_POWER_THERMAL\n");
-		if (write(r->fd, &r->data, sizeof(r->data)) < 0)
-			dlog("write: %s\n", strerror(errno));
-		r->data++;
-	}
+	UNUSED_PARAM(e);
+	dlog("event: FPGA_EVENT_POWER_THERMAL\n");
+	if (write(r->fd, &r->data, sizeof(r->data)) < 0)
+		dlog("write: %s\n", strerror(errno));
+	r->data++;
 }
 
 void evt_notify_ap6(const struct fpga_err *e)
 {
-	for_each_registered_event(evt_notify_ap6_callback, e);
+	ring_publish(FPGA_EVENT_POWER_THERMAL, e->socket, e->sysfsfile,
+		     e->reg_field, e->value);
+	for_each_registered_event(FPGA_EVENT_POWER_THERMAL,
+				  evt_notify_ap6_callback, e);
 }
 
 /* trigger NULL bitstream programming and notify AP6 event clients */
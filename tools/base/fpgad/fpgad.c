@@ -39,6 +39,7 @@
 #include "config_int.h"
 #include "log.h"
 #include "ap_event.h"
+#include "ring.h"
 #include <getopt.h>
 
 #include "safe_string/safe_string.h"
@@ -254,6 +255,9 @@ int main(int argc, char *argv[])
 
 	}
 
+	if (ring_init())
+		dlog("event ring unavailable, clients will only be notified.\n");
+
 	for (i = 0; i < MAX_SOCKETS; i++) {
 		sem_init(&ap6_sem[i], 0, 0);
 
@@ -307,6 +311,8 @@ int main(int argc, char *argv[])
 	for (i = 0; i < MAX_SOCKETS; i++)
 		pthread_join(ap6[i], NULL);
 
+	ring_destroy();
+
 	if (stdout != fLog)
 		close_log();
 
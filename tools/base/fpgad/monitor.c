@@ -0,0 +1,182 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * monitor.c : event-driven watching of sysfs registers.
+ */
+
+#include <poll.h>
+
+#include "monitor.h"
+#include "log.h"
+
+#include "safe_string/safe_string.h"
+
+void mon_init(struct monitor *m, struct config *c)
+{
+	memset_s(m, sizeof(*m), 0);
+	m->c = c;
+	m->interval_usec = c->poll_interval_usec;
+}
+
+void mon_destroy(struct monitor *m)
+{
+	unsigned i;
+
+	for (i = 0 ; i < m->num_regs ; ++i) {
+		if (m->regs[i].fd >= 0)
+			close(m->regs[i].fd);
+		m->regs[i].fd = -1;
+	}
+}
+
+/*
+ * Add a register to the monitor. Many error table rows describe fields of
+ * the same register; they all share one entry.
+ *
+ * @returns the register index, or -1 if the monitor is full
+ */
+int mon_add_reg(struct monitor *m, const char *sysfsfile)
+{
+	unsigned i;
+
+	for (i = 0 ; i < m->num_regs ; ++i) {
+		if (!strcmp(m->regs[i].sysfsfile, sysfsfile))
+			return i;
+	}
+
+	if (m->num_regs == MON_MAX_REGS) {
+		dlog("monitor: too many registers, ignoring %s\n", sysfsfile);
+		return -1;
+	}
+
+	m->regs[i].sysfsfile = sysfsfile;
+	m->regs[i].fd = -1;
+	m->regs[i].value = 0;
+	++m->num_regs;
+	return i;
+}
+
+/*
+ * Read a register, opening it first if needed.
+ *
+ * @returns 1 if the value changed, 0 if not, -1 if it can't be read
+ */
+static int mon_read_reg(struct mon_reg *r)
+{
+	char buf[SYSFS_PATH_MAX];
+	ssize_t res;
+	size_t b = 0;
+	uint64_t value;
+
+	if (r->fd < 0) {
+		// file may not exist (yet), e.g. on single-socket.
+		r->fd = open(r->sysfsfile, O_RDONLY | O_CLOEXEC);
+		if (r->fd < 0)
+			return -1;
+	}
+
+	do {
+		res = pread(r->fd, buf + b, sizeof(buf) - 1 - b, b);
+		if (res <= 0) {
+			// device went away; try to reopen next time
+			close(r->fd);
+			r->fd = -1;
+			return -1;
+		}
+		b += res;
+	} while (buf[b-1] != '\n' && b < sizeof(buf) - 1);
+
+	buf[b] = 0;
+	value = strtoull(buf, NULL, 0);
+
+	if (value == r->value)
+		return 0;
+
+	r->value = value;
+	return 1;
+}
+
+bool mon_reg_present(struct monitor *m, int reg)
+{
+	return reg >= 0 && m->regs[reg].fd >= 0;
+}
+
+/*
+ * Read every register of the monitor once.
+ *
+ * @returns number of registers whose value changed
+ */
+int mon_read(struct monitor *m)
+{
+	unsigned i;
+	int changed = 0;
+
+	for (i = 0 ; i < m->num_regs ; ++i) {
+		if (mon_read_reg(&m->regs[i]) > 0)
+			++changed;
+	}
+
+	return changed;
+}
+
+/*
+ * Sleep until the driver notifies one of the register files, or the
+ * polling interval expires. The interval is reset
+ * to poll_interval_usec when the last read saw a change and doubles
+ * (up to MON_MAX_BACKOFF times that) while nothing happens.
+ */
+void mon_wait(struct monitor *m, bool changed)
+{
+	struct pollfd pfd[MON_MAX_REGS];
+	useconds_t max_usec = m->c->poll_interval_usec * MON_MAX_BACKOFF;
+	unsigned n = 0;
+	unsigned i;
+	int res;
+
+	if (changed)
+		m->interval_usec = m->c->poll_interval_usec;
+
+	for (i = 0 ; i < m->num_regs ; ++i) {
+		if (m->regs[i].fd < 0)
+			continue;
+		pfd[n].fd = m->regs[i].fd;
+		pfd[n].events = POLLPRI;
+		pfd[n].revents = 0;
+		++n;
+	}
+
+	res = poll(pfd, n, (m->interval_usec + 999) / 1000);
+
+	if (res > 0) {
+		// the registers get re-read, which re-arms the notification
+		m->interval_usec = m->c->poll_interval_usec;
+	} else if (!changed && m->interval_usec < max_usec) {
+		m->interval_usec *= 2;
+		if (m->interval_usec > max_usec)
+			m->interval_usec = max_usec;
+	}
+}
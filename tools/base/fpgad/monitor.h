@@ -0,0 +1,71 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __FPGAD_MONITOR_H__
+#define __FPGAD_MONITOR_H__
+
+#include "errtable.h"
+#include "config_int.h"
+
+#define MON_MAX_REGS 32
+/* idle polling backs off up to this multiple of poll_interval_usec */
+#define MON_MAX_BACKOFF 8
+
+/*
+ * A sysfs register watched by a monitor. The file is kept open and
+ * re-read with pread(), which also re-arms sysfs_notify() for attributes
+ * whose driver supports it.
+ */
+struct mon_reg {
+	const char *sysfsfile;
+	int fd;
+	uint64_t value;
+};
+
+/*
+ * A set of registers plus the event sources that can wake their readers:
+ * sysfs_notify() (POLLPRI on the register files) and, failing that, a
+ * polling interval that doubles while nothing changes.
+ *
+ * The FME device is deliberately not opened for its error interrupt:
+ * fpgaOpen() opens devices exclusively, so holding it would keep
+ * fpgaconf and the AP6 handler from opening the FME.
+ */
+struct monitor {
+	struct config *c;
+	unsigned num_regs;
+	struct mon_reg regs[MON_MAX_REGS];
+	useconds_t interval_usec;
+};
+
+void mon_init(struct monitor *m, struct config *c);
+void mon_destroy(struct monitor *m);
+int mon_add_reg(struct monitor *m, const char *sysfsfile);
+bool mon_reg_present(struct monitor *m, int reg);
+int mon_read(struct monitor *m);
+void mon_wait(struct monitor *m, bool changed);
+
+#endif
@@ -0,0 +1,190 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * ring.c : shared memory ring of decoded events, see event_ring.h.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#undef _GNU_SOURCE
+
+#include "ring.h"
+#include "event_ring.h"
+#include "log.h"
+
+#include "safe_string/safe_string.h"
+
+static struct event_ring *ring;
+/* read-only descriptor of the ring memfd, handed to clients */
+static int ring_rdfd = -1;
+/*
+ * Next sequence number to write. The copy in the ring is only published
+ * for readers; anything in the shared mapping may have been tampered
+ * with, so the writer never reads it back.
+ */
+static uint64_t ring_head;
+/* the logger and AP event threads both publish */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int ring_init(void)
+{
+	size_t size = EVENT_RING_SIZE(EVENT_RING_SLOTS);
+	char path[32];
+	void *addr;
+	int rdfd;
+	int fd;
+
+	fd = memfd_create("fpgad-event-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		dlog("ring: memfd_create() failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		dlog("ring: ftruncate() failed: %s\n", strerror(errno));
+		goto out_close;
+	}
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		dlog("ring: mmap() failed: %s\n", strerror(errno));
+		goto out_close;
+	}
+
+	/*
+	 * Clients get a read-only descriptor, so they can only map the ring
+	 * PROT_READ. Drop the write permission bits too, or they could get a
+	 * writable one back by reopening it through /proc.
+	 */
+	if (fchmod(fd, S_IRUSR | S_IRGRP | S_IROTH) < 0) {
+		dlog("ring: fchmod() failed: %s\n", strerror(errno));
+		goto out_unmap;
+	}
+
+	snprintf_s_i(path, sizeof(path), "/proc/self/fd/%d", fd);
+	rdfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (rdfd < 0) {
+		dlog("ring: failed to reopen memfd read-only: %s\n",
+		     strerror(errno));
+		goto out_unmap;
+	}
+
+#ifdef F_SEAL_FUTURE_WRITE
+	/* keeps our mapping writable, refuses any new writable one (4.20+) */
+	fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+#endif
+	/* nobody may resize the ring under its readers */
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+		dlog("ring: failed to seal memfd: %s\n", strerror(errno));
+		close(rdfd);
+		goto out_unmap;
+	}
+
+	/* the mapping keeps the ring alive */
+	close(fd);
+
+	ring = (struct event_ring *)addr;
+	ring->version = EVENT_RING_VERSION;
+	ring->num_slots = EVENT_RING_SLOTS;
+	ring->slot_size = sizeof(struct event_ring_slot);
+	ring_head = 0;
+	ring->head = 0;
+	/* readers check the magic last */
+	__atomic_store_n(&ring->magic, EVENT_RING_MAGIC, __ATOMIC_RELEASE);
+
+	ring_rdfd = rdfd;
+	dlog("ring: publishing %u events in %zu bytes\n",
+	     EVENT_RING_SLOTS, size);
+	return 0;
+
+out_unmap:
+	munmap(addr, size);
+out_close:
+	close(fd);
+	return -1;
+}
+
+void ring_destroy(void)
+{
+	if (ring) {
+		munmap(ring, EVENT_RING_SIZE(EVENT_RING_SLOTS));
+		ring = NULL;
+	}
+
+	if (ring_rdfd >= 0) {
+		close(ring_rdfd);
+		ring_rdfd = -1;
+	}
+}
+
+int ring_fd(void)
+{
+	return ring_rdfd;
+}
+
+void ring_publish(fpga_event_type type, int socket, const char *reg,
+		  const char *name, uint64_t value)
+{
+	struct event_ring_slot *slot;
+	struct timespec now;
+	uint64_t head;
+
+	if (!ring)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	pthread_mutex_lock(&ring_lock);
+
+	head = ring_head++;
+	slot = &ring->slots[head & (EVENT_RING_SLOTS - 1)];
+
+	/* invalidate the slot before overwriting the record */
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->rec.sequence = head;
+	slot->rec.timestamp = (uint64_t)now.tv_sec * 1000000000ULL +
+			      (uint64_t)now.tv_nsec;
+	slot->rec.type = type;
+	slot->rec.socket = socket;
+	slot->rec.value = value;
+	strncpy_s(slot->rec.reg, sizeof(slot->rec.reg),
+		  reg ? reg : "", sizeof(slot->rec.reg) - 1);
+	strncpy_s(slot->rec.name, sizeof(slot->rec.name),
+		  name ? name : "", sizeof(slot->rec.name) - 1);
+
+	__atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&ring_lock);
+}
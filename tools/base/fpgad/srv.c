@@ -32,9 +32,9 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
 #include <pthread.h>
 #include <fcntl.h>
-#include <poll.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
@@ -45,37 +45,174 @@
 #include "srv.h"
 #include "config_int.h"
 #include "log.h"
+#include "ring.h"
+#include "event_ring.h"
+#include "event_protocol.h"
 
-#define MAX_CLIENT_CONNECTIONS 41
+/* number of epoll events harvested per wakeup */
+#define SRV_MAX_EVENTS 64
+/* must be a power of 2 */
+#define DEVICE_BUCKETS 64
+#define NUM_EVENT_TYPES (FPGA_EVENT_POWER_THERMAL + 1)
 
 pthread_mutex_t list_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
-struct client_event_registry *event_registry_list;
 
-enum request_type {
-	REGISTER_EVENT = 0,
-	UNREGISTER_EVENT = 1
+/*
+ * A connected client. The epoll data pointer of each client socket
+ * refers to one of these; the server socket uses NULL.
+ *
+ * Client sockets are non-blocking. A request is gathered in msg (and its
+ * eventfds in fds) over as many wakeups as it takes to arrive, so a
+ * client that stalls halfway through one holds up nobody else.
+ */
+struct client {
+	int conn_socket;
+	struct client_event_registry *events;
+	struct client *next;
+	struct client *prev;
+	union {
+		struct event_request req;
+		struct {
+			struct event_batch_header hdr;
+			struct event_batch_entry entries[EVENT_BATCH_MAX];
+		} batch;
+	} msg;
+	size_t have;	/* bytes of msg received so far */
+	int fds[EVENT_BATCH_MAX];
+	int nfds;
 };
 
-struct request {
-	enum request_type type;
-	fpga_event_type event;
+/*
+ * Subscribers for a single device path, indexed by event type, so that
+ * a notification touches only the clients interested in it.
+ */
+struct device_events {
 	char device[MAX_PATH_LEN];
+	size_t len;
+	uint32_t hash;
+	struct client_event_registry *events[NUM_EVENT_TYPES];
+	struct device_events *next;
 };
 
-struct client_event_registry *register_event(int conn_socket, int fd,
+static struct device_events *device_table[DEVICE_BUCKETS];
+static struct client *client_list;
+
+#define FNV1A_INIT  2166136261U
+#define FNV1A_PRIME 16777619U
+
+static inline uint32_t hash_step(uint32_t h, char c)
+{
+	return (h ^ (uint8_t)c) * FNV1A_PRIME;
+}
+
+static uint32_t hash_device(const char *device, size_t len)
+{
+	uint32_t h = FNV1A_INIT;
+	size_t i;
+
+	for (i = 0 ; i < len ; ++i)
+		h = hash_step(h, device[i]);
+
+	return h;
+}
+
+/* length of device, ignoring any trailing '/' */
+static size_t device_len(const char *device)
+{
+	size_t len = strnlen_s(device, MAX_PATH_LEN);
+
+	while (len > 1 && device[len-1] == '/')
+		--len;
+
+	return len;
+}
+
+/* call with list_lock held */
+static struct device_events *find_device(const char *device, size_t len,
+					 uint32_t hash)
+{
+	struct device_events *d;
+
+	for (d = device_table[hash & (DEVICE_BUCKETS-1)] ; d ; d = d->next)
+		if ((d->hash == hash) && (d->len == len) &&
+		    !memcmp(d->device, device, len))
+			break;
+
+	return d;
+}
+
+/* call with list_lock held */
+static struct device_events *get_device(const char *device)
+{
+	size_t len = device_len(device);
+	uint32_t hash = hash_device(device, len);
+	struct device_events *d;
+	errno_t err;
+
+	d = find_device(device, len, hash);
+	if (d)
+		return d;
+
+	d = (struct device_events *) calloc(1, sizeof(*d));
+	if (!d)
+		return NULL;
+
+	err = strncpy_s(d->device, sizeof(d->device), device, len);
+	if (EOK != err) {
+		free(d);
+		return NULL;
+	}
+
+	d->len = len;
+	d->hash = hash;
+	d->next = device_table[hash & (DEVICE_BUCKETS-1)];
+	device_table[hash & (DEVICE_BUCKETS-1)] = d;
+
+	return d;
+}
+
+/* call with list_lock held */
+static void put_device(struct device_events *d)
+{
+	struct device_events **pd;
+	int i;
+
+	for (i = 0 ; i < NUM_EVENT_TYPES ; ++i)
+		if (d->events[i])
+			return;
+
+	for (pd = &device_table[d->hash & (DEVICE_BUCKETS-1)] ; *pd ;
+	     pd = &(*pd)->next) {
+		if (*pd == d) {
+			*pd = d->next;
+			break;
+		}
+	}
+
+	free(d);
+}
+
+struct client_event_registry *register_event(struct client *client,
+					uint64_t owner, int fd,
 					fpga_event_type e, const char *device)
 {
-	struct client_event_registry *r =
-		(struct client_event_registry *) malloc(sizeof(*r));
+	struct client_event_registry *r;
+	struct device_events *d;
 	errno_t err;
 
+	if ((unsigned)e >= NUM_EVENT_TYPES)
+		return NULL;
+
+	r = (struct client_event_registry *) malloc(sizeof(*r));
 	if (!r)
 		return NULL;
 
-	r->conn_socket = conn_socket;
+	r->conn_socket = client->conn_socket;
+	r->owner = owner;
 	r->fd = fd;
 	r->data = 1;
 	r->event = e;
+	r->client = client;
 
 	err = strncpy_s(r->device, sizeof(r->device),
 			device, MAX_PATH_LEN);
@@ -88,8 +225,26 @@ struct client_event_registry *register_event(int conn_socket, int fd,
 	if (err)
 		dlog("pthread_mutex_lock() failed: %s", strerror(err));
 
-	r->next = event_registry_list;
-	event_registry_list = r;
+	d = get_device(r->device);
+	if (!d) {
+		err = pthread_mutex_unlock(&list_lock);
+		if (err)
+			dlog("pthread_mutex_unlock() failed: %s", strerror(err));
+		goto out_free;
+	}
+
+	r->dev = d;
+	r->prev = NULL;
+	r->next = d->events[e];
+	if (r->next)
+		r->next->prev = r;
+	d->events[e] = r;
+
+	r->client_prev = NULL;
+	r->client_next = client->events;
+	if (r->client_next)
+		r->client_next->client_prev = r;
+	client->events = r;
 
 	err = pthread_mutex_unlock(&list_lock);
 	if (err)
@@ -102,88 +257,87 @@ out_free:
 	return NULL;
 }
 
-void release_event_registry(struct client_event_registry *r)
+/* call with list_lock held */
+static void release_event_registry(struct client_event_registry *r)
 {
+	struct device_events *d = r->dev;
+
+	if (r->prev)
+		r->prev->next = r->next;
+	else
+		d->events[r->event] = r->next;
+	if (r->next)
+		r->next->prev = r->prev;
+
+	if (r->client_prev)
+		r->client_prev->client_next = r->client_next;
+	else
+		r->client->events = r->client_next;
+	if (r->client_next)
+		r->client_next->client_prev = r->client_prev;
+
+	put_device(d);
+
 	close(r->fd);
 	free(r);
 }
 
-void unregister_event(int conn_socket, fpga_event_type e, const char *device)
+/*
+ * Remove the registration of owner for event e on device.
+ *
+ * @returns true if there was one.
+ */
+bool unregister_event(struct client *client, uint64_t owner,
+		      fpga_event_type e, const char *device)
 {
-	struct client_event_registry *trash;
-	struct client_event_registry *save;
+	struct client_event_registry *r = NULL;
+	struct device_events *d;
+	size_t len;
 	int err;
 
+	if ((unsigned)e >= NUM_EVENT_TYPES)
+		return false;
+
+	len = device_len(device);
+
 	err = pthread_mutex_lock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_lock() failed: %s", strerror(err));
 
-	trash = event_registry_list;
-
-	if (!trash) // empty list
+	d = find_device(device, len, hash_device(device, len));
+	if (!d) // not found
 		goto out_unlock;
 
-	if ((conn_socket == trash->conn_socket) &&
-		(e == trash->event) &&
-		!strncmp(device, trash->device, MAX_PATH_LEN)) {
-
-		// found at head of list
-
-		event_registry_list = event_registry_list->next;
-		release_event_registry(trash);
-		goto out_unlock;
-	}
-
-	save = trash;
-	trash = trash->next;
-	while (trash) {
-
-		if ((conn_socket == trash->conn_socket) &&
-			(e == trash->event) &&
-			!strncmp(device, trash->device, MAX_PATH_LEN))
+	for (r = d->events[e] ; r ; r = r->next)
+		if ((r->client == client) && (r->owner == owner))
 			break;
 
-		save = trash;
-		trash = trash->next;
-	}
+	if (r)
+		release_event_registry(r);
 
-	if (!trash) // not found
-		goto out_unlock;
-
-	// found at trash
-	save->next = trash->next;
-	release_event_registry(trash);
 out_unlock:
 	err = pthread_mutex_unlock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_unlock() failed: %s", strerror(err));
-}
 
-struct client_event_registry *
-find_event_for(int conn_socket)
-{
-	struct client_event_registry *r;
-
-	for (r = event_registry_list ; r ; r = r->next)
-		if (conn_socket == r->conn_socket)
-			break;
-
-	return r;
+	return r != NULL;
 }
 
-void unregister_all_events_for(int conn_socket)
+/* remove every registration that owner made over this connection */
+void unregister_owner(struct client *client, uint64_t owner)
 {
 	struct client_event_registry *r;
+	struct client_event_registry *next;
 	int err;
 
 	err = pthread_mutex_lock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_lock() failed: %s", strerror(err));
 
-	r = find_event_for(conn_socket);
-	while (r) {
-		unregister_event(conn_socket, r->event, r->device);
-		r = find_event_for(conn_socket);
+	for (r = client->events ; r ; r = next) {
+		next = r->client_next;
+		if (r->owner == owner)
+			release_event_registry(r);
 	}
 
 	err = pthread_mutex_unlock(&list_lock);
@@ -191,41 +345,59 @@ void unregister_all_events_for(int conn_socket)
 		dlog("pthread_mutex_unlock() failed: %s", strerror(err));
 }
 
-void unregister_all_events(void)
+void unregister_all_events_for(struct client *client)
 {
-	struct client_event_registry *r;
 	int err;
 
 	err = pthread_mutex_lock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_lock() failed: %s", strerror(err));
 
-	for (r = event_registry_list ; r != NULL ; ) {
-		struct client_event_registry *trash;
-		trash = r;
-		r = r->next;
-		release_event_registry(trash);
-	}
-
-	event_registry_list = NULL;
+	while (client->events)
+		release_event_registry(client->events);
 
 	err = pthread_mutex_unlock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_unlock() failed: %s", strerror(err));
 }
 
-void for_each_registered_event(void (*cb)(struct client_event_registry *,
+void for_each_registered_event(fpga_event_type e,
+			       void (*cb)(struct client_event_registry *,
 					  const struct fpga_err *),
-			       const struct fpga_err *e) {
+			       const struct fpga_err *err_desc)
+{
+	const char *path = err_desc->sysfsfile;
 	struct client_event_registry *r;
+	struct device_events *d;
+	uint32_t h = FNV1A_INIT;
+	size_t i;
 	int err;
 
+	if ((unsigned)e >= NUM_EVENT_TYPES)
+		return;
+
 	err = pthread_mutex_lock(&list_lock);
 	if (err)
 		dlog("pthread_mutex_lock() failed: %s", strerror(err));
 
-	for (r = event_registry_list; r != NULL; r = r->next) {
-		cb(r, e);
+	/*
+	 * Clients register against a device directory, while errors are
+	 * raised by files below it. Look up each directory prefix of the
+	 * sysfs file (and the file itself), hashing incrementally.
+	 */
+	for (i = 0 ; i < MAX_PATH_LEN ; ++i) {
+		if ((i > 0) && ((path[i] == '/') || (path[i] == '\0'))) {
+			d = find_device(path, i, h);
+			if (d) {
+				for (r = d->events[e] ; r ; r = r->next)
+					cb(r, err_desc);
+			}
+		}
+
+		if (path[i] == '\0')
+			break;
+
+		h = hash_step(h, path[i]);
 	}
 
 	err = pthread_mutex_unlock(&list_lock);
@@ -233,115 +405,406 @@ void for_each_registered_event(void (*cb)(struct client_event_registry *,
 		dlog("pthread_mutex_unlock() failed: %s", strerror(err));
 }
 
-#define SRV_SOCKET          0
-#define FIRST_CLIENT_SOCKET 1
-/* array keeping track of all connection file descriptors (plus server socket) */
-static struct pollfd pollfds[MAX_CLIENT_CONNECTIONS+1];
-static nfds_t num_fds = 1;
-
-void remove_client(int conn_socket)
+static struct client *add_client(int epfd, int conn_socket)
 {
-	struct pollfd tmp_pollfds[MAX_CLIENT_CONNECTIONS+1];
-	unsigned i, j;
+	struct epoll_event ev;
+	struct client *client;
+
+	client = (struct client *) calloc(1, sizeof(*client));
+	if (!client)
+		return NULL;
 
-	unregister_all_events_for(conn_socket);
-	dlog("server: closing connection %d.\n", conn_socket);
-	close(conn_socket);
+	client->conn_socket = conn_socket;
+	client->have = 0;
+	client->nfds = 0;
 
-	for (i = 0 ; i < num_fds ; ++i) {
-		tmp_pollfds[i] = pollfds[i];
-	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = client;
 
-	for (i = j = 1 ; i < num_fds ; ++i) {
-		if (conn_socket == tmp_pollfds[i].fd)
-			continue;
-		pollfds[j++] = tmp_pollfds[i];
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, conn_socket, &ev) < 0) {
+		dlog("server: epoll_ctl() failed: %s\n", strerror(errno));
+		free(client);
+		return NULL;
 	}
 
-	num_fds = j;
+	client->next = client_list;
+	if (client_list)
+		client_list->prev = client;
+	client_list = client;
+
+	return client;
 }
 
-int handle_message(int conn_socket)
+/* close the eventfds that did not make it into the registry */
+static void close_client_fds(struct client *client)
+{
+	int i;
+
+	for (i = 0 ; i < client->nfds ; ++i)
+		if (client->fds[i] >= 0)
+			close(client->fds[i]);
+	client->nfds = 0;
+}
+
+void remove_client(int epfd, struct client *client)
+{
+	unregister_all_events_for(client);
+	close_client_fds(client);
+	dlog("server: closing connection %d.\n", client->conn_socket);
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, client->conn_socket, NULL);
+	close(client->conn_socket);
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		client_list = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+
+	free(client);
+}
+
+/*
+ * Reply to GET_EVENT_RING with the ring version, plus the ring memfd
+ * unless the ring is unavailable.
+ */
+static int send_event_ring(int conn_socket)
 {
 	struct msghdr mh;
 	struct cmsghdr *cmh;
 	struct iovec iov[1];
-	struct request req;
+	uint32_t version = 0;
 	char buf[CMSG_SPACE(sizeof(int))];
-	ssize_t n;
-	int *fd_ptr;
+	int fd = ring_fd();
 
-	/* set up ancillary data message header */
-	iov[0].iov_base = &req;
-	iov[0].iov_len = sizeof(req);
+	iov[0].iov_base = &version;
+	iov[0].iov_len = sizeof(version);
 	memset_s(buf, sizeof(buf), 0);
 	mh.msg_name = NULL;
 	mh.msg_namelen = 0;
 	mh.msg_iov = iov;
 	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
-	mh.msg_control = buf;
-	mh.msg_controllen = CMSG_LEN(sizeof(int));
+	mh.msg_control = NULL;
+	mh.msg_controllen = 0;
 	mh.msg_flags = 0;
-	cmh = CMSG_FIRSTHDR(&mh);
-	cmh->cmsg_len = CMSG_LEN(sizeof(int));
-	cmh->cmsg_level = SOL_SOCKET;
-	cmh->cmsg_type = SCM_RIGHTS;
 
-	n = recvmsg(conn_socket, &mh, 0);
-	if (n < 0) {
-		dlog("server: recvmsg() failed: %s\n", strerror(errno));
-		return (int)n;
+	if (fd >= 0) {
+		version = EVENT_RING_VERSION;
+		mh.msg_control = buf;
+		mh.msg_controllen = CMSG_LEN(sizeof(int));
+		cmh = CMSG_FIRSTHDR(&mh);
+		cmh->cmsg_len = CMSG_LEN(sizeof(int));
+		cmh->cmsg_level = SOL_SOCKET;
+		cmh->cmsg_type = SCM_RIGHTS;
+		*((int *)CMSG_DATA(cmh)) = fd;
 	}
 
-	if (!n) { // socket closed by peer
-		remove_client(conn_socket);
-		return (int)n;
+	if (sendmsg(conn_socket, &mh, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+		dlog("server: sendmsg() failed: %s\n", strerror(errno));
+		return -1;
 	}
 
-	switch (req.type) {
+	return 0;
+}
+
+static void handle_request(struct client *client, struct event_request *req,
+			   int *fds, int nfds)
+{
+	req->device[sizeof(req->device)-1] = '\0';
+
+	switch (req->type) {
 
 	case REGISTER_EVENT:
-		fd_ptr = (int *)CMSG_DATA(cmh);
+		if (!nfds) {
+			dlog("server: no eventfd to register\n");
+			break;
+		}
 
-		if (!register_event(conn_socket, *fd_ptr, req.event,
-							  req.device)) {
+		if (!register_event(client, 0, fds[0], req->event,
+							  req->device)) {
 			dlog("server: failed to register event\n");
-			return -1;
+			break;
 		}
 
 		dlog("server: registered event %d:%d(%d %s)\n",
-			conn_socket, *fd_ptr, req.event, req.device);
+			client->conn_socket, fds[0], req->event, req->device);
+		fds[0] = -1; // owned by the registry
 
 		break;
 
 	case UNREGISTER_EVENT:
-		unregister_event(conn_socket, req.event, req.device);
+		unregister_event(client, 0, req->event, req->device);
+		break;
+
+	case GET_EVENT_RING:
+		send_event_ring(client->conn_socket);
 		break;
 
 	default:
-		dlog("server: unknown request type %d\n", req.type);
+		dlog("server: unknown request type %d\n", req->type);
+		break;
+	}
+}
+
+/*
+ * Check the header of a version 2 batch, before its entries arrive.
+ * Unsupported batches get an empty response.
+ *
+ * @returns false if the connection must be dropped.
+ */
+static bool check_batch(struct client *client)
+{
+	const struct event_batch_header *hdr = &client->msg.batch.hdr;
+	struct event_batch_response rsp;
+
+	if ((hdr->version == EVENT_PROTOCOL_VERSION) &&
+	    (hdr->count <= EVENT_BATCH_MAX))
+		return true;
+
+	/* the rest of the stream can't be parsed */
+	dlog("server: unsupported request version %u (%u entries)\n",
+		hdr->version, hdr->count);
+	memset_s(&rsp, sizeof(rsp), 0);
+	rsp.version = EVENT_PROTOCOL_VERSION;
+	rsp.id = hdr->id;
+	send(client->conn_socket, &rsp, sizeof(rsp),
+	     MSG_NOSIGNAL | MSG_DONTWAIT);
+	return false;
+}
+
+/*
+ * Process a complete version 2 batch and acknowledge it.
+ *
+ * @returns false if the connection must be dropped.
+ */
+static bool handle_batch(struct client *client)
+{
+	const struct event_batch_header *hdr = &client->msg.batch.hdr;
+	struct event_batch_response rsp;
+	struct event_batch_entry *entry;
+	int *fds = client->fds;
+	int nfds = client->nfds;
+	int next_fd = 0;
+	fpga_result res;
+	uint32_t i;
+
+	memset_s(&rsp, sizeof(rsp), 0);
+	rsp.version = EVENT_PROTOCOL_VERSION;
+	rsp.id = hdr->id;
+
+	for (i = 0 ; i < hdr->count ; ++i) {
+		entry = &client->msg.batch.entries[i];
+		entry->device[sizeof(entry->device)-1] = '\0';
+
+		switch (entry->op) {
+
+		case EVENT_OP_REGISTER:
+			if (next_fd >= nfds) {
+				res = FPGA_INVALID_PARAM;
+				break;
+			}
+
+			if ((unsigned)entry->event >= NUM_EVENT_TYPES) {
+				res = FPGA_INVALID_PARAM;
+				++next_fd; // closed by the caller
+				break;
+			}
+
+			if (!register_event(client, entry->owner,
+					    fds[next_fd], entry->event,
+					    entry->device)) {
+				res = FPGA_NO_MEMORY;
+				++next_fd;
+				break;
+			}
+
+			fds[next_fd++] = -1; // owned by the registry
+			res = FPGA_OK;
+			break;
+
+		case EVENT_OP_UNREGISTER:
+			res = unregister_event(client, entry->owner,
+					       entry->event, entry->device) ?
+				FPGA_OK : FPGA_INVALID_PARAM;
+			break;
+
+		case EVENT_OP_UNREGISTER_ALL:
+			unregister_owner(client, entry->owner);
+			res = FPGA_OK;
+			break;
+
+		default:
+			res = FPGA_INVALID_PARAM;
+			break;
+		}
+
+		rsp.result[i] = res;
+	}
+
+	rsp.count = hdr->count;
+
+	/*
+	 * A client that lets its acknowledgements pile up until the socket
+	 * buffer is full is dropped rather than waited for.
+	 */
+	if (send(client->conn_socket, &rsp, sizeof(rsp),
+		 MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+		dlog("server: send() failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Length of the request being received, as far as it is known: a batch
+ * header until that has arrived, then the whole request.
+ */
+static size_t request_len(const struct client *client)
+{
+	if (client->have < sizeof(struct event_batch_header))
+		return sizeof(struct event_batch_header);
+
+	if (client->msg.req.type == EVENT_BATCH)
+		return sizeof(struct event_batch_header) +
+		       client->msg.batch.hdr.count *
+		       sizeof(struct event_batch_entry);
+
+	return sizeof(struct event_request);
+}
+
+/*
+ * Read what the client has sent of its current request, without
+ * blocking, and process the request once it is complete.
+ */
+int handle_message(int epfd, struct client *client)
+{
+	struct msghdr mh;
+	struct cmsghdr *cmh;
+	struct iovec iov[1];
+	char buf[CMSG_SPACE(EVENT_BATCH_MAX * sizeof(int))];
+	size_t len = request_len(client);
+	bool ok = true;
+	ssize_t n;
+	int i;
+
+	/*
+	 * Never read past the current request: eventfds arrive with the
+	 * first byte of the request they belong to.
+	 */
+	iov[0].iov_base = (char *)&client->msg + client->have;
+	iov[0].iov_len = len - client->have;
+	memset_s(buf, sizeof(buf), 0);
+	mh.msg_name = NULL;
+	mh.msg_namelen = 0;
+	mh.msg_iov = iov;
+	mh.msg_iovlen = sizeof(iov) / sizeof(iov[0]);
+	mh.msg_control = buf;
+	mh.msg_controllen = sizeof(buf);
+	mh.msg_flags = 0;
+
+	n = recvmsg(client->conn_socket, &mh, MSG_CMSG_CLOEXEC);
+	if (n < 0) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		dlog("server: recvmsg() failed: %s\n", strerror(errno));
+		/* the socket stays readable: drop the client */
+		remove_client(epfd, client);
+		return (int)n;
+	}
+
+	for (cmh = CMSG_FIRSTHDR(&mh) ; cmh ; cmh = CMSG_NXTHDR(&mh, cmh)) {
+		if ((cmh->cmsg_level == SOL_SOCKET) &&
+		    (cmh->cmsg_type == SCM_RIGHTS)) {
+			int count = (cmh->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			int fd;
+
+			for (i = 0 ; i < count ; ++i) {
+				fd = ((int *)CMSG_DATA(cmh))[i];
+				if (client->nfds < EVENT_BATCH_MAX)
+					client->fds[client->nfds++] = fd;
+				else
+					close(fd);
+			}
+		}
+	}
+
+	if (n == 0) { // socket closed by peer
+		remove_client(epfd, client);
+		return -1;
+	}
+
+	client->have += n;
+	if (client->have < len)
+		return 0;
+
+	if (len == sizeof(struct event_batch_header)) {
+		/* the header tells how long the request is */
+		if ((client->msg.req.type == EVENT_BATCH) &&
+		    !check_batch(client)) {
+			remove_client(epfd, client);
+			return -1;
+		}
+		if (client->have < request_len(client))
+			return 0;
+	}
+
+	if (client->msg.req.type == EVENT_BATCH)
+		ok = handle_batch(client);
+	else
+		handle_request(client, &client->msg.req,
+			       client->fds, client->nfds);
+
+	close_client_fds(client);
+	client->have = 0;
+
+	if (!ok) {
+		remove_client(epfd, client);
 		return -1;
 	}
 
 	return 0;
 }
 
+static void accept_client(int epfd, int server_socket)
+{
+	int conn_socket;
+
+	conn_socket = accept4(server_socket, NULL, NULL,
+			      SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+	if (conn_socket < 0) {
+		dlog("server: failed to accept new connection!\n");
+		return;
+	}
+
+	dlog("server: accepting connection %d.\n", conn_socket);
+
+	if (!add_client(epfd, conn_socket)) {
+		dlog("server: failed to track connection %d.\n", conn_socket);
+		close(conn_socket);
+	}
+}
+
 void *server_thread(void *thread_context)
 {
 	struct config *c = (struct config *)thread_context;
 
-	nfds_t i;
+	struct epoll_event ev;
+	struct epoll_event events[SRV_MAX_EVENTS];
+	int epfd;
 
 	struct sockaddr_un addr;
 	int server_socket;
-	int conn_socket;
 
+	int i;
 	int res;
 	errno_t e;
 
 	unlink(c->socket);
 
-	server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	server_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 	if (server_socket < 0) {
 		dlog("server: failed to create server socket.\n");
 		return NULL;
@@ -363,67 +826,52 @@ void *server_thread(void *thread_context)
 	}
 	dlog("server: bind success.\n");
 
-	if (listen(server_socket, 20) < 0) {
+	if (listen(server_socket, SOMAXCONN) < 0) {
 		dlog("server: failed to listen on socket.\n");
 		goto out_close_server;
 	}
 	dlog("server: listening for connections.\n");
 
-	pollfds[SRV_SOCKET].fd = server_socket;
-	pollfds[SRV_SOCKET].events = POLLIN | POLLPRI;
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		dlog("server: epoll_create1() failed: %s\n", strerror(errno));
+		goto out_close_server;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, server_socket, &ev) < 0) {
+		dlog("server: epoll_ctl() failed: %s\n", strerror(errno));
+		goto out_close_epoll;
+	}
 
 	while (c->running) {
 
-		res = poll(pollfds, num_fds, 100);
+		/* time out periodically to observe c->running */
+		res = epoll_wait(epfd, events, SRV_MAX_EVENTS, 100);
 		if (res < 0) {
-			dlog("server: poll error!\n");
+			if (errno != EINTR)
+				dlog("server: epoll_wait error!\n");
 			continue;
 		}
 
-		if (0 == res) // timeout
-			continue;
-
-		if ((nfds_t)res > num_fds) { // weird
-			dlog("server: something bad happened during poll!\n");
-			continue;
-		}
-
-		// handle requests on existing sockets
-		for (i = FIRST_CLIENT_SOCKET ; i < num_fds ; ++i) {
-			if (pollfds[i].revents) {
-				handle_message(pollfds[i].fd);
-			}
-		}
-
-		// handle new connection requests
-		if (pollfds[SRV_SOCKET].revents) {
-
-			if (num_fds == MAX_CLIENT_CONNECTIONS+1) {
-				dlog("server: exceeded max connections!\n");
-				continue;
-			}
-
-			conn_socket = accept(server_socket, NULL, NULL);
-
-			if (conn_socket < 0) {
-				dlog("server: failed to accept new connection!\n");
-			} else {
-				dlog("server: accepting connection %d.\n", conn_socket);
-
-				pollfds[num_fds].fd = conn_socket;
-				pollfds[num_fds].events = POLLIN | POLLPRI;
-				++num_fds;
-			}
-
+		for (i = 0 ; i < res ; ++i) {
+			if (!events[i].data.ptr) // new connection request
+				accept_client(epfd, server_socket);
+			else
+				handle_message(epfd,
+					(struct client *)events[i].data.ptr);
 		}
 
 	}
 
-	unregister_all_events();
+	while (client_list)
+		remove_client(epfd, client_list);
 
+out_close_epoll:
+	close(epfd);
 out_close_server:
 	close(server_socket);
 
 	return NULL;
 }
-
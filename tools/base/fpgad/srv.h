@@ -33,18 +33,34 @@ struct fpga_err;
 
 #define MAX_PATH_LEN 256
 
+struct client;
+struct device_events;
+
 struct client_event_registry {
 	int conn_socket;
+	/* the client-side handle that registered, 0 for version 1 clients */
+	uint64_t owner;
 	int fd;
 	uint64_t data;
 	fpga_event_type event;
 	char device[MAX_PATH_LEN];
+	/* subscribers to the same event on the same device */
 	struct client_event_registry *next;
+	struct client_event_registry *prev;
+	/* registrations made over the same connection */
+	struct client_event_registry *client_next;
+	struct client_event_registry *client_prev;
+	struct client *client;
+	struct device_events *dev;
 };
 
 void *server_thread(void *thread_context);
 
-void for_each_registered_event(
+/*
+ * Invoke cb for each client registered for event type e on the device
+ * owning the sysfs file that raised the error (or any of its parents).
+ */
+void for_each_registered_event(fpga_event_type e,
 	void (*cb)(struct client_event_registry *, const struct fpga_err *),
 				const struct fpga_err *);
 
@@ -29,9 +29,14 @@
  * \brief FPGA DMA User-mode driver
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include <opae/fpga.h>
 #include <stddef.h>
 #include <poll.h>
@@ -40,6 +45,10 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <cpuid.h>
 #include "fpga_dma_internal.h"
 #include "fpga_dma.h"
 
@@ -57,10 +66,71 @@ static struct sigaction old_action;
 static volatile uint32_t *CsrControl;
 static void sig_handler(int sig, siginfo_t *signfo, void *unused);
 
+static fpga_result _engine_start(fpga_dma_handle dma_h);
+static void _engine_stop(fpga_dma_handle dma_h);
+
+#ifndef USE_MEMCPY
+// Non-temporal copy kernel for large copies, NULL if the CPU has none
+static void (*nt_block_copy)(int64_t *__restrict dst,
+			     int64_t *__restrict src, size_t size);
+static uint64_t nt_block_bytes;
+static pthread_once_t nt_block_once = PTHREAD_ONCE_INIT;
+
+/**
+ * _select_nt_block_copy
+ *
+ * @brief                Picks the widest non-temporal copy kernel supported
+ * by the CPU and the OS.
+ *
+ */
+static void _select_nt_block_copy(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		nt_block_copy = block_copy_nt_avx512;
+		nt_block_bytes = BLOCK_COPY_NT_AVX512_BYTES;
+	} else if (__builtin_cpu_supports("avx2")) {
+		nt_block_copy = block_copy_nt_avx2;
+		nt_block_bytes = BLOCK_COPY_NT_AVX2_BYTES;
+	}
+}
+#endif
+
+#ifndef USE_ASE
+#ifndef bit_MOVDIR64B
+#define bit_MOVDIR64B (1 << 28)
+#endif
+
+// 64-byte MMIO store kernel, NULL if the CPU has none
+static void (*mmio_write_lines)(volatile void *dst, const void *src,
+				size_t size);
+static pthread_once_t mmio_write_lines_once = PTHREAD_ONCE_INIT;
+
+/**
+ * _select_mmio_write_lines
+ *
+ * @brief                Picks MOVDIR64B, which always writes a line as one
+ * transaction, or else AVX-512 stores, if the CPU has either.
+ *
+ */
+static void _select_mmio_write_lines(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	__builtin_cpu_init();
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+	    && (ecx & bit_MOVDIR64B))
+		mmio_write_lines = mmio_write_lines_movdir64b;
+	else if (__builtin_cpu_supports("avx512f"))
+		mmio_write_lines = mmio_write_lines_avx512;
+}
+#endif
+
 /**
  * local_memcpy
  *
- * @brief                memcpy using SSE2 or REP MOVSB
+ * @brief                memcpy using AVX non-temporal stores, SSE2 or
+ * REP MOVSB
  * @param[in] dst        Pointer to the destination memory
  * @param[in] src        Pointer to the source memory
  * @param[in] n          Size in bytes
@@ -74,17 +144,34 @@ void *local_memcpy(void *dst, void *src, size_t n)
 #else
 	void *ldst = dst;
 	void *lsrc = (void *)src;
-	if (IS_CL_ALIGNED(src) && IS_CL_ALIGNED(dst)) // 64-byte aligned
+	uint64_t len = 0;
+
+	// Large copies are not reread by the CPU, so keep them out of the
+	// cache. The kernels need a cache line aligned destination.
+	if (n >= MIN_NT_SIZE && IS_CL_ALIGNED(dst)) {
+		pthread_once(&nt_block_once, _select_nt_block_copy);
+		if (nt_block_copy) {
+			len = n & ~(nt_block_bytes - 1);
+			debug_print("copying 0x%lx bytes with AVX\n", len);
+			nt_block_copy((int64_t * __restrict) ldst,
+				      (int64_t * __restrict) lsrc, len);
+			ldst = (void *)((uint64_t)ldst + len);
+			lsrc = (void *)((uint64_t)lsrc + len);
+			n -= len;
+		}
+	}
+
+	if (IS_CL_ALIGNED(lsrc) && IS_CL_ALIGNED(ldst)) // 64-byte aligned
 	{
 		if (n >= MIN_SSE2_SIZE) // Arbitrary crossover performance point
 		{
 			debug_print("copying 0x%lx bytes with SSE2\n",
 				    (uint64_t)ALIGN_TO_CL(n));
-			aligned_block_copy_sse2((int64_t * __restrict) dst,
-						(int64_t * __restrict) src,
+			aligned_block_copy_sse2((int64_t * __restrict) ldst,
+						(int64_t * __restrict) lsrc,
 						ALIGN_TO_CL(n));
-			ldst = (void *)((uint64_t)dst + ALIGN_TO_CL(n));
-			lsrc = (void *)((uint64_t)src + ALIGN_TO_CL(n));
+			ldst = (void *)((uint64_t)ldst + ALIGN_TO_CL(n));
+			lsrc = (void *)((uint64_t)lsrc + ALIGN_TO_CL(n));
 			n -= ALIGN_TO_CL(n);
 		}
 	} else {
@@ -93,11 +180,11 @@ void *local_memcpy(void *dst, void *src, size_t n)
 			debug_print(
 				"copying 0x%lx bytes (unaligned) with SSE2\n",
 				(uint64_t)ALIGN_TO_CL(n));
-			unaligned_block_copy_sse2((int64_t * __restrict) dst,
-						  (int64_t * __restrict) src,
+			unaligned_block_copy_sse2((int64_t * __restrict) ldst,
+						  (int64_t * __restrict) lsrc,
 						  ALIGN_TO_CL(n));
-			ldst = (void *)((uint64_t)dst + ALIGN_TO_CL(n));
-			lsrc = (void *)((uint64_t)src + ALIGN_TO_CL(n));
+			ldst = (void *)((uint64_t)ldst + ALIGN_TO_CL(n));
+			lsrc = (void *)((uint64_t)lsrc + ALIGN_TO_CL(n));
 			n -= ALIGN_TO_CL(n);
 		}
 	}
@@ -179,6 +266,50 @@ static fpga_result MMIOWrite64Blk(fpga_dma_handle dma_h, uint64_t device,
 	return res;
 }
 
+/**
+ * MMIOWrite512Blk
+ *
+ * @brief                Writes a block to FPGA MMIO space, in 64-byte stores
+ * where the handle allows it and 64-bit values otherwise
+ * @param[in] dma        Handle to the FPGA DMA object
+ * @param[in] device     FPGA address
+ * @param[in] host       Host buffer address
+ * @param[in] count      Size in bytes
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result MMIOWrite512Blk(fpga_dma_handle dma_h, uint64_t device,
+				   uint64_t host, uint64_t bytes)
+{
+	assert(IS_ALIGNED_QWORD(device));
+	assert(IS_ALIGNED_QWORD(bytes));
+
+#ifndef USE_ASE
+	fpga_result res = FPGA_OK;
+	uint64_t len = 0;
+
+	if (dma_h->wide_mmio) {
+		// QWORDs up to the first line boundary
+		len = min(bytes, -device & (MMIO_LINE_BYTES - 1));
+		res = MMIOWrite64Blk(dma_h, device, host, len);
+		ON_ERR_RETURN(res, "MMIOWrite64Blk");
+		device += len;
+		host += len;
+		bytes -= len;
+
+		len = bytes & ~((uint64_t)MMIO_LINE_BYTES - 1);
+		if (len) {
+			mmio_write_lines(HOST_MMIO_64_ADDR(dma_h, device),
+					 (const void *)host, len);
+			device += len;
+			host += len;
+			bytes -= len;
+		}
+	}
+#endif
+	return MMIOWrite64Blk(dma_h, device, host, bytes);
+}
+
 /**
  * MMIOWrite32Blk
  *
@@ -579,24 +710,81 @@ out:
 }
 
 // Public APIs
+void fpgaDmaGetDefaultConfig(fpga_dma_config_t *config)
+{
+	if (!config)
+		return;
+	config->depth = FPGA_DMA_MAX_BUF;
+	config->chunk_size = FPGA_DMA_BUF_SIZE;
+	config->fence_interval = FPGA_DMA_FENCE_INTERVAL;
+	config->polled = false;
+	config->copy_threads = 0;
+	config->wide_mmio = false;
+	config->rmw_unaligned = false;
+}
+
 fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma_p)
+{
+	return fpgaDmaOpenEx(fpga, NULL, dma_p);
+}
+
+fpga_result fpgaDmaOpenEx(fpga_handle fpga, const fpga_dma_config_t *config,
+			  fpga_dma_handle *dma_p)
 {
 	fpga_result res = FPGA_OK;
 	fpga_dma_handle dma_h = NULL;
-	int i = 0;
+	fpga_dma_config_t cfg;
+	uint32_t i = 0;
 	if (!fpga) {
 		return FPGA_INVALID_PARAM;
 	}
 	if (!dma_p) {
 		return FPGA_INVALID_PARAM;
 	}
+	if (config) {
+		cfg = *config;
+	} else {
+		fpgaDmaGetDefaultConfig(&cfg);
+	}
+	if (cfg.depth < 1 || cfg.depth > FPGA_DMA_MAX_DEPTH) {
+		error_print("Error: invalid DMA depth\n");
+		return FPGA_INVALID_PARAM;
+	}
+	if (cfg.chunk_size == 0 || cfg.chunk_size > FPGA_DMA_BUF_SIZE
+	    || !IS_DMA_ALIGNED(cfg.chunk_size)) {
+		error_print("Error: invalid DMA chunk size\n");
+		return FPGA_INVALID_PARAM;
+	}
+	// A full pipeline must contain a fence, or no bounce buffer is ever
+	// recycled
+	if (cfg.fence_interval < 1 || cfg.fence_interval > cfg.depth) {
+		error_print("Error: invalid DMA fence interval\n");
+		return FPGA_INVALID_PARAM;
+	}
+	if (cfg.copy_threads > FPGA_DMA_MAX_COPY_THREADS) {
+		error_print("Error: invalid DMA copy thread count\n");
+		return FPGA_INVALID_PARAM;
+	}
 	// init the dma handle
 	dma_h = (fpga_dma_handle)malloc(sizeof(struct _dma_handle_t));
 	if (!dma_h) {
 		return FPGA_NO_MEMORY;
 	}
 	dma_h->fpga_h = fpga;
-	for (i = 0; i < FPGA_DMA_MAX_BUF; i++)
+	dma_h->depth = cfg.depth;
+	dma_h->chunk_size = cfg.chunk_size;
+	dma_h->fence_interval = cfg.fence_interval;
+	dma_h->polled = cfg.polled;
+	dma_h->copy_threads = cfg.copy_threads;
+	dma_h->wide_mmio = false;
+#ifndef USE_ASE
+	if (cfg.wide_mmio) {
+		pthread_once(&mmio_write_lines_once, _select_mmio_write_lines);
+		dma_h->wide_mmio = mmio_write_lines != NULL;
+	}
+#endif
+	dma_h->rmw_unaligned = cfg.rmw_unaligned;
+	for (i = 0; i < FPGA_DMA_MAX_DEPTH; i++)
 		dma_h->dma_buf_ptr[i] = NULL;
 	dma_h->mmio_num = 0;
 	dma_h->mmio_offset = 0;
@@ -649,8 +837,8 @@ fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma_p)
 	}
 
 	// Buffer size must be page aligned for prepareBuffer
-	for (i = 0; i < FPGA_DMA_MAX_BUF; i++) {
-		res = fpgaPrepareBuffer(dma_h->fpga_h, FPGA_DMA_BUF_SIZE,
+	for (i = 0; i < dma_h->depth; i++) {
+		res = fpgaPrepareBuffer(dma_h->fpga_h, dma_h->chunk_size,
 					(void **)&(dma_h->dma_buf_ptr[i]),
 					&dma_h->dma_buf_wsid[i], 0);
 		ON_ERR_GOTO(res, out, "fpgaPrepareBuffer");
@@ -660,16 +848,16 @@ fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma_p)
 		ON_ERR_GOTO(res, rel_buf, "fpgaGetIOAddress");
 	}
 
-	// Allocate magic number buffer
-	res = fpgaPrepareBuffer(dma_h->fpga_h, FPGA_DMA_ALIGN_BYTES,
-				(void **)&(dma_h->magic_buf),
-				&dma_h->magic_wsid, 0);
+	// Allocate write fence buffer
+	res = fpgaPrepareBuffer(dma_h->fpga_h, FPGA_DMA_FENCE_BUF_SIZE,
+				(void **)&(dma_h->fence_buf),
+				&dma_h->fence_wsid, 0);
 	ON_ERR_GOTO(res, out, "fpgaPrepareBuffer");
 
-	res = fpgaGetIOAddress(dma_h->fpga_h, dma_h->magic_wsid,
-			       &dma_h->magic_iova);
+	res = fpgaGetIOAddress(dma_h->fpga_h, dma_h->fence_wsid,
+			       &dma_h->fence_iova);
 	ON_ERR_GOTO(res, rel_buf, "fpgaGetIOAddress");
-	memset((void *)dma_h->magic_buf, 0, FPGA_DMA_ALIGN_BYTES);
+	memset((void *)dma_h->fence_buf, 0, FPGA_DMA_FENCE_BUF_SIZE);
 
 	// turn on global interrupts
 	msgdma_ctrl_t ctrl = {0};
@@ -686,6 +874,9 @@ fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma_p)
 				0 /*vector id */);
 	ON_ERR_GOTO(res, destroy_eh, "fpgaRegisterEvent");
 
+	res = _engine_start(dma_h);
+	ON_ERR_GOTO(res, unreg_event, "_engine_start");
+
 	struct sigaction sa;
 	int sigres;
 
@@ -695,19 +886,22 @@ fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma_p)
 
 	sigres = sigaction(SIGHUP, &sa, &old_action);
 	if (sigres < 0) {
-		ON_ERR_GOTO(sigres < 0, destroy_eh,
+		_engine_stop(dma_h);
+		ON_ERR_GOTO(sigres < 0, unreg_event,
 			    "Error: failed to unregister signal handler.\n");
 	}
 	CsrControl = HOST_MMIO_32_ADDR(dma_h, CSR_CONTROL(dma_h));
 
 	return FPGA_OK;
 
+unreg_event:
+	fpgaUnregisterEvent(dma_h->fpga_h, FPGA_EVENT_INTERRUPT, dma_h->eh);
 destroy_eh:
 	res = fpgaDestroyEventHandle(&dma_h->eh);
 	ON_ERR_GOTO(res, rel_buf, "fpgaDestroyEventHandle");
 
 rel_buf:
-	for (i = 0; i < FPGA_DMA_MAX_BUF; i++) {
+	for (i = 0; i < dma_h->depth; i++) {
 		res = fpgaReleaseBuffer(dma_h->fpga_h, dma_h->dma_buf_wsid[i]);
 		ON_ERR_GOTO(res, out, "fpgaReleaseBuffer");
 	}
@@ -869,9 +1063,9 @@ static fpga_result _write_memory_mmio(fpga_dma_handle dma_h, uint64_t *dst_ptr,
 			break;
 		_switch_to_ase_page(dma_h, dst);
 		offset = dst & DMA_ADDR_SPAN_EXT_WINDOW_MASK;
-		res = MMIOWrite64Blk(dma_h, ASE_DATA_BASE(dma_h) + offset,
-				     (uint64_t)src, size_to_copy);
-		ON_ERR_RETURN(res, "MMIOWrite64Blk");
+		res = MMIOWrite512Blk(dma_h, ASE_DATA_BASE(dma_h) + offset,
+				      (uint64_t)src, size_to_copy);
+		ON_ERR_RETURN(res, "MMIOWrite512Blk");
 		src += size_to_copy;
 		dst += size_to_copy;
 		align_bytes -= size_to_copy;
@@ -1117,498 +1311,1544 @@ static fpga_result clear_interrupt(fpga_dma_handle dma_h)
 			      sizeof(status.reg));
 }
 
-static fpga_result poll_interrupt(fpga_dma_handle dma_h)
-{
-	struct pollfd pfd = {0};
-	fpga_result res = FPGA_OK;
-	int poll_res;
+#define FENCE_SLOT(dma_h, slot)                                                \
+	((dma_h)->fence_buf[(slot) * (FPGA_DMA_ALIGN_BYTES / sizeof(uint64_t))])
+#define FENCE_IOVA(dma_h, slot)                                                \
+	((dma_h)->fence_iova + (slot) * FPGA_DMA_ALIGN_BYTES)
 
-	res = fpgaGetOSObjectFromEventHandle(dma_h->eh, &pfd.fd);
-	ON_ERR_GOTO(res, out, "fpgaGetOSObjectFromEventHandle failed\n");
+/**
+ * _copy_thread
+ *
+ * @brief                Runs slices of staging copies queued by
+ * _staged_copy().
+ * @param[in] arg        Handle to the FPGA DMA object
+ * @return NULL
+ *
+ */
+static void *_copy_thread(void *arg)
+{
+	fpga_dma_handle dma_h = (fpga_dma_handle)arg;
+	dma_copy_slice_t *slice = NULL;
+
+	pthread_mutex_lock(&dma_h->copy_lock);
+	while (1) {
+		while (!dma_h->copy_queue && !dma_h->copy_shutdown)
+			pthread_cond_wait(&dma_h->copy_cond, &dma_h->copy_lock);
+		slice = dma_h->copy_queue;
+		if (!slice)
+			break;
+		dma_h->copy_queue = slice->next;
+		pthread_mutex_unlock(&dma_h->copy_lock);
 
-	pfd.events = POLLIN;
+		local_memcpy(slice->dst, slice->src, slice->n);
 
-#ifdef CHECK_DELAYS
-	if (0 == poll(&pfd, 1, 0))
-		poll_wait_count++;
-#endif
-	poll_res = poll(&pfd, 1, FPGA_DMA_TIMEOUT_MSEC);
-	if (poll_res < 0) {
-		fprintf(stderr, "Poll error errno = %s\n", strerror(errno));
-		res = FPGA_EXCEPTION;
-		goto out;
-	} else if (poll_res == 0) {
-		fprintf(stderr, "Poll(interrupt) timeout \n");
-		res = FPGA_EXCEPTION;
-	} else {
-		uint64_t count = 0;
-		ssize_t bytes_read = read(pfd.fd, &count, sizeof(count));
-		if (bytes_read > 0) {
-			debug_print("Poll success. Return = %d, count = %d\n",
-				    poll_res, (int)count);
-			res = FPGA_OK;
-		} else {
-			fprintf(stderr, "Error: poll failed read: %s\n",
-				bytes_read > 0 ? strerror(errno)
-					       : "zero bytes read");
-			res = FPGA_EXCEPTION;
-		}
+		pthread_mutex_lock(&dma_h->copy_lock);
+		if (--*slice->pending == 0)
+			pthread_cond_broadcast(&dma_h->copy_done_cond);
 	}
-
-out:
-	clear_interrupt(dma_h);
-	return res;
+	pthread_mutex_unlock(&dma_h->copy_lock);
+	return NULL;
 }
 
-static fpga_result _issue_magic(fpga_dma_handle dma_h)
+/**
+ * _staged_copy
+ *
+ * @brief                Copies between a bounce buffer and user memory. Large
+ * copies are split between the calling thread and the copy threads.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] dst        Pointer to the destination memory
+ * @param[in] src        Pointer to the source memory
+ * @param[in] n          Size in bytes
+ *
+ */
+static void _staged_copy(fpga_dma_handle dma_h, void *dst, void *src,
+			 size_t n)
 {
-	fpga_result res = FPGA_OK;
-	*(dma_h->magic_buf) = 0x0ULL;
+	dma_copy_slice_t slices[FPGA_DMA_MAX_COPY_THREADS];
+	uint64_t slice_size = 0;
+	uint32_t pending = 0;
+	uint32_t parts = 0;
+	uint32_t i = 0;
+
+	parts = min(dma_h->copy_threads + 1,
+		    (uint32_t)(n / FPGA_DMA_COPY_SLICE_SIZE));
+	if (parts < 2) {
+		local_memcpy(dst, src, n);
+		return;
+	}
 
-	res = _do_dma(dma_h, dma_h->magic_iova | FPGA_DMA_WF_HOST_MASK,
-		      FPGA_DMA_WF_ROM_MAGIC_NO_MASK, 64, 1, FPGA_TO_HOST_MM,
-		      true /*intr_en */);
-	return res;
-}
+	// Page multiples keep every slice as aligned as the whole copy
+	slice_size = (n / parts + FPGA_DMA_PAGE_SIZE - 1)
+		     & ~((uint64_t)FPGA_DMA_PAGE_SIZE - 1);
+	parts = (n + slice_size - 1) / slice_size;
+
+	pthread_mutex_lock(&dma_h->copy_lock);
+	for (i = 0; i < parts - 1; i++) {
+		slices[i].dst = (void *)((uint64_t)dst + (i + 1) * slice_size);
+		slices[i].src = (void *)((uint64_t)src + (i + 1) * slice_size);
+		slices[i].n = min(slice_size, n - (i + 1) * slice_size);
+		slices[i].pending = &pending;
+		slices[i].next = dma_h->copy_queue;
+		dma_h->copy_queue = &slices[i];
+	}
+	pending = parts - 1;
+	pthread_cond_broadcast(&dma_h->copy_cond);
+	pthread_mutex_unlock(&dma_h->copy_lock);
 
-static void _wait_magic(fpga_dma_handle dma_h)
-{
-	poll_interrupt(dma_h);
-	while (*(dma_h->magic_buf) != FPGA_DMA_WF_MAGIC_NO)
-		;
-	*(dma_h->magic_buf) = 0x0ULL;
+	local_memcpy(dst, src, slice_size);
+
+	pthread_mutex_lock(&dma_h->copy_lock);
+	while (pending)
+		pthread_cond_wait(&dma_h->copy_done_cond, &dma_h->copy_lock);
+	pthread_mutex_unlock(&dma_h->copy_lock);
 }
 
-fpga_result transferHostToFpga(fpga_dma_handle dma_h, uint64_t dst,
-			       uint64_t src, size_t count,
-			       fpga_dma_transfer_t type)
+#ifndef USE_ASE
+/**
+ * _copy_cpus
+ *
+ * @brief                Reads the CPUs local to the FPGA from sysfs.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[out] cpus      CPU set
+ * @return true if cpus was filled in
+ *
+ */
+static bool _copy_cpus(fpga_dma_handle dma_h, cpu_set_t *cpus)
 {
-	fpga_result res = FPGA_OK;
-	uint64_t i = 0;
-	uint64_t count_left = count;
-	uint64_t aligned_addr = 0;
-	uint64_t align_bytes = 0;
-	int issued_intr = 0;
-	debug_print("Host To Fpga ----------- src = %08lx, dst = %08lx \n", src,
-		    dst);
-	if (!IS_DMA_ALIGNED(dst)) {
-		if (count_left < FPGA_DMA_ALIGN_BYTES) {
-			res = _ase_host_to_fpga(dma_h, &dst, &src, count_left);
-			ON_ERR_GOTO(res, out,
-				    "HOST_TO_FPGA_MM Transfer failed\n");
-			return res;
-		} else {
-			aligned_addr = ((dst / FPGA_DMA_ALIGN_BYTES) + 1)
-				       * FPGA_DMA_ALIGN_BYTES;
-			align_bytes = aligned_addr - dst;
-			res = _ase_host_to_fpga(dma_h, &dst, &src, align_bytes);
-			ON_ERR_GOTO(res, out,
-				    "HOST_TO_FPGA_MM Transfer failed\n");
-			count_left = count_left - align_bytes;
-		}
+	fpga_properties props = NULL;
+	uint16_t segment = 0;
+	uint8_t bus = 0;
+	uint8_t device = 0;
+	uint8_t function = 0;
+	char path[PATH_MAX];
+	char list[4096];
+	char *p = NULL;
+	unsigned long first, last;
+	FILE *f = NULL;
+	bool ok = false;
+
+	if (fpgaGetPropertiesFromHandle(dma_h->fpga_h, &props) != FPGA_OK)
+		return false;
+	if (fpgaPropertiesGetSegment(props, &segment) == FPGA_OK
+	    && fpgaPropertiesGetBus(props, &bus) == FPGA_OK
+	    && fpgaPropertiesGetDevice(props, &device) == FPGA_OK
+	    && fpgaPropertiesGetFunction(props, &function) == FPGA_OK) {
+		snprintf(path, sizeof(path),
+			 "/sys/bus/pci/devices/%04x:%02x:%02x.%x/local_cpulist",
+			 segment, bus, device, function);
+		f = fopen(path, "r");
 	}
-	if (count_left) {
-		uint64_t dma_chunks = count_left / FPGA_DMA_BUF_SIZE;
-		count_left -= (dma_chunks * FPGA_DMA_BUF_SIZE);
-		debug_print("DMA TX : dma chuncks = %" PRIu64
-			    ", count_left = %08lx, dst = %08lx, src = %08lx \n",
-			    dma_chunks, count_left, dst, src);
-
-		for (i = 0; i < dma_chunks; i++) {
-			// constant size transfer, no length check required for
-			// memcpy
-			local_memcpy(dma_h->dma_buf_ptr[i % FPGA_DMA_MAX_BUF],
-				     (void *)(src + i * FPGA_DMA_BUF_SIZE),
-				     FPGA_DMA_BUF_SIZE);
-			if ((i % (FPGA_DMA_MAX_BUF / 2)
-			     == (FPGA_DMA_MAX_BUF / 2) - 1)
-			    || i == (dma_chunks - 1) /*last descriptor */) {
-				if (i == (FPGA_DMA_MAX_BUF / 2) - 1) {
-					res = _do_dma(
-						dma_h,
-						(dst + i * FPGA_DMA_BUF_SIZE),
-						dma_h->dma_buf_iova
-								[i
-								 % FPGA_DMA_MAX_BUF]
-							| FPGA_DMA_HOST_MASK,
-						FPGA_DMA_BUF_SIZE, 0, type,
-						true);
-				} else {
-					if (issued_intr)
-						poll_interrupt(dma_h);
-					res = _do_dma(
-						dma_h,
-						(dst + i * FPGA_DMA_BUF_SIZE),
-						dma_h->dma_buf_iova
-								[i
-								 % FPGA_DMA_MAX_BUF]
-							| FPGA_DMA_HOST_MASK,
-						FPGA_DMA_BUF_SIZE, 0, type,
-						true /*intr_en */);
-				}
-				issued_intr = 1;
-			} else {
-				res = _do_dma(
-					dma_h, (dst + i * FPGA_DMA_BUF_SIZE),
-					dma_h->dma_buf_iova[i
-							    % FPGA_DMA_MAX_BUF]
-						| FPGA_DMA_HOST_MASK,
-					FPGA_DMA_BUF_SIZE, 0, type,
-					false /*intr_en */);
-			}
-		}
-		if (issued_intr) {
-			poll_interrupt(dma_h);
-			issued_intr = 0;
-		}
-		if (count_left) {
-			uint64_t dma_tx_bytes =
-				(count_left / FPGA_DMA_ALIGN_BYTES)
-				* FPGA_DMA_ALIGN_BYTES;
-			if (dma_tx_bytes != 0) {
-				debug_print(
-					"dma_tx_bytes = %08lx  was transfered using DMA\n",
-					dma_tx_bytes);
-				if (dma_tx_bytes > FPGA_DMA_BUF_SIZE) {
-					res = FPGA_NO_MEMORY;
-					ON_ERR_GOTO(res, out,
-						    "Illegal transfer size\n");
-				}
-
-				local_memcpy(
-					dma_h->dma_buf_ptr[0],
-					(void *)(src
-						 + dma_chunks
-							   * FPGA_DMA_BUF_SIZE),
-					dma_tx_bytes);
-				res = _do_dma(
-					dma_h,
-					(dst + dma_chunks * FPGA_DMA_BUF_SIZE),
-					dma_h->dma_buf_iova[0]
-						| FPGA_DMA_HOST_MASK,
-					dma_tx_bytes, 1, type,
-					true /*intr_en */);
-				ON_ERR_GOTO(
-					res, out,
-					"HOST_TO_FPGA_MM Transfer failed\n");
-				poll_interrupt(dma_h);
-			}
-			count_left -= dma_tx_bytes;
-			if (count_left) {
-				dst = dst + dma_chunks * FPGA_DMA_BUF_SIZE
-				      + dma_tx_bytes;
-				src = src + dma_chunks * FPGA_DMA_BUF_SIZE
-				      + dma_tx_bytes;
-				res = _ase_host_to_fpga(dma_h, &dst, &src,
-							count_left);
-				ON_ERR_GOTO(
-					res, out,
-					"HOST_TO_FPGA_MM Transfer failed\n");
+	fpgaDestroyProperties(&props);
+	if (!f)
+		return false;
+
+	// A list of ranges such as 0-7,16-23
+	CPU_ZERO(cpus);
+	if (fgets(list, sizeof(list), f)) {
+		p = list;
+		while (*p >= '0' && *p <= '9') {
+			first = strtoul(p, &p, 10);
+			last = first;
+			if (*p == '-')
+				last = strtoul(p + 1, &p, 10);
+			for (; first <= last && first < CPU_SETSIZE; first++) {
+				CPU_SET(first, cpus);
+				ok = true;
 			}
+			if (*p == ',')
+				p++;
 		}
 	}
-out:
-	return res;
+	fclose(f);
+	return ok;
 }
+#endif
 
-fpga_result transferFpgaToHost(fpga_dma_handle dma_h, uint64_t dst,
-			       uint64_t src, size_t count,
-			       fpga_dma_transfer_t type)
+/**
+ * _copy_pool_stop
+ *
+ * @brief                Stops the copy threads. No copy may be in progress.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ *
+ */
+static void _copy_pool_stop(fpga_dma_handle dma_h)
 {
-	fpga_result res = FPGA_OK;
-	uint64_t i = 0;
-	uint64_t j = 0;
-	uint64_t count_left = count;
-	uint64_t aligned_addr = 0;
-	uint64_t align_bytes = 0;
-	int wf_issued = 0;
+	uint32_t i = 0;
+
+	pthread_mutex_lock(&dma_h->copy_lock);
+	dma_h->copy_shutdown = true;
+	pthread_cond_broadcast(&dma_h->copy_cond);
+	pthread_mutex_unlock(&dma_h->copy_lock);
+	for (i = 0; i < dma_h->copy_threads; i++)
+		pthread_join(dma_h->copy_thread[i], NULL);
+
+	pthread_cond_destroy(&dma_h->copy_done_cond);
+	pthread_cond_destroy(&dma_h->copy_cond);
+	pthread_mutex_destroy(&dma_h->copy_lock);
+}
 
-	debug_print("FPGA To Host ----------- src = %08lx, dst = %08lx \n", src,
-		    dst);
-	if (!IS_DMA_ALIGNED(src)) {
-		if (count_left < FPGA_DMA_ALIGN_BYTES) {
-			res = _ase_fpga_to_host(dma_h, &src, &dst, count_left);
-			ON_ERR_GOTO(res, out,
-				    "FPGA_TO_HOST_MM Transfer failed");
-			return res;
-		} else {
-			aligned_addr = ((src / FPGA_DMA_ALIGN_BYTES) + 1)
-				       * FPGA_DMA_ALIGN_BYTES;
-			align_bytes = aligned_addr - src;
-			res = _ase_fpga_to_host(dma_h, &src, &dst, align_bytes);
-			ON_ERR_GOTO(res, out,
-				    "FPGA_TO_HOST_MM Transfer failed");
-			count_left = count_left - align_bytes;
-		}
+/**
+ * _copy_pool_start
+ *
+ * @brief                Starts the copy threads, if any were requested.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _copy_pool_start(fpga_dma_handle dma_h)
+{
+	pthread_attr_t attr;
+	uint32_t i = 0;
+	int err = 0;
+
+	dma_h->copy_queue = NULL;
+	dma_h->copy_shutdown = false;
+	pthread_mutex_init(&dma_h->copy_lock, NULL);
+	pthread_cond_init(&dma_h->copy_cond, NULL);
+	pthread_cond_init(&dma_h->copy_done_cond, NULL);
+
+	pthread_attr_init(&attr);
+#ifndef USE_ASE
+	// Bounce buffers come from the FPGA's node, so copy from there too
+	cpu_set_t cpus;
+	if (dma_h->copy_threads && _copy_cpus(dma_h, &cpus))
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+#endif
+	for (i = 0; i < dma_h->copy_threads; i++) {
+		err = pthread_create(&dma_h->copy_thread[i], &attr,
+				     _copy_thread, dma_h);
+		if (err)
+			break;
 	}
-	if (count_left) {
-		uint64_t dma_chunks = count_left / FPGA_DMA_BUF_SIZE;
-		count_left -= (dma_chunks * FPGA_DMA_BUF_SIZE);
-		debug_print("DMA TX : dma chunks = %" PRIu64
-			    ", count_left = %08lx, dst = %08lx, src = %08lx \n",
-			    dma_chunks, count_left, dst, src);
-		assert(FPGA_DMA_MAX_BUF >= 8);
-		uint64_t pending_buf = 0;
-		for (i = 0; i < dma_chunks; i++) {
-			res = _do_dma(
-				dma_h,
-				dma_h->dma_buf_iova[i % (FPGA_DMA_MAX_BUF)]
-					| FPGA_DMA_HOST_MASK,
-				(src + i * FPGA_DMA_BUF_SIZE),
-				FPGA_DMA_BUF_SIZE, 1, type, false /*intr_en */);
-			ON_ERR_GOTO(res, out,
-				    "FPGA_TO_HOST_MM Transfer failed");
-
-			const int num_pending = i - pending_buf + 1;
-			if (num_pending
-			    == (FPGA_DMA_MAX_BUF
-				/ 2)) { // Enters this loop only once,after
-					// first batch of descriptors.
-				res = _issue_magic(dma_h);
-				ON_ERR_GOTO(res, out,
-					    "Magic number issue failed");
-				wf_issued = 1;
-			}
-			if (num_pending > (FPGA_DMA_MAX_BUF - 1)
-			    || i == (dma_chunks - 1) /*last descriptor */) {
-				if (wf_issued) {
-					_wait_magic(dma_h);
-					for (j = 0; j < (FPGA_DMA_MAX_BUF / 2);
-					     j++) {
-						// constant size transfer; no
-						// length check required
-						local_memcpy(
-							(void *)(dst
-								 + pending_buf
-									   * FPGA_DMA_BUF_SIZE),
-							dma_h->dma_buf_ptr
-								[pending_buf
-								 % (FPGA_DMA_MAX_BUF)],
-							FPGA_DMA_BUF_SIZE);
-						pending_buf++;
-					}
-					wf_issued = 0;
-				}
-				res = _issue_magic(dma_h);
-				ON_ERR_GOTO(res, out,
-					    "Magic number issue failed");
-				wf_issued = 1;
-			}
-		}
+	pthread_attr_destroy(&attr);
 
-		if (wf_issued)
-			_wait_magic(dma_h);
-
-		// clear out final dma memcpy operations
-		while (pending_buf < dma_chunks) {
-			// constant size transfer; no length check required
-			local_memcpy(
-				(void *)(dst + pending_buf * FPGA_DMA_BUF_SIZE),
-				dma_h->dma_buf_ptr[pending_buf
-						   % (FPGA_DMA_MAX_BUF)],
-				FPGA_DMA_BUF_SIZE);
-			pending_buf++;
-		}
-		if (count_left > 0) {
-			uint64_t dma_tx_bytes =
-				(count_left / FPGA_DMA_ALIGN_BYTES)
-				* FPGA_DMA_ALIGN_BYTES;
-			if (dma_tx_bytes != 0) {
-				debug_print(
-					"dma_tx_bytes = %08lx  was transfered using DMA\n",
-					dma_tx_bytes);
-				res = _do_dma(
-					dma_h,
-					dma_h->dma_buf_iova[0]
-						| FPGA_DMA_HOST_MASK,
-					(src + dma_chunks * FPGA_DMA_BUF_SIZE),
-					dma_tx_bytes, 1, type,
-					false /*intr_en */);
-				ON_ERR_GOTO(res, out,
-					    "FPGA_TO_HOST_MM Transfer failed");
-				res = _issue_magic(dma_h);
-				ON_ERR_GOTO(res, out,
-					    "Magic number issue failed");
-				_wait_magic(dma_h);
-				if (dma_tx_bytes > FPGA_DMA_BUF_SIZE) {
-					res = FPGA_NO_MEMORY;
-					ON_ERR_GOTO(res, out,
-						    "Illegal transfer size\n");
-				}
-				local_memcpy(
-					(void *)(dst
-						 + dma_chunks
-							   * FPGA_DMA_BUF_SIZE),
-					dma_h->dma_buf_ptr[0], dma_tx_bytes);
-			}
-			count_left -= dma_tx_bytes;
-			if (count_left) {
-				dst = dst + dma_chunks * FPGA_DMA_BUF_SIZE
-				      + dma_tx_bytes;
-				src = src + dma_chunks * FPGA_DMA_BUF_SIZE
-				      + dma_tx_bytes;
-				res = _ase_fpga_to_host(dma_h, &src, &dst,
-							count_left);
-				ON_ERR_GOTO(res, out,
-					    "FPGA_TO_HOST_MM Transfer failed");
-			}
-		}
+	if (err) {
+		dma_h->copy_threads = i;
+		_copy_pool_stop(dma_h);
+		return FPGA_EXCEPTION;
 	}
-out:
-	return res;
+	return FPGA_OK;
 }
 
-fpga_result transferFpgaToFpga(fpga_dma_handle dma_h, uint64_t dst,
-			       uint64_t src, size_t count,
-			       fpga_dma_transfer_t type)
+/**
+ * _engine_fail
+ *
+ * @brief                Marks the engine failed. In-flight chunks are retired
+ * with the error by the completion thread and queued transfers fail.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] res        Error to report
+ *
+ */
+static void _engine_fail(fpga_dma_handle dma_h, fpga_result res)
 {
-	fpga_result res = FPGA_OK;
-	uint64_t i = 0;
-	uint64_t count_left = count;
-	uint64_t *tmp_buf = NULL;
-	if (IS_DMA_ALIGNED(dst) && IS_DMA_ALIGNED(src)
-	    && IS_DMA_ALIGNED(count_left)) {
-		uint64_t dma_chunks = count_left / FPGA_DMA_BUF_SIZE;
-		count_left -= (dma_chunks * FPGA_DMA_BUF_SIZE);
-		debug_print("!!!FPGA to FPGA!!! TX :dma chunks = %" PRIu64
-			    ", count = %08lx, dst = %08lx, src = %08lx \n",
-			    dma_chunks, count_left, dst, src);
-
-		for (i = 0; i < dma_chunks; i++) {
-			res = _do_dma(dma_h, (dst + i * FPGA_DMA_BUF_SIZE),
-				      (src + i * FPGA_DMA_BUF_SIZE),
-				      FPGA_DMA_BUF_SIZE, 0, type,
-				      false /*intr_en */);
-			ON_ERR_GOTO(res, out,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-			if ((i + 1) % FPGA_DMA_MAX_BUF == 0
-			    || i == (dma_chunks - 1) /*last descriptor */) {
-				res = _issue_magic(dma_h);
-				ON_ERR_GOTO(res, out,
-					    "Magic number issue failed");
-				_wait_magic(dma_h);
-			}
-		}
-		if (count_left > 0) {
-			debug_print(
-				"Count_left = %08lx  was transfered using DMA\n",
-				count_left);
-			res = _do_dma(dma_h,
-				      (dst + dma_chunks * FPGA_DMA_BUF_SIZE),
-				      (src + dma_chunks * FPGA_DMA_BUF_SIZE),
-				      count_left, 1, type, false /*intr_en */);
-			ON_ERR_GOTO(res, out,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-			res = _issue_magic(dma_h);
-			ON_ERR_GOTO(res, out, "Magic number issue failed");
-			_wait_magic(dma_h);
-		}
-	} else {
-		if ((src < dst) && (src + count_left >= dst)) {
-			debug_print(
-				"Overlapping addresses, Provide correct dst address\n");
-			return FPGA_NOT_SUPPORTED;
-		}
-		uint32_t tx_chunks = count_left / FPGA_DMA_BUF_ALIGN_SIZE;
-		count_left -= (tx_chunks * FPGA_DMA_BUF_ALIGN_SIZE);
-		debug_print(
-			"!!!FPGA to FPGA TX!!! : tx chunks = %d, count = %08lx, dst = %08lx, src = %08lx \n",
-			tx_chunks, count_left, dst, src);
-		tmp_buf = (uint64_t *)malloc(FPGA_DMA_BUF_ALIGN_SIZE);
-		for (i = 0; i < tx_chunks; i++) {
-			res = transferFpgaToHost(
-				dma_h, (uint64_t)tmp_buf,
-				(src + i * FPGA_DMA_BUF_ALIGN_SIZE),
-				FPGA_DMA_BUF_ALIGN_SIZE, FPGA_TO_HOST_MM);
-			ON_ERR_GOTO(res, out_spl,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-			res = transferHostToFpga(
-				dma_h, (dst + i * FPGA_DMA_BUF_ALIGN_SIZE),
-				(uint64_t)tmp_buf, FPGA_DMA_BUF_ALIGN_SIZE,
-				HOST_TO_FPGA_MM);
-			ON_ERR_GOTO(res, out_spl,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-		}
-		if (count_left > 0) {
-			res = transferFpgaToHost(
-				dma_h, (uint64_t)tmp_buf,
-				(src + tx_chunks * FPGA_DMA_BUF_ALIGN_SIZE),
-				count_left, FPGA_TO_HOST_MM);
-			ON_ERR_GOTO(res, out_spl,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-			res = transferHostToFpga(
-				dma_h,
-				(dst + tx_chunks * FPGA_DMA_BUF_ALIGN_SIZE),
-				(uint64_t)tmp_buf, count_left, HOST_TO_FPGA_MM);
-			ON_ERR_GOTO(res, out_spl,
-				    "FPGA_TO_FPGA_MM Transfer failed");
-		}
-		free(tmp_buf);
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&dma_h->lock);
+	if (dma_h->engine_error == FPGA_OK)
+		dma_h->engine_error = res;
+	pthread_cond_broadcast(&dma_h->inflight_cond);
+	pthread_mutex_unlock(&dma_h->lock);
+
+	if (write(dma_h->wake_fd, &one, sizeof(one)) < 0) {
+		error_print("Error: failed to wake completion thread\n");
 	}
-out:
-	return res;
-out_spl:
-	free(tmp_buf);
-	return res;
 }
 
-fpga_result fpgaDmaTransferSync(fpga_dma_handle dma_h, uint64_t dst,
-				uint64_t src, size_t count,
-				fpga_dma_transfer_t type)
+/**
+ * _transfer_complete
+ *
+ * @brief                Queues a transfer whose last reference was dropped
+ * for delivery by the completion thread. Called with the lock held.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Completed transfer
+ *
+ */
+static void _transfer_complete(fpga_dma_handle dma_h,
+			       struct _dma_transfer_t *xfer)
 {
+	xfer->next = NULL;
+	if (dma_h->cq_tail)
+		dma_h->cq_tail->next = xfer;
+	else
+		dma_h->cq_head = xfer;
+	dma_h->cq_tail = xfer;
+}
 
-	fpga_result res = FPGA_OK;
-
-	if (!dma_h)
-		return FPGA_INVALID_PARAM;
+/**
+ * _transfer_finish
+ *
+ * @brief                Delivers the completion of a transfer taken off the
+ * completion queue. Must be called without the lock held.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Completed transfer
+ *
+ */
+static void _transfer_finish(fpga_dma_handle dma_h,
+			     struct _dma_transfer_t *xfer)
+{
+	bool detached = xfer->detached;
 
-	if (type >= FPGA_MAX_TRANSFER_TYPE)
-		return FPGA_INVALID_PARAM;
+	if (xfer->cb)
+		xfer->cb(xfer->context);
 
-	if (!(type == HOST_TO_FPGA_MM || type == FPGA_TO_HOST_MM
-	      || type == FPGA_TO_FPGA_MM))
-		return FPGA_NOT_SUPPORTED;
+	pthread_mutex_lock(&dma_h->lock);
+	xfer->done = true;
+	dma_h->active--;
+	pthread_cond_broadcast(&dma_h->done_cond);
+	pthread_mutex_unlock(&dma_h->lock);
 
-	if (!dma_h->fpga_h)
-		return FPGA_INVALID_PARAM;
+	// The waiter owns a future once done is set
+	if (detached)
+		free(xfer);
+}
 
-	if (type == HOST_TO_FPGA_MM) {
-		res = transferHostToFpga(dma_h, dst, src, count,
-					 HOST_TO_FPGA_MM);
-	} else if (type == FPGA_TO_HOST_MM) {
-		res = transferFpgaToHost(dma_h, dst, src, count,
-					 FPGA_TO_HOST_MM);
-	} else if (type == FPGA_TO_FPGA_MM) {
-		res = transferFpgaToFpga(dma_h, dst, src, count,
-					 FPGA_TO_FPGA_MM);
-	} else {
-		return FPGA_NOT_SUPPORTED;
+/**
+ * _engine_reserve
+ *
+ * @brief                Waits for a free in-flight slot and, if requested, a
+ * free bounce buffer.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] need_buf   True to also reserve a bounce buffer
+ * @param[out] buf       Reserved bounce buffer index, -1 if none
+ * @return fpga_result FPGA_OK on success, the engine error otherwise
+ *
+ */
+static fpga_result _engine_reserve(fpga_dma_handle dma_h, bool need_buf,
+				   int *buf)
+{
+	fpga_result res;
+	int free_buf;
+
+	*buf = -1;
+	pthread_mutex_lock(&dma_h->lock);
+	while ((res = dma_h->engine_error) == FPGA_OK) {
+		if (dma_h->inflight_head - dma_h->inflight_tail
+		    < dma_h->depth) {
+			if (!need_buf)
+				break;
+			free_buf = __builtin_ffsll(~(uint64_t)dma_h->buf_busy
+						   & ((1ull << dma_h->depth) - 1));
+			if (free_buf) {
+				*buf = free_buf - 1;
+				dma_h->buf_busy |= 1u << *buf;
+				break;
+			}
+		}
+		pthread_cond_wait(&dma_h->inflight_cond, &dma_h->lock);
 	}
-
+	pthread_mutex_unlock(&dma_h->lock);
 	return res;
 }
 
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#pragma GCC diagnostic ignored "-Wunused-value"
-#define UNUSED(...) (void)(__VA_ARGS__)
-
-fpga_result fpgaDmaTransferAsync(fpga_dma_handle dma, uint64_t dst,
-				 uint64_t src, size_t count,
-				 fpga_dma_transfer_t type,
-				 fpga_dma_transfer_cb cb, void *context)
+/**
+ * _engine_drain
+ *
+ * @brief                Waits until every posted chunk has been retired. Used
+ * before MMIO accesses through the address span expander, which are not
+ * ordered with descriptors still in the FIFO.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @return fpga_result FPGA_OK on success, the engine error otherwise
+ *
+ */
+static fpga_result _engine_drain(fpga_dma_handle dma_h)
 {
-	// TODO
-	UNUSED(dma, dst, src, count, type, cb, context);
-	return FPGA_NOT_SUPPORTED;
+	fpga_result res;
+
+	pthread_mutex_lock(&dma_h->lock);
+	while ((res = dma_h->engine_error) == FPGA_OK
+	       && dma_h->inflight_tail != dma_h->inflight_head)
+		pthread_cond_wait(&dma_h->inflight_cond, &dma_h->lock);
+	pthread_mutex_unlock(&dma_h->lock);
+	return res;
 }
 
-fpga_result fpgaDmaClose(fpga_dma_handle dma_h)
-{
-	fpga_result res = FPGA_OK;
-	int i = 0;
-	int sigres;
-	if (!dma_h) {
-		return FPGA_INVALID_PARAM;
+/**
+ * _engine_post
+ *
+ * @brief                Posts one chunk to the descriptor FIFO and records it
+ * in the next in-flight slot. Every fence_interval-th chunk and the last chunk
+ * of a transfer are followed by a write fence, which raises an interrupt
+ * unless completion is polled.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer the chunk belongs to
+ * @param[in] dst        Destination address as seen by the DMA
+ * @param[in] src        Source address as seen by the DMA
+ * @param[in] len        Number of bytes, multiple of FPGA_DMA_ALIGN_BYTES
+ * @param[in] type       Direction of transfer
+ * @param[in] buf        Reserved bounce buffer index, -1 if none
+ * @param[in] copy_dst   Host address to copy the bounce buffer to on
+ * retirement, 0 if none
+ * @param[in] last       True for the last chunk of a transfer
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_post(fpga_dma_handle dma_h,
+				struct _dma_transfer_t *xfer, uint64_t dst,
+				uint64_t src, uint64_t len,
+				fpga_dma_transfer_t type, int buf,
+				uint64_t copy_dst, bool last)
+{
+	// Only the engine thread advances inflight_head
+	uint32_t slot = FPGA_DMA_INFLIGHT_IDX(dma_h->inflight_head);
+	dma_chunk_t *chunk = &dma_h->inflight[slot];
+	fpga_result res = FPGA_OK;
+	uint64_t one = 1;
+	bool idle = false;
+
+	chunk->xfer = xfer;
+	chunk->buf = buf;
+	chunk->copy_dst = copy_dst;
+	chunk->len = len;
+	// fence_interval <= depth, so a full pipeline always holds a fence
+	// whose retirement frees slots and bounce buffers
+	chunk->fenced = last
+			|| ++dma_h->unfenced >= dma_h->fence_interval;
+	if (chunk->fenced)
+		dma_h->unfenced = 0;
+	FENCE_SLOT(dma_h, slot) = 0x0ULL;
+
+	res = _do_dma(dma_h, dst, src, len, last, type, false /*intr_en */);
+	if (res != FPGA_OK) {
+		pthread_mutex_lock(&dma_h->lock);
+		if (buf >= 0)
+			dma_h->buf_busy &= ~(1u << buf);
+		pthread_mutex_unlock(&dma_h->lock);
+		_engine_fail(dma_h, res);
+		return res;
+	}
+
+	// Publish the chunk before its fence can land
+	pthread_mutex_lock(&dma_h->lock);
+	idle = dma_h->inflight_head == dma_h->inflight_tail;
+	xfer->refs++;
+	dma_h->inflight_head++;
+	pthread_mutex_unlock(&dma_h->lock);
+
+	if (chunk->fenced) {
+		res = _do_dma(dma_h, FENCE_IOVA(dma_h, slot)
+					     | FPGA_DMA_WF_HOST_MASK,
+			      FPGA_DMA_WF_ROM_MAGIC_NO_MASK,
+			      FPGA_DMA_ALIGN_BYTES, 1, FPGA_TO_HOST_MM,
+			      !dma_h->polled /*intr_en */);
+		if (res != FPGA_OK)
+			_engine_fail(dma_h, res);
+	}
+
+	// A polling completion thread sleeps while nothing is in flight
+	if (dma_h->polled && idle
+	    && write(dma_h->wake_fd, &one, sizeof(one)) < 0) {
+		error_print("Error: failed to wake completion thread\n");
+	}
+	return res;
+}
+
+/**
+ * _host_iova
+ *
+ * @brief                Looks up the IO address of a host range that lies in
+ * memory shared with fpgaPrepareBuffer(), so that it can be transferred
+ * without a bounce buffer.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] host       Host address
+ * @param[in] len        Size in bytes
+ * @param[out] iova      IO address of host
+ * @return true if the range is DMA aligned and contiguous in IO space
+ *
+ */
+static bool _host_iova(fpga_dma_handle dma_h, uint64_t host, uint64_t len,
+		       uint64_t *iova)
+{
+	uint64_t last = 0;
+
+	if (!IS_DMA_ALIGNED(host))
+		return false;
+
+	if (fpgaGetIOAddressFromVA(dma_h->fpga_h, (void *)host, iova)
+	    != FPGA_OK)
+		return false;
+
+	if (fpgaGetIOAddressFromVA(dma_h->fpga_h, (void *)(host + len - 1),
+				   &last)
+	    != FPGA_OK)
+		return false;
+
+	return last - *iova == len - 1;
+}
+
+/**
+ * _rmw_whole
+ *
+ * @brief                Checks whether an unaligned region is small enough to
+ * be moved in one piece, rounded out to lines in a single bounce buffer.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] fpga       FPGA address
+ * @param[in] count      Size in bytes, non-zero
+ * @return true if rmw_unaligned is set and the region fits one chunk
+ *
+ */
+static bool _rmw_whole(fpga_dma_handle dma_h, uint64_t fpga, uint64_t count)
+{
+	if (!dma_h->rmw_unaligned)
+		return false;
+	if (IS_DMA_ALIGNED(fpga) && IS_DMA_ALIGNED(count))
+		return false;
+	return DMA_ALIGN_UP(fpga + count) - DMA_ALIGN_DOWN(fpga)
+	       <= dma_h->chunk_size;
+}
+
+/**
+ * _engine_release_buf
+ *
+ * @brief                Returns a bounce buffer that was reserved without
+ * being handed to an in-flight chunk.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] buf        Bounce buffer index
+ *
+ */
+static void _engine_release_buf(fpga_dma_handle dma_h, int buf)
+{
+	pthread_mutex_lock(&dma_h->lock);
+	dma_h->buf_busy &= ~(1u << buf);
+	pthread_cond_broadcast(&dma_h->inflight_cond);
+	pthread_mutex_unlock(&dma_h->lock);
+}
+
+/**
+ * _engine_rmw_host_to_fpga
+ *
+ * @brief                Writes a region of at most one chunk by DMA from a
+ * bounce buffer holding the lines it touches. Partial first and last lines
+ * are read back from the FPGA and merged with the new bytes first.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer to credit the chunks to
+ * @param[in] dst        FPGA address
+ * @param[in] src        Host address
+ * @param[in] count      Size in bytes
+ * @param[in] fence_end  True to fence the write
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_rmw_host_to_fpga(fpga_dma_handle dma_h,
+					    struct _dma_transfer_t *xfer,
+					    uint64_t dst, uint64_t src,
+					    uint64_t count, bool fence_end)
+{
+	uint64_t start = DMA_ALIGN_DOWN(dst);
+	uint64_t end = DMA_ALIGN_UP(dst + count);
+	uint64_t tail = end - FPGA_DMA_ALIGN_BYTES;
+	fpga_result res = FPGA_OK;
+	uint64_t iova = 0;
+	int slot = -1;
+	int buf = -1;
+
+	res = _engine_reserve(dma_h, true, &buf);
+	ON_ERR_RETURN(res, "_engine_reserve");
+	iova = dma_h->dma_buf_iova[buf];
+
+	// Earlier writes to the partial lines must land before they are read
+	res = _engine_drain(dma_h);
+	if (res == FPGA_OK && start != dst)
+		res = _engine_post(dma_h, xfer, iova | FPGA_DMA_HOST_MASK,
+				   start, FPGA_DMA_ALIGN_BYTES,
+				   FPGA_TO_HOST_MM, -1, 0, true);
+	if (res == FPGA_OK && end != dst + count
+	    && (tail != start || start == dst)) {
+		res = _engine_reserve(dma_h, false, &slot);
+		if (res == FPGA_OK)
+			res = _engine_post(dma_h, xfer,
+					   (iova + tail - start)
+						   | FPGA_DMA_HOST_MASK,
+					   tail, FPGA_DMA_ALIGN_BYTES,
+					   FPGA_TO_HOST_MM, -1, 0, true);
+	}
+	if (res == FPGA_OK)
+		res = _engine_drain(dma_h);
+	if (res == FPGA_OK)
+		res = _engine_reserve(dma_h, false, &slot);
+	if (res != FPGA_OK) {
+		_engine_release_buf(dma_h, buf);
+		return res;
+	}
+
+	local_memcpy((uint8_t *)dma_h->dma_buf_ptr[buf] + (dst - start),
+		     (void *)src, count);
+	return _engine_post(dma_h, xfer, start, iova | FPGA_DMA_HOST_MASK,
+			    end - start, HOST_TO_FPGA_MM, buf, 0, fence_end);
+}
+
+/**
+ * _engine_rmw_fpga_to_host
+ *
+ * @brief                Reads a region of at most one chunk by DMA into a
+ * bounce buffer holding the lines it touches, and copies it out once the read
+ * has landed.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer to credit the chunk to
+ * @param[in] dst        Host address
+ * @param[in] src        FPGA address
+ * @param[in] count      Size in bytes
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_rmw_fpga_to_host(fpga_dma_handle dma_h,
+					    struct _dma_transfer_t *xfer,
+					    uint64_t dst, uint64_t src,
+					    uint64_t count)
+{
+	uint64_t start = DMA_ALIGN_DOWN(src);
+	uint64_t end = DMA_ALIGN_UP(src + count);
+	fpga_result res = FPGA_OK;
+	int buf = -1;
+
+	res = _engine_reserve(dma_h, true, &buf);
+	ON_ERR_RETURN(res, "_engine_reserve");
+
+	res = _engine_post(dma_h, xfer,
+			   dma_h->dma_buf_iova[buf] | FPGA_DMA_HOST_MASK,
+			   start, end - start, FPGA_TO_HOST_MM, -1, 0, true);
+	if (res == FPGA_OK)
+		res = _engine_drain(dma_h);
+	if (res == FPGA_OK)
+		local_memcpy((void *)dst,
+			     (uint8_t *)dma_h->dma_buf_ptr[buf] + (src - start),
+			     count);
+	_engine_release_buf(dma_h, buf);
+	return res;
+}
+
+/**
+ * _engine_host_to_fpga
+ *
+ * @brief                Issues a HOST_TO_FPGA_MM transfer. The DMA aligned
+ * body is read in place from shared host memory or staged through the bounce
+ * buffers; unaligned head and tail bytes are written through the address
+ * span expander, or merged into whole lines by DMA if rmw_unaligned is set.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer to credit the chunks to
+ * @param[in] dst        FPGA address
+ * @param[in] src        Host address
+ * @param[in] count      Size in bytes
+ * @param[in] fence_end  True to fence the final chunk
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_host_to_fpga(fpga_dma_handle dma_h,
+					struct _dma_transfer_t *xfer,
+					uint64_t dst, uint64_t src,
+					uint64_t count, bool fence_end)
+{
+	fpga_result res = FPGA_OK;
+	uint64_t align_bytes = 0;
+	uint64_t iova = 0;
+	uint64_t len = 0;
+	bool last = false;
+	int buf = -1;
+
+	debug_print("Host To Fpga ----------- src = %08lx, dst = %08lx \n", src,
+		    dst);
+	if (_rmw_whole(dma_h, dst, count))
+		return _engine_rmw_host_to_fpga(dma_h, xfer, dst, src, count,
+						fence_end);
+
+	if (!IS_DMA_ALIGNED(dst)) {
+		align_bytes = min(count, FPGA_DMA_ALIGN_BYTES
+					 - dst % FPGA_DMA_ALIGN_BYTES);
+		if (dma_h->rmw_unaligned) {
+			// Fenced if the tail is next, which drains first
+			res = _engine_rmw_host_to_fpga(
+				dma_h, xfer, dst, src, align_bytes,
+				count - align_bytes < FPGA_DMA_ALIGN_BYTES);
+			dst += align_bytes;
+			src += align_bytes;
+		} else {
+			res = _engine_drain(dma_h);
+			ON_ERR_RETURN(res, "_engine_drain");
+			res = _ase_host_to_fpga(dma_h, &dst, &src,
+						align_bytes);
+		}
+		ON_ERR_RETURN(res, "HOST_TO_FPGA_MM Transfer failed\n");
+		count -= align_bytes;
+	}
+
+	while (count >= FPGA_DMA_ALIGN_BYTES) {
+		len = min(count, (uint64_t)dma_h->chunk_size)
+		      & ~((uint64_t)FPGA_DMA_ALIGN_BYTES - 1);
+		// A tail written through the address span expander waits
+		// for this chunk, so it must be fenced
+		last = count - len < FPGA_DMA_ALIGN_BYTES
+		       && (fence_end || count > len);
+		if (_host_iova(dma_h, src, len, &iova)) {
+			res = _engine_reserve(dma_h, false, &buf);
+			ON_ERR_RETURN(res, "_engine_reserve");
+		} else {
+			res = _engine_reserve(dma_h, true, &buf);
+			ON_ERR_RETURN(res, "_engine_reserve");
+			_staged_copy(dma_h, dma_h->dma_buf_ptr[buf],
+				     (void *)src, len);
+			iova = dma_h->dma_buf_iova[buf];
+		}
+		res = _engine_post(dma_h, xfer, dst, iova | FPGA_DMA_HOST_MASK,
+				   len, HOST_TO_FPGA_MM, buf, 0, last);
+		ON_ERR_RETURN(res, "HOST_TO_FPGA_MM Transfer failed\n");
+		src += len;
+		dst += len;
+		count -= len;
+	}
+
+	if (count && dma_h->rmw_unaligned) {
+		res = _engine_rmw_host_to_fpga(dma_h, xfer, dst, src, count,
+					       fence_end);
+		ON_ERR_RETURN(res, "HOST_TO_FPGA_MM Transfer failed\n");
+	} else if (count) {
+		res = _engine_drain(dma_h);
+		ON_ERR_RETURN(res, "_engine_drain");
+		res = _ase_host_to_fpga(dma_h, &dst, &src, count);
+		ON_ERR_RETURN(res, "HOST_TO_FPGA_MM Transfer failed\n");
+	}
+	return res;
+}
+
+/**
+ * _engine_fpga_to_host
+ *
+ * @brief                Issues a FPGA_TO_HOST_MM transfer. The DMA aligned
+ * body lands in place in shared host memory, or in the bounce buffers to be
+ * copied out by the completion thread; unaligned head and tail bytes are read
+ * through the address span expander, or as whole lines by DMA if
+ * rmw_unaligned is set.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer to credit the chunks to
+ * @param[in] dst        Host address
+ * @param[in] src        FPGA address
+ * @param[in] count      Size in bytes
+ * @param[in] fence_end  True to fence the final chunk
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_fpga_to_host(fpga_dma_handle dma_h,
+					struct _dma_transfer_t *xfer,
+					uint64_t dst, uint64_t src,
+					uint64_t count, bool fence_end)
+{
+	fpga_result res = FPGA_OK;
+	uint64_t align_bytes = 0;
+	uint64_t iova = 0;
+	uint64_t len = 0;
+	bool last = false;
+	int buf = -1;
+
+	debug_print("FPGA To Host ----------- src = %08lx, dst = %08lx \n", src,
+		    dst);
+	if (_rmw_whole(dma_h, src, count))
+		return _engine_rmw_fpga_to_host(dma_h, xfer, dst, src, count);
+
+	if (!IS_DMA_ALIGNED(src)) {
+		align_bytes = min(count, FPGA_DMA_ALIGN_BYTES
+					 - src % FPGA_DMA_ALIGN_BYTES);
+		if (dma_h->rmw_unaligned) {
+			res = _engine_rmw_fpga_to_host(dma_h, xfer, dst, src,
+						       align_bytes);
+			dst += align_bytes;
+			src += align_bytes;
+		} else {
+			res = _engine_drain(dma_h);
+			ON_ERR_RETURN(res, "_engine_drain");
+			res = _ase_fpga_to_host(dma_h, &src, &dst,
+						align_bytes);
+		}
+		ON_ERR_RETURN(res, "FPGA_TO_HOST_MM Transfer failed");
+		count -= align_bytes;
+	}
+
+	while (count >= FPGA_DMA_ALIGN_BYTES) {
+		len = min(count, (uint64_t)dma_h->chunk_size)
+		      & ~((uint64_t)FPGA_DMA_ALIGN_BYTES - 1);
+		// A tail read through the address span expander waits for
+		// this chunk, so it must be fenced
+		last = count - len < FPGA_DMA_ALIGN_BYTES
+		       && (fence_end || count > len);
+		if (_host_iova(dma_h, dst, len, &iova)) {
+			res = _engine_reserve(dma_h, false, &buf);
+			ON_ERR_RETURN(res, "_engine_reserve");
+			res = _engine_post(dma_h, xfer,
+					   iova | FPGA_DMA_HOST_MASK, src, len,
+					   FPGA_TO_HOST_MM, -1, 0, last);
+		} else {
+			res = _engine_reserve(dma_h, true, &buf);
+			ON_ERR_RETURN(res, "_engine_reserve");
+			res = _engine_post(dma_h, xfer,
+					   dma_h->dma_buf_iova[buf]
+						   | FPGA_DMA_HOST_MASK,
+					   src, len, FPGA_TO_HOST_MM, buf, dst,
+					   last);
+		}
+		ON_ERR_RETURN(res, "FPGA_TO_HOST_MM Transfer failed");
+		src += len;
+		dst += len;
+		count -= len;
+	}
+
+	if (count && dma_h->rmw_unaligned) {
+		res = _engine_rmw_fpga_to_host(dma_h, xfer, dst, src, count);
+		ON_ERR_RETURN(res, "FPGA_TO_HOST_MM Transfer failed");
+	} else if (count) {
+		res = _engine_drain(dma_h);
+		ON_ERR_RETURN(res, "_engine_drain");
+		res = _ase_fpga_to_host(dma_h, &src, &dst, count);
+		ON_ERR_RETURN(res, "FPGA_TO_HOST_MM Transfer failed");
+	}
+	return res;
+}
+
+/**
+ * _engine_fpga_to_fpga
+ *
+ * @brief                Issues a FPGA_TO_FPGA_MM transfer. Aligned transfers
+ * are posted directly; others are staged through host memory.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] xfer       Transfer to credit the chunks to
+ * @param[in] dst        FPGA destination address
+ * @param[in] src        FPGA source address
+ * @param[in] count      Size in bytes
+ * @param[in] fence_end  True to fence the final chunk
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_fpga_to_fpga(fpga_dma_handle dma_h,
+					struct _dma_transfer_t *xfer,
+					uint64_t dst, uint64_t src,
+					uint64_t count, bool fence_end)
+{
+	fpga_result res = FPGA_OK;
+	uint64_t *tmp_buf = NULL;
+	uint64_t len = 0;
+	int buf = -1;
+
+	if (IS_DMA_ALIGNED(dst) && IS_DMA_ALIGNED(src)
+	    && IS_DMA_ALIGNED(count)) {
+		debug_print("!!!FPGA to FPGA!!! TX : count = %08lx, dst = %08lx, src = %08lx \n",
+			    count, dst, src);
+		while (count) {
+			len = min(count, (uint64_t)dma_h->chunk_size);
+			res = _engine_reserve(dma_h, false, &buf);
+			ON_ERR_RETURN(res, "_engine_reserve");
+			res = _engine_post(dma_h, xfer, dst, src, len,
+					   FPGA_TO_FPGA_MM, -1, 0,
+					   fence_end && len == count);
+			ON_ERR_RETURN(res, "FPGA_TO_FPGA_MM Transfer failed");
+			src += len;
+			dst += len;
+			count -= len;
+		}
+		return res;
+	}
+
+	tmp_buf = (uint64_t *)malloc(FPGA_DMA_BUF_ALIGN_SIZE);
+	if (!tmp_buf)
+		return FPGA_NO_MEMORY;
+
+	while (count) {
+		len = min(count, (uint64_t)FPGA_DMA_BUF_ALIGN_SIZE);
+		res = _engine_fpga_to_host(dma_h, xfer, (uint64_t)tmp_buf, src,
+					   len, true);
+		ON_ERR_GOTO(res, out, "FPGA_TO_FPGA_MM Transfer failed");
+		// tmp_buf is filled as the chunks retire
+		res = _engine_drain(dma_h);
+		ON_ERR_GOTO(res, out, "_engine_drain");
+		// tmp_buf is copied to the bounce buffers before posting. The
+		// next piece may start with an MMIO read that waits for this one.
+		res = _engine_host_to_fpga(dma_h, xfer, dst, (uint64_t)tmp_buf,
+					   len, len == count ? fence_end : true);
+		ON_ERR_GOTO(res, out, "FPGA_TO_FPGA_MM Transfer failed");
+		src += len;
+		dst += len;
+		count -= len;
+	}
+
+out:
+	free(tmp_buf);
+	return res;
+}
+
+/**
+ * _sg_drains_first
+ *
+ * @brief                Tells whether a region accesses the address span
+ * expander before posting any chunk, which waits for every chunk posted
+ * before it to retire. So does a read-modify-write of its first line.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] type       Direction of transfer
+ * @param[in] entry      Region
+ * @return true if the chunks posted before entry must end with a fence
+ *
+ */
+static bool _sg_drains_first(fpga_dma_handle dma_h, fpga_dma_transfer_t type,
+			     const fpga_dma_sg_entry_t *entry)
+{
+	uint64_t fpga = type == HOST_TO_FPGA_MM ? entry->dst : entry->src;
+
+	if (type == HOST_TO_FPGA_MM && _rmw_whole(dma_h, fpga, entry->count))
+		return true;
+	return !IS_DMA_ALIGNED(fpga) || entry->count < FPGA_DMA_ALIGN_BYTES;
+}
+
+/**
+ * _engine_thread
+ *
+ * @brief                Takes transfers off the submission queue in order and
+ * posts their descriptors. Does not wait for a transfer to complete before
+ * starting the next one, so the descriptor FIFO stays full across transfers.
+ * @param[in] arg        Handle to the FPGA DMA object
+ * @return NULL
+ *
+ */
+static void *_engine_thread(void *arg)
+{
+	fpga_dma_handle dma_h = (fpga_dma_handle)arg;
+	struct _dma_transfer_t *xfer = NULL;
+	fpga_dma_sg_entry_t *entry = NULL;
+	fpga_result res = FPGA_OK;
+	uint64_t one = 1;
+	bool fence_end = false;
+	bool done = false;
+	size_t i = 0;
+
+	while (1) {
+		pthread_mutex_lock(&dma_h->lock);
+		while (!dma_h->sq_head && !dma_h->shutdown)
+			pthread_cond_wait(&dma_h->sq_cond, &dma_h->lock);
+		xfer = dma_h->sq_head;
+		if (xfer) {
+			dma_h->sq_head = xfer->next;
+			if (!dma_h->sq_head)
+				dma_h->sq_tail = NULL;
+		}
+		res = dma_h->engine_error;
+		pthread_mutex_unlock(&dma_h->lock);
+
+		if (!xfer)
+			break;
+
+		// Only the end of the batch, and chunks that an MMIO access
+		// of the next region waits for, are fenced
+		for (i = 0; i < xfer->sg_count && res == FPGA_OK; i++) {
+			entry = &xfer->sg[i];
+			fence_end = i + 1 == xfer->sg_count
+				    || _sg_drains_first(dma_h, xfer->type,
+							&xfer->sg[i + 1]);
+			switch (xfer->type) {
+			case HOST_TO_FPGA_MM:
+				res = _engine_host_to_fpga(dma_h, xfer,
+							   entry->dst,
+							   entry->src,
+							   entry->count,
+							   fence_end);
+				break;
+			case FPGA_TO_HOST_MM:
+				res = _engine_fpga_to_host(dma_h, xfer,
+							   entry->dst,
+							   entry->src,
+							   entry->count,
+							   fence_end);
+				break;
+			default:
+				res = _engine_fpga_to_fpga(dma_h, xfer,
+							   entry->dst,
+							   entry->src,
+							   entry->count,
+							   fence_end);
+				break;
+			}
+		}
+
+		// Drop the engine reference
+		pthread_mutex_lock(&dma_h->lock);
+		if (res != FPGA_OK && xfer->result == FPGA_OK)
+			xfer->result = res;
+		done = --xfer->refs == 0;
+		if (done)
+			_transfer_complete(dma_h, xfer);
+		pthread_mutex_unlock(&dma_h->lock);
+
+		if (done && write(dma_h->wake_fd, &one, sizeof(one)) < 0) {
+			error_print("Error: failed to wake completion thread\n");
+		}
+	}
+
+	pthread_mutex_lock(&dma_h->lock);
+	dma_h->engine_exited = true;
+	pthread_mutex_unlock(&dma_h->lock);
+	return NULL;
+}
+
+/**
+ * _retire_chunks
+ *
+ * @brief                Retires in-flight chunks up to the newest landed
+ * fence, copying FPGA_TO_HOST_MM bounce buffers out, and delivers the
+ * transfers that completed. Fences land in order, so the scan stops at the
+ * first one that has not. On engine failure all in-flight chunks are retired
+ * with the error. Transfers are delivered in completion queue order, which
+ * is submission order.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @return true if any chunk was retired
+ *
+ */
+static bool _retire_chunks(fpga_dma_handle dma_h)
+{
+	struct _dma_transfer_t *completed = NULL;
+	struct _dma_transfer_t *xfer = NULL;
+	dma_chunk_t *chunk = NULL;
+	fpga_result res = FPGA_OK;
+	uint32_t tail = 0;
+	uint32_t head = 0;
+	uint32_t end = 0;
+	uint32_t i = 0;
+
+	pthread_mutex_lock(&dma_h->lock);
+	tail = dma_h->inflight_tail;
+	head = dma_h->inflight_head;
+	res = dma_h->engine_error;
+	pthread_mutex_unlock(&dma_h->lock);
+
+	if (res != FPGA_OK) {
+		end = head;
+	} else {
+		end = tail;
+		for (i = tail; i != head; i++) {
+			chunk = &dma_h->inflight[FPGA_DMA_INFLIGHT_IDX(i)];
+			if (!chunk->fenced)
+				continue;
+			if (FENCE_SLOT(dma_h, FPGA_DMA_INFLIGHT_IDX(i))
+			    != FPGA_DMA_WF_MAGIC_NO)
+				break;
+			end = i + 1;
+		}
+		// Bounce buffer contents are valid once the fence is seen
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+
+	// Slots in [tail, end) are not reused until inflight_tail moves
+	for (i = tail; i != end && res == FPGA_OK; i++) {
+		chunk = &dma_h->inflight[FPGA_DMA_INFLIGHT_IDX(i)];
+		if (chunk->copy_dst)
+			_staged_copy(dma_h, (void *)chunk->copy_dst,
+				     dma_h->dma_buf_ptr[chunk->buf], chunk->len);
+	}
+
+	pthread_mutex_lock(&dma_h->lock);
+	for (i = tail; i != end; i++) {
+		chunk = &dma_h->inflight[FPGA_DMA_INFLIGHT_IDX(i)];
+		xfer = chunk->xfer;
+		if (chunk->buf >= 0)
+			dma_h->buf_busy &= ~(1u << chunk->buf);
+		if (res != FPGA_OK && xfer->result == FPGA_OK)
+			xfer->result = res;
+		if (--xfer->refs == 0)
+			_transfer_complete(dma_h, xfer);
+	}
+	if (end != tail) {
+		dma_h->inflight_tail = end;
+		pthread_cond_broadcast(&dma_h->inflight_cond);
+	}
+	completed = dma_h->cq_head;
+	dma_h->cq_head = NULL;
+	dma_h->cq_tail = NULL;
+	pthread_mutex_unlock(&dma_h->lock);
+
+	while (completed) {
+		xfer = completed;
+		completed = xfer->next;
+		_transfer_finish(dma_h, xfer);
+	}
+	return end != tail;
+}
+
+/**
+ * _elapsed_msec
+ *
+ * @brief                Milliseconds of CLOCK_MONOTONIC time since start.
+ * @param[in] start      Start time
+ * @return elapsed time
+ *
+ */
+static int64_t _elapsed_msec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000
+	       + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/**
+ * _completion_thread
+ *
+ * @brief                Waits on the DMA interrupt eventfd and retires the
+ * chunks whose fences have landed. Interrupts may be coalesced, so each
+ * wakeup retires everything that is complete. With polled completion the
+ * thread spins on the fences while chunks are in flight instead.
+ * @param[in] arg        Handle to the FPGA DMA object
+ * @return NULL
+ *
+ */
+static void *_completion_thread(void *arg)
+{
+	fpga_dma_handle dma_h = (fpga_dma_handle)arg;
+	struct pollfd pfd[2];
+	struct timespec progress;
+	uint64_t count = 0;
+	bool was_busy = false;
+	bool busy = false;
+	bool stop = false;
+	int poll_res;
+
+	pfd[0].fd = dma_h->irq_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = dma_h->wake_fd;
+	pfd[1].events = POLLIN;
+
+	while (1) {
+		pthread_mutex_lock(&dma_h->lock);
+		busy = dma_h->inflight_tail != dma_h->inflight_head;
+		stop = dma_h->engine_exited && !busy && !dma_h->active;
+		pthread_mutex_unlock(&dma_h->lock);
+
+		if (stop)
+			break;
+
+		if (busy && dma_h->polled) {
+			if (!was_busy || _retire_chunks(dma_h)) {
+				clock_gettime(CLOCK_MONOTONIC, &progress);
+			} else if (_elapsed_msec(&progress)
+				   > FPGA_DMA_TIMEOUT_MSEC) {
+				fprintf(stderr, "Poll(fence) timeout \n");
+				_engine_fail(dma_h, FPGA_EXCEPTION);
+			} else {
+				__builtin_ia32_pause();
+			}
+			was_busy = true;
+			continue;
+		}
+		was_busy = false;
+
+#ifdef CHECK_DELAYS
+		if (0 == poll(pfd, 2, 0))
+			poll_wait_count++;
+#endif
+		poll_res = poll(pfd, 2, busy ? FPGA_DMA_TIMEOUT_MSEC : -1);
+		if (poll_res < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Poll error errno = %s\n",
+				strerror(errno));
+			_engine_fail(dma_h, FPGA_EXCEPTION);
+		} else if (poll_res == 0) {
+			fprintf(stderr, "Poll(interrupt) timeout \n");
+			_engine_fail(dma_h, FPGA_EXCEPTION);
+		} else {
+			if (pfd[0].revents & POLLIN) {
+				if (read(dma_h->irq_fd, &count, sizeof(count))
+				    > 0) {
+					debug_print("Poll success. count = %d\n",
+						    (int)count);
+				}
+				clear_interrupt(dma_h);
+			}
+			if ((pfd[1].revents & POLLIN)
+			    && read(dma_h->wake_fd, &count, sizeof(count))
+				       < 0) {
+				error_print("Error: failed to read wake fd\n");
+			}
+		}
+
+		_retire_chunks(dma_h);
+	}
+	return NULL;
+}
+
+/**
+ * _engine_start
+ *
+ * @brief                Initializes the asynchronous engine and starts its
+ * threads.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_start(fpga_dma_handle dma_h)
+{
+	pthread_condattr_t attr;
+	fpga_result res = FPGA_OK;
+
+	dma_h->pinned = NULL;
+	dma_h->sq_head = NULL;
+	dma_h->sq_tail = NULL;
+	dma_h->cq_head = NULL;
+	dma_h->cq_tail = NULL;
+	dma_h->inflight_head = 0;
+	dma_h->inflight_tail = 0;
+	dma_h->unfenced = 0;
+	dma_h->buf_busy = 0;
+	dma_h->active = 0;
+	dma_h->shutdown = false;
+	dma_h->engine_exited = false;
+	dma_h->engine_error = FPGA_OK;
+
+	res = fpgaGetOSObjectFromEventHandle(dma_h->eh, &dma_h->irq_fd);
+	ON_ERR_RETURN(res, "fpgaGetOSObjectFromEventHandle");
+
+	dma_h->wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (dma_h->wake_fd < 0)
+		return FPGA_EXCEPTION;
+
+	pthread_mutex_init(&dma_h->lock, NULL);
+	pthread_cond_init(&dma_h->sq_cond, NULL);
+	pthread_cond_init(&dma_h->inflight_cond, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&dma_h->done_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	res = _copy_pool_start(dma_h);
+	if (res != FPGA_OK)
+		goto out_destroy;
+
+	if (pthread_create(&dma_h->completion_thread, NULL, _completion_thread,
+			   dma_h)) {
+		res = FPGA_EXCEPTION;
+		goto out_stop_pool;
+	}
+
+	if (pthread_create(&dma_h->engine_thread, NULL, _engine_thread,
+			   dma_h)) {
+		// No transfers were queued, so this stops the completion
+		// thread
+		pthread_mutex_lock(&dma_h->lock);
+		dma_h->engine_exited = true;
+		pthread_mutex_unlock(&dma_h->lock);
+		_engine_fail(dma_h, FPGA_EXCEPTION);
+		pthread_join(dma_h->completion_thread, NULL);
+		res = FPGA_EXCEPTION;
+		goto out_stop_pool;
+	}
+
+	return FPGA_OK;
+
+out_stop_pool:
+	_copy_pool_stop(dma_h);
+out_destroy:
+	pthread_cond_destroy(&dma_h->done_cond);
+	pthread_cond_destroy(&dma_h->inflight_cond);
+	pthread_cond_destroy(&dma_h->sq_cond);
+	pthread_mutex_destroy(&dma_h->lock);
+	close(dma_h->wake_fd);
+	return res;
+}
+
+/**
+ * _engine_stop
+ *
+ * @brief                Completes all queued transfers and stops the engine
+ * threads.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ *
+ */
+static void _engine_stop(fpga_dma_handle dma_h)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&dma_h->lock);
+	dma_h->shutdown = true;
+	pthread_cond_signal(&dma_h->sq_cond);
+	pthread_mutex_unlock(&dma_h->lock);
+	pthread_join(dma_h->engine_thread, NULL);
+
+	if (write(dma_h->wake_fd, &one, sizeof(one)) < 0) {
+		error_print("Error: failed to wake completion thread\n");
+	}
+	pthread_join(dma_h->completion_thread, NULL);
+	_copy_pool_stop(dma_h);
+
+	pthread_cond_destroy(&dma_h->done_cond);
+	pthread_cond_destroy(&dma_h->inflight_cond);
+	pthread_cond_destroy(&dma_h->sq_cond);
+	pthread_mutex_destroy(&dma_h->lock);
+	close(dma_h->wake_fd);
+}
+
+/**
+ * _engine_submit
+ *
+ * @brief                Validates a transfer and appends it to the submission
+ * queue. Empty regions are dropped and regions that continue the previous one
+ * on both sides are merged.
+ * @param[in] dma_h      Handle to the FPGA DMA object
+ * @param[in] sg         Regions to copy
+ * @param[in] sg_count   Number of regions
+ * @param[in] type       Direction of transfer
+ * @param[in] cb         Completion callback, may be NULL
+ * @param[in] context    Callback context
+ * @param[out] future    Future to return, NULL for a detached transfer
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+static fpga_result _engine_submit(fpga_dma_handle dma_h,
+				  const fpga_dma_sg_entry_t *sg,
+				  size_t sg_count, fpga_dma_transfer_t type,
+				  fpga_dma_transfer_cb cb, void *context,
+				  fpga_dma_future *future)
+{
+	struct _dma_transfer_t *xfer = NULL;
+	fpga_dma_sg_entry_t *prev = NULL;
+	fpga_dma_sg_entry_t *entry = NULL;
+	size_t i = 0;
+
+	if (!dma_h)
+		return FPGA_INVALID_PARAM;
+
+	if (!sg && sg_count)
+		return FPGA_INVALID_PARAM;
+
+	if (type >= FPGA_MAX_TRANSFER_TYPE)
+		return FPGA_INVALID_PARAM;
+
+	if (!(type == HOST_TO_FPGA_MM || type == FPGA_TO_HOST_MM
+	      || type == FPGA_TO_FPGA_MM))
+		return FPGA_NOT_SUPPORTED;
+
+	if (!dma_h->fpga_h)
+		return FPGA_INVALID_PARAM;
+
+	xfer = (struct _dma_transfer_t *)calloc(
+		1, sizeof(*xfer) + sg_count * sizeof(*sg));
+	if (!xfer)
+		return FPGA_NO_MEMORY;
+
+	for (i = 0; i < sg_count; i++) {
+		if (!sg[i].count)
+			continue;
+		if (prev && prev->dst + prev->count == sg[i].dst
+		    && prev->src + prev->count == sg[i].src) {
+			prev->count += sg[i].count;
+			continue;
+		}
+		prev = &xfer->sg[xfer->sg_count++];
+		*prev = sg[i];
+	}
+
+	for (i = 0; i < xfer->sg_count; i++) {
+		entry = &xfer->sg[i];
+		if (type == FPGA_TO_FPGA_MM
+		    && !(IS_DMA_ALIGNED(entry->dst) && IS_DMA_ALIGNED(entry->src)
+			 && IS_DMA_ALIGNED(entry->count))
+		    && (entry->src < entry->dst)
+		    && (entry->src + entry->count >= entry->dst)) {
+			debug_print(
+				"Overlapping addresses, Provide correct dst address\n");
+			free(xfer);
+			return FPGA_NOT_SUPPORTED;
+		}
+	}
+
+	xfer->dma_h = dma_h;
+	xfer->type = type;
+	xfer->cb = cb;
+	xfer->context = context;
+	xfer->refs = 1;
+	xfer->result = FPGA_OK;
+	xfer->detached = !future;
+
+	pthread_mutex_lock(&dma_h->lock);
+	if (dma_h->shutdown) {
+		pthread_mutex_unlock(&dma_h->lock);
+		free(xfer);
+		return FPGA_EXCEPTION;
+	}
+	if (dma_h->sq_tail)
+		dma_h->sq_tail->next = xfer;
+	else
+		dma_h->sq_head = xfer;
+	dma_h->sq_tail = xfer;
+	dma_h->active++;
+	pthread_cond_signal(&dma_h->sq_cond);
+	pthread_mutex_unlock(&dma_h->lock);
+
+	if (future)
+		*future = xfer;
+	return FPGA_OK;
+}
+
+fpga_result fpgaDmaTransferSync(fpga_dma_handle dma_h, uint64_t dst,
+				uint64_t src, size_t count,
+				fpga_dma_transfer_t type)
+{
+	fpga_dma_sg_entry_t entry = {dst, src, count};
+
+	return fpgaDmaTransferSGSync(dma_h, &entry, 1, type);
+}
+
+fpga_result fpgaDmaTransferAsync(fpga_dma_handle dma_h, uint64_t dst,
+				 uint64_t src, size_t count,
+				 fpga_dma_transfer_t type,
+				 fpga_dma_transfer_cb cb, void *context)
+{
+	fpga_dma_sg_entry_t entry = {dst, src, count};
+
+	return _engine_submit(dma_h, &entry, 1, type, cb, context, NULL);
+}
+
+fpga_result fpgaDmaTransferStart(fpga_dma_handle dma_h, uint64_t dst,
+				 uint64_t src, size_t count,
+				 fpga_dma_transfer_t type,
+				 fpga_dma_future *future)
+{
+	fpga_dma_sg_entry_t entry = {dst, src, count};
+
+	return fpgaDmaTransferSGStart(dma_h, &entry, 1, type, future);
+}
+
+fpga_result fpgaDmaTransferSGSync(fpga_dma_handle dma_h,
+				  const fpga_dma_sg_entry_t *sg,
+				  size_t sg_count, fpga_dma_transfer_t type)
+{
+	fpga_dma_future future = NULL;
+	fpga_result res = FPGA_OK;
+
+	res = _engine_submit(dma_h, sg, sg_count, type, NULL, NULL, &future);
+	if (res != FPGA_OK)
+		return res;
+
+	return fpgaDmaTransferWait(future, -1);
+}
+
+fpga_result fpgaDmaTransferSGAsync(fpga_dma_handle dma_h,
+				   const fpga_dma_sg_entry_t *sg,
+				   size_t sg_count, fpga_dma_transfer_t type,
+				   fpga_dma_transfer_cb cb, void *context)
+{
+	return _engine_submit(dma_h, sg, sg_count, type, cb, context, NULL);
+}
+
+fpga_result fpgaDmaTransferSGStart(fpga_dma_handle dma_h,
+				   const fpga_dma_sg_entry_t *sg,
+				   size_t sg_count, fpga_dma_transfer_t type,
+				   fpga_dma_future *future)
+{
+	if (!future)
+		return FPGA_INVALID_PARAM;
+
+	return _engine_submit(dma_h, sg, sg_count, type, NULL, NULL, future);
+}
+
+fpga_result fpgaDmaTransferWait(fpga_dma_future future, int timeout_msec)
+{
+	fpga_dma_handle dma_h = NULL;
+	fpga_result res = FPGA_OK;
+	struct timespec ts;
+	int err = 0;
+
+	if (!future)
+		return FPGA_INVALID_PARAM;
+
+	dma_h = future->dma_h;
+
+	if (timeout_msec > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += timeout_msec / 1000;
+		ts.tv_nsec += (timeout_msec % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&dma_h->lock);
+	while (!future->done && err != ETIMEDOUT) {
+		if (timeout_msec < 0)
+			err = pthread_cond_wait(&dma_h->done_cond,
+						&dma_h->lock);
+		else if (timeout_msec == 0)
+			err = ETIMEDOUT;
+		else
+			err = pthread_cond_timedwait(&dma_h->done_cond,
+						     &dma_h->lock, &ts);
+	}
+	if (!future->done) {
+		pthread_mutex_unlock(&dma_h->lock);
+		return FPGA_BUSY;
+	}
+	res = future->result;
+	pthread_mutex_unlock(&dma_h->lock);
+
+	free(future);
+	return res;
+}
+
+fpga_result fpgaDmaAllocBuffer(fpga_dma_handle dma_h, size_t size,
+			       void **buf)
+{
+	struct _dma_pinned_buf_t *pinned = NULL;
+	fpga_result res = FPGA_OK;
+
+	if (!dma_h || !dma_h->fpga_h || !buf || !size)
+		return FPGA_INVALID_PARAM;
+
+	pinned = (struct _dma_pinned_buf_t *)malloc(sizeof(*pinned));
+	if (!pinned)
+		return FPGA_NO_MEMORY;
+
+	res = fpgaPrepareBuffer(dma_h->fpga_h, size, &pinned->addr,
+				&pinned->wsid, 0);
+	if (res != FPGA_OK) {
+		free(pinned);
+		ON_ERR_RETURN(res, "fpgaPrepareBuffer");
+	}
+
+	pthread_mutex_lock(&dma_h->lock);
+	pinned->next = dma_h->pinned;
+	dma_h->pinned = pinned;
+	pthread_mutex_unlock(&dma_h->lock);
+
+	*buf = pinned->addr;
+	return FPGA_OK;
+}
+
+fpga_result fpgaDmaFreeBuffer(fpga_dma_handle dma_h, void *buf)
+{
+	struct _dma_pinned_buf_t **prev = NULL;
+	struct _dma_pinned_buf_t *pinned = NULL;
+	fpga_result res = FPGA_OK;
+
+	if (!dma_h || !dma_h->fpga_h || !buf)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&dma_h->lock);
+	for (prev = &dma_h->pinned; *prev; prev = &(*prev)->next) {
+		if ((*prev)->addr == buf) {
+			pinned = *prev;
+			*prev = pinned->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dma_h->lock);
+
+	if (!pinned)
+		return FPGA_NOT_FOUND;
+
+	res = fpgaReleaseBuffer(dma_h->fpga_h, pinned->wsid);
+	free(pinned);
+	return res;
+}
+
+fpga_result fpgaDmaClose(fpga_dma_handle dma_h)
+{
+	struct _dma_pinned_buf_t *pinned = NULL;
+	fpga_result res = FPGA_OK;
+	uint32_t i = 0;
+	int sigres;
+	if (!dma_h) {
+		return FPGA_INVALID_PARAM;
 	}
 
 	if (!dma_h->fpga_h) {
@@ -1616,6 +2856,15 @@ fpga_result fpgaDmaClose(fpga_dma_handle dma_h)
 		goto out;
 	}
 
+	_engine_stop(dma_h);
+
+	while (dma_h->pinned) {
+		pinned = dma_h->pinned;
+		dma_h->pinned = pinned->next;
+		fpgaReleaseBuffer(dma_h->fpga_h, pinned->wsid);
+		free(pinned);
+	}
+
 	if (CsrControl) {
 		sigres = sigaction(SIGHUP, &old_action, NULL);
 		if (sigres < 0) {
@@ -1625,12 +2874,12 @@ fpga_result fpgaDmaClose(fpga_dma_handle dma_h)
 		CsrControl = NULL;
 	}
 
-	for (i = 0; i < FPGA_DMA_MAX_BUF; i++) {
+	for (i = 0; i < dma_h->depth; i++) {
 		res = fpgaReleaseBuffer(dma_h->fpga_h, dma_h->dma_buf_wsid[i]);
 		ON_ERR_GOTO(res, out, "fpgaReleaseBuffer failed");
 	}
 
-	res = fpgaReleaseBuffer(dma_h->fpga_h, dma_h->magic_wsid);
+	res = fpgaReleaseBuffer(dma_h->fpga_h, dma_h->fence_wsid);
 	ON_ERR_GOTO(res, out, "fpgaReleaseBuffer");
 
 	fpgaUnregisterEvent(dma_h->fpga_h, FPGA_EVENT_INTERRUPT, dma_h->eh);
@@ -28,8 +28,17 @@
  * \fpga_dma.h
  * \brief FPGA DMA BBB API Header
  *
- * Known Limitations
- * - Supports only synchronous (blocking) transfers
+ * Transfers are queued to a per-handle engine thread that keeps the
+ * descriptor FIFO of the DMA BBB full across outstanding requests.
+ * Completions are detected by a second thread driven by the DMA
+ * interrupt, or by polling when the handle is opened that way.
+ * fpgaDmaTransferSync() is a submission followed by a wait. A
+ * scatter-gather transfer queues a list of regions that complete as one.
+ *
+ * Host memory shared with the FPGA through fpgaPrepareBuffer(), a buffer
+ * pool or fpgaDmaAllocBuffer() is transferred in place. Other host memory,
+ * and host memory that is not 64-byte aligned where the FPGA address is,
+ * is staged through bounce buffers.
  */
 
 #ifndef __FPGA_DMA_H__
@@ -56,9 +65,63 @@ typedef enum {
 
 typedef struct _dma_handle_t *fpga_dma_handle;
 
+// Pending transfer started with fpgaDmaTransferStart()
+typedef struct _dma_transfer_t *fpga_dma_future;
+
 // Callback for asynchronous DMA transfers
 typedef void (*fpga_dma_transfer_cb)(void *context);
 
+// One region of a scatter-gather transfer
+typedef struct {
+	uint64_t dst;
+	uint64_t src;
+	size_t count;
+} fpga_dma_sg_entry_t;
+
+// Largest supported fpga_dma_config_t.depth
+#define FPGA_DMA_MAX_DEPTH 32
+// Largest supported fpga_dma_config_t.copy_threads
+#define FPGA_DMA_MAX_COPY_THREADS 16
+
+/*
+ * Pipelining parameters of a DMA handle. Obtain the defaults with
+ * fpgaDmaGetDefaultConfig() and override individual fields.
+ */
+typedef struct {
+	// Number of chunks kept in flight, and of host bounce buffers.
+	// 1 to FPGA_DMA_MAX_DEPTH.
+	uint32_t depth;
+	// Bytes per descriptor. A non-zero multiple of 64, no larger than the
+	// maximum transfer length the DMA IP is configured for.
+	uint32_t chunk_size;
+	// Chunks per write fence; completion is detected, and bounce buffers
+	// are recycled, once per fence. 1 to depth.
+	uint32_t fence_interval;
+	// Poll the write fences from the completion thread instead of
+	// waiting for the DMA interrupt
+	bool polled;
+	// Helper threads that share large bounce buffer copies, bound to
+	// the CPUs local to the FPGA. 0 copies on the DMA threads alone.
+	uint32_t copy_threads;
+	// Write through the address span expander in 64-byte stores
+	// (MOVDIR64B or AVX-512) where the CPU has them. The AFU must accept
+	// 512-bit MMIO writes.
+	bool wide_mmio;
+	// Move unaligned head and tail bytes by DMA, rounded out to 64-byte
+	// lines in a bounce buffer and merged by read-modify-write, instead
+	// of through the address span expander. The rest of those lines is
+	// rewritten, so the AFU must not update it concurrently.
+	bool rmw_unaligned;
+} fpga_dma_config_t;
+
+/**
+ * fpgaDmaGetDefaultConfig
+ *
+ * @brief             Fill in the parameters used by fpgaDmaOpen().
+ * @param[out] config Pipelining parameters
+ */
+void fpgaDmaGetDefaultConfig(fpga_dma_config_t *config);
+
 /**
  * fpgaDmaOpen
  *
@@ -71,6 +134,21 @@ typedef void (*fpga_dma_transfer_cb)(void *context);
  */
 fpga_result fpgaDmaOpen(fpga_handle fpga, fpga_dma_handle *dma);
 
+/**
+ * fpgaDmaOpenEx
+ *
+ * @brief            Open a handle to DMA BBB with explicit pipelining
+ *                   parameters.
+ *
+ * @param[in]  fpga   Handle to the FPGA AFU object obtained via fpgaOpen()
+ * @param[in]  config Pipelining parameters, NULL for the defaults
+ * @param[out] dma    DMA object handle
+ * @returns           FPGA_OK on success, FPGA_INVALID_PARAM if config is
+ *                    out of range, return code otherwise
+ */
+fpga_result fpgaDmaOpenEx(fpga_handle fpga, const fpga_dma_config_t *config,
+			  fpga_dma_handle *dma);
+
 /**
  * fpgaDmaTransferSync
  *
@@ -94,11 +172,12 @@ fpga_result fpgaDmaTransferSync(fpga_dma_handle dma, uint64_t dst, uint64_t src,
 				size_t count, fpga_dma_transfer_t type);
 
 /**
- * fpgaDmaTransferAsync (Not supported)
+ * fpgaDmaTransferAsync
  *
- * @brief             Perform a non-blocking copy of 'count' bytes from memory
+ * @brief             Queue a non-blocking copy of 'count' bytes from memory
  * area pointed by src to memory area pointed by dst where fpga_dma_transfer_t
- * specifies the type of memory transfer.
+ * specifies the type of memory transfer. Transfers are performed in the order
+ * in which they are queued.
  * @param[in] dma     Handle to the FPGA DMA object
  * @param[in] dst     Address of the destination buffer
  * @param[in] src     Address of the source buffer
@@ -109,9 +188,12 @@ fpga_result fpgaDmaTransferSync(fpga_dma_handle dma, uint64_t dst, uint64_t src,
  * Copy data from memory mapped FPGA interface to host memory User must specify
  * valid src and dst. FPGA_TO_FPGA_MM - Copy data between memory mapped FPGA
  * interfaces User must specify valid src and dst.
- * @param[in] cb      Callback to invoke when DMA transfer is complete
+ * @param[in] cb      Callback to invoke when DMA transfer is complete. The
+ * callback runs on an internal DMA thread and must not call fpgaDmaClose().
+ * May be NULL.
  * @param[in] context Pointer to define user-defined context
- * @return fpga_result FPGA_OK on success, return code otherwise
+ * @return fpga_result FPGA_OK if the transfer was queued, return code
+ * otherwise
  *
  */
 fpga_result fpgaDmaTransferAsync(fpga_dma_handle dma, uint64_t dst,
@@ -119,10 +201,133 @@ fpga_result fpgaDmaTransferAsync(fpga_dma_handle dma, uint64_t dst,
 				 fpga_dma_transfer_t type,
 				 fpga_dma_transfer_cb cb, void *context);
 
+/**
+ * fpgaDmaTransferStart
+ *
+ * @brief             Queue a non-blocking copy like fpgaDmaTransferAsync(),
+ * returning a future that reports the result of the transfer.
+ * @param[in] dma     Handle to the FPGA DMA object
+ * @param[in] dst     Address of the destination buffer
+ * @param[in] src     Address of the source buffer
+ * @param[in] count   Size in bytes
+ * @param[in] type    Type of memory transfer, see fpgaDmaTransferSync()
+ * @param[out] future Handle to pass to fpgaDmaTransferWait()
+ * @return fpga_result FPGA_OK if the transfer was queued, return code
+ * otherwise
+ *
+ */
+fpga_result fpgaDmaTransferStart(fpga_dma_handle dma, uint64_t dst,
+				 uint64_t src, size_t count,
+				 fpga_dma_transfer_t type,
+				 fpga_dma_future *future);
+
+/**
+ * fpgaDmaTransferWait
+ *
+ * @brief                 Wait for a transfer queued by fpgaDmaTransferStart().
+ * Every future must be waited on to completion before fpgaDmaClose().
+ * @param[in] future       Future returned by fpgaDmaTransferStart()
+ * @param[in] timeout_msec Time to wait in milliseconds; negative waits
+ * indefinitely and 0 polls.
+ * @return fpga_result FPGA_BUSY if the transfer is still pending; the future
+ * remains valid. Otherwise the result of the transfer, and the future is
+ * released.
+ *
+ */
+fpga_result fpgaDmaTransferWait(fpga_dma_future future, int timeout_msec);
+
+/**
+ * fpgaDmaTransferSGSync
+ *
+ * @brief              Perform a blocking scatter-gather copy of each region
+ * in sg, all of the same type. Regions that continue the previous one on both
+ * sides are merged. The regions are posted back to back and the batch raises
+ * one completion interrupt, plus one per fence_interval chunks. Regions whose
+ * FPGA address or size is not 64-byte aligned still write or read the
+ * unaligned bytes through MMIO, which waits for the regions posted before.
+ * @param[in] dma      Handle to the FPGA DMA object
+ * @param[in] sg       Regions to copy
+ * @param[in] sg_count Number of regions
+ * @param[in] type     Type of memory transfer, see fpgaDmaTransferSync()
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+fpga_result fpgaDmaTransferSGSync(fpga_dma_handle dma,
+				  const fpga_dma_sg_entry_t *sg,
+				  size_t sg_count, fpga_dma_transfer_t type);
+
+/**
+ * fpgaDmaTransferSGAsync
+ *
+ * @brief              Queue a non-blocking scatter-gather copy, see
+ * fpgaDmaTransferSGSync() and fpgaDmaTransferAsync(). sg may be reused as
+ * soon as this returns.
+ * @param[in] dma      Handle to the FPGA DMA object
+ * @param[in] sg       Regions to copy
+ * @param[in] sg_count Number of regions
+ * @param[in] type     Type of memory transfer, see fpgaDmaTransferSync()
+ * @param[in] cb       Callback to invoke when all regions are copied, see
+ * fpgaDmaTransferAsync(). May be NULL.
+ * @param[in] context  Pointer to define user-defined context
+ * @return fpga_result FPGA_OK if the transfer was queued, return code
+ * otherwise
+ *
+ */
+fpga_result fpgaDmaTransferSGAsync(fpga_dma_handle dma,
+				   const fpga_dma_sg_entry_t *sg,
+				   size_t sg_count, fpga_dma_transfer_t type,
+				   fpga_dma_transfer_cb cb, void *context);
+
+/**
+ * fpgaDmaTransferSGStart
+ *
+ * @brief              Queue a non-blocking scatter-gather copy, returning a
+ * future for fpgaDmaTransferWait(). sg may be reused as soon as this returns.
+ * @param[in] dma      Handle to the FPGA DMA object
+ * @param[in] sg       Regions to copy
+ * @param[in] sg_count Number of regions
+ * @param[in] type     Type of memory transfer, see fpgaDmaTransferSync()
+ * @param[out] future  Handle to pass to fpgaDmaTransferWait()
+ * @return fpga_result FPGA_OK if the transfer was queued, return code
+ * otherwise
+ *
+ */
+fpga_result fpgaDmaTransferSGStart(fpga_dma_handle dma,
+				   const fpga_dma_sg_entry_t *sg,
+				   size_t sg_count, fpga_dma_transfer_t type,
+				   fpga_dma_future *future);
+
+/**
+ * fpgaDmaAllocBuffer
+ *
+ * @brief             Allocate host memory shared with the FPGA. Transfers to
+ * and from it do not use the bounce buffers.
+ * @param[in] dma     Handle to the FPGA DMA object
+ * @param[in] size    Size in bytes
+ * @param[out] buf    Address of the buffer
+ * @return fpga_result FPGA_OK on success, return code otherwise
+ *
+ */
+fpga_result fpgaDmaAllocBuffer(fpga_dma_handle dma, size_t size, void **buf);
+
+/**
+ * fpgaDmaFreeBuffer
+ *
+ * @brief             Free a buffer from fpgaDmaAllocBuffer(). No transfer
+ * may be using it. Buffers still allocated are freed by fpgaDmaClose().
+ * @param[in] dma     Handle to the FPGA DMA object
+ * @param[in] buf     Address returned by fpgaDmaAllocBuffer()
+ * @return fpga_result FPGA_OK on success, FPGA_NOT_FOUND if buf was not
+ * allocated from dma, return code otherwise
+ *
+ */
+fpga_result fpgaDmaFreeBuffer(fpga_dma_handle dma, void *buf);
+
 /**
  * fpgaDmaClose
  *
- * @brief           Close the DMA BBB handle.
+ * @brief           Close the DMA BBB handle. Waits for all queued
+ *                  transfers to complete.
  *
  * @param[in] dma   DMA object handle
  * @returns         FPGA_OK on success, return code otherwise
@@ -0,0 +1,199 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+/**
+ * \fpga_dma_copy_bench.c
+ * \brief Compares the host copy kernels available to the DMA bounce buffers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "x86-sse2.h"
+#include "x86-avx.h"
+
+// Bytes moved per measurement
+#define BENCH_BYTES (1024UL * 1024 * 1024)
+// Alignment of the buffers, in bytes
+#define BENCH_ALIGN 4096
+// Source streamed through, larger than the last level cache like the
+// user buffers of a DMA transfer
+#define BENCH_SRC_SIZE (256UL * 1024 * 1024)
+// Destinations rotated through, like the DMA bounce buffers
+#define BENCH_NUM_DST 8
+
+typedef void (*copy_fn)(int64_t *__restrict dst, int64_t *__restrict src,
+			size_t size);
+
+static void copy_memcpy(int64_t *__restrict dst, int64_t *__restrict src,
+			size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+static void copy_movsb(int64_t *__restrict dst, int64_t *__restrict src,
+		       size_t size)
+{
+	aligned_block_copy_movsb(dst, src, (int)size);
+}
+
+static void copy_sse2(int64_t *__restrict dst, int64_t *__restrict src,
+		      size_t size)
+{
+	aligned_block_copy_sse2(dst, src, (int)size);
+}
+
+static void copy_unaligned_sse2(int64_t *__restrict dst,
+				int64_t *__restrict src, size_t size)
+{
+	unaligned_block_copy_sse2(dst, src, (int)size);
+}
+
+static void copy_nt_sse2(int64_t *__restrict dst, int64_t *__restrict src,
+			 size_t size)
+{
+	aligned_block_copy_nt_sse2(dst, src, (int)size);
+	__builtin_ia32_sfence();
+}
+
+static const struct {
+	const char *name;
+	copy_fn copy;
+	// CPU feature for __builtin_cpu_supports(), NULL if always present
+	const char *feature;
+	// Whether src may be unaligned
+	int unaligned_src;
+} kernels[] = {
+	{"memcpy", copy_memcpy, NULL, 1},
+	{"rep movsb", copy_movsb, NULL, 1},
+	{"sse2", copy_sse2, NULL, 0},
+	{"sse2 unaligned", copy_unaligned_sse2, NULL, 1},
+	{"sse2 nt", copy_nt_sse2, NULL, 0},
+	{"avx2 nt", block_copy_nt_avx2, "avx2", 1},
+	{"avx512 nt", block_copy_nt_avx512, "avx512f", 1},
+};
+
+static const size_t sizes[] = {
+	64 * 1024, 256 * 1024, 1023 * 1024, 16 * 1024 * 1024,
+};
+
+// Source offsets, in bytes
+static const size_t offsets[] = {0, 8};
+
+static int cpu_supports(const char *feature)
+{
+	if (!feature)
+		return 1;
+	if (!strcmp(feature, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	if (!strcmp(feature, "avx512f"))
+		return __builtin_cpu_supports("avx512f");
+	return 0;
+}
+
+// return elapsed time
+static inline double getTime(struct timespec start, struct timespec end)
+{
+	uint64_t diff = 1000000000L * (end.tv_sec - start.tv_sec) + end.tv_nsec
+			- start.tv_nsec;
+	return (double)diff / (double)1000000000L;
+}
+
+int main(void)
+{
+	struct timespec start, end;
+	size_t max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	size_t k, s, o, i, iters, pieces;
+	uint8_t *src = NULL;
+	uint8_t *dst = NULL;
+	int err_cnt = 0;
+	double seconds;
+
+	if (posix_memalign((void **)&src, BENCH_ALIGN,
+			   BENCH_SRC_SIZE + BENCH_ALIGN)
+	    || posix_memalign((void **)&dst, BENCH_ALIGN,
+			      max_size * BENCH_NUM_DST)) {
+		fprintf(stderr, "Unable to allocate test buffers\n");
+		return 1;
+	}
+	for (i = 0; i < BENCH_SRC_SIZE + BENCH_ALIGN; i++)
+		src[i] = (uint8_t)(i * 7 + (i >> 12));
+	memset(dst, 0, max_size * BENCH_NUM_DST);
+
+	__builtin_cpu_init();
+	printf("%-16s %10s %6s %16s\n", "kernel", "size", "offset",
+	       "Megabytes/sec");
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		if (!cpu_supports(kernels[k].feature)) {
+			printf("%-16s not supported by this CPU\n",
+			       kernels[k].name);
+			continue;
+		}
+		for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+			if (offsets[o] && !kernels[k].unaligned_src)
+				continue;
+			for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+				memset(dst, 0, sizes[s]);
+				kernels[k].copy((int64_t *)dst,
+						(int64_t *)(src + offsets[o]),
+						sizes[s]);
+				if (memcmp(dst, src + offsets[o], sizes[s])) {
+					printf("%-16s %10zu %6zu data mismatch\n",
+					       kernels[k].name, sizes[s],
+					       offsets[o]);
+					err_cnt++;
+					continue;
+				}
+
+				iters = BENCH_BYTES / sizes[s];
+				pieces = BENCH_SRC_SIZE / sizes[s];
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				for (i = 0; i < iters; i++)
+					kernels[k].copy(
+						(int64_t *)(dst
+							    + (i % BENCH_NUM_DST)
+								      * sizes[s]),
+						(int64_t *)(src + offsets[o]
+							    + (i % pieces)
+								      * sizes[s]),
+						sizes[s]);
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				seconds = getTime(start, end);
+				printf("%-16s %10zu %6zu %16.1lf\n",
+				       kernels[k].name, sizes[s], offsets[o],
+				       (double)(iters * sizes[s])
+					       / (seconds * 1000 * 1000));
+			}
+		}
+	}
+
+	free(src);
+	free(dst);
+	return err_cnt ? 1 : 0;
+}
@@ -32,8 +32,12 @@
 #ifndef __FPGA_DMA_INT_H__
 #define __FPGA_DMA_INT_H__
 
+#include <stdbool.h>
+#include <pthread.h>
 #include <opae/fpga.h>
+#include "fpga_dma.h"
 #include "x86-sse2.h"
+#include "x86-avx.h"
 
 #ifdef CHECK_DELAYS
 #pragma message "Compiled with -DCHECK_DELAYS.  Not to be used in production"
@@ -105,10 +109,21 @@
 
 #define FPGA_DMA_ALIGN_BYTES 64
 #define IS_DMA_ALIGNED(addr) (addr % FPGA_DMA_ALIGN_BYTES == 0)
+#define DMA_ALIGN_DOWN(addr)                                                   \
+	((uint64_t)(addr) & ~((uint64_t)FPGA_DMA_ALIGN_BYTES - 1))
+#define DMA_ALIGN_UP(addr)                                                     \
+	DMA_ALIGN_DOWN((uint64_t)(addr) + FPGA_DMA_ALIGN_BYTES - 1)
 
 // MIN_SSE2_SIZE is the minimum size in bytes of a memcpy where SSE2 copy
 // benefits over movsb
 #define MIN_SSE2_SIZE 4096
+
+// Minimum size in bytes of a memcpy that uses the AVX non-temporal kernels
+#define MIN_NT_SIZE (128 * 1024)
+
+// Minimum bytes per copy thread when a staging copy is split
+#define FPGA_DMA_COPY_SLICE_SIZE (128 * 1024)
+#define FPGA_DMA_PAGE_SIZE 4096
 #define CACHE_LINE_SIZE 64
 #define ALIGN_TO_CL(x) ((uint64_t)(x) & ~(CACHE_LINE_SIZE - 1))
 #define IS_CL_ALIGNED(x) (((uint64_t)(x) & (CACHE_LINE_SIZE - 1)) == 0)
@@ -133,7 +148,7 @@
 // Granularity of DMA transfer (maximum bytes that can be packed
 // in a single descriptor).This value must match configuration of
 // the DMA IP. Larger transfers will be broken down into smaller
-// transactions.
+// transactions. It bounds fpga_dma_config_t.chunk_size.
 #define FPGA_DMA_BUF_SIZE (1023 * 1024)
 #define FPGA_DMA_BUF_ALIGN_SIZE FPGA_DMA_BUF_SIZE
 
@@ -157,7 +172,45 @@
 #define error_print(...)
 #endif
 
+// Default pipelining parameters
 #define FPGA_DMA_MAX_BUF 8
+#define FPGA_DMA_FENCE_INTERVAL (FPGA_DMA_MAX_BUF / 2)
+
+// Size of the in-flight ring, at least FPGA_DMA_MAX_DEPTH. A chunk that
+// is followed by a write fence owns the fence slot with the same index.
+#define FPGA_DMA_MAX_INFLIGHT 64
+#define FPGA_DMA_FENCE_BUF_SIZE (FPGA_DMA_MAX_INFLIGHT * FPGA_DMA_ALIGN_BYTES)
+#define FPGA_DMA_INFLIGHT_IDX(i) ((i) % FPGA_DMA_MAX_INFLIGHT)
+
+// A transfer queued to the engine
+struct _dma_transfer_t {
+	fpga_dma_handle dma_h;
+	fpga_dma_transfer_t type;
+	fpga_dma_transfer_cb cb;
+	void *context;
+	// Engine reference plus one per in-flight chunk
+	uint32_t refs;
+	fpga_result result;
+	bool done;
+	// Released on completion rather than by fpgaDmaTransferWait()
+	bool detached;
+	struct _dma_transfer_t *next;
+	// Regions to copy, with adjacent ones merged
+	size_t sg_count;
+	fpga_dma_sg_entry_t sg[];
+};
+
+// One descriptor (or descriptor group from _do_dma) owned by a transfer
+typedef struct {
+	struct _dma_transfer_t *xfer;
+	// Bounce buffer index, -1 for FPGA_TO_FPGA_MM chunks
+	int buf;
+	// Host destination of FPGA_TO_HOST_MM chunks, copied on retirement
+	uint64_t copy_dst;
+	uint64_t len;
+	// Followed by a write fence to the slot of the same index
+	bool fenced;
+} dma_chunk_t;
 
 typedef struct __attribute__((__packed__)) {
 	volatile uint64_t dfh;
@@ -179,6 +232,23 @@ typedef union {
 	} bits;
 } dfh_reg_t;
 
+// Part of a staging copy handed to a copy thread
+typedef struct _dma_copy_slice_t {
+	void *dst;
+	void *src;
+	size_t n;
+	// Slices of the copy still running, protected by copy_lock
+	uint32_t *pending;
+	struct _dma_copy_slice_t *next;
+} dma_copy_slice_t;
+
+// Host buffer allocated by fpgaDmaAllocBuffer()
+struct _dma_pinned_buf_t {
+	void *addr;
+	uint64_t wsid;
+	struct _dma_pinned_buf_t *next;
+};
+
 struct _dma_handle_t {
 	fpga_handle fpga_h;
 	uint32_t mmio_num;
@@ -193,13 +263,63 @@ struct _dma_handle_t {
 	uint64_t dma_ase_data_base;
 	// Interrupt event handle
 	fpga_event_handle eh;
-	// magic number buffer
-	volatile uint64_t *magic_buf;
-	uint64_t magic_iova;
-	uint64_t magic_wsid;
-	uint64_t *dma_buf_ptr[FPGA_DMA_MAX_BUF];
-	uint64_t dma_buf_wsid[FPGA_DMA_MAX_BUF];
-	uint64_t dma_buf_iova[FPGA_DMA_MAX_BUF];
+	// write fence buffer, one magic number slot per in-flight chunk
+	volatile uint64_t *fence_buf;
+	uint64_t fence_iova;
+	uint64_t fence_wsid;
+	// Pipelining parameters, see fpga_dma_config_t
+	uint32_t depth;
+	uint32_t chunk_size;
+	uint32_t fence_interval;
+	bool polled;
+	uint32_t copy_threads;
+	// Set only if the CPU has 64-byte MMIO stores
+	bool wide_mmio;
+	bool rmw_unaligned;
+	uint64_t *dma_buf_ptr[FPGA_DMA_MAX_DEPTH];
+	uint64_t dma_buf_wsid[FPGA_DMA_MAX_DEPTH];
+	uint64_t dma_buf_iova[FPGA_DMA_MAX_DEPTH];
+	// Buffers from fpgaDmaAllocBuffer(), protected by lock
+	struct _dma_pinned_buf_t *pinned;
+	// Asynchronous engine
+	pthread_mutex_t lock;
+	// Submission queue is non-empty or shutdown requested
+	pthread_cond_t sq_cond;
+	// In-flight chunks were retired
+	pthread_cond_t inflight_cond;
+	// A transfer completed
+	pthread_cond_t done_cond;
+	pthread_t engine_thread;
+	pthread_t completion_thread;
+	struct _dma_transfer_t *sq_head;
+	struct _dma_transfer_t *sq_tail;
+	// Completed transfers, delivered in order by the completion thread
+	struct _dma_transfer_t *cq_head;
+	struct _dma_transfer_t *cq_tail;
+	dma_chunk_t inflight[FPGA_DMA_MAX_INFLIGHT];
+	// Next slot to post and oldest unretired slot
+	uint32_t inflight_head;
+	uint32_t inflight_tail;
+	// Chunks posted since the last write fence
+	uint32_t unfenced;
+	// Bit mask of bounce buffers owned by in-flight chunks
+	uint32_t buf_busy;
+	// Queued transfers whose completion has not been delivered
+	uint32_t active;
+	int irq_fd;
+	int wake_fd;
+	bool shutdown;
+	bool engine_exited;
+	fpga_result engine_error;
+	// Copy thread pool, see _staged_copy()
+	pthread_t copy_thread[FPGA_DMA_MAX_COPY_THREADS];
+	pthread_mutex_t copy_lock;
+	// Slices were queued or shutdown requested
+	pthread_cond_t copy_cond;
+	// A staged copy finished its last slice
+	pthread_cond_t copy_done_cond;
+	dma_copy_slice_t *copy_queue;
+	bool copy_shutdown;
 };
 
 typedef union {
@@ -0,0 +1,668 @@
+// Copyright(c) 2017, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \fpga_dma_model_test.c
+ * \brief DMA engine test against the software MSGDMA model
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "fpga_dma.h"
+#include "msgdma_model.h"
+
+#define MODEL_MEM_SIZE (64 * 1024 * 1024)
+#define MODEL_FIFO_DEPTH 32
+#define TEST_BUF_SIZE (8 * 1024 * 1024)
+#define NUM_ASYNC 32
+
+static int err_cnt = 0;
+
+#define CHECK(cond, desc)                                                      \
+	do {                                                                   \
+		if (!(cond)) {                                                 \
+			fprintf(stderr, "%s (%d) : %s\n", __FUNCTION__,        \
+				__LINE__, (desc));                             \
+			err_cnt++;                                             \
+			goto out;                                              \
+		}                                                              \
+	} while (0)
+
+struct model_ctx {
+	fpga_handle model;
+	fpga_dma_handle dma_h;
+	uint8_t *mem;
+	uint8_t *src;
+	uint8_t *dst;
+};
+
+static void fill_pattern(uint8_t *buf, size_t count, uint32_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = (uint8_t)((i * 7 + seed) ^ (i >> 11));
+}
+
+static fpga_result ctx_open(struct model_ctx *ctx, uint32_t ns_per_kb,
+			    const fpga_dma_config_t *config)
+{
+	fpga_result res;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->model = msgdma_model_open(MODEL_MEM_SIZE, MODEL_FIFO_DEPTH,
+				       ns_per_kb);
+	if (!ctx->model)
+		return FPGA_NO_MEMORY;
+	ctx->mem = (uint8_t *)msgdma_model_mem(ctx->model);
+
+	ctx->src = (uint8_t *)malloc(TEST_BUF_SIZE);
+	ctx->dst = (uint8_t *)malloc(TEST_BUF_SIZE);
+	if (!ctx->src || !ctx->dst)
+		return FPGA_NO_MEMORY;
+
+	if (config)
+		res = fpgaDmaOpenEx(ctx->model, config, &ctx->dma_h);
+	else
+		res = fpgaDmaOpen(ctx->model, &ctx->dma_h);
+	return res;
+}
+
+static void ctx_close(struct model_ctx *ctx)
+{
+	struct msgdma_model_stats stats;
+
+	if (ctx->dma_h && fpgaDmaClose(ctx->dma_h) != FPGA_OK) {
+		fprintf(stderr, "fpgaDmaClose failed\n");
+		err_cnt++;
+	}
+	if (ctx->model) {
+		msgdma_model_get_stats(ctx->model, &stats);
+		if (stats.overflows || stats.errors) {
+			fprintf(stderr,
+				"model: %lu descriptor overflows, %lu errors\n",
+				(unsigned long)stats.overflows,
+				(unsigned long)stats.errors);
+			err_cnt++;
+		}
+		msgdma_model_close(ctx->model);
+	}
+	free(ctx->src);
+	free(ctx->dst);
+}
+
+// Round trips through FPGA memory at aligned and unaligned offsets
+static void test_sync(void)
+{
+	static const struct {
+		uint64_t fpga;
+		uint64_t host;
+		size_t count;
+	} cases[] = {
+		{0, 0, 4096},
+		{0, 0, TEST_BUF_SIZE},
+		{64, 0, 3 * 1024 * 1024 + 192},
+		{13, 5, 3 * 1024 * 1024 + 101},
+		{4094, 0, 5},
+		{3, 1, 50},
+		{0, 3, 64 * 17},
+		{1024 * 1024 + 60, 0, 1023 * 1024 + 7},
+	};
+	struct model_ctx ctx;
+	fpga_result res;
+	size_t i;
+
+	res = ctx_open(&ctx, 0, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		fill_pattern(ctx.src, TEST_BUF_SIZE, i);
+		memset(ctx.dst, 0, TEST_BUF_SIZE);
+
+		res = fpgaDmaTransferSync(ctx.dma_h, cases[i].fpga,
+					  (uint64_t)ctx.src + cases[i].host,
+					  cases[i].count, HOST_TO_FPGA_MM);
+		CHECK(res == FPGA_OK, "HOST_TO_FPGA_MM");
+		CHECK(!memcmp(ctx.mem + cases[i].fpga, ctx.src + cases[i].host,
+			      cases[i].count),
+		      "HOST_TO_FPGA_MM data mismatch");
+
+		res = fpgaDmaTransferSync(ctx.dma_h,
+					  (uint64_t)ctx.dst + cases[i].host,
+					  cases[i].fpga, cases[i].count,
+					  FPGA_TO_HOST_MM);
+		CHECK(res == FPGA_OK, "FPGA_TO_HOST_MM");
+		CHECK(!memcmp(ctx.dst + cases[i].host, ctx.src + cases[i].host,
+			      cases[i].count),
+		      "FPGA_TO_HOST_MM data mismatch");
+	}
+
+	// Aligned copies are posted directly, others staged through the host
+	fill_pattern(ctx.mem, 4 * 1024 * 1024, 99);
+	res = fpgaDmaTransferSync(ctx.dma_h, 16 * 1024 * 1024, 0,
+				  4 * 1024 * 1024, FPGA_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "FPGA_TO_FPGA_MM aligned");
+	CHECK(!memcmp(ctx.mem + 16 * 1024 * 1024, ctx.mem, 4 * 1024 * 1024),
+	      "FPGA_TO_FPGA_MM aligned data mismatch");
+
+	res = fpgaDmaTransferSync(ctx.dma_h, 32 * 1024 * 1024 + 9, 3,
+				  2 * 1024 * 1024 + 77, FPGA_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "FPGA_TO_FPGA_MM unaligned");
+	CHECK(!memcmp(ctx.mem + 32 * 1024 * 1024 + 9, ctx.mem + 3,
+		      2 * 1024 * 1024 + 77),
+	      "FPGA_TO_FPGA_MM unaligned data mismatch");
+
+	res = fpgaDmaTransferSync(ctx.dma_h, 100, 3, 1000, FPGA_TO_FPGA_MM);
+	CHECK(res == FPGA_NOT_SUPPORTED, "overlapping FPGA_TO_FPGA_MM");
+
+	res = fpgaDmaTransferSync(ctx.dma_h, 0, 0, 0, FPGA_MAX_TRANSFER_TYPE);
+	CHECK(res == FPGA_INVALID_PARAM, "invalid transfer type");
+
+out:
+	ctx_close(&ctx);
+}
+
+// Shared host memory is transferred in place, other memory is staged
+static void test_zero_copy(void)
+{
+	const size_t count = 3 * 1024 * 1024 + 128;
+	struct model_ctx ctx;
+	uint64_t wsid = 0;
+	uint8_t *pinned = NULL;
+	uint8_t *prepared = NULL;
+	fpga_result res;
+
+	res = ctx_open(&ctx, 0, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+
+	res = fpgaDmaAllocBuffer(ctx.dma_h, TEST_BUF_SIZE, (void **)&pinned);
+	CHECK(res == FPGA_OK, "fpgaDmaAllocBuffer");
+	res = fpgaPrepareBuffer(ctx.model, TEST_BUF_SIZE, (void **)&prepared,
+				&wsid, 0);
+	CHECK(res == FPGA_OK, "fpgaPrepareBuffer");
+
+	fill_pattern(pinned, TEST_BUF_SIZE, 3);
+	res = fpgaDmaTransferSync(ctx.dma_h, 0, (uint64_t)pinned, count,
+				  HOST_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "HOST_TO_FPGA_MM");
+	CHECK(!memcmp(ctx.mem, pinned, count), "HOST_TO_FPGA_MM data mismatch");
+	CHECK(msgdma_model_buffer_bytes(ctx.model, pinned) == count,
+	      "HOST_TO_FPGA_MM was staged");
+
+	res = fpgaDmaTransferSync(ctx.dma_h, (uint64_t)prepared, 0, count,
+				  FPGA_TO_HOST_MM);
+	CHECK(res == FPGA_OK, "FPGA_TO_HOST_MM");
+	CHECK(!memcmp(prepared, pinned, count), "FPGA_TO_HOST_MM data mismatch");
+	CHECK(msgdma_model_buffer_bytes(ctx.model, prepared) == count,
+	      "FPGA_TO_HOST_MM was staged");
+
+	// Host and FPGA addresses that are not mutually aligned are staged
+	res = fpgaDmaTransferSync(ctx.dma_h, (uint64_t)prepared + 8, 0, count,
+				  FPGA_TO_HOST_MM);
+	CHECK(res == FPGA_OK, "misaligned FPGA_TO_HOST_MM");
+	CHECK(!memcmp(prepared + 8, pinned, count),
+	      "misaligned FPGA_TO_HOST_MM data mismatch");
+	CHECK(msgdma_model_buffer_bytes(ctx.model, prepared) == count,
+	      "misaligned FPGA_TO_HOST_MM was not staged");
+
+	res = fpgaDmaFreeBuffer(ctx.dma_h, prepared);
+	CHECK(res == FPGA_NOT_FOUND, "free of foreign buffer");
+	res = fpgaReleaseBuffer(ctx.model, wsid);
+	CHECK(res == FPGA_OK, "fpgaReleaseBuffer");
+	// pinned is released by fpgaDmaClose()
+
+out:
+	ctx_close(&ctx);
+}
+
+struct async_ctx {
+	uint32_t completed;
+	uint32_t order[NUM_ASYNC];
+};
+
+struct async_req {
+	struct async_ctx *actx;
+	uint32_t id;
+};
+
+static void async_cb(void *context)
+{
+	struct async_req *req = (struct async_req *)context;
+	uint32_t n = __atomic_fetch_add(&req->actx->completed, 1,
+					__ATOMIC_SEQ_CST);
+
+	req->actx->order[n] = req->id;
+}
+
+// Callbacks complete in submission order and every transfer lands
+static void test_async_callbacks(void)
+{
+	const size_t chunk = TEST_BUF_SIZE / NUM_ASYNC;
+	struct async_req reqs[NUM_ASYNC];
+	struct async_ctx actx;
+	struct model_ctx ctx;
+	fpga_dma_future future = NULL;
+	fpga_result res;
+	uint32_t i;
+
+	memset(&actx, 0, sizeof(actx));
+	res = ctx_open(&ctx, 0, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+
+	fill_pattern(ctx.src, TEST_BUF_SIZE, 7);
+	for (i = 0; i < NUM_ASYNC; i++) {
+		reqs[i].actx = &actx;
+		reqs[i].id = i;
+		res = fpgaDmaTransferAsync(ctx.dma_h, i * chunk,
+					   (uint64_t)ctx.src + i * chunk, chunk,
+					   HOST_TO_FPGA_MM, async_cb, &reqs[i]);
+		CHECK(res == FPGA_OK, "fpgaDmaTransferAsync");
+	}
+
+	// Transfers run in order, so this completes after all of the above
+	res = fpgaDmaTransferStart(ctx.dma_h, (uint64_t)ctx.dst, 0,
+				   TEST_BUF_SIZE, FPGA_TO_HOST_MM, &future);
+	CHECK(res == FPGA_OK, "fpgaDmaTransferStart");
+	res = fpgaDmaTransferWait(future, -1);
+	CHECK(res == FPGA_OK, "fpgaDmaTransferWait");
+
+	CHECK(__atomic_load_n(&actx.completed, __ATOMIC_SEQ_CST) == NUM_ASYNC,
+	      "missing callbacks");
+	for (i = 0; i < NUM_ASYNC; i++)
+		CHECK(actx.order[i] == i, "callbacks out of order");
+	CHECK(!memcmp(ctx.dst, ctx.src, TEST_BUF_SIZE), "data mismatch");
+
+out:
+	ctx_close(&ctx);
+}
+
+// Futures report pending transfers and close drains detached ones
+static void test_futures(void)
+{
+	struct async_req reqs[NUM_ASYNC];
+	struct async_ctx actx;
+	struct model_ctx ctx;
+	fpga_dma_future future = NULL;
+	fpga_result res;
+	uint32_t i;
+
+	memset(&actx, 0, sizeof(actx));
+	// 1 MB per millisecond
+	res = ctx_open(&ctx, 1000, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+
+	res = fpgaDmaTransferStart(ctx.dma_h, 0, 16 * 1024 * 1024,
+				   8 * 1024 * 1024, FPGA_TO_FPGA_MM, &future);
+	CHECK(res == FPGA_OK, "fpgaDmaTransferStart");
+	res = fpgaDmaTransferWait(future, 0);
+	CHECK(res == FPGA_BUSY, "poll of pending transfer");
+	res = fpgaDmaTransferWait(future, 1);
+	CHECK(res == FPGA_BUSY, "timed wait on pending transfer");
+	res = fpgaDmaTransferWait(future, -1);
+	CHECK(res == FPGA_OK, "fpgaDmaTransferWait");
+
+	res = fpgaDmaTransferWait(NULL, -1);
+	CHECK(res == FPGA_INVALID_PARAM, "wait on NULL future");
+	res = fpgaDmaTransferStart(ctx.dma_h, 0, 0, 64, FPGA_TO_FPGA_MM, NULL);
+	CHECK(res == FPGA_INVALID_PARAM, "start without future");
+
+	for (i = 0; i < NUM_ASYNC; i++) {
+		reqs[i].actx = &actx;
+		reqs[i].id = i;
+		res = fpgaDmaTransferAsync(ctx.dma_h, 0, 16 * 1024 * 1024,
+					   64 * 1024, FPGA_TO_FPGA_MM, async_cb,
+					   &reqs[i]);
+		CHECK(res == FPGA_OK, "fpgaDmaTransferAsync");
+	}
+
+	res = fpgaDmaClose(ctx.dma_h);
+	ctx.dma_h = NULL;
+	CHECK(res == FPGA_OK, "fpgaDmaClose");
+	CHECK(actx.completed == NUM_ASYNC, "close did not drain transfers");
+
+out:
+	ctx_close(&ctx);
+}
+
+// Back to back transfers keep the descriptor FIFO from running dry
+static void test_streaming(void)
+{
+	fpga_dma_future futures[NUM_ASYNC];
+	struct msgdma_model_stats stats;
+	struct model_ctx ctx;
+	fpga_result res;
+	uint32_t i;
+
+	// 2 MB per millisecond
+	res = ctx_open(&ctx, 500, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+
+	for (i = 0; i < NUM_ASYNC; i++) {
+		res = fpgaDmaTransferStart(ctx.dma_h,
+					   32 * 1024 * 1024 + (i % 4) * 4 * 1024 * 1024,
+					   (i % 4) * 4 * 1024 * 1024,
+					   4 * 1024 * 1024, FPGA_TO_FPGA_MM,
+					   &futures[i]);
+		CHECK(res == FPGA_OK, "fpgaDmaTransferStart");
+	}
+	for (i = 0; i < NUM_ASYNC; i++) {
+		res = fpgaDmaTransferWait(futures[i], -1);
+		CHECK(res == FPGA_OK, "fpgaDmaTransferWait");
+	}
+
+	msgdma_model_get_stats(ctx.model, &stats);
+	printf("streaming: %lu descriptors, %lu interrupts, %lu restarts, "
+	       "max fill %u\n",
+	       (unsigned long)stats.descriptors,
+	       (unsigned long)stats.interrupts, (unsigned long)stats.restarts,
+	       stats.max_fill);
+	// Waiting for each transfer before the next would restart the
+	// dispatcher once per transfer
+	CHECK(stats.restarts < NUM_ASYNC / 4, "descriptor FIFO ran dry");
+	CHECK(stats.max_fill > 1, "descriptor FIFO never filled");
+
+out:
+	ctx_close(&ctx);
+}
+
+// Pipelining parameters are validated and every combination moves data
+static void test_config(void)
+{
+	static const fpga_dma_config_t invalid[] = {
+		{0, 4096, 1, false, 0, false, false},
+		{FPGA_DMA_MAX_DEPTH + 1, 4096, 1, false, 0, false, false},
+		{4, 0, 1, false, 0, false, false},
+		{4, 4096 + 8, 1, false, 0, false, false},
+		{4, 1024 * 1024, 1, false, 0, false, false},
+		{4, 4096, 0, false, 0, false, false},
+		{4, 4096, 5, false, 0, false, false},
+		{4, 4096, 1, false, FPGA_DMA_MAX_COPY_THREADS + 1, false,
+		 false},
+	};
+	static const fpga_dma_config_t valid[] = {
+		{1, 4096, 1, false, 0, false, false},
+		{3, 192, 2, true, 0, false, false},
+		{FPGA_DMA_MAX_DEPTH, 64 * 1024, FPGA_DMA_MAX_DEPTH, false, 0,
+		 false, false},
+		{FPGA_DMA_MAX_DEPTH, 64 * 1024, 8, true, 0, false, false},
+		{8, 1023 * 1024, 4, false, 4, false, false},
+		{4, 512 * 1024, 2, true, FPGA_DMA_MAX_COPY_THREADS, false, false},
+		{2, 4096, 1, false, 0, true, true},
+	};
+	const size_t count = 1024 * 1024 + 101;
+	struct msgdma_model_stats stats;
+	struct model_ctx ctx;
+	fpga_dma_handle dma_h = NULL;
+	fpga_result res;
+	size_t i;
+
+	res = ctx_open(&ctx, 0, NULL);
+	CHECK(res == FPGA_OK, "ctx_open");
+	res = fpgaDmaClose(ctx.dma_h);
+	ctx.dma_h = NULL;
+	CHECK(res == FPGA_OK, "fpgaDmaClose");
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		res = fpgaDmaOpenEx(ctx.model, &invalid[i], &dma_h);
+		CHECK(res == FPGA_INVALID_PARAM, "invalid config accepted");
+	}
+	ctx_close(&ctx);
+
+	for (i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+		res = ctx_open(&ctx, 0, &valid[i]);
+		CHECK(res == FPGA_OK, "ctx_open");
+
+		fill_pattern(ctx.src, count, i);
+		memset(ctx.dst, 0, count);
+		res = fpgaDmaTransferSync(ctx.dma_h, 7, (uint64_t)ctx.src + 3,
+					  count, HOST_TO_FPGA_MM);
+		CHECK(res == FPGA_OK, "HOST_TO_FPGA_MM");
+		res = fpgaDmaTransferSync(ctx.dma_h, 4 * 1024 * 1024 + 7, 7,
+					  count, FPGA_TO_FPGA_MM);
+		CHECK(res == FPGA_OK, "FPGA_TO_FPGA_MM");
+		res = fpgaDmaTransferSync(ctx.dma_h, (uint64_t)ctx.dst + 3,
+					  4 * 1024 * 1024 + 7, count,
+					  FPGA_TO_HOST_MM);
+		CHECK(res == FPGA_OK, "FPGA_TO_HOST_MM");
+		CHECK(!memcmp(ctx.dst + 3, ctx.src + 3, count), "data mismatch");
+
+		msgdma_model_get_stats(ctx.model, &stats);
+		if (valid[i].polled) {
+			CHECK(stats.interrupts == 0, "polled handle interrupted");
+		} else {
+			// At most one interrupt per fence interval, plus one
+			// per transfer and staging pass
+			CHECK(stats.interrupts
+				      <= stats.descriptors / valid[i].fence_interval
+						 + 8,
+			      "interrupts were not coalesced");
+		}
+		ctx_close(&ctx);
+	}
+	return;
+
+out:
+	ctx_close(&ctx);
+}
+
+// Regions are merged, posted back to back and complete with one interrupt
+static void test_scatter_gather(void)
+{
+	const fpga_dma_config_t config = {FPGA_DMA_MAX_DEPTH, 64 * 1024,
+					  FPGA_DMA_MAX_DEPTH, false, 0, false,
+					  false};
+	fpga_dma_sg_entry_t sg[NUM_ASYNC];
+	fpga_dma_sg_entry_t back[NUM_ASYNC];
+	struct msgdma_model_stats before, after;
+	struct model_ctx ctx;
+	fpga_dma_future future = NULL;
+	fpga_result res;
+	uint32_t i;
+
+	res = ctx_open(&ctx, 0, &config);
+	CHECK(res == FPGA_OK, "ctx_open");
+	fill_pattern(ctx.src, TEST_BUF_SIZE, 11);
+
+	// Aligned records scattered through FPGA memory
+	for (i = 0; i < NUM_ASYNC; i++) {
+		sg[i].dst = i * 64 * 1024;
+		sg[i].src = (uint64_t)ctx.src + i * 8 * 1024;
+		sg[i].count = 4 * 1024;
+		back[i].dst = (uint64_t)ctx.dst + i * 8 * 1024;
+		back[i].src = sg[i].dst;
+		back[i].count = sg[i].count;
+	}
+	msgdma_model_get_stats(ctx.model, &before);
+	res = fpgaDmaTransferSGSync(ctx.dma_h, sg, NUM_ASYNC, HOST_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "scattered HOST_TO_FPGA_MM");
+	msgdma_model_get_stats(ctx.model, &after);
+	CHECK(after.interrupts - before.interrupts == 1,
+	      "one interrupt per batch");
+	memset(ctx.dst, 0, TEST_BUF_SIZE);
+	res = fpgaDmaTransferSGSync(ctx.dma_h, back, NUM_ASYNC,
+				    FPGA_TO_HOST_MM);
+	CHECK(res == FPGA_OK, "gathered FPGA_TO_HOST_MM");
+	for (i = 0; i < NUM_ASYNC; i++)
+		CHECK(!memcmp(ctx.dst + i * 8 * 1024, ctx.src + i * 8 * 1024,
+			      4 * 1024),
+		      "scatter-gather data mismatch");
+
+	// Unaligned records that are adjacent on both sides become one
+	// aligned region
+	for (i = 0; i < NUM_ASYNC; i++) {
+		sg[i].dst = 1024 * 1024 + i * 1000;
+		sg[i].src = (uint64_t)ctx.src + i * 1000;
+		sg[i].count = 1000;
+	}
+	msgdma_model_get_stats(ctx.model, &before);
+	res = fpgaDmaTransferSGStart(ctx.dma_h, sg, NUM_ASYNC, HOST_TO_FPGA_MM,
+				     &future);
+	CHECK(res == FPGA_OK, "fpgaDmaTransferSGStart");
+	// The list is copied on submission
+	memset(sg, 0, sizeof(sg));
+	res = fpgaDmaTransferWait(future, -1);
+	CHECK(res == FPGA_OK, "merged HOST_TO_FPGA_MM");
+	msgdma_model_get_stats(ctx.model, &after);
+	CHECK(after.interrupts - before.interrupts == 1,
+	      "merged regions interrupted more than once");
+	CHECK(!memcmp(ctx.mem + 1024 * 1024, ctx.src, NUM_ASYNC * 1000),
+	      "merged data mismatch");
+
+	// Unaligned records that cannot be merged
+	for (i = 0; i < NUM_ASYNC; i++) {
+		sg[i].dst = 2 * 1024 * 1024 + i * 4096 + i;
+		sg[i].src = (uint64_t)ctx.src + i * 1000;
+		sg[i].count = 300 + i * 37;
+		back[i].dst = (uint64_t)ctx.dst + i * 1000;
+		back[i].src = sg[i].dst;
+		back[i].count = sg[i].count;
+	}
+	res = fpgaDmaTransferSGSync(ctx.dma_h, sg, NUM_ASYNC, HOST_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "unaligned HOST_TO_FPGA_MM");
+	memset(ctx.dst, 0, TEST_BUF_SIZE);
+	res = fpgaDmaTransferSGSync(ctx.dma_h, back, NUM_ASYNC,
+				    FPGA_TO_HOST_MM);
+	CHECK(res == FPGA_OK, "unaligned FPGA_TO_HOST_MM");
+	for (i = 0; i < NUM_ASYNC; i++)
+		CHECK(!memcmp(ctx.dst + i * 1000, ctx.src + i * 1000,
+			      300 + i * 37),
+		      "unaligned scatter-gather data mismatch");
+
+	res = fpgaDmaTransferSGSync(ctx.dma_h, NULL, 1, HOST_TO_FPGA_MM);
+	CHECK(res == FPGA_INVALID_PARAM, "NULL region list");
+	res = fpgaDmaTransferSGSync(ctx.dma_h, NULL, 0, HOST_TO_FPGA_MM);
+	CHECK(res == FPGA_OK, "empty region list");
+
+out:
+	ctx_close(&ctx);
+}
+
+// Unaligned edges are merged into whole lines by DMA, leaving the rest of
+// those lines intact and never touching the address span expander
+static void test_rmw_unaligned(void)
+{
+	static const fpga_dma_config_t configs[] = {
+		{8, 64 * 1024, 4, false, 0, false, true},
+		{2, 64, 1, false, 0, false, true},
+	};
+	static const struct {
+		uint64_t fpga;
+		uint64_t host;
+		size_t count;
+	} cases[] = {
+		{3, 1, 50},
+		{60, 0, 4},
+		{4094, 0, 5},
+		{64, 0, 100},
+		{32, 0, 64},
+		{13, 5, 64 * 1024 - 100},
+		{100, 7, 64 * 1024 + 29},
+		{1024 * 1024 + 60, 0, 1023 * 1024 + 7},
+	};
+	const uint64_t guard = 128;
+	struct msgdma_model_stats stats;
+	struct model_ctx ctx;
+	uint8_t *expect = NULL;
+	fpga_result res;
+	size_t c, i;
+
+	expect = (uint8_t *)malloc(TEST_BUF_SIZE);
+	CHECK(expect, "malloc");
+
+	for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+		res = ctx_open(&ctx, 0, &configs[c]);
+		CHECK(res == FPGA_OK, "ctx_open");
+		fill_pattern(ctx.mem, 4 * 1024 * 1024, 77);
+
+		for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+			uint64_t lo = cases[i].fpga < guard
+					      ? 0
+					      : cases[i].fpga - guard;
+			uint64_t hi = cases[i].fpga + cases[i].count + guard;
+
+			fill_pattern(ctx.src, TEST_BUF_SIZE, i);
+			memcpy(expect, ctx.mem + lo, hi - lo);
+			memcpy(expect + cases[i].fpga - lo,
+			       ctx.src + cases[i].host, cases[i].count);
+
+			res = fpgaDmaTransferSync(
+				ctx.dma_h, cases[i].fpga,
+				(uint64_t)ctx.src + cases[i].host,
+				cases[i].count, HOST_TO_FPGA_MM);
+			CHECK(res == FPGA_OK, "HOST_TO_FPGA_MM");
+			CHECK(!memcmp(ctx.mem + lo, expect, hi - lo),
+			      "read-modify-write data mismatch");
+
+			memset(ctx.dst, 0, TEST_BUF_SIZE);
+			res = fpgaDmaTransferSync(
+				ctx.dma_h, (uint64_t)ctx.dst + cases[i].host,
+				cases[i].fpga, cases[i].count,
+				FPGA_TO_HOST_MM);
+			CHECK(res == FPGA_OK, "FPGA_TO_HOST_MM");
+			CHECK(!memcmp(ctx.dst + cases[i].host,
+				      ctx.src + cases[i].host, cases[i].count),
+			      "FPGA_TO_HOST_MM data mismatch");
+			CHECK(ctx.dst[cases[i].host + cases[i].count] == 0,
+			      "FPGA_TO_HOST_MM overran the region");
+		}
+
+		res = fpgaDmaTransferSync(ctx.dma_h, 32 * 1024 * 1024 + 9, 3,
+					  2 * 1024 * 1024 + 77,
+					  FPGA_TO_FPGA_MM);
+		CHECK(res == FPGA_OK, "FPGA_TO_FPGA_MM unaligned");
+		CHECK(!memcmp(ctx.mem + 32 * 1024 * 1024 + 9, ctx.mem + 3,
+			      2 * 1024 * 1024 + 77),
+		      "FPGA_TO_FPGA_MM unaligned data mismatch");
+
+		msgdma_model_get_stats(ctx.model, &stats);
+		CHECK(stats.window_accesses == 0,
+		      "address span expander was used");
+		ctx_close(&ctx);
+	}
+	free(expect);
+	return;
+
+out:
+	ctx_close(&ctx);
+	free(expect);
+}
+
+int main(void)
+{
+	test_sync();
+	test_zero_copy();
+	test_async_callbacks();
+	test_futures();
+	test_streaming();
+	test_config();
+	test_scatter_gather();
+	test_rmw_unaligned();
+
+	printf("%s\n", err_cnt ? "FAIL" : "PASS");
+	return err_cnt ? 1 : 0;
+}
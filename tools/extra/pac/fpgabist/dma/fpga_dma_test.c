@@ -52,6 +52,7 @@
 #define HELLO_AFU_ID "331DB30C-9885-41EA-9081-F88B8F655CAA"
 #define TEST_BUF_SIZE (10 * 1024 * 1024)
 #define ASE_TEST_BUF_SIZE (4 * 1024)
+#define TUNE_BUF_SIZE (256 * 1024 * 1024)
 
 #ifdef CHECK_DELAYS
 extern double poll_wait_count;
@@ -71,6 +72,9 @@ bool use_advise = false;
 bool do_not_verify = false;
 bool cpu_affinity = true;
 bool memory_affinity = true;
+// Search for the fastest DMA pipelining parameters before the DDR sweep
+bool auto_tune = false;
+fpga_dma_config_t dma_config;
 
 /*
  * macro for checking return codes
@@ -99,7 +103,7 @@ config = {.target = {.bus = -1}};
 /*
  *  *  * Parse command line arguments
  *   *   */
-#define GETOPT_STRING ":B:mpc2nayCM"
+#define GETOPT_STRING ":B:mpc2nayCMD:S:F:PTt:WR"
 fpga_result parse_args(int argc, char *argv[])
 {
 	struct option longopts[] = {{"bus", required_argument, NULL, 'B'}};
@@ -158,6 +162,56 @@ fpga_result parse_args(int argc, char *argv[])
 		case 'M':
 			memory_affinity = true;
 			break;
+		case 'D':
+			endptr = NULL;
+			dma_config.depth = (uint32_t)strtoul(tmp_optarg, &endptr, 0);
+			if (endptr != tmp_optarg + strnlen(tmp_optarg, 100)) {
+				fprintf(stderr, "invalid depth: %s\n", tmp_optarg);
+				return FPGA_EXCEPTION;
+			}
+			break;
+		case 'S':
+			endptr = NULL;
+			dma_config.chunk_size =
+				(uint32_t)strtoul(tmp_optarg, &endptr, 0);
+			if (endptr != tmp_optarg + strnlen(tmp_optarg, 100)) {
+				fprintf(stderr, "invalid chunk size: %s\n",
+					tmp_optarg);
+				return FPGA_EXCEPTION;
+			}
+			break;
+		case 'F':
+			endptr = NULL;
+			dma_config.fence_interval =
+				(uint32_t)strtoul(tmp_optarg, &endptr, 0);
+			if (endptr != tmp_optarg + strnlen(tmp_optarg, 100)) {
+				fprintf(stderr, "invalid fence interval: %s\n",
+					tmp_optarg);
+				return FPGA_EXCEPTION;
+			}
+			break;
+		case 'P':
+			dma_config.polled = true;
+			break;
+		case 'T':
+			auto_tune = true;
+			break;
+		case 't':
+			endptr = NULL;
+			dma_config.copy_threads =
+				(uint32_t)strtoul(tmp_optarg, &endptr, 0);
+			if (endptr != tmp_optarg + strnlen(tmp_optarg, 100)) {
+				fprintf(stderr, "invalid copy thread count: %s\n",
+					tmp_optarg);
+				return FPGA_EXCEPTION;
+			}
+			break;
+		case 'W':
+			dma_config.wide_mmio = true;
+			break;
+		case 'R':
+			dma_config.rmw_unaligned = true;
+			break;
 
 		default: /* invalid option */
 			fprintf(stderr, "Invalid cmdline options\n");
@@ -480,6 +534,117 @@ fpga_result ddr_sweep(fpga_dma_handle dma_h, uint64_t ptr_align,
 	return FPGA_OK;
 }
 
+// Round trip of size bytes between host buffer buf and FPGA address 0
+static fpga_result tune_run(fpga_dma_handle dma_h, uint64_t buf, size_t size,
+			    double *seconds)
+{
+	struct timespec start, end;
+	fpga_result res;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	res = fpgaDmaTransferSync(dma_h, 0x0, buf, size, HOST_TO_FPGA_MM);
+	if (res == FPGA_OK)
+		res = fpgaDmaTransferSync(dma_h, buf, 0x0, size,
+					  FPGA_TO_HOST_MM);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*seconds = getTime(start, end);
+	return res;
+}
+
+/*
+ * Measure every combination of DMA pipelining parameters and reopen
+ * *dma_h with the one giving the highest round trip bandwidth. The
+ * result is also stored in dma_config.
+ */
+fpga_result ddr_tune(fpga_handle afc_h, fpga_dma_handle *dma_h)
+{
+	static const uint32_t depths[] = {2, 4, 8, 16, FPGA_DMA_MAX_DEPTH};
+	static const uint32_t chunk_sizes[] = {64 * 1024, 256 * 1024,
+					       512 * 1024, 1023 * 1024};
+	fpga_dma_config_t cfg, best;
+	fpga_result res = FPGA_OK;
+	uint64_t *buf = NULL;
+	uint32_t intervals[3];
+	double best_bw = 0.0;
+	double seconds, bw;
+	size_t d, c, f;
+	int polled;
+
+	res = fpgaDmaClose(*dma_h);
+	*dma_h = NULL;
+	ON_ERR_GOTO(res, out, "fpgaDmaClose");
+
+	buf = malloc_aligned(getpagesize(), TUNE_BUF_SIZE);
+	if (!buf) {
+		res = FPGA_NO_MEMORY;
+		ON_ERR_GOTO(res, out, "Error allocating memory");
+	}
+	fill_buffer((char *)buf, TUNE_BUF_SIZE);
+
+	best = dma_config;
+	printf("Tuning DMA parameters\n");
+	for (polled = 0; polled < 2; polled++) {
+		for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+			intervals[0] = 1;
+			intervals[1] = depths[d] / 2;
+			intervals[2] = depths[d];
+			for (c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+			     c++) {
+				for (f = 0; f < 3; f++) {
+					// Skip repeats for small depths
+					if (f && intervals[f] <= intervals[f - 1])
+						continue;
+					cfg.depth = depths[d];
+					cfg.chunk_size = chunk_sizes[c];
+					cfg.fence_interval = intervals[f];
+					cfg.polled = polled;
+					cfg.copy_threads =
+						dma_config.copy_threads;
+					cfg.wide_mmio = dma_config.wide_mmio;
+					cfg.rmw_unaligned =
+						dma_config.rmw_unaligned;
+
+					res = fpgaDmaOpenEx(afc_h, &cfg, dma_h);
+					ON_ERR_GOTO(res, out_free, "fpgaDmaOpenEx");
+					res = tune_run(*dma_h, (uint64_t)buf,
+						       TUNE_BUF_SIZE, &seconds);
+					ON_ERR_GOTO(res, out_free, "tune_run");
+					res = fpgaDmaClose(*dma_h);
+					*dma_h = NULL;
+					ON_ERR_GOTO(res, out_free, "fpgaDmaClose");
+
+					bw = 2.0 * TUNE_BUF_SIZE
+					     / (seconds * 1000 * 1000);
+					printf("depth %2u chunk %7u fence %2u %s: %lf Megabytes/sec\n",
+					       cfg.depth, cfg.chunk_size,
+					       cfg.fence_interval,
+					       cfg.polled ? "polled" : "interrupt",
+					       bw);
+					if (bw > best_bw) {
+						best_bw = bw;
+						best = cfg;
+					}
+				}
+			}
+		}
+	}
+
+	printf("Best: -D %u -S %u -F %u%s (%lf Megabytes/sec)\n", best.depth,
+	       best.chunk_size, best.fence_interval, best.polled ? " -P" : "",
+	       best_bw);
+	dma_config = best;
+
+out_free:
+	if (buf)
+		free_aligned(buf);
+	if (!*dma_h && res == FPGA_OK) {
+		res = fpgaDmaOpenEx(afc_h, &dma_config, dma_h);
+		ON_ERR_GOTO(res, out, "fpgaDmaOpenEx");
+	}
+out:
+	return res;
+}
+
 static void usage(void)
 {
 	printf("Usage: fpga_dma_test <use_ase = 1 (simulation only), 0 (hardware)> [options]\n");
@@ -494,12 +659,20 @@ static void usage(void)
 	printf("\t-C\tDo not restrict process to CPUs attached to DCP NUMA node\n");
 	printf("\t-M\tDo not restrict process memory allocation to DCP NUMA node\n");
 	printf("\t-B\t Set a target bus number\n");
+	printf("\t-D\tNumber of DMA chunks in flight (default 8)\n");
+	printf("\t-S\tDMA chunk size in bytes (default 1047552)\n");
+	printf("\t-F\tChunks per DMA completion interrupt (default 4)\n");
+	printf("\t-P\tPoll for DMA completion instead of using interrupts\n");
+	printf("\t-T\tFind the fastest of the above settings before the DDR sweep\n");
+	printf("\t-t\tNumber of helper threads for bounce buffer copies (default 0)\n");
+	printf("\t-W\tUse 64-byte MMIO writes for unaligned bytes (AFU must support them)\n");
+	printf("\t-R\tMove unaligned bytes by DMA with read-modify-write instead of MMIO\n");
 }
 
 int main(int argc, char *argv[])
 {
 	fpga_result res = FPGA_OK;
-	fpga_dma_handle dma_h;
+	fpga_dma_handle dma_h = NULL;
 	uint64_t count;
 	// fpga_properties filter = NULL;
 	fpga_token afc_token;
@@ -516,6 +689,7 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	fpgaDmaGetDefaultConfig(&dma_config);
 	res = parse_args(argc, argv);
 	if (res == FPGA_EXCEPTION) {
 		return 1;
@@ -624,8 +798,8 @@ int main(int argc, char *argv[])
 	res = fpgaReset(afc_h);
 	ON_ERR_GOTO(res, out_unmap, "fpgaReset");
 
-	res = fpgaDmaOpen(afc_h, &dma_h);
-	ON_ERR_GOTO(res, out_dma_close, "fpgaDmaOpen");
+	res = fpgaDmaOpenEx(afc_h, &dma_config, &dma_h);
+	ON_ERR_GOTO(res, out_dma_close, "fpgaDmaOpenEx");
 
 	if (use_ase)
 		count = ASE_TEST_BUF_SIZE;
@@ -718,6 +892,10 @@ int main(int argc, char *argv[])
 	ON_ERR_GOTO(res, out_free_buff, "verify_buffer");
 
 	if (!use_ase) {
+		if (auto_tune) {
+			res = ddr_tune(afc_h, &dma_h);
+			ON_ERR_GOTO(res, out_free_buff, "ddr_tune");
+		}
 		printf("Running DDR sweep test\n");
 		res = ddr_sweep(dma_h, 0, 0);
 		printf("DDR sweep with unaligned pointer and size\n");
@@ -0,0 +1,660 @@
+// Copyright(c) 2017, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \msgdma_model.c
+ * \brief Software model of the MSGDMA BBB
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "fpga_dma_internal.h"
+#include "msgdma_model.h"
+
+#define MODEL_MAGIC 0x4d534744
+#define MODEL_PAGE_SIZE 4096
+// Host addresses carry FPGA_DMA_HOST_MASK above the 48-bit virtual address
+#define MODEL_HOST_ADDR_MASK 0xffffffffffffULL
+
+#define DESC_SIZE sizeof(msgdma_ext_desc_t)
+#define CSR_OFFSET(field) (FPGA_DMA_CSR + offsetof(msgdma_csr_t, field))
+
+struct model_event {
+	int fd;
+};
+
+struct model_buffer {
+	uint8_t *addr;
+	uint64_t len;
+	// Bytes moved to or from the buffer by descriptors
+	uint64_t dma_bytes;
+	struct model_buffer *next;
+};
+
+struct msgdma_model {
+	uint32_t magic;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t dispatcher;
+	bool stop;
+	uint8_t *mem;
+	size_t mem_size;
+	uint32_t ns_per_kb;
+	msgdma_ctrl_t ctrl;
+	bool irq;
+	// Descriptor port staging, pushed when the control word is written
+	uint8_t stage[DESC_SIZE];
+	msgdma_ext_desc_t *fifo;
+	uint32_t depth;
+	uint32_t fifo_head;
+	uint32_t fill;
+	bool busy;
+	uint64_t ase_page;
+	int irq_fd;
+	struct model_buffer *buffers;
+	struct msgdma_model_stats stats;
+};
+
+static struct msgdma_model *model_check(fpga_handle handle)
+{
+	struct msgdma_model *m = (struct msgdma_model *)handle;
+
+	if (!m || m->magic != MODEL_MAGIC)
+		return NULL;
+	return m;
+}
+
+static struct model_buffer *model_find_buffer(struct msgdma_model *m,
+					      uint64_t addr)
+{
+	struct model_buffer *b = NULL;
+
+	for (b = m->buffers; b; b = b->next)
+		if (addr - (uint64_t)b->addr < b->len)
+			return b;
+	return NULL;
+}
+
+/*
+ * Translates a descriptor address. Host addresses are identity mapped,
+ * anything else below mem_size is FPGA memory. Sets rom for the magic
+ * number ROM used as the source of write fences.
+ */
+static uint8_t *model_addr(struct msgdma_model *m, uint64_t addr, uint32_t len,
+			   bool *rom)
+{
+	*rom = false;
+	if (addr & FPGA_DMA_HOST_MASK)
+		return (uint8_t *)(addr & MODEL_HOST_ADDR_MASK);
+	if (addr & FPGA_DMA_WF_ROM_MAGIC_NO_MASK) {
+		*rom = true;
+		return NULL;
+	}
+	if (addr + len > m->mem_size)
+		return NULL;
+	return m->mem + addr;
+}
+
+static bool model_execute(struct msgdma_model *m, msgdma_ext_desc_t *desc)
+{
+	uint64_t rd = ((uint64_t)desc->rd_address_ext << 32) | desc->rd_address;
+	uint64_t wr = ((uint64_t)desc->wr_address_ext << 32) | desc->wr_address;
+	struct timespec ts;
+	uint64_t magic = FPGA_DMA_WF_MAGIC_NO;
+	uint64_t ns = 0;
+	uint8_t *src = NULL;
+	uint8_t *dst = NULL;
+	bool src_rom = false;
+	bool dst_rom = false;
+	uint32_t i = 0;
+
+	src = model_addr(m, rd, desc->len, &src_rom);
+	dst = model_addr(m, wr, desc->len, &dst_rom);
+	if ((!src && !src_rom) || !dst)
+		return false;
+
+	if (src_rom) {
+		for (i = 0; i + sizeof(magic) <= desc->len; i += sizeof(magic))
+			memcpy(dst + i, &magic, sizeof(magic));
+	} else {
+		memcpy(dst, src, desc->len);
+	}
+
+	ns = (uint64_t)m->ns_per_kb * desc->len / 1024;
+	if (ns) {
+		ts.tv_sec = ns / 1000000000ULL;
+		ts.tv_nsec = ns % 1000000000ULL;
+		nanosleep(&ts, NULL);
+	}
+	return true;
+}
+
+static void *model_dispatcher(void *arg)
+{
+	struct msgdma_model *m = (struct msgdma_model *)arg;
+	struct model_buffer *b = NULL;
+	msgdma_ext_desc_t desc;
+	uint64_t one = 1;
+	uint64_t addr = 0;
+	bool ok = false;
+
+	pthread_mutex_lock(&m->lock);
+	while (1) {
+		while (!m->fill && !m->stop) {
+			m->busy = false;
+			pthread_cond_wait(&m->cond, &m->lock);
+		}
+		if (m->stop)
+			break;
+
+		desc = m->fifo[m->fifo_head];
+		m->fifo_head = (m->fifo_head + 1) % m->depth;
+		m->fill--;
+		pthread_mutex_unlock(&m->lock);
+
+		ok = model_execute(m, &desc);
+
+		pthread_mutex_lock(&m->lock);
+		if (!ok) {
+			m->stats.errors++;
+			continue;
+		}
+		m->stats.descriptors++;
+		m->stats.bytes += desc.len;
+		addr = ((uint64_t)desc.rd_address_ext << 32) | desc.rd_address;
+		if (!(addr & FPGA_DMA_HOST_MASK))
+			addr = ((uint64_t)desc.wr_address_ext << 32)
+			       | desc.wr_address;
+		if (addr & FPGA_DMA_HOST_MASK) {
+			b = model_find_buffer(m, addr & MODEL_HOST_ADDR_MASK);
+			if (b)
+				b->dma_bytes += desc.len;
+		}
+		if (desc.control.transfer_irq_en) {
+			m->irq = true;
+			if (m->ctrl.ct.global_intr_en_mask && m->irq_fd >= 0) {
+				m->stats.interrupts++;
+				if (write(m->irq_fd, &one, sizeof(one)) < 0)
+					m->stats.errors++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&m->lock);
+	return NULL;
+}
+
+static void model_push(struct msgdma_model *m)
+{
+	msgdma_ext_desc_t *desc = (msgdma_ext_desc_t *)m->stage;
+
+	if (!desc->control.go)
+		return;
+
+	if (m->fill == m->depth) {
+		m->stats.overflows++;
+		return;
+	}
+
+	m->fifo[(m->fifo_head + m->fill) % m->depth] = *desc;
+	m->fill++;
+	if (m->fill > m->stats.max_fill)
+		m->stats.max_fill = m->fill;
+	if (!m->busy)
+		m->stats.restarts++;
+	m->busy = true;
+	pthread_cond_signal(&m->cond);
+}
+
+static fpga_result model_read(struct msgdma_model *m, uint64_t offset,
+			      void *value, size_t size)
+{
+	uint64_t dfh[3] = {
+		((uint64_t)FPGA_DMA_BBB << AFU_DFH_TYPE_OFFSET)
+			| (1ULL << AFU_DFH_EOL_OFFSET),
+		FPGA_DMA_UUID_L, FPGA_DMA_UUID_H};
+	msgdma_status_t status = {0};
+	msgdma_fill_level_t fill = {0};
+	uint64_t addr = 0;
+	uint32_t reg = 0;
+
+	if (offset + size <= sizeof(dfh)) {
+		memcpy(value, (uint8_t *)dfh + offset, size);
+		return FPGA_OK;
+	}
+
+	if (offset >= FPGA_DMA_ADDR_SPAN_EXT_DATA
+	    && offset + size
+		       <= FPGA_DMA_ADDR_SPAN_EXT_DATA + DMA_ADDR_SPAN_EXT_WINDOW) {
+		addr = m->ase_page + offset - FPGA_DMA_ADDR_SPAN_EXT_DATA;
+		if (addr + size > m->mem_size)
+			return FPGA_INVALID_PARAM;
+		memcpy(value, m->mem + addr, size);
+		m->stats.window_accesses++;
+		return FPGA_OK;
+	}
+
+	if (size != sizeof(uint32_t))
+		return FPGA_INVALID_PARAM;
+
+	if (offset == CSR_OFFSET(status)) {
+		status.st.busy = m->busy;
+		status.st.desc_buf_empty = !m->fill;
+		status.st.desc_buf_full = m->fill == m->depth;
+		status.st.rsp_buf_empty = 1;
+		status.st.irq = m->irq;
+		reg = status.reg;
+	} else if (offset == CSR_OFFSET(ctrl)) {
+		reg = m->ctrl.reg;
+	} else if (offset == CSR_OFFSET(fill_level)) {
+		fill.fl.rd_fill_level = m->fill;
+		fill.fl.wr_fill_level = m->fill;
+		reg = fill.reg;
+	}
+	memcpy(value, &reg, size);
+	return FPGA_OK;
+}
+
+static fpga_result model_write(struct msgdma_model *m, uint64_t offset,
+			       const void *value, size_t size)
+{
+	msgdma_status_t status = {0};
+	uint64_t addr = 0;
+
+	if (offset >= FPGA_DMA_DESC && offset + size <= FPGA_DMA_DESC + DESC_SIZE) {
+		memcpy(m->stage + offset - FPGA_DMA_DESC, value, size);
+		if (offset + size == FPGA_DMA_DESC + DESC_SIZE)
+			model_push(m);
+		return FPGA_OK;
+	}
+
+	if (offset >= FPGA_DMA_ADDR_SPAN_EXT_DATA
+	    && offset + size
+		       <= FPGA_DMA_ADDR_SPAN_EXT_DATA + DMA_ADDR_SPAN_EXT_WINDOW) {
+		addr = m->ase_page + offset - FPGA_DMA_ADDR_SPAN_EXT_DATA;
+		if (addr + size > m->mem_size)
+			return FPGA_INVALID_PARAM;
+		memcpy(m->mem + addr, value, size);
+		m->stats.window_accesses++;
+		return FPGA_OK;
+	}
+
+	if (offset == FPGA_DMA_ADDR_SPAN_EXT_CNTL && size == sizeof(uint64_t)) {
+		memcpy(&m->ase_page, value, size);
+		m->stats.page_switches++;
+		return FPGA_OK;
+	}
+
+	if (size != sizeof(uint32_t))
+		return FPGA_INVALID_PARAM;
+
+	if (offset == CSR_OFFSET(status)) {
+		// IRQ is write one to clear
+		memcpy(&status.reg, value, size);
+		if (status.st.irq)
+			m->irq = false;
+	} else if (offset == CSR_OFFSET(ctrl)) {
+		memcpy(&m->ctrl.reg, value, size);
+	}
+	return FPGA_OK;
+}
+
+fpga_handle msgdma_model_open(size_t mem_size, uint32_t depth,
+			      uint32_t ns_per_kb)
+{
+	struct msgdma_model *m = NULL;
+
+	if (!depth)
+		return NULL;
+
+	m = (struct msgdma_model *)calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+
+	m->mem = (uint8_t *)calloc(1, mem_size);
+	m->fifo = (msgdma_ext_desc_t *)calloc(depth, DESC_SIZE);
+	if (!m->mem || !m->fifo)
+		goto out_free;
+
+	m->magic = MODEL_MAGIC;
+	m->mem_size = mem_size;
+	m->depth = depth;
+	m->ns_per_kb = ns_per_kb;
+	m->irq_fd = -1;
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_cond_init(&m->cond, NULL);
+
+	if (pthread_create(&m->dispatcher, NULL, model_dispatcher, m)) {
+		pthread_cond_destroy(&m->cond);
+		pthread_mutex_destroy(&m->lock);
+		goto out_free;
+	}
+	return m;
+
+out_free:
+	free(m->fifo);
+	free(m->mem);
+	free(m);
+	return NULL;
+}
+
+void msgdma_model_close(fpga_handle model)
+{
+	struct msgdma_model *m = model_check(model);
+	struct model_buffer *b = NULL;
+
+	if (!m)
+		return;
+
+	pthread_mutex_lock(&m->lock);
+	m->stop = true;
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	pthread_join(m->dispatcher, NULL);
+
+	while (m->buffers) {
+		b = m->buffers;
+		m->buffers = b->next;
+		free(b->addr);
+		free(b);
+	}
+
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->lock);
+	m->magic = 0;
+	free(m->fifo);
+	free(m->mem);
+	free(m);
+}
+
+void *msgdma_model_mem(fpga_handle model)
+{
+	struct msgdma_model *m = model_check(model);
+
+	return m ? m->mem : NULL;
+}
+
+void msgdma_model_get_stats(fpga_handle model,
+			    struct msgdma_model_stats *stats)
+{
+	struct msgdma_model *m = model_check(model);
+
+	if (!m || !stats)
+		return;
+
+	pthread_mutex_lock(&m->lock);
+	*stats = m->stats;
+	pthread_mutex_unlock(&m->lock);
+}
+
+uint64_t msgdma_model_buffer_bytes(fpga_handle model, void *buf)
+{
+	struct msgdma_model *m = model_check(model);
+	struct model_buffer *b = NULL;
+	uint64_t bytes = 0;
+
+	if (!m)
+		return 0;
+
+	pthread_mutex_lock(&m->lock);
+	b = model_find_buffer(m, (uint64_t)buf);
+	if (b)
+		bytes = b->dma_bytes;
+	pthread_mutex_unlock(&m->lock);
+	return bytes;
+}
+
+// OPAE calls made by fpga_dma.c
+
+fpga_result fpgaReadMMIO32(fpga_handle handle, uint32_t mmio_num,
+			   uint64_t offset, uint32_t *value)
+{
+	struct msgdma_model *m = model_check(handle);
+	fpga_result res;
+
+	if (!m || mmio_num || !value)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	res = model_read(m, offset, value, sizeof(*value));
+	pthread_mutex_unlock(&m->lock);
+	return res;
+}
+
+fpga_result fpgaWriteMMIO32(fpga_handle handle, uint32_t mmio_num,
+			    uint64_t offset, uint32_t value)
+{
+	struct msgdma_model *m = model_check(handle);
+	fpga_result res;
+
+	if (!m || mmio_num)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	res = model_write(m, offset, &value, sizeof(value));
+	pthread_mutex_unlock(&m->lock);
+	return res;
+}
+
+fpga_result fpgaReadMMIO64(fpga_handle handle, uint32_t mmio_num,
+			   uint64_t offset, uint64_t *value)
+{
+	struct msgdma_model *m = model_check(handle);
+	fpga_result res;
+
+	if (!m || mmio_num || !value)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	res = model_read(m, offset, value, sizeof(*value));
+	pthread_mutex_unlock(&m->lock);
+	return res;
+}
+
+fpga_result fpgaWriteMMIO64(fpga_handle handle, uint32_t mmio_num,
+			    uint64_t offset, uint64_t value)
+{
+	struct msgdma_model *m = model_check(handle);
+	fpga_result res;
+
+	if (!m || mmio_num)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	res = model_write(m, offset, &value, sizeof(value));
+	pthread_mutex_unlock(&m->lock);
+	return res;
+}
+
+fpga_result fpgaPrepareBuffer(fpga_handle handle, uint64_t len,
+			      void **buf_addr, uint64_t *wsid, int flags)
+{
+	struct msgdma_model *m = model_check(handle);
+	struct model_buffer *b = NULL;
+	void *buf = NULL;
+
+	(void)flags;
+
+	if (!m || !buf_addr || !wsid || !len)
+		return FPGA_INVALID_PARAM;
+
+	b = (struct model_buffer *)calloc(1, sizeof(*b));
+	if (!b)
+		return FPGA_NO_MEMORY;
+
+	len = (len + MODEL_PAGE_SIZE - 1) & ~((uint64_t)MODEL_PAGE_SIZE - 1);
+	if (posix_memalign(&buf, MODEL_PAGE_SIZE, len)) {
+		free(b);
+		return FPGA_NO_MEMORY;
+	}
+
+	b->addr = (uint8_t *)buf;
+	b->len = len;
+	pthread_mutex_lock(&m->lock);
+	b->next = m->buffers;
+	m->buffers = b;
+	pthread_mutex_unlock(&m->lock);
+
+	*buf_addr = buf;
+	*wsid = (uint64_t)buf;
+	return FPGA_OK;
+}
+
+fpga_result fpgaReleaseBuffer(fpga_handle handle, uint64_t wsid)
+{
+	struct msgdma_model *m = model_check(handle);
+	struct model_buffer **prev = NULL;
+	struct model_buffer *b = NULL;
+
+	if (!m)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	for (prev = &m->buffers; *prev; prev = &(*prev)->next) {
+		if ((uint64_t)(*prev)->addr == wsid) {
+			b = *prev;
+			*prev = b->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m->lock);
+
+	if (!b)
+		return FPGA_NOT_FOUND;
+
+	free(b->addr);
+	free(b);
+	return FPGA_OK;
+}
+
+fpga_result fpgaGetIOAddress(fpga_handle handle, uint64_t wsid,
+			     uint64_t *ioaddr)
+{
+	if (!model_check(handle) || !ioaddr)
+		return FPGA_INVALID_PARAM;
+
+	*ioaddr = wsid;
+	return FPGA_OK;
+}
+
+fpga_result fpgaGetIOAddressFromVA(fpga_handle handle, void *va,
+				   uint64_t *ioaddr)
+{
+	struct msgdma_model *m = model_check(handle);
+	struct model_buffer *b = NULL;
+
+	if (!m || !ioaddr)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	b = model_find_buffer(m, (uint64_t)va);
+	pthread_mutex_unlock(&m->lock);
+
+	if (!b)
+		return FPGA_NOT_FOUND;
+
+	*ioaddr = (uint64_t)va;
+	return FPGA_OK;
+}
+
+fpga_result fpgaCreateEventHandle(fpga_event_handle *event_handle)
+{
+	struct model_event *e = NULL;
+
+	if (!event_handle)
+		return FPGA_INVALID_PARAM;
+
+	e = (struct model_event *)malloc(sizeof(*e));
+	if (!e)
+		return FPGA_NO_MEMORY;
+
+	e->fd = eventfd(0, EFD_CLOEXEC);
+	if (e->fd < 0) {
+		free(e);
+		return FPGA_EXCEPTION;
+	}
+
+	*event_handle = e;
+	return FPGA_OK;
+}
+
+fpga_result fpgaDestroyEventHandle(fpga_event_handle *event_handle)
+{
+	struct model_event *e = NULL;
+
+	if (!event_handle || !*event_handle)
+		return FPGA_INVALID_PARAM;
+
+	e = (struct model_event *)*event_handle;
+	close(e->fd);
+	free(e);
+	*event_handle = NULL;
+	return FPGA_OK;
+}
+
+fpga_result fpgaGetOSObjectFromEventHandle(const fpga_event_handle eh, int *fd)
+{
+	if (!eh || !fd)
+		return FPGA_INVALID_PARAM;
+
+	*fd = ((struct model_event *)eh)->fd;
+	return FPGA_OK;
+}
+
+fpga_result fpgaRegisterEvent(fpga_handle handle, fpga_event_type event_type,
+			      fpga_event_handle event_handle, uint32_t flags)
+{
+	struct msgdma_model *m = model_check(handle);
+
+	(void)flags;
+
+	if (!m || !event_handle || event_type != FPGA_EVENT_INTERRUPT)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	m->irq_fd = ((struct model_event *)event_handle)->fd;
+	pthread_mutex_unlock(&m->lock);
+	return FPGA_OK;
+}
+
+fpga_result fpgaUnregisterEvent(fpga_handle handle, fpga_event_type event_type,
+				fpga_event_handle event_handle)
+{
+	struct msgdma_model *m = model_check(handle);
+
+	if (!m || !event_handle || event_type != FPGA_EVENT_INTERRUPT)
+		return FPGA_INVALID_PARAM;
+
+	pthread_mutex_lock(&m->lock);
+	m->irq_fd = -1;
+	pthread_mutex_unlock(&m->lock);
+	return FPGA_OK;
+}
@@ -0,0 +1,123 @@
+// Copyright(c) 2017, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \msgdma_model.h
+ * \brief Software model of the MSGDMA BBB
+ *
+ * The model implements the OPAE calls made by fpga_dma.c when it is built
+ * with USE_ASE, which routes every MMIO access through fpgaReadMMIO*() and
+ * fpgaWriteMMIO*(). It decodes the DMA BBB feature header, the msgdma_csr_t
+ * registers, the msgdma_ext_desc_t descriptor port and the address span
+ * expander, and executes descriptors on a dispatcher thread against a
+ * buffer standing in for FPGA memory. Shared host buffers are identity
+ * mapped, so the DMA engine runs without a card.
+ */
+
+#ifndef __MSGDMA_MODEL_H__
+#define __MSGDMA_MODEL_H__
+
+#include <opae/fpga.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct msgdma_model_stats {
+	// Descriptors executed
+	uint64_t descriptors;
+	// Bytes moved by executed descriptors
+	uint64_t bytes;
+	// Interrupts signalled to the registered eventfd
+	uint64_t interrupts;
+	// Times the dispatcher ran dry and was restarted by a new descriptor
+	uint64_t restarts;
+	// Descriptors written while the FIFO was full
+	uint64_t overflows;
+	// Descriptors with an address outside the model
+	uint64_t errors;
+	// Reads and writes through the address span expander data window
+	uint64_t window_accesses;
+	// Writes to the address span expander page register
+	uint64_t page_switches;
+	// Highest descriptor FIFO fill level
+	uint32_t max_fill;
+};
+
+/**
+ * msgdma_model_open
+ *
+ * @brief                Creates a model instance usable as an fpga_handle.
+ * @param[in] mem_size   Size in bytes of the modelled FPGA memory
+ * @param[in] depth      Descriptor FIFO depth
+ * @param[in] ns_per_kb  Time the dispatcher spends per KB moved
+ * @return Model handle, NULL on failure
+ */
+fpga_handle msgdma_model_open(size_t mem_size, uint32_t depth,
+			      uint32_t ns_per_kb);
+
+/**
+ * msgdma_model_close
+ *
+ * @brief                Stops the dispatcher and frees the model.
+ * @param[in] model      Handle from msgdma_model_open()
+ */
+void msgdma_model_close(fpga_handle model);
+
+/**
+ * msgdma_model_mem
+ *
+ * @brief                Returns the modelled FPGA memory.
+ * @param[in] model      Handle from msgdma_model_open()
+ * @return Pointer to FPGA address 0
+ */
+void *msgdma_model_mem(fpga_handle model);
+
+/**
+ * msgdma_model_get_stats
+ *
+ * @brief                Snapshots the model counters.
+ * @param[in] model      Handle from msgdma_model_open()
+ * @param[out] stats     Counters
+ */
+void msgdma_model_get_stats(fpga_handle model,
+			    struct msgdma_model_stats *stats);
+
+/**
+ * msgdma_model_buffer_bytes
+ *
+ * @brief                Returns the number of bytes descriptors have moved to
+ * or from a buffer allocated with fpgaPrepareBuffer().
+ * @param[in] model      Handle from msgdma_model_open()
+ * @param[in] buf        Address within the buffer
+ * @return Byte count, 0 if buf is not within a shared buffer
+ */
+uint64_t msgdma_model_buffer_bytes(fpga_handle model, void *buf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __MSGDMA_MODEL_H__
@@ -0,0 +1,61 @@
+// Copyright(c) 2018, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef __X86_AVX_H__
+#define __X86_AVX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes moved per loop iteration, the granularity of size
+#define BLOCK_COPY_NT_AVX2_BYTES 128
+#define BLOCK_COPY_NT_AVX512_BYTES 256
+
+// Non-temporal copies to a vector aligned dst from any src, see x86-avx.S.
+// Callers must check CPU support first.
+void block_copy_nt_avx2(int64_t *__restrict dst, int64_t *__restrict src,
+			size_t size);
+void block_copy_nt_avx512(int64_t *__restrict dst, int64_t *__restrict src,
+			  size_t size);
+
+// Bytes per MMIO store of the kernels below, the granularity of size
+#define MMIO_LINE_BYTES 64
+
+// Writes to a 64-byte aligned MMIO dst in full line stores, see x86-avx.S.
+// Callers must check CPU support first.
+void mmio_write_lines_avx512(volatile void *dst, const void *src, size_t size);
+void mmio_write_lines_movdir64b(volatile void *dst, const void *src,
+				size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __X86_AVX_H__